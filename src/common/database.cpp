@@ -3,8 +3,14 @@
 
 #include "database.hpp"
 
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
 #include "malloc.hpp"
 #include "showmsg.hpp"
@@ -12,6 +18,294 @@
 
 using namespace rathena;
 
+#define YAML_SNAPSHOT_MAGIC "RASN"
+#define YAML_SNAPSHOT_FORMAT 2
+
+/// Hash over all database files loaded so far, a snapshot is only valid if everything loaded before it is unchanged
+static uint64 yaml_snapshot_chain = util::hash_fnv1a( nullptr, 0 );
+/// Directory of the snapshots, empty while they are not used
+static std::string yaml_snapshot_path;
+/// Number of worker threads of database_load_group
+static int32 yaml_load_threads = 0;
+
+static uint64 yaml_hash_file( uint64 hash, const std::string& path, uint64 content ){
+	hash = util::hash_fnv1a( path.c_str(), path.length() + 1, hash );
+
+	return util::hash_fnv1a( &content, sizeof( content ), hash );
+}
+
+/// Reads a whole file, returns false if it could not be opened.
+/// Database files are read in text mode as they always were, snapshots in binary mode.
+static bool yaml_read_file( const std::string& path, std::string& buf, bool binary = false ){
+	FILE* f = fopen( path.c_str(), binary ? "rb" : "r" );
+
+	if( f == nullptr ){
+		return false;
+	}
+
+	fseek( f, 0, SEEK_END );
+	buf.resize( ftell( f ) );
+	rewind( f );
+	buf.resize( fread( &buf[0], sizeof( char ), buf.size(), f ) );
+	fclose( f );
+
+	return true;
+}
+
+/**
+ * Reads the header of a snapshot and the files it was made from, safe to call from any thread.
+ * @param reader: Snapshot, positioned at the records afterwards
+ * @param key: Key the snapshot was saved with
+ * @param files: Files the snapshot was made from with their content hash
+ * @return false if the snapshot is invalid or any of its files changed
+ */
+static bool yaml_snapshot_read_header( BinaryReader& reader, uint64& key, std::vector<std::pair<std::string, uint64>>& files ){
+	char magic[4];
+	uint32 format, count;
+
+	if( !reader.read( magic ) || memcmp( magic, YAML_SNAPSHOT_MAGIC, 4 ) != 0 || !reader.read( format ) || format != YAML_SNAPSHOT_FORMAT || !reader.read( key ) || !reader.read( count ) ){
+		return false;
+	}
+
+	// Every source file has to be unchanged
+	for( uint32 i = 0; i < count; i++ ){
+		std::string path, content;
+		uint64 hash;
+
+		if( !reader.readString( path ) || !reader.read( hash ) || !yaml_read_file( path, content ) ){
+			return false;
+		}
+
+		if( util::hash_fnv1a( content.data(), content.length() ) != hash ){
+			return false;
+		}
+
+		files.emplace_back( path, hash );
+	}
+
+	return !files.empty();
+}
+
+/// A database file read and parsed into its own tree, possibly on a preload thread
+struct s_yaml_file {
+	std::string path;
+	bool opened;
+	uint64 hash; ///< Hash of the content
+	std::string error; ///< Parser error message, empty on success
+	ryml::Parser parser;
+	ryml::Tree tree;
+};
+
+enum class e_yaml_preload_state {
+	QUEUED,
+	PARSING,
+	DONE,
+};
+
+struct s_yaml_preload_entry {
+	e_yaml_preload_state state;
+	std::string snapshot; ///< Snapshot of the database the file is the default location of, empty for imports
+	std::unique_ptr<s_yaml_file> file; ///< nullptr if it was skipped for an unchanged snapshot
+};
+
+/// Files of the databases parsed ahead of time by background threads at startup.
+/// Only reading and parsing happens on these threads, the entries are still processed by load() in the usual order.
+static struct {
+	std::mutex mutex;
+	std::condition_variable work; ///< Signaled when a file was queued or the threads should stop
+	std::condition_variable done; ///< Signaled when a file finished parsing
+	std::deque<std::string> queue;
+	std::unordered_map<std::string, s_yaml_preload_entry> files;
+	std::vector<std::thread> threads;
+	bool stopping;
+} yaml_preload;
+
+/// All database instances, their default locations are preloaded
+static std::vector<YamlDatabase*>& yaml_database_registry(){
+	static std::vector<YamlDatabase*> registry;
+
+	return registry;
+}
+
+/// Returns the mode an import has to be marked with to be loaded by this build
+static const char* yaml_import_mode( const std::string& importFile ){
+#ifdef RENEWAL
+	// RENEWAL mode with RENEWAL_ASPD off, load pre-re ASPD
+#ifndef RENEWAL_ASPD
+	if( importFile.find( "job_aspd.yml" ) != std::string::npos ){
+		return "Prerenewal";
+	}
+#endif
+	return "Renewal";
+#else
+	return "Prerenewal";
+#endif
+}
+
+/// Reads and parses a database file, safe to call from any thread
+static void yaml_file_parse( s_yaml_file& file ){
+	std::string buf;
+
+	file.opened = yaml_read_file( file.path, buf );
+
+	if( !file.opened ){
+		return;
+	}
+
+	file.hash = util::hash_fnv1a( buf.data(), buf.length() );
+
+	try{
+		file.tree = file.parser.parse_in_arena( c4::to_csubstr( file.path ), c4::to_csubstr( buf ) );
+	}catch( const std::runtime_error& e ){
+		file.error = e.what();
+	}
+}
+
+/// Queues the imports of a parsed file that apply to this build, must be called with the preload mutex held
+static void yaml_preload_queue_imports( s_yaml_file& file ){
+	if( !file.opened || !file.error.empty() ){
+		return;
+	}
+
+	ryml::NodeRef root = file.tree.rootref();
+
+	if( !root.is_map() || !root.has_child( "Footer" ) || !root["Footer"].is_map() || !root["Footer"].has_child( "Imports" ) ){
+		return;
+	}
+
+	for( ryml::NodeRef node : root["Footer"]["Imports"] ){
+		if( !node.is_map() || !node.has_child( "Path" ) || !node["Path"].has_val() ){
+			continue;
+		}
+
+		std::string path( node["Path"].val().str, node["Path"].val().len );
+
+		if( node.has_child( "Mode" ) && node["Mode"].has_val() && node["Mode"].val() != c4::to_csubstr( yaml_import_mode( path ) ) ){
+			continue;
+		}
+
+		if( yaml_preload.files.find( path ) == yaml_preload.files.end() ){
+			yaml_preload.files[path].state = e_yaml_preload_state::QUEUED;
+			yaml_preload.queue.push_back( path );
+			yaml_preload.work.notify_one();
+		}
+	}
+}
+
+/// Parses a file that was claimed by the calling thread and stores the result
+static void yaml_preload_parse( std::unique_lock<std::mutex>& lock, const std::string& path ){
+	std::unique_ptr<s_yaml_file> file = std::make_unique<s_yaml_file>();
+
+	file->path = path;
+
+	lock.unlock();
+	yaml_file_parse( *file );
+	lock.lock();
+
+	yaml_preload_queue_imports( *file );
+
+	s_yaml_preload_entry& entry = yaml_preload.files[path];
+
+	entry.state = e_yaml_preload_state::DONE;
+	entry.file = std::move( file );
+	yaml_preload.done.notify_all();
+}
+
+static void yaml_preload_worker(){
+	std::unique_lock<std::mutex> lock( yaml_preload.mutex );
+
+	while( true ){
+		yaml_preload.work.wait( lock, [](){ return yaml_preload.stopping || !yaml_preload.queue.empty(); } );
+
+		if( yaml_preload.stopping ){
+			return;
+		}
+
+		std::string path = std::move( yaml_preload.queue.front() );
+
+		yaml_preload.queue.pop_front();
+
+		auto it = yaml_preload.files.find( path );
+
+		// Already claimed by the main thread
+		if( it == yaml_preload.files.end() || it->second.state != e_yaml_preload_state::QUEUED ){
+			continue;
+		}
+
+		it->second.state = e_yaml_preload_state::PARSING;
+
+		// The database will most likely be read from its snapshot, so its files are not parsed ahead of time
+		if( !it->second.snapshot.empty() ){
+			std::string snapshot = it->second.snapshot;
+
+			lock.unlock();
+
+			std::string buf;
+			std::vector<std::pair<std::string, uint64>> files;
+			uint64 key;
+			bool unchanged = yaml_read_file( snapshot, buf, true );
+
+			if( unchanged ){
+				BinaryReader reader( (const uint8*)buf.data(), buf.length() );
+
+				unchanged = yaml_snapshot_read_header( reader, key, files ) && files.front().first == path;
+			}
+
+			lock.lock();
+
+			if( unchanged ){
+				yaml_preload.files[path].state = e_yaml_preload_state::DONE;
+				yaml_preload.done.notify_all();
+				continue;
+			}
+		}
+
+		yaml_preload_parse( lock, path );
+	}
+}
+
+/// Takes the preloaded file for the path, waiting for it if it is being parsed.
+/// Returns nullptr if the file was not preloaded or skipped for a snapshot.
+static std::unique_ptr<s_yaml_file> yaml_preload_take( const std::string& path ){
+	std::unique_lock<std::mutex> lock( yaml_preload.mutex );
+
+	auto it = yaml_preload.files.find( path );
+
+	if( it == yaml_preload.files.end() ){
+		return nullptr;
+	}
+
+	// Nobody started on it yet, so parse it directly instead of waiting
+	if( it->second.state == e_yaml_preload_state::QUEUED ){
+		it->second.state = e_yaml_preload_state::PARSING;
+		yaml_preload_parse( lock, path );
+	}else{
+		yaml_preload.done.wait( lock, [&path](){ return yaml_preload.files[path].state == e_yaml_preload_state::DONE; } );
+	}
+
+	it = yaml_preload.files.find( path );
+
+	std::unique_ptr<s_yaml_file> file = std::move( it->second.file );
+
+	yaml_preload.files.erase( it );
+
+	return file;
+}
+
+YamlDatabase::YamlDatabase( const std::string& type_, uint16 version_, uint16 minimumVersion_ ){
+	this->type = type_;
+	this->version = version_;
+	this->minimumVersion = minimumVersion_;
+
+	yaml_database_registry().push_back( this );
+}
+
+YamlDatabase::~YamlDatabase(){
+	std::vector<YamlDatabase*>& registry = yaml_database_registry();
+
+	util::vector_erase_if_exists( registry, this );
+}
+
 bool YamlDatabase::nodeExists( const ryml::NodeRef& node, const std::string& name ){
 	return (node.num_children() > 0 && node.has_child(c4::to_csubstr(name)));
 }
@@ -76,13 +370,45 @@ bool YamlDatabase::verifyCompatibility( const ryml::Tree& tree ){
 }
 
 bool YamlDatabase::load(){
+	bool ret = this->loadFiles( yaml_snapshot_chain );
+
+	this->finishLoad();
+
+	return ret;
+}
+
+/**
+ * Fills the database from its snapshot or its files, without touching anything shared with other databases.
+ * @param chain: Hash of the files loaded before this database
+ * @return true if the default file was loaded
+ */
+bool YamlDatabase::loadFiles( uint64 chain ){
+	this->loadedFiles.clear();
+	this->loadErrors = 0;
+
+	if( this->loadSnapshot( chain ) ){
+		return true;
+	}
+
 	bool ret = this->load( this->getDefaultLocation() );
 
-	this->loadingFinished();
+	// Only databases that loaded without any complaint are saved, so no warning gets lost on the next start
+	if( ret && this->loadErrors == 0 ){
+		this->saveSnapshot( chain );
+	}
 
 	return ret;
 }
 
+/// Adds the loaded files to the snapshot chain of the databases loaded afterwards and runs the loading hook
+void YamlDatabase::finishLoad(){
+	for( const auto& file : this->loadedFiles ){
+		yaml_snapshot_chain = yaml_hash_file( yaml_snapshot_chain, file.first, file.second );
+	}
+
+	this->loadingFinished();
+}
+
 bool YamlDatabase::reload(){
 	this->clear();
 
@@ -91,39 +417,40 @@ bool YamlDatabase::reload(){
 
 bool YamlDatabase::load(const std::string& path) {
 	ShowStatus("Loading '" CL_WHITE "%s" CL_RESET "'..." CL_CLL "\r", path.c_str());
-	FILE* f = fopen(path.c_str(), "r");
-	if (f == nullptr) {
+	std::unique_ptr<s_yaml_file> file = yaml_preload_take( path );
+
+	if( file == nullptr ){
+		file = std::make_unique<s_yaml_file>();
+		file->path = path;
+		yaml_file_parse( *file );
+	}
+
+	if( !file->opened ){
 		ShowError("Failed to open %s database file from '" CL_WHITE "%s" CL_RESET "'.\n", this->type.c_str(), path.c_str());
+		this->loadErrors++;
 		return false;
 	}
-	fseek(f, 0, SEEK_END);
-	size_t size = ftell(f);
-	char* buf = (char *)aMalloc(size+1);
-	rewind(f);
-	size_t real_size = fread(buf, sizeof(char), size, f);
-	// Zero terminate
-	buf[real_size] = '\0';
-	fclose(f);
 
-	parser = {};
-	ryml::Tree tree;
+	this->loadedFiles.emplace_back( path, file->hash );
 
-	try{
-		tree = parser.parse_in_arena(c4::to_csubstr(path), c4::to_csubstr(buf));
-	}catch( const std::runtime_error& e ){
+	if( !file->error.empty() ){
+		this->loadErrors++;
 		ShowError( "Failed to load %s database file from '" CL_WHITE "%s" CL_RESET "'.\n", this->type.c_str(), path.c_str() );
 		ShowError( "There is likely a syntax error in the file.\n" );
-		ShowError( "Error message: %s\n", e.what() );
-		aFree(buf);
+		ShowError( "Error message: %s\n", file->error.c_str() );
 		return false;
 	}
 
+	// Keep the parser of the tree for line number lookups
+	parser = std::move( file->parser );
+	ryml::Tree& tree = file->tree;
+
 	// Required here already for header error reporting
 	this->currentFile = path;
 
 	if (!this->verifyCompatibility(tree)){
 		ShowError("Failed to verify compatibility with %s database file from '" CL_WHITE "%s" CL_RESET "'.\n", this->type.c_str(), this->currentFile.c_str());
-		aFree(buf);
+		this->loadErrors++;
 		return false;
 	}
 
@@ -141,7 +468,6 @@ bool YamlDatabase::load(const std::string& path) {
 
 	this->parseImports( tree );
 
-	aFree(buf);
 	return true;
 }
 
@@ -149,6 +475,164 @@ void YamlDatabase::loadingFinished(){
 	// Does nothing by default, just for hooking
 }
 
+bool YamlDatabase::writeSnapshot( BinaryWriter& writer ){
+	// Not supported by default
+	return false;
+}
+
+bool YamlDatabase::readSnapshot( BinaryReader& reader ){
+	// Not supported by default
+	return false;
+}
+
+/**
+ * Adds everything outside of the database files the records depend on to the snapshot key, like settings applied while parsing.
+ * @param key: Snapshot key so far
+ * @return the new snapshot key
+ */
+uint64 YamlDatabase::hashSnapshotDependencies( uint64 key ){
+	// Only the database files by default
+	return key;
+}
+
+bool YamlDatabase::canLoadInParallel(){
+	// Parsers might use anything by default
+	return false;
+}
+
+/**
+ * Key of a snapshot of this database: the build, the database type and the content of every
+ * database file loaded before it (as records might reference other databases) and by it.
+ * @param chain: Hash of the files loaded before this database
+ */
+uint64 YamlDatabase::snapshotKey( uint64 chain ){
+	std::string build = std::string( get_git_hash() ) + "|" + get_svn_revision();
+
+#ifdef RENEWAL
+	build += "|RE";
+#endif
+#ifdef RENEWAL_ASPD
+	build += "|RE_ASPD";
+#endif
+#ifdef PACKETVER
+	build += "|" + std::to_string( PACKETVER );
+#endif
+
+	uint64 key = util::hash_fnv1a( YAML_SNAPSHOT_MAGIC, 4, chain );
+	uint32 format = YAML_SNAPSHOT_FORMAT;
+
+	key = util::hash_fnv1a( &format, sizeof( format ), key );
+	key = util::hash_fnv1a( build.c_str(), build.length() + 1, key );
+	key = util::hash_fnv1a( this->type.c_str(), this->type.length() + 1, key );
+	key = util::hash_fnv1a( &this->version, sizeof( this->version ), key );
+	key = this->hashSnapshotDependencies( key );
+
+	for( const auto& file : this->loadedFiles ){
+		key = yaml_hash_file( key, file.first, file.second );
+	}
+
+	return key;
+}
+
+std::string YamlDatabase::snapshotFile(){
+	return yaml_snapshot_path + "/" + this->type + ".bin";
+}
+
+/**
+ * Loads the records from the snapshot of this database, if it is still valid.
+ * Snapshot layout: magic, format, key, the loaded files with their content hash, the records.
+ * @param chain: Hash of the files loaded before this database
+ * @return true if the database was loaded from the snapshot
+ */
+bool YamlDatabase::loadSnapshot( uint64 chain ){
+	if( yaml_snapshot_path.empty() ){
+		return false;
+	}
+
+	std::string filename = this->snapshotFile();
+	std::string buf;
+
+	if( !yaml_read_file( filename, buf, true ) ){
+		return false;
+	}
+
+	BinaryReader reader( (const uint8*)buf.data(), buf.length() );
+	uint64 key;
+
+	if( !yaml_snapshot_read_header( reader, key, this->loadedFiles ) || this->loadedFiles.front().first != this->getDefaultLocation() || this->snapshotKey( chain ) != key ){
+		this->loadedFiles.clear();
+		return false;
+	}
+
+	if( !this->readSnapshot( reader ) || !reader.finished() ){
+		ShowWarning( "Snapshot of %s database in '" CL_WHITE "%s" CL_RESET "' is damaged, loading the YAML files instead.\n", this->type.c_str(), filename.c_str() );
+		this->clear();
+		this->loadedFiles.clear();
+		return false;
+	}
+
+	ShowStatus( "Done reading %s database from snapshot '" CL_WHITE "%s" CL_RESET "'" CL_CLL "\n", this->type.c_str(), filename.c_str() );
+
+	return true;
+}
+
+/**
+ * Writes the records of this database and the files they came from into its snapshot.
+ * @param chain: Hash of the files loaded before this database
+ */
+void YamlDatabase::saveSnapshot( uint64 chain ){
+	if( yaml_snapshot_path.empty() || this->loadedFiles.empty() ){
+		return;
+	}
+
+	BinaryWriter writer;
+	char magic[4];
+
+	memcpy( magic, YAML_SNAPSHOT_MAGIC, sizeof( magic ) );
+	writer.write( magic );
+	writer.write<uint32>( YAML_SNAPSHOT_FORMAT );
+	writer.write( this->snapshotKey( chain ) );
+	writer.write<uint32>( (uint32)this->loadedFiles.size() );
+
+	for( const auto& file : this->loadedFiles ){
+		writer.writeString( file.first );
+		writer.write( file.second );
+	}
+
+	if( !this->writeSnapshot( writer ) ){
+		return;
+	}
+
+	std::string filename = this->snapshotFile();
+	std::string temporary = filename + ".tmp";
+	std::error_code error;
+
+	std::filesystem::create_directories( yaml_snapshot_path, error );
+
+	FILE* fp = fopen( temporary.c_str(), "wb" );
+
+	if( fp == nullptr ){
+		ShowWarning( "Could not write the snapshot of %s database to '" CL_WHITE "%s" CL_RESET "'.\n", this->type.c_str(), filename.c_str() );
+		return;
+	}
+
+	const std::vector<uint8>& buffer = writer.getBuffer();
+	bool written = fwrite( buffer.data(), 1, buffer.size(), fp ) == buffer.size();
+
+	written = fclose( fp ) == 0 && written;
+
+	// Replace the old snapshot only once the new one is complete
+	if( written ){
+		std::filesystem::rename( temporary, filename, error );
+		written = !error;
+	}
+
+	if( !written ){
+		ShowWarning( "Could not write the snapshot of %s database to '" CL_WHITE "%s" CL_RESET "'.\n", this->type.c_str(), filename.c_str() );
+		std::filesystem::remove( temporary, error );
+	}
+}
+
 void YamlDatabase::parse( const ryml::Tree& tree ){
 	uint64 count = 0;
 
@@ -194,19 +678,7 @@ void YamlDatabase::parseImports( const ryml::Tree& rootNode ){
 						continue;
 					}
 
-#ifdef RENEWAL
-					std::string compiledMode = "Renewal";
-
-					// RENEWAL mode with RENEWAL_ASPD off, load pre-re ASPD
-#ifndef RENEWAL_ASPD
-					if (importFile.find("job_aspd.yml") != std::string::npos)
-						compiledMode = "Prerenewal";
-#endif
-#else
-					std::string compiledMode = "Prerenewal";
-#endif
-
-					if( compiledMode != mode ){
+					if( mode != yaml_import_mode( importFile ) ){
 						// Skip this import
 						continue;
 					}
@@ -359,6 +831,8 @@ int32 YamlDatabase::getColumnNumber(const ryml::NodeRef& node) {
 void YamlDatabase::invalidWarning( const ryml::NodeRef& node, const char* fmt, ... ){
 	va_list ap;
 
+	this->loadErrors++;
+
 	va_start(ap, fmt);
 
 	// Remove any remaining garbage of a previous loading line
@@ -390,3 +864,321 @@ void on_yaml_error( const char* msg, size_t len, ryml::Location loc, void *user_
 void do_init_database(){
 	ryml::set_callbacks( ryml::Callbacks( nullptr, nullptr, nullptr, on_yaml_error ) );
 }
+
+/**
+ * Starts parsing the default files of all databases and their imports on background threads.
+ * load() picks the parsed trees up in its usual order, so the databases are still filled,
+ * validated and finished one after another and the output stays the same.
+ * Databases with an unchanged snapshot are skipped, so database_snapshot_start has to be called first.
+ * The same number of threads loads the databases of database_load_group.
+ * @param workers: Number of threads, at most one less than the CPU cores. 0 to not preload anything
+ */
+void database_preload_start( int32 workers ){
+	uint32 cores = std::thread::hardware_concurrency();
+
+	// The main thread keeps loading meanwhile, on a single core preloading only adds overhead
+	if( cores > 0 ){
+		workers = std::min( workers, (int32)cores - 1 );
+	}
+
+	yaml_load_threads = std::max( workers, 0 );
+
+	if( workers <= 0 ){
+		return;
+	}
+
+	static bool registered = false;
+
+	// Threads have to be joined before they are destroyed, even if the server exits during startup
+	if( !registered ){
+		atexit( database_preload_final );
+		registered = true;
+	}
+
+	std::unique_lock<std::mutex> lock( yaml_preload.mutex );
+
+	yaml_preload.stopping = false;
+
+	for( YamlDatabase* db : yaml_database_registry() ){
+		std::string path = db->getDefaultLocation();
+
+		if( yaml_preload.files.find( path ) == yaml_preload.files.end() ){
+			yaml_preload.files[path].state = e_yaml_preload_state::QUEUED;
+			yaml_preload.queue.push_back( path );
+
+			if( !yaml_snapshot_path.empty() ){
+				yaml_preload.files[path].snapshot = db->snapshotFile();
+			}
+		}
+	}
+
+	for( int32 i = 0; i < workers; i++ ){
+		yaml_preload.threads.emplace_back( yaml_preload_worker );
+	}
+}
+
+enum class e_yaml_load_state {
+	WAITING,
+	RUNNING,
+	LOADED,
+	FINISHED,
+};
+
+/// Database of a load group while the group is loaded
+struct s_yaml_load_task {
+	YamlDatabase* database;
+	std::vector<size_t> dependencies; ///< Tasks that have to be finished before this one starts
+	std::vector<bool> required; ///< Tasks this one depends on, directly or through other tasks
+	bool parallel;
+	e_yaml_load_state state;
+	std::vector<s_captured_message> messages;
+};
+
+/**
+ * Loads a group of databases that depend on each other only within the group.
+ * Databases that allow it are loaded on the threads of database_preload_start as soon as every database of the
+ * group they depend on is finished, all others are loaded on the main thread while nothing else is loading.
+ * The messages of each database are shown and its loadingFinished hook is run on the main thread in the declared
+ * order, so the output and the snapshot keys are the same for any number of threads.
+ * @param entries: Databases in the order they would be loaded one after another, dependencies are declared before
+ */
+void database_load_group( std::initializer_list<s_database_load_entry> entries ){
+	std::vector<s_yaml_load_task> tasks;
+
+	for( const s_database_load_entry& entry : entries ){
+		s_yaml_load_task task;
+
+		task.database = entry.database;
+		task.required.resize( tasks.size(), false );
+		task.parallel = yaml_load_threads > 0 && entry.database->canLoadInParallel();
+		task.state = e_yaml_load_state::WAITING;
+
+		for( YamlDatabase* dependency : entry.dependencies ){
+			size_t index;
+
+			for( index = 0; index < tasks.size(); index++ ){
+				if( tasks[index].database == dependency ){
+					break;
+				}
+			}
+
+			if( index == tasks.size() ){
+				ShowError( "database_load_group: %s database depends on %s database, which has to be declared before it.\n", entry.database->type.c_str(), dependency->type.c_str() );
+				continue;
+			}
+
+			task.dependencies.push_back( index );
+			task.required[index] = true;
+
+			for( size_t i = 0; i < index; i++ ){
+				if( tasks[index].required[i] ){
+					task.required[i] = true;
+				}
+			}
+		}
+
+		tasks.push_back( std::move( task ) );
+	}
+
+	uint64 chain = yaml_snapshot_chain;
+	std::mutex mutex;
+	std::condition_variable changed;
+	int32 running = 0;
+	bool exclusive = false;
+	bool stopping = false;
+
+	auto ready = [&tasks]( size_t index ){
+		if( tasks[index].state != e_yaml_load_state::WAITING ){
+			return false;
+		}
+
+		for( size_t dependency : tasks[index].dependencies ){
+			if( tasks[dependency].state != e_yaml_load_state::FINISHED ){
+				return false;
+			}
+		}
+
+		return true;
+	};
+
+	// The snapshot chain of a database are the files loaded before the group and those of the databases it depends on
+	auto start = [&tasks, chain]( size_t index ){
+		uint64 task_chain = chain;
+
+		for( size_t i = 0; i < index; i++ ){
+			if( tasks[index].required[i] ){
+				for( const auto& file : tasks[i].database->loadedFiles ){
+					task_chain = yaml_hash_file( task_chain, file.first, file.second );
+				}
+			}
+		}
+
+		tasks[index].state = e_yaml_load_state::RUNNING;
+
+		return task_chain;
+	};
+
+	auto run = [&tasks]( size_t index, uint64 task_chain ){
+		ShowCaptureStart( tasks[index].messages );
+		tasks[index].database->loadFiles( task_chain );
+		ShowCaptureStop();
+	};
+
+	auto worker = [&](){
+		std::unique_lock<std::mutex> lock( mutex );
+		size_t index = 0;
+
+		while( true ){
+			changed.wait( lock, [&](){
+				if( stopping ){
+					return true;
+				}
+
+				if( exclusive ){
+					return false;
+				}
+
+				for( index = 0; index < tasks.size(); index++ ){
+					if( tasks[index].parallel && ready( index ) ){
+						return true;
+					}
+				}
+
+				return false;
+			} );
+
+			if( stopping ){
+				return;
+			}
+
+			uint64 task_chain = start( index );
+
+			running++;
+			lock.unlock();
+			run( index, task_chain );
+			lock.lock();
+			running--;
+			tasks[index].state = e_yaml_load_state::LOADED;
+			changed.notify_all();
+		}
+	};
+
+	std::vector<std::thread> threads;
+
+	for( const s_yaml_load_task& task : tasks ){
+		if( task.parallel ){
+			for( int32 i = 0; i < yaml_load_threads; i++ ){
+				threads.emplace_back( worker );
+			}
+
+			break;
+		}
+	}
+
+	std::unique_lock<std::mutex> lock( mutex );
+
+	for( size_t next = 0; next < tasks.size(); ){
+		s_yaml_load_task& task = tasks[next];
+
+		if( task.state == e_yaml_load_state::LOADED ){
+			lock.unlock();
+			ShowCaptured( task.messages );
+			task.messages.clear();
+			task.database->finishLoad();
+			lock.lock();
+			task.state = e_yaml_load_state::FINISHED;
+			next++;
+			changed.notify_all();
+			continue;
+		}
+
+		// Everything before it is finished, so the next database is always ready unless it is already loading
+		size_t index = tasks.size();
+
+		if( task.state == e_yaml_load_state::WAITING ){
+			if( task.parallel ){
+				index = next;
+			}else{
+				// No other database may start until it is loaded
+				exclusive = true;
+
+				if( running == 0 ){
+					index = next;
+				}
+			}
+		}else{
+			// Help the threads while waiting for it
+			for( size_t i = next + 1; i < tasks.size(); i++ ){
+				if( tasks[i].parallel && ready( i ) ){
+					index = i;
+					break;
+				}
+			}
+		}
+
+		if( index == tasks.size() ){
+			changed.wait( lock );
+			continue;
+		}
+
+		uint64 task_chain = start( index );
+
+		lock.unlock();
+		run( index, task_chain );
+		lock.lock();
+		tasks[index].state = e_yaml_load_state::LOADED;
+		exclusive = false;
+		changed.notify_all();
+	}
+
+	stopping = true;
+	changed.notify_all();
+	lock.unlock();
+
+	for( std::thread& thread : threads ){
+		thread.join();
+	}
+}
+
+/**
+ * Makes the databases loaded from now on use binary snapshots of their records.
+ * A database that supports it loads its snapshot instead of the YAML files when none of
+ * the database files loaded up to it changed, and saves a new one after loading the YAML files.
+ * @param path: Directory of the snapshots
+ */
+void database_snapshot_start( const std::string& path ){
+	// The key relies on the revision to tell builds apart, an unknown one could hand out records of another build
+	if( get_git_hash()[0] == UNKNOWN_VERSION && get_svn_revision()[0] == UNKNOWN_VERSION ){
+		ShowWarning( "Database snapshots are disabled, because the revision of this build is unknown.\n" );
+		return;
+	}
+
+	yaml_snapshot_path = path;
+}
+
+/**
+ * Stops using snapshots, so reloads always read the YAML files.
+ */
+void database_snapshot_final(){
+	yaml_snapshot_path.clear();
+}
+
+/**
+ * Stops the preload threads and drops the files that were not loaded.
+ */
+void database_preload_final(){
+	{
+		std::unique_lock<std::mutex> lock( yaml_preload.mutex );
+
+		yaml_preload.stopping = true;
+		yaml_preload.work.notify_all();
+	}
+
+	for( std::thread& thread : yaml_preload.threads ){
+		thread.join();
+	}
+
+	yaml_preload.threads.clear();
+	yaml_preload.queue.clear();
+	yaml_preload.files.clear();
+}
@@ -4,6 +4,9 @@
 #ifndef DATABASE_HPP
 #define DATABASE_HPP
 
+#include <cstring>
+#include <initializer_list>
+#include <type_traits>
 #include <unordered_map>
 #include <vector>
 
@@ -16,6 +19,111 @@
 #include "core.hpp"
 #include "utilities.hpp"
 
+/// Serializes values into a byte buffer, used by the database snapshots and the script cache
+class BinaryWriter{
+private:
+	std::vector<uint8> buffer;
+
+public:
+	template <typename T> void write( const T& value ){
+		static_assert( std::is_trivially_copyable<T>::value, "Only plain values can be written directly" );
+		static_assert( !std::is_same<T, bool>::value, "Booleans are written as a single byte" );
+
+		const uint8* data = reinterpret_cast<const uint8*>( &value );
+
+		this->buffer.insert( this->buffer.end(), data, data + sizeof( T ) );
+	}
+
+	void write( bool value ){
+		this->write<uint8>( value ? 1 : 0 );
+	}
+
+	void writeString( const std::string& value ){
+		this->write<uint32>( (uint32)value.length() );
+		this->buffer.insert( this->buffer.end(), value.begin(), value.end() );
+	}
+
+	void writeBytes( const void* data, size_t length ){
+		const uint8* bytes = reinterpret_cast<const uint8*>( data );
+
+		this->buffer.insert( this->buffer.end(), bytes, bytes + length );
+	}
+
+	const std::vector<uint8>& getBuffer() const{
+		return this->buffer;
+	}
+};
+
+/// Reads values back from a buffer written by BinaryWriter, every read fails once the data is exhausted
+class BinaryReader{
+private:
+	const uint8* position;
+	const uint8* end;
+
+public:
+	BinaryReader( const uint8* data, size_t size ){
+		this->position = data;
+		this->end = data + size;
+	}
+
+	template <typename T> bool read( T& value ){
+		static_assert( std::is_trivially_copyable<T>::value, "Only plain values can be read directly" );
+		static_assert( !std::is_same<T, bool>::value, "Booleans are read as a single byte" );
+
+		if( (size_t)( this->end - this->position ) < sizeof( T ) ){
+			return false;
+		}
+
+		memcpy( &value, this->position, sizeof( T ) );
+		this->position += sizeof( T );
+
+		return true;
+	}
+
+	/// Any byte other than 0 or 1 is not a valid boolean and fails the read
+	bool read( bool& value ){
+		uint8 byte;
+
+		if( !this->read( byte ) || byte > 1 ){
+			return false;
+		}
+
+		value = byte == 1;
+
+		return true;
+	}
+
+	bool readString( std::string& value ){
+		uint32 length;
+
+		if( !this->read( length ) || (size_t)( this->end - this->position ) < length ){
+			return false;
+		}
+
+		value.assign( reinterpret_cast<const char*>( this->position ), length );
+		this->position += length;
+
+		return true;
+	}
+
+	bool readBytes( void* data, size_t length ){
+		if( (size_t)( this->end - this->position ) < length ){
+			return false;
+		}
+
+		memcpy( data, this->position, length );
+		this->position += length;
+
+		return true;
+	}
+
+	bool finished() const{
+		return this->position == this->end;
+	}
+};
+
+struct s_database_load_entry;
+
 class YamlDatabase{
 // Internal stuff
 private:
@@ -24,9 +132,16 @@ private:
 	uint16 minimumVersion;
 	std::string currentFile;
 	bool shouldLoadGenerator{false};
+	std::vector<std::pair<std::string, uint64>> loadedFiles; ///< Files of the current load and their content hash
+	uint32 loadErrors{0};
 
 	bool verifyCompatibility( const ryml::Tree& rootNode );
 	bool load( const std::string& path );
+	bool loadFiles( uint64 chain );
+	void finishLoad();
+	uint64 snapshotKey( uint64 chain );
+	bool loadSnapshot( uint64 chain );
+	void saveSnapshot( uint64 chain );
 	void parse( const ryml::Tree& rootNode );
 	void parseImports( const ryml::Tree& rootNode );
 	template <typename R> bool asType( const ryml::NodeRef& node, const std::string& name, R& out );
@@ -61,12 +176,21 @@ protected:
 
 	virtual void loadingFinished();
 
+	// Snapshot support, databases whose records can be serialized override the first two and the
+	// last one if their records also depend on something other than the database files
+	virtual bool writeSnapshot( BinaryWriter& writer );
+	virtual bool readSnapshot( BinaryReader& reader );
+	virtual uint64 hashSnapshotDependencies( uint64 key );
+
+	// Databases whose parser only reads databases that were loaded before them and writes nothing but
+	// their own records override this, so database_load_group may load them on a worker thread
+	virtual bool canLoadInParallel();
+
+	friend void database_load_group( std::initializer_list<s_database_load_entry> entries );
+
 public:
-	YamlDatabase( const std::string& type_, uint16 version_, uint16 minimumVersion_ ){
-		this->type = type_;
-		this->version = version_;
-		this->minimumVersion = minimumVersion_;
-	}
+	YamlDatabase( const std::string& type_, uint16 version_, uint16 minimumVersion_ );
+	virtual ~YamlDatabase();
 
 	YamlDatabase( const std::string& type_, uint16 version_ ) : YamlDatabase( type_, version_, version_ ){
 		// Empty since everything is handled by the real constructor
@@ -74,6 +198,7 @@ public:
 
 	bool load();
 	bool reload();
+	std::string snapshotFile();
 
 	// Functions that need to be implemented for each type
 	virtual void clear() = 0;
@@ -250,6 +375,17 @@ public:
 	}
 };
 
+/// Database of a load group and the databases of the same group it depends on, see database_load_group
+struct s_database_load_entry{
+	YamlDatabase* database;
+	std::vector<YamlDatabase*> dependencies;
+};
+
 void do_init_database();
+void database_load_group( std::initializer_list<s_database_load_entry> entries );
+void database_preload_start( int32 workers );
+void database_preload_final();
+void database_snapshot_start( const std::string& path );
+void database_snapshot_final();
 
 #endif /* DATABASE_HPP */
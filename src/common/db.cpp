@@ -10,6 +10,8 @@
  *  (5) Public functions
  *
  *  The databases are structured as a hashtable of RED-BLACK trees.
+ *  Databases allocated with DB_OPT_OPEN_HASH index their nodes in a growable
+ *  open addressing hashtable (linear probing) instead, see db_open_find.
  *
  *  <B>Properties of the RED-BLACK trees being used:</B>
  *  1. The value of any node is greater than the value of its left child and
@@ -123,9 +125,11 @@ typedef enum node_color {
 
 /**
  * A node in a RED-BLACK tree of the database.
+ * In DB_OPT_OPEN_HASH databases left and right link all nodes in the order
+ * they were added instead.
  * @param parent Parent node
- * @param left Left child node
- * @param right Right child node
+ * @param left Left child node, or previous node
+ * @param right Right child node, or next node
  * @param key Key of this database entry
  * @param data Data of this database entry
  * @param deleted If the node is deleted
@@ -158,6 +162,18 @@ struct db_free {
 	DBNode **root;
 };
 
+/**
+ * Slot of the open addressing hashtable.
+ * @param node Node in this slot, nullptr if the slot is empty
+ * @param hash Mixed hash of the key, used as home index and to skip most key comparisons
+ * @private
+ * @see DBMap_impl#slots
+ */
+struct db_slot {
+	DBNode *node;
+	uint32 hash;
+};
+
 /**
  * Complete database structure.
  * @param vtable Interface of the database
@@ -172,6 +188,11 @@ struct db_free {
  * @param hash Hasher of the database
  * @param release Releaser of the database
  * @param ht Hashtable of RED-BLACK trees
+ * @param slots Open addressing hashtable of DB_OPT_OPEN_HASH databases
+ * @param slot_mask Size of slots minus one, the size is a power of two
+ * @param slot_used Number of used slots, including deleted nodes
+ * @param first First node of DB_OPT_OPEN_HASH databases
+ * @param last Last node of DB_OPT_OPEN_HASH databases
  * @param type Type of the database
  * @param options Options of the database
  * @param item_count Number of items in the database
@@ -197,6 +218,11 @@ typedef struct DBMap_impl {
 	DBHasher hash;
 	DBReleaser release;
 	DBNode *ht[HASH_SIZE];
+	struct db_slot *slots;
+	uint32 slot_mask;
+	uint32 slot_used;
+	DBNode *first;
+	DBNode *last;
 	DBNode *cache;
 	DBType type;
 	DBOptions options;
@@ -344,6 +370,10 @@ struct eri *db_alloc_ers;
  *  db_rotate_right    - Rotate a tree node to the right.                    *
  *  db_rebalance       - Rebalance the tree.                                 *
  *  db_rebalance_erase - Rebalance the tree after a BLACK node was erased.   *
+ *  db_open_hash       - Mix a hash for the open addressing hashtable.       *
+ *  db_open_find       - Find a key in the open addressing hashtable.        *
+ *  db_open_add        - Add a node to the open addressing hashtable.        *
+ *  db_open_erase      - Erase a node from the open addressing hashtable.    *
  *  db_is_key_null     - Returns not 0 if the key is considered nullptr.     *
  *  db_dup_key         - Duplicate a key for internal use.                   *
  *  db_dup_key_free    - Free the duplicated key.                            *
@@ -620,6 +650,127 @@ static void db_rebalance_erase(DBNode *node, DBNode **root)
 	}
 }
 
+/**
+ * Mixes the hash of a key for the open addressing hashtable.
+ * The default hashers return integer keys as they are, so the bits are
+ * spread with a multiplicative (fibonacci) hash before masking.
+ * @param hash Hash returned by the hasher of the database
+ * @return Mixed hash
+ * @private
+ */
+static inline uint32 db_open_hash(uint64 hash)
+{
+	return (uint32)((hash * UINT64_C(0x9E3779B97F4A7C15)) >> 32);
+}
+
+/**
+ * Finds the node of a key in the open addressing hashtable.
+ * Deleted nodes are found as well, they stay in the hashtable until the
+ * database is unlocked.
+ * @param db Target database
+ * @param key Key of the node
+ * @param hash Mixed hash of the key
+ * @return Node of the key or nullptr if not found
+ * @private
+ * @see #db_open_hash(uint64)
+ */
+static DBNode* db_open_find(DBMap_impl* db, DBKey key, uint32 hash)
+{
+	uint32 i;
+
+	if (db->slots == nullptr)
+		return nullptr;
+
+	for (i = hash&db->slot_mask; db->slots[i].node; i = (i+1)&db->slot_mask) {
+		if (db->slots[i].hash == hash && db->cmp(key, db->slots[i].node->key, db->maxlen) == 0)
+			return db->slots[i].node;
+	}
+	return nullptr;
+}
+
+/**
+ * Adds a node to the open addressing hashtable and to the end of the node list.
+ * The hashtable grows when it is filled to 3/4, nodes never move in memory.
+ * @param db Target database
+ * @param node New node
+ * @param hash Mixed hash of the key of the node
+ * @private
+ */
+static void db_open_add(DBMap_impl* db, DBNode *node, uint32 hash)
+{
+	uint32 i;
+
+	if (db->slots == nullptr || (db->slot_used+1)*4 > (db->slot_mask+1)*3) { // grow and rehash
+		struct db_slot *old_slots = db->slots;
+		uint32 old_size = (old_slots ? db->slot_mask+1 : 0);
+
+		db->slot_mask = (old_size ? old_size*2 : 16) - 1;
+		CREATE(db->slots, struct db_slot, db->slot_mask+1);
+		for (i = 0; i < old_size; i++) {
+			uint32 j;
+
+			if (old_slots[i].node == nullptr)
+				continue;
+			for (j = old_slots[i].hash&db->slot_mask; db->slots[j].node; j = (j+1)&db->slot_mask);
+			db->slots[j] = old_slots[i];
+		}
+		if (old_slots)
+			aFree(old_slots);
+	}
+
+	for (i = hash&db->slot_mask; db->slots[i].node; i = (i+1)&db->slot_mask);
+	db->slots[i].node = node;
+	db->slots[i].hash = hash;
+	db->slot_used++;
+
+	node->parent = nullptr;
+	node->left = db->last;
+	node->right = nullptr;
+	if (db->last)
+		db->last->right = node;
+	else
+		db->first = node;
+	db->last = node;
+}
+
+/**
+ * Erases a node from the open addressing hashtable and the node list.
+ * Following nodes of the probe sequence are shifted back, so lookups never
+ * need tombstones.
+ * NOTE: Only called when the database is unlocked.
+ * @param db Target database
+ * @param node Node being erased
+ * @private
+ * @see #db_free_unlock(DBMap_impl*)
+ */
+static void db_open_erase(DBMap_impl* db, DBNode *node)
+{
+	uint32 i, j;
+
+	for (i = db_open_hash(db->hash(node->key, db->maxlen))&db->slot_mask; db->slots[i].node != node; i = (i+1)&db->slot_mask);
+	db->slots[i].node = nullptr;
+	db->slot_used--;
+	for (j = (i+1)&db->slot_mask; db->slots[j].node; j = (j+1)&db->slot_mask) {
+		uint32 home = db->slots[j].hash&db->slot_mask;
+
+		// keep the node if its home lies cyclically in (i,j]
+		if (i <= j ? (i < home && home <= j) : (i < home || home <= j))
+			continue;
+		db->slots[i] = db->slots[j];
+		db->slots[j].node = nullptr;
+		i = j;
+	}
+
+	if (node->left)
+		node->left->right = node->right;
+	else
+		db->first = node->right;
+	if (node->right)
+		node->right->left = node->left;
+	else
+		db->last = node->left;
+}
+
 /**
  * Returns not 0 if the key is considered to be nullptr.
  * @param type Type of database
@@ -828,7 +979,10 @@ static void db_free_unlock(DBMap_impl* db)
 		return; // Not last lock
 
 	for (i = 0; i < db->free_count ; i++) {
-		db_rebalance_erase(db->free_list[i].node, db->free_list[i].root);
+		if (db->options&DB_OPT_OPEN_HASH)
+			db_open_erase(db, db->free_list[i].node);
+		else
+			db_rebalance_erase(db->free_list[i].node, db->free_list[i].root);
 		db_dup_key_free(db, db->free_list[i].node->key);
 		DB_COUNTSTAT(db_node_free);
 		ers_free(db->nodes, db->free_list[i].node);
@@ -1277,6 +1431,27 @@ DBData* dbit_obj_next(DBIterator* self, DBKey* out_key)
 	struct dbn fake;
 
 	DB_COUNTSTAT(dbit_next);
+	if( it->db->options&DB_OPT_OPEN_HASH )
+	{// follow the node list
+		if( it->ht_index < 0 )
+			node = it->db->first;// get first node
+		else if( it->ht_index >= HASH_SIZE || it->node == nullptr )
+			node = nullptr;// already after the last node
+		else
+			node = it->node->right;
+		while( node && node->deleted )
+			node = node->right;
+		it->node = node;
+		if( node == nullptr )
+		{
+			it->ht_index = HASH_SIZE;
+			return nullptr;// not found
+		}
+		it->ht_index = 0;
+		if( out_key )
+			memcpy(out_key, &node->key, sizeof(DBKey));
+		return &node->data;
+	}
 	if( it->ht_index < 0 )
 	{// get first node
 		it->ht_index = 0;
@@ -1353,6 +1528,27 @@ DBData* dbit_obj_prev(DBIterator* self, DBKey* out_key)
 	struct dbn fake;
 
 	DB_COUNTSTAT(dbit_prev);
+	if( it->db->options&DB_OPT_OPEN_HASH )
+	{// follow the node list backwards
+		if( it->ht_index >= HASH_SIZE )
+			node = it->db->last;// get last node
+		else if( it->ht_index < 0 || it->node == nullptr )
+			node = nullptr;// already before the first node
+		else
+			node = it->node->left;
+		while( node && node->deleted )
+			node = node->left;
+		it->node = node;
+		if( node == nullptr )
+		{
+			it->ht_index = -1;
+			return nullptr;// not found
+		}
+		it->ht_index = 0;
+		if( out_key )
+			memcpy(out_key, &node->key, sizeof(DBKey));
+		return &node->data;
+	}
 	if( it->ht_index >= HASH_SIZE )
 	{// get last node
 		it->ht_index = HASH_SIZE-1;
@@ -1457,7 +1653,7 @@ int32 dbit_obj_remove(DBIterator* self, DBData *out_data)
 		if( out_data )
 			memcpy(out_data, &node->data, sizeof(DBData));
 		retval = 1;
-		db_free_add(db, node, &db->ht[it->ht_index]);
+		db_free_add(db, node, (db->options&DB_OPT_OPEN_HASH) ? nullptr : &db->ht[it->ht_index]);
 	}
 	return retval;
 }
@@ -1542,6 +1738,15 @@ static bool db_obj_exists(DBMap* self, DBKey key)
 	}
 
 	db_free_lock(db);
+	if (db->options&DB_OPT_OPEN_HASH) {
+		node = db_open_find(db, key, db_open_hash(db->hash(key, db->maxlen)));
+		if (node && !(node->deleted)) {
+			db->cache = node;
+			found = true;
+		}
+		db_free_unlock(db);
+		return found;
+	}
 	node = db->ht[db->hash(key, db->maxlen)%HASH_SIZE];
 	while (node) {
 		int32 c = db->cmp(key, node->key, db->maxlen);
@@ -1593,6 +1798,15 @@ static DBData* db_obj_get(DBMap* self, DBKey key)
 	}
 
 	db_free_lock(db);
+	if (db->options&DB_OPT_OPEN_HASH) {
+		node = db_open_find(db, key, db_open_hash(db->hash(key, db->maxlen)));
+		if (node && !(node->deleted)) {
+			data = &node->data;
+			db->cache = node;
+		}
+		db_free_unlock(db);
+		return data;
+	}
 	node = db->ht[db->hash(key, db->maxlen)%HASH_SIZE];
 	while (node) {
 		int32 c = db->cmp(key, node->key, db->maxlen);
@@ -1641,6 +1855,22 @@ static uint32 db_obj_vgetall(DBMap* self, DBData **buf, uint32 max, DBMatcher ma
 	if (match == nullptr) return 0; // nullpo candidate
 
 	db_free_lock(db);
+	if (db->options&DB_OPT_OPEN_HASH) {
+		for (node = db->first; node; node = node->right) {
+			if (!(node->deleted)) {
+				va_list argscopy;
+				va_copy(argscopy, args);
+				if (match(node->key, node->data, argscopy) == 0) {
+					if (buf && ret < max)
+						buf[ret] = &node->data;
+					ret++;
+				}
+				va_end(argscopy);
+			}
+		}
+		db_free_unlock(db);
+		return ret;
+	}
 	for (i = 0; i < HASH_SIZE; i++) {
 		// Match in the order: current node, left tree, right tree
 		node = db->ht[i];
@@ -1750,18 +1980,23 @@ static DBData* db_obj_vensure(DBMap* self, DBKey key, DBCreateData create, va_li
 		return &db->cache->data; // cache hit
 
 	db_free_lock(db);
-	hash = db->hash(key, db->maxlen)%HASH_SIZE;
-	node = db->ht[hash];
-	while (node) {
-		c = db->cmp(key, node->key, db->maxlen);
-		if (c == 0) {
-			break;
+	if (db->options&DB_OPT_OPEN_HASH) {
+		hash = db_open_hash(db->hash(key, db->maxlen));
+		node = db_open_find(db, key, hash);
+	} else {
+		hash = db->hash(key, db->maxlen)%HASH_SIZE;
+		node = db->ht[hash];
+		while (node) {
+			c = db->cmp(key, node->key, db->maxlen);
+			if (c == 0) {
+				break;
+			}
+			parent = node;
+			if (c < 0)
+				node = node->left;
+			else
+				node = node->right;
 		}
-		parent = node;
-		if (c < 0)
-			node = node->left;
-		else
-			node = node->right;
 	}
 	// Create node if necessary
 	if (node == nullptr) {
@@ -1778,7 +2013,9 @@ static DBData* db_obj_vensure(DBMap* self, DBKey key, DBCreateData create, va_li
 		node->right = nullptr;
 		node->deleted = 0;
 		db->item_count++;
-		if (c == 0) { // hash entry is empty
+		if (db->options&DB_OPT_OPEN_HASH) {
+			db_open_add(db, node, hash);
+		} else if (c == 0) { // hash entry is empty
 			node->color = BLACK;
 			node->parent = nullptr;
 			db->ht[hash] = node;
@@ -1888,10 +2125,10 @@ static int32 db_obj_put(DBMap* self, DBKey key, DBData data, DBData *out_data)
 	}
 	// search for an equal node
 	db_free_lock(db);
-	hash = db->hash(key, db->maxlen)%HASH_SIZE;
-	for (node = db->ht[hash]; node; ) {
-		c = db->cmp(key, node->key, db->maxlen);
-		if (c == 0) { // equal entry, replace
+	if (db->options&DB_OPT_OPEN_HASH) {
+		hash = db_open_hash(db->hash(key, db->maxlen));
+		node = db_open_find(db, key, hash);
+		if (node) { // equal entry, replace
 			if (node->deleted) {
 				db_free_remove(db, node);
 			} else {
@@ -1900,13 +2137,28 @@ static int32 db_obj_put(DBMap* self, DBKey key, DBData data, DBData *out_data)
 					memcpy(out_data, &node->data, sizeof(*out_data));
 				retval = 1;
 			}
-			break;
 		}
-		parent = node;
-		if (c < 0) {
-			node = node->left;
-		} else {
-			node = node->right;
+	} else {
+		hash = db->hash(key, db->maxlen)%HASH_SIZE;
+		for (node = db->ht[hash]; node; ) {
+			c = db->cmp(key, node->key, db->maxlen);
+			if (c == 0) { // equal entry, replace
+				if (node->deleted) {
+					db_free_remove(db, node);
+				} else {
+					db->release(node->key, node->data, DB_RELEASE_BOTH);
+					if (out_data)
+						memcpy(out_data, &node->data, sizeof(*out_data));
+					retval = 1;
+				}
+				break;
+			}
+			parent = node;
+			if (c < 0) {
+				node = node->left;
+			} else {
+				node = node->right;
+			}
 		}
 	}
 	// allocate a new node if necessary
@@ -1917,7 +2169,9 @@ static int32 db_obj_put(DBMap* self, DBKey key, DBData data, DBData *out_data)
 		node->right = nullptr;
 		node->deleted = 0;
 		db->item_count++;
-		if (c == 0) { // hash entry is empty
+		if (db->options&DB_OPT_OPEN_HASH) {
+			db_open_add(db, node, hash);
+		} else if (c == 0) { // hash entry is empty
 			node->color = BLACK;
 			node->parent = nullptr;
 			db->ht[hash] = node;
@@ -1981,6 +2235,20 @@ static int32 db_obj_remove(DBMap* self, DBKey key, DBData *out_data)
 	}
 
 	db_free_lock(db);
+	if (db->options&DB_OPT_OPEN_HASH) {
+		node = db_open_find(db, key, db_open_hash(db->hash(key, db->maxlen)));
+		if (node && !(node->deleted)) {
+			if (db->cache == node)
+				db->cache = nullptr;
+			db->release(node->key, node->data, DB_RELEASE_DATA);
+			if (out_data)
+				memcpy(out_data, &node->data, sizeof(*out_data));
+			retval = 1;
+			db_free_add(db, node, nullptr);
+		}
+		db_free_unlock(db);
+		return retval;
+	}
 	hash = db->hash(key, db->maxlen)%HASH_SIZE;
 	for(node = db->ht[hash]; node; ){
 		int32 c = db->cmp(key, node->key, db->maxlen);
@@ -2031,6 +2299,19 @@ static int32 db_obj_vforeach(DBMap* self, DBApply func, va_list args)
 	}
 
 	db_free_lock(db);
+	if (db->options&DB_OPT_OPEN_HASH) {
+		// Apply func in the order the nodes were added
+		for (node = db->first; node; node = node->right) {
+			if (!(node->deleted)) {
+				va_list argscopy;
+				va_copy(argscopy, args);
+				sum += func(node->key, &node->data, argscopy);
+				va_end(argscopy);
+			}
+		}
+		db_free_unlock(db);
+		return sum;
+	}
 	for (i = 0; i < HASH_SIZE; i++) {
 		// Apply func in the order: current node, left node, right node
 		node = db->ht[i];
@@ -2114,20 +2395,12 @@ static int32 db_obj_vclear(DBMap* self, DBApply func, va_list args)
 
 	db_free_lock(db);
 	db->cache = nullptr;
-	for (i = 0; i < HASH_SIZE; i++) {
-		// Apply the func and delete in the order: left tree, right tree, current node
-		node = db->ht[i];
-		db->ht[i] = nullptr;
+	if (db->options&DB_OPT_OPEN_HASH) {
+		// Apply the func and delete in the order the nodes were added
+		node = db->first;
+		db->first = db->last = nullptr;
 		while (node) {
-			parent = node->parent;
-			if (node->left) {
-				node = node->left;
-				continue;
-			}
-			if (node->right) {
-				node = node->right;
-				continue;
-			}
+			parent = node->right;
 			if (node->deleted) {
 				db_dup_key_free(db, node->key);
 			} else {
@@ -2142,16 +2415,52 @@ static int32 db_obj_vclear(DBMap* self, DBApply func, va_list args)
 				node->deleted = 1;
 			}
 			DB_COUNTSTAT(db_node_free);
-			if (parent) {
-				if (parent->left == node)
-					parent->left = nullptr;
-				else
-					parent->right = nullptr;
-			}
 			ers_free(db->nodes, node);
 			node = parent;
 		}
-		db->ht[i] = nullptr;
+		if (db->slots)
+			memset(db->slots, 0, (db->slot_mask+1)*sizeof(struct db_slot));
+		db->slot_used = 0;
+	} else {
+		for (i = 0; i < HASH_SIZE; i++) {
+			// Apply the func and delete in the order: left tree, right tree, current node
+			node = db->ht[i];
+			db->ht[i] = nullptr;
+			while (node) {
+				parent = node->parent;
+				if (node->left) {
+					node = node->left;
+					continue;
+				}
+				if (node->right) {
+					node = node->right;
+					continue;
+				}
+				if (node->deleted) {
+					db_dup_key_free(db, node->key);
+				} else {
+					if (func)
+					{
+						va_list argscopy;
+						va_copy(argscopy, args);
+						sum += func(node->key, &node->data, argscopy);
+						va_end(argscopy);
+					}
+					db->release(node->key, node->data, DB_RELEASE_BOTH);
+					node->deleted = 1;
+				}
+				DB_COUNTSTAT(db_node_free);
+				if (parent) {
+					if (parent->left == node)
+						parent->left = nullptr;
+					else
+						parent->right = nullptr;
+				}
+				ers_free(db->nodes, node);
+				node = parent;
+			}
+			db->ht[i] = nullptr;
+		}
 	}
 	db->free_count = 0;
 	db->item_count = 0;
@@ -2235,6 +2544,9 @@ static int32 db_obj_vdestroy(DBMap* self, DBApply func, va_list args)
 	sum = self->vclear(self, func, args);
 	aFree(db->free_list);
 	db->free_list = nullptr;
+	if (db->slots)
+		aFree(db->slots);
+	db->slots = nullptr;
 	db->free_max = 0;
 	ers_destroy(db->nodes);
 	db_free_unlock(db);
@@ -2573,6 +2885,11 @@ DBMap* db_alloc(const char *file, const char *func, int32 line, DBType type, DBO
 	db->release = db_default_release(type, options);
 	for (i = 0; i < HASH_SIZE; i++)
 		db->ht[i] = nullptr;
+	db->slots = nullptr;
+	db->slot_mask = 0;
+	db->slot_used = 0;
+	db->first = nullptr;
+	db->last = nullptr;
 	db->cache = nullptr;
 	db->type = type;
 	db->options = options;
@@ -122,6 +122,10 @@ typedef enum DBType {
  * @param DB_OPT_RELEASE_BOTH Releases both key and data.
  * @param DB_OPT_ALLOW_NULL_KEY Allow nullptr keys in the database.
  * @param DB_OPT_ALLOW_NULL_DATA Allow nullptr data in the database.
+ * @param DB_OPT_OPEN_HASH Index the entries in a growable open addressing
+ *          hashtable instead of the fixed hashtable of RED-BLACK trees.
+ *          Lookups stay O(1) for large databases, iteration follows the
+ *          insertion order of the entries.
  * @public
  * @see #db_fix_options(DBType,DBOptions)
  * @see #db_default_release(DBType,DBOptions)
@@ -135,6 +139,7 @@ typedef enum DBOptions {
 	DB_OPT_RELEASE_BOTH    = DB_OPT_RELEASE_KEY|DB_OPT_RELEASE_DATA,
 	DB_OPT_ALLOW_NULL_KEY  = 0x08,
 	DB_OPT_ALLOW_NULL_DATA = 0x10,
+	DB_OPT_OPEN_HASH       = 0x20,
 } DBOptions;
 
 /**
@@ -384,13 +384,14 @@ static void grfio_localpath_create(char* buffer, size_t size, const char* filena
 }
 
 
-/// Reads a file into a newly allocated buffer (from grf or data directory).
-void* grfio_reads(const char* fname, size_t* size)
+/// Reads a file into a buffer (from grf or data directory).
+/// Does not use the memory manager and does not modify the file list, so it can be called by several threads.
+bool grfio_read(const char* fname, std::vector<uint8>& buffer)
 {
-	unsigned char* buf2 = nullptr;
-
 	FILELIST* entry = filelist_find(fname);
-	if( entry == nullptr || entry->gentry <= 0 ) {// LocalFileCheck
+	int32 gentry = ( entry != nullptr ) ? entry->gentry : 0;
+
+	if( gentry <= 0 ) {// LocalFileCheck
 		char lfname[256];
 		FILE* in;
 		grfio_localpath_create(lfname, sizeof(lfname), ( entry && entry->fnd ) ? entry->fnd : fname);
@@ -400,73 +401,83 @@ void* grfio_reads(const char* fname, size_t* size)
 			fseek(in,0,SEEK_END);
 			size_t declen = ftell(in);
 			fseek(in,0,SEEK_SET);
-			buf2 = (unsigned char *)aMalloc(declen+1);  // +1 for resnametable zero-termination
-			if(fread(buf2, 1, declen, in) != declen) ShowError("An error occured in fread grfio_reads, fname=%s \n",fname);
+			buffer.resize(declen);
+			if(fread(buffer.data(), 1, declen, in) != declen) ShowError("An error occured in fread grfio_read, fname=%s \n",fname);
 			fclose(in);
-
-			if( size )
-				*size = declen;
-		} else {
-			if (entry != nullptr && entry->gentry < 0) {
-				entry->gentry = -entry->gentry;	// local file checked
-			} else {
-				ShowError("grfio_reads: %s not found (local file: %s)\n", fname, lfname);
-				return nullptr;
-			}
+			return true;
 		}
-	}
 
-	if( entry != nullptr && entry->gentry > 0 ) {// Archive[GRF] File Read
-		char* grfname = gentry_table[entry->gentry - 1];
-		FILE* in = fopen(grfname, "rb");
-		if( in != nullptr ) {
-			size_t fsize = entry->srclen_aligned;
-			unsigned char *buf = (unsigned char *)aMalloc(fsize);
-			fseek(in, entry->srcpos, 0);
-			if(fread(buf, 1, fsize, in) != fsize) ShowError("An error occured in fread in grfio_reads, grfname=%s\n",grfname);
-			fclose(in);
+		if( gentry == 0 ) {
+			ShowError("grfio_read: %s not found (local file: %s)\n", fname, lfname);
+			return false;
+		}
 
-			buf2 = (unsigned char *)aMalloc(entry->declen+1);  // +1 for resnametable zero-termination
-			if( entry->type & FILELIST_TYPE_FILE )
-			{// file
-				uLongf len;
-				grf_decode(buf, fsize, entry->type, entry->srclen);
-				len = entry->declen;
-				decode_zip(buf2, &len, buf, entry->srclen);
-				if (len != (uLong)entry->declen) {
-					ShowError("decode_zip size mismatch err: %d != %d\n", (int32)len, entry->declen);
-					aFree(buf);
-					aFree(buf2);
-					return nullptr;
-				}
-			} else {// directory?
-				memcpy(buf2, buf, entry->declen);
-			}
+		gentry = -gentry;	// local file checked
+	}
 
-			if( size )
-				*size = entry->declen;
+	// Archive[GRF] File Read
+	char* grfname = gentry_table[gentry - 1];
+	FILE* in = fopen(grfname, "rb");
+	if( in == nullptr ) {
+		ShowError("grfio_read: %s not found (GRF file: %s)\n", fname, grfname);
+		return false;
+	}
 
-			aFree(buf);
-		} else {
-			ShowError("grfio_reads: %s not found (GRF file: %s)\n", fname, grfname);
-			return nullptr;
+	size_t fsize = entry->srclen_aligned;
+	std::vector<uint8> buf(fsize);
+	fseek(in, entry->srcpos, 0);
+	if(fread(buf.data(), 1, fsize, in) != fsize) ShowError("An error occured in fread in grfio_read, grfname=%s\n",grfname);
+	fclose(in);
+
+	buffer.resize(entry->declen);
+	if( entry->type & FILELIST_TYPE_FILE )
+	{// file
+		uLongf len;
+		grf_decode(buf.data(), fsize, entry->type, entry->srclen);
+		len = entry->declen;
+		decode_zip(buffer.data(), &len, buf.data(), entry->srclen);
+		if (len != (uLong)entry->declen) {
+			ShowError("decode_zip size mismatch err: %d != %d\n", (int32)len, entry->declen);
+			return false;
 		}
+	} else {// directory?
+		memcpy(buffer.data(), buf.data(), entry->declen);
 	}
 
-	return buf2;
+	return true;
+}
+
+/// Reads a file into a newly allocated buffer (from grf or data directory).
+void* grfio_reads(const char* fname, size_t* size)
+{
+	std::vector<uint8> buffer;
+
+	if( !grfio_read(fname, buffer) )
+		return nullptr;
+
+	unsigned char* buf = (unsigned char *)aMalloc(buffer.size()+1);  // +1 for resnametable zero-termination
+	memcpy(buf, buffer.data(), buffer.size());
+
+	if( size )
+		*size = buffer.size();
+
+	return buf;
 }
 
+/// Reads the water level of a map from its .rsw file.
+/// Does not use the memory manager, so it can be called by several threads.
 int32 grfio_read_rsw_water_level( const char* fname ){
-	unsigned char* rsw = (unsigned char *)grfio_reads( fname );
+	std::vector<uint8> buffer;
 
-	if( rsw == nullptr ){
+	if( !grfio_read( fname, buffer ) ){
 		// Error already reported in grfio_read
 		return RSW_NO_WATER;
 	}
 
-	if( strncmp( (char*)rsw, "GRSW", strlen( "GRSW" ) ) ){
+	const uint8* rsw = buffer.data();
+
+	if( buffer.size() < 6 || strncmp( (const char*)rsw, "GRSW", strlen( "GRSW" ) ) ){
 		ShowError( "grfio_read_rsw_water_level: Invalid RSW signature in file %s\n", fname );
-		aFree( rsw );
 		return RSW_NO_WATER;
 	}
 
@@ -474,23 +485,25 @@ int32 grfio_read_rsw_water_level( const char* fname ){
 
 	if( version < 0x104 || version > 0x205 ){
 		ShowError( "grfio_read_rsw_water_level: Unsupported RSW version 0x%04x in file %s\n", version, fname );
-		aFree( rsw );
 		return RSW_NO_WATER;
 	}
 
-	int32 level;
+	size_t offset;
 
 	if( version >= 0x205 ){
-		level = (int32)*(float*)( rsw + 171 );
+		offset = 171;
 	} else if( version >= 0x202 ){
-		level = (int32)*(float*)( rsw + 167 );
+		offset = 167;
 	}else{
-		level = (int32)*(float*)( rsw + 166 );
+		offset = 166;
 	}
 
-	aFree( rsw );
+	if( buffer.size() < offset + sizeof( float ) ){
+		ShowError( "grfio_read_rsw_water_level: Truncated RSW file %s\n", fname );
+		return RSW_NO_WATER;
+	}
 
-	return level;
+	return (int32)*(const float*)( rsw + offset );
 }
 
 /// Decodes encrypted filename from a version 01xx grf index.
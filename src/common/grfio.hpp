@@ -4,12 +4,15 @@
 #ifndef GRFIO_HPP
 #define GRFIO_HPP
 
+#include <vector>
+
 #include "cbasetypes.hpp"
 
 const int32 RSW_NO_WATER = 1000000;
 
 void grfio_init(const char* fname);
 void grfio_final(void);
+bool grfio_read(const char* fname, std::vector<uint8>& buffer);
 void* grfio_reads(const char* fname, size_t* size = nullptr);
 char* grfio_find_file(const char* fname);
 int32 grfio_read_rsw_water_level( const char* fname );
@@ -0,0 +1,43 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#ifndef MAPCACHE_HPP
+#define MAPCACHE_HPP
+
+#include "cbasetypes.hpp"
+#include "mmo.hpp"
+
+// Version 2 of the map cache starts with this header, followed by the index sorted by map name
+// and the uncompressed terrain flags of every cell, so maps can be looked up without scanning
+// and loaded without decompression.
+// All numbers are stored in little-endian, like in version 1.
+#define MAP_CACHE_V2_MAGIC "RAMC"
+#define MAP_CACHE_V2_VERSION 2
+
+struct map_cache_v2_header {
+	char magic[4];
+	uint32 version;
+	uint32 map_count;
+	uint32 reserved;
+};
+
+// Index entry of a map in the v2 map cache
+struct map_cache_v2_index {
+	char name[MAP_NAME_LENGTH];
+	int16 xs;
+	int16 ys;
+	uint64 offset; // position of the cells in the file
+};
+
+// The structures are written to and mapped from the file as they are
+static_assert( sizeof( struct map_cache_v2_header ) == 16, "map_cache_v2_header must not be padded" );
+static_assert( sizeof( struct map_cache_v2_index ) == 24, "map_cache_v2_index must not be padded" );
+
+// Terrain flags of a cell in the v2 map cache
+enum e_map_cache_cell : uint8 {
+	MAP_CACHE_CELL_WALKABLE = 0x1,
+	MAP_CACHE_CELL_SHOOTABLE = 0x2,
+	MAP_CACHE_CELL_WATER = 0x4,
+};
+
+#endif /* MAPCACHE_HPP */
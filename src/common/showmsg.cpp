@@ -662,6 +662,9 @@ int32	FPRINTF(FILE *file, const char *fmt, ...)
 
 char timestamp_format[20] = ""; //For displaying Timestamps
 
+/// Messages of the current thread are collected here instead of being shown, see ShowCaptureStart
+static thread_local std::vector<s_captured_message>* captured_messages = nullptr;
+
 int32 _vShowMessage(enum msg_type flag, const char *string, va_list ap)
 {
 	va_list apcopy;
@@ -674,6 +677,26 @@ int32 _vShowMessage(enum msg_type flag, const char *string, va_list ap)
 		ShowError("Empty string passed to _vShowMessage().\n");
 		return 1;
 	}
+	if( captured_messages != nullptr ){
+		int32 len;
+
+		va_copy(apcopy, ap);
+		len = vsnprintf(nullptr, 0, string, apcopy);
+		va_end(apcopy);
+
+		if( len > 0 ){
+			s_captured_message& message = captured_messages->emplace_back();
+
+			message.flag = flag;
+			message.text.resize(len + 1);
+			va_copy(apcopy, ap);
+			vsnprintf(&message.text[0], len + 1, string, apcopy);
+			va_end(apcopy);
+			message.text.resize(len);
+		}
+
+		return 0;
+	}
 	/**
 	 * For the buildbot, these result in a EXIT_FAILURE from core.cpp when done reading the params.
 	 **/
@@ -811,6 +834,36 @@ int32 _ShowMessage(enum msg_type flag, const char *string, ...)
 }
 
 // direct printf replacement
+/**
+ * Collects the messages of the current thread instead of showing them, until ShowCaptureStop is called.
+ * Used to show the messages of work done in parallel in a deterministic order.
+ * @param messages: Where the messages are collected
+ */
+void ShowCaptureStart(std::vector<s_captured_message>& messages) {
+	captured_messages = &messages;
+}
+
+void ShowCaptureStop(void) {
+	captured_messages = nullptr;
+}
+
+static void ShowCapturedMessage(enum msg_type flag, const char *string, ...) {
+	va_list ap;
+	va_start(ap, string);
+	_vShowMessage(flag, string, ap);
+	va_end(ap);
+}
+
+/**
+ * Shows captured messages as if they were shown right now.
+ * @param messages: Messages collected by ShowCaptureStart
+ */
+void ShowCaptured(const std::vector<s_captured_message>& messages) {
+	for( const s_captured_message& message : messages ){
+		ShowCapturedMessage(message.flag, "%s", message.text.c_str());
+	}
+}
+
 void ShowMessage(const char *string, ...) {
 	va_list ap;
 	va_start(ap, string);
@@ -4,6 +4,9 @@
 #ifndef SHOWMSG_HPP
 #define SHOWMSG_HPP
 
+#include <string>
+#include <vector>
+
 #include <libconfig.h>
 
 #include <common/cbasetypes.hpp>
@@ -100,4 +103,14 @@ extern void ShowError(const char *, ...);
 extern void ShowFatalError(const char *, ...);
 extern void ShowConfigWarning(config_setting_t *config, const char *string, ...);
 
+/// A message that was captured instead of being shown
+struct s_captured_message {
+	enum msg_type flag;
+	std::string text;
+};
+
+extern void ShowCaptureStart(std::vector<s_captured_message>& messages);
+extern void ShowCaptureStop(void);
+extern void ShowCaptured(const std::vector<s_captured_message>& messages);
+
 #endif /* SHOWMSG_HPP */
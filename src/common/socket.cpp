@@ -3,6 +3,7 @@
 
 #include "socket.hpp"
 
+#include <algorithm>
 #include <cstdlib>
 
 #ifdef WIN32
@@ -23,6 +24,14 @@
 		#ifdef SOCKET_EPOLL
 			#include <sys/epoll.h>
 		#endif
+
+		#ifdef SOCKET_IO_URING
+			#include <linux/io_uring.h>
+			#include <sys/mman.h>
+			#include <sys/syscall.h>
+		#endif
+	#elif defined(SOCKET_IO_URING)
+		#error "SOCKET_IO_URING is only available on Linux"
 	#else 
 		#include <netinet/in.h>
 		#include <netinet/tcp.h>
@@ -219,6 +228,43 @@ char* sErr(int32 code)
 	#define MSG_NOSIGNAL 0
 #endif
 
+// Gather sends of a write fifo together with its shared buffers
+#define SEND_VEC_MAX 64
+
+#ifdef WIN32
+	typedef WSABUF send_vec;
+
+	static inline void send_vec_set( send_vec& vec, const void* ptr, size_t size ){
+		vec.buf = (CHAR*)ptr;
+		vec.len = (ULONG)size;
+	}
+
+	static int32 sSendv( int32 fd, send_vec* vec, int32 count ){
+		DWORD sent = 0;
+
+		if( WSASend( fd2sock( fd ), vec, count, &sent, 0, nullptr, nullptr ) == SOCKET_ERROR )
+			return SOCKET_ERROR;
+
+		return (int32)sent;
+	}
+#else
+	typedef struct iovec send_vec;
+
+	static inline void send_vec_set( send_vec& vec, const void* ptr, size_t size ){
+		vec.iov_base = (void*)ptr;
+		vec.iov_len = size;
+	}
+
+	static int32 sSendv( int32 fd, send_vec* vec, int32 count ){
+		struct msghdr msg = {};
+
+		msg.msg_iov = vec;
+		msg.msg_iovlen = count;
+
+		return (int32)sendmsg( fd, &msg, MSG_NOSIGNAL );
+	}
+#endif
+
 #ifndef SOCKET_EPOLL
 	// Select based Event Dispatcher
 	fd_set readfds;
@@ -230,6 +276,62 @@ char* sErr(int32 code)
 	static struct epoll_event *epevents = nullptr;
 #endif
 
+#ifdef SOCKET_IO_URING
+	// io_uring based batched sending, receiving and accepting
+	static int32 io_uring_entries = 256;
+
+	/// Operations submitted through the socket ring
+	enum e_socket_ring_op : uint8{
+		SOCKET_RING_SEND, // flush the write fifo, see send_from_fifo
+		SOCKET_RING_RECV, // fill the read fifo, see recv_to_fifo
+		SOCKET_RING_ACCEPT, // accept a connection on a listening socket, see connect_client
+	};
+
+	/// A session in the current batch of the socket ring
+	struct s_socket_ring_entry{
+		int32 fd;
+		e_socket_ring_op op;
+		bool completed;
+
+		// Peer address of an accepted connection
+		struct sockaddr_in addr;
+		socklen_t addrlen;
+	};
+
+	/// Memory mapped submission and completion rings used to send, receive and accept on all ready sessions with a single syscall
+	static struct s_socket_ring{
+		int32 fd = SOCKET_ERROR;
+		uint32 entries = 0;
+
+		// Submission queue
+		void* sq_ptr = nullptr;
+		size_t sq_size = 0;
+		uint32* sq_tail = nullptr;
+		uint32* sq_mask = nullptr;
+		uint32* sq_array = nullptr;
+		struct io_uring_sqe* sqes = nullptr;
+		size_t sqes_size = 0;
+
+		// Completion queue
+		void* cq_ptr = nullptr;
+		size_t cq_size = 0;
+		uint32* cq_head = nullptr;
+		uint32* cq_tail = nullptr;
+		uint32* cq_mask = nullptr;
+		struct io_uring_cqe* cqes = nullptr;
+
+		// Sessions of the current batch, indexed by the user data of their submission
+		struct s_socket_ring_entry* batch = nullptr;
+
+		// The read fifos are registered as fixed buffers, indexed by session
+		bool fixed_buffers = false;
+		bool* registered = nullptr;
+
+		// The kernel can accept without waiting for a connection, since Linux 6.10
+		bool accept = true;
+	} socket_ring;
+#endif
+
 int32 fd_max;
 time_t last_tick;
 time_t stall_time = 60;
@@ -271,6 +373,8 @@ uint32 send_shortlist_set[(MAXCONN+31)/32];// to know if specific fd's are alrea
 #endif
 
 static int32 create_session(int32 fd, RecvFunc func_recv, SendFunc func_send, ParseFunc func_parse);
+static int32 connect_client_accepted(int32 fd, struct sockaddr_in* client_address);
+int32 connect_client(int32 listen_fd);
 
 #ifndef MINICORE
 	int32 ip_rules = 1;
@@ -368,28 +472,13 @@ void set_eof(int32 fd)
 	}
 }
 
-int32 recv_to_fifo(int32 fd)
+/// Appends len successfully received bytes to the read fifo of a session, a length of 0 is the end of the connection.
+static void recv_to_fifo_received(int32 fd, int32 len)
 {
-	int32 len;
-
-	if( !session_isActive(fd) )
-		return -1;
-
-	len = sRecv(fd, (char *) session[fd]->rdata + session[fd]->rdata_size, (int32)RFIFOSPACE(fd), 0);
-
-	if( len == SOCKET_ERROR )
-	{//An exception has occured
-		if( sErrno != S_EWOULDBLOCK ) {
-			//ShowDebug("recv_to_fifo: %s, closing connection #%d\n", error_msg(), fd);
-			set_eof(fd);
-		}
-		return 0;
-	}
-
 	if( len == 0 )
 	{//Normal connection end.
 		set_eof(fd);
-		return 0;
+		return;
 	}
 
 	session[fd]->rdata_size += len;
@@ -402,44 +491,128 @@ int32 recv_to_fifo(int32 fd)
 		socket_data_ci += len;
 	}
 #endif
-	return 0;
 }
 
-int32 send_from_fifo(int32 fd)
+int32 recv_to_fifo(int32 fd)
 {
 	int32 len;
 
-	if( !session_isValid(fd) )
+	if( !session_isActive(fd) )
 		return -1;
 
-	if( session[fd]->wdata_size == 0 )
-		return 0; // nothing to send
-
-	len = sSend(fd, (const char *) session[fd]->wdata, (int32)session[fd]->wdata_size, MSG_NOSIGNAL);
+	len = sRecv(fd, (char *) session[fd]->rdata + session[fd]->rdata_size, (int32)RFIFOSPACE(fd), 0);
 
 	if( len == SOCKET_ERROR )
 	{//An exception has occured
 		if( sErrno != S_EWOULDBLOCK ) {
-			//ShowDebug("send_from_fifo: %s, ending connection #%d\n", error_msg(), fd);
-#ifdef SHOW_SERVER_STATS
-			socket_data_qo -= session[fd]->wdata_size;
-#endif
-			session[fd]->wdata_size = 0; //Clear the send queue as we can't send anymore. [Skotlex]
+			//ShowDebug("recv_to_fifo: %s, closing connection #%d\n", error_msg(), fd);
 			set_eof(fd);
 		}
 		return 0;
 	}
 
+	recv_to_fifo_received(fd, len);
+
+	return 0;
+}
+
+/*======================================
+ *	CORE : Shared send buffers
+ *--------------------------------------*/
+
+/// Creates a shared buffer with a copy of a packet, the caller holds the first reference.
+struct s_send_buffer* send_buffer_create(const void* data, size_t len)
+{
+	struct s_send_buffer* buffer = (struct s_send_buffer*)aMalloc( sizeof( struct s_send_buffer ) + len );
+
+	buffer->refcount = 1;
+	buffer->len = len;
+	buffer->data = (uint8*)( buffer + 1 );
+	memcpy( buffer->data, data, len );
+
+	return buffer;
+}
+
+/// Drops a reference to a shared buffer and frees it with the last one.
+void send_buffer_release(struct s_send_buffer* buffer)
+{
+	if( --buffer->refcount == 0 )
+		aFree( buffer );
+}
+
+/// Drops all shared buffers from the send queue of a session.
+static void send_refs_clear(int32 fd)
+{
+	struct socket_data* s = session[fd];
+
+	for( size_t i = 0; i < s->wref_count; i++ )
+		send_buffer_release( s->wrefs[i].buffer );
+
+	s->wref_count = 0;
+	s->wdata_shared = 0;
+}
+
+/// Clears the send queue of a session whose socket can't send anymore and marks it as eof.
+static void send_from_fifo_failed(int32 fd)
+{
+#ifdef SHOW_SERVER_STATS
+	socket_data_qo -= session[fd]->wdata_size + session[fd]->wdata_shared;
+#endif
+	session[fd]->wdata_size = 0; //Clear the send queue as we can't send anymore. [Skotlex]
+	send_refs_clear(fd);
+	set_eof(fd);
+}
+
+/// Removes len successfully sent bytes from the front of the send queue of a session.
+/// The queue is the write fifo with the shared buffers in between, in the order they were queued.
+static void send_from_fifo_sent(int32 fd, int32 len)
+{
 	if( len > 0 )
 	{
-		session[fd]->wdata_tick = last_tick;
+		struct socket_data* s = session[fd];
+		size_t sent = len;
+		size_t own = 0; // sent bytes of the write fifo
+		size_t done = 0; // completely sent shared buffers
+
+		s->wdata_tick = last_tick;
+
+		while( sent > 0 ){
+			size_t n = std::min( sent, ( done < s->wref_count ? s->wrefs[done].pos : s->wdata_size ) - own );
+
+			own += n;
+			sent -= n;
+
+			if( sent == 0 || done == s->wref_count )
+				break;
+
+			struct s_send_ref* ref = &s->wrefs[done];
+
+			n = std::min( sent, ref->buffer->len - ref->offset );
+			ref->offset += n;
+			s->wdata_shared -= n;
+			sent -= n;
+
+			if( ref->offset < ref->buffer->len )
+				break;
+
+			send_buffer_release( ref->buffer );
+			done++;
+		}
+
+		if( done > 0 ){
+			memmove( s->wrefs, s->wrefs + done, ( s->wref_count - done ) * sizeof( struct s_send_ref ) );
+			s->wref_count -= done;
+		}
+
+		for( size_t i = 0; i < s->wref_count; i++ )
+			s->wrefs[i].pos -= own;
 
 		// some data could not be transferred?
 		// shift unsent data to the beginning of the queue
-		if( (size_t)len < session[fd]->wdata_size )
-			memmove(session[fd]->wdata, session[fd]->wdata + len, session[fd]->wdata_size - len);
+		if( own < s->wdata_size )
+			memmove(s->wdata, s->wdata + own, s->wdata_size - own);
 
-		session[fd]->wdata_size -= len;
+		s->wdata_size -= own;
 #ifdef SHOW_SERVER_STATS
 		socket_data_o += len;
 		socket_data_qo -= len;
@@ -449,6 +622,60 @@ int32 send_from_fifo(int32 fd)
 		}
 #endif
 	}
+}
+
+/// Sends the write fifo of a session together with its shared buffers in a single call.
+static int32 send_from_fifo_vec(int32 fd)
+{
+	struct socket_data* s = session[fd];
+	send_vec vec[SEND_VEC_MAX];
+	int32 count = 0;
+	size_t pos = 0;
+	size_t i;
+
+	for( i = 0; i < s->wref_count && count < SEND_VEC_MAX - 1; i++ ){
+		struct s_send_ref* ref = &s->wrefs[i];
+
+		if( ref->pos > pos ){
+			send_vec_set( vec[count++], s->wdata + pos, ref->pos - pos );
+			pos = ref->pos;
+		}
+
+		send_vec_set( vec[count++], ref->buffer->data + ref->offset, ref->buffer->len - ref->offset );
+	}
+
+	// The rest of the write fifo can only follow once all shared buffers are in
+	if( i == s->wref_count && pos < s->wdata_size && count < SEND_VEC_MAX )
+		send_vec_set( vec[count++], s->wdata + pos, s->wdata_size - pos );
+
+	return sSendv( fd, vec, count );
+}
+
+int32 send_from_fifo(int32 fd)
+{
+	int32 len;
+
+	if( !session_isValid(fd) )
+		return -1;
+
+	if( session[fd]->wdata_size == 0 && session[fd]->wref_count == 0 )
+		return 0; // nothing to send
+
+	if( session[fd]->wref_count > 0 )
+		len = send_from_fifo_vec(fd);
+	else
+		len = sSend(fd, (const char *) session[fd]->wdata, (int32)session[fd]->wdata_size, MSG_NOSIGNAL);
+
+	if( len == SOCKET_ERROR )
+	{//An exception has occured
+		if( sErrno != S_EWOULDBLOCK ) {
+			//ShowDebug("send_from_fifo: %s, ending connection #%d\n", error_msg(), fd);
+			send_from_fifo_failed(fd);
+		}
+		return 0;
+	}
+
+	send_from_fifo_sent(fd, len);
 
 	return 0;
 }
@@ -467,6 +694,417 @@ void flush_fifos(void)
 		flush_fifo(i);
 }
 
+#ifdef SOCKET_IO_URING
+#ifndef IORING_ACCEPT_DONTWAIT
+	#define IORING_ACCEPT_DONTWAIT (1U << 1)
+#endif
+
+/// Releases the socket ring, all sessions are handled with their own functions afterwards.
+static void socket_ring_final(void)
+{
+	if( socket_ring.sqes != nullptr )
+		munmap( socket_ring.sqes, socket_ring.sqes_size );
+	if( socket_ring.cq_ptr != nullptr && socket_ring.cq_ptr != socket_ring.sq_ptr )
+		munmap( socket_ring.cq_ptr, socket_ring.cq_size );
+	if( socket_ring.sq_ptr != nullptr )
+		munmap( socket_ring.sq_ptr, socket_ring.sq_size );
+	// Closing the ring also unregisters the fixed buffers
+	if( socket_ring.fd != SOCKET_ERROR )
+		close( socket_ring.fd );
+	if( socket_ring.batch != nullptr )
+		aFree( socket_ring.batch );
+	if( socket_ring.registered != nullptr )
+		aFree( socket_ring.registered );
+
+	socket_ring = {};
+}
+
+/// Maps one of the shared ring regions of the socket ring.
+/// @return the mapped region or nullptr on failure
+static void* socket_ring_map( size_t size, off_t offset )
+{
+	void* ptr = mmap( nullptr, size, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, socket_ring.fd, offset );
+
+	if( ptr == MAP_FAILED ){
+		ShowWarning( "socket_ring_map: Failed to map io_uring region %" PRIdPTR ": %s\n", (intptr_t)offset, error_msg() );
+		return nullptr;
+	}
+
+	return ptr;
+}
+
+/// Sets up the socket ring with the given amount of submission entries.
+/// @param entries: amount of operations submitted per syscall, rounded up to a power of two by the kernel
+/// @return true on success, false if the kernel can't handle sockets through io_uring
+static bool socket_ring_init( uint32 entries )
+{
+	struct io_uring_params params = {};
+
+	socket_ring.fd = (int32)syscall( __NR_io_uring_setup, entries, &params );
+
+	if( socket_ring.fd < 0 ){
+		ShowWarning( "socket_ring_init: io_uring_setup failed: %s\n", error_msg() );
+		socket_ring.fd = SOCKET_ERROR;
+		return false;
+	}
+
+	socket_ring.entries = params.sq_entries;
+	socket_ring.batch = (struct s_socket_ring_entry*)aCalloc( params.sq_entries, sizeof( struct s_socket_ring_entry ) );
+	socket_ring.sq_size = params.sq_off.array + params.sq_entries * sizeof( uint32 );
+	socket_ring.cq_size = params.cq_off.cqes + params.cq_entries * sizeof( struct io_uring_cqe );
+	socket_ring.sqes_size = params.sq_entries * sizeof( struct io_uring_sqe );
+
+	// Since Linux 5.4 both rings share a single mapping
+	if( params.features & IORING_FEAT_SINGLE_MMAP ){
+		socket_ring.sq_size = socket_ring.cq_size = std::max( socket_ring.sq_size, socket_ring.cq_size );
+	}
+
+	if( ( socket_ring.sq_ptr = socket_ring_map( socket_ring.sq_size, IORING_OFF_SQ_RING ) ) == nullptr ){
+		socket_ring_final();
+		return false;
+	}
+
+	if( params.features & IORING_FEAT_SINGLE_MMAP ){
+		socket_ring.cq_ptr = socket_ring.sq_ptr;
+	}else if( ( socket_ring.cq_ptr = socket_ring_map( socket_ring.cq_size, IORING_OFF_CQ_RING ) ) == nullptr ){
+		socket_ring_final();
+		return false;
+	}
+
+	if( ( socket_ring.sqes = (struct io_uring_sqe*)socket_ring_map( socket_ring.sqes_size, IORING_OFF_SQES ) ) == nullptr ){
+		socket_ring_final();
+		return false;
+	}
+
+	uint8* sq = (uint8*)socket_ring.sq_ptr;
+	uint8* cq = (uint8*)socket_ring.cq_ptr;
+
+	socket_ring.sq_tail = (uint32*)( sq + params.sq_off.tail );
+	socket_ring.sq_mask = (uint32*)( sq + params.sq_off.ring_mask );
+	socket_ring.sq_array = (uint32*)( sq + params.sq_off.array );
+	socket_ring.cq_head = (uint32*)( cq + params.cq_off.head );
+	socket_ring.cq_tail = (uint32*)( cq + params.cq_off.tail );
+	socket_ring.cq_mask = (uint32*)( cq + params.cq_off.ring_mask );
+	socket_ring.cqes = (struct io_uring_cqe*)( cq + params.cq_off.cqes );
+
+	// IORING_OP_SEND and IORING_OP_RECV were added in Linux 5.6, older kernels would fail every single submission
+	struct io_uring_probe* probe = (struct io_uring_probe*)aCalloc( 1, sizeof( struct io_uring_probe ) + IORING_OP_LAST * sizeof( struct io_uring_probe_op ) );
+	bool supported = syscall( __NR_io_uring_register, socket_ring.fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST ) >= 0
+		&& probe->last_op >= IORING_OP_RECV
+		&& ( probe->ops[IORING_OP_SEND].flags & IO_URING_OP_SUPPORTED )
+		&& ( probe->ops[IORING_OP_RECV].flags & IO_URING_OP_SUPPORTED )
+		&& ( probe->ops[IORING_OP_ACCEPT].flags & IO_URING_OP_SUPPORTED );
+
+	aFree( probe );
+
+	if( !supported ){
+		ShowWarning( "socket_ring_init: The kernel does not support IORING_OP_SEND and IORING_OP_RECV.\n" );
+		socket_ring_final();
+		return false;
+	}
+
+	// Reserve an empty fixed buffer slot for every possible session, the read fifos are filled in as sessions are created.
+	// Sparse tables need Linux 5.19 and the kernel allows up to 16384 buffers, otherwise the sessions are received into without registration.
+	struct io_uring_rsrc_register reg = {};
+
+	reg.nr = MAXCONN;
+	reg.flags = IORING_RSRC_REGISTER_SPARSE;
+
+	if( syscall( __NR_io_uring_register, socket_ring.fd, IORING_REGISTER_BUFFERS2, &reg, sizeof( reg ) ) == 0 ){
+		socket_ring.fixed_buffers = true;
+		socket_ring.registered = (bool*)aCalloc( MAXCONN, sizeof( bool ) );
+	}
+
+	return true;
+}
+
+/// Registers the read fifo of a session as its fixed buffer, or clears the slot of a deleted session.
+/// Has to be called whenever the read fifo is allocated or moved, receives into unregistered fifos are not fixed.
+static void socket_ring_register( int32 fd )
+{
+	if( !socket_ring.fixed_buffers || fd <= 0 )
+		return;
+
+	struct iovec iov = {};
+
+	if( session[fd] != nullptr ){
+		iov.iov_base = session[fd]->rdata;
+		iov.iov_len = session[fd]->max_rdata;
+	}else if( !socket_ring.registered[fd] )
+		return;
+
+	struct io_uring_rsrc_update2 update = {};
+
+	update.offset = fd;
+	update.data = (uintptr_t)&iov;
+	update.nr = 1;
+
+	// Pinning the fifo can fail when it exceeds the locked memory limit of the process
+	socket_ring.registered[fd] = syscall( __NR_io_uring_register, socket_ring.fd, IORING_REGISTER_BUFFERS_UPDATE, &update, sizeof( update ) ) == 1 && iov.iov_base != nullptr;
+}
+
+/// Checks if the receive function of a ready session can be submitted through the socket ring.
+static bool socket_ring_can_recv( int32 fd )
+{
+	if( socket_ring.fd == SOCKET_ERROR )
+		return false;
+
+	if( session[fd]->func_recv == recv_to_fifo )
+		return true;
+
+	return session[fd]->func_recv == connect_client && socket_ring.accept;
+}
+
+/// Applies the result of an operation that was submitted through the socket ring, the same way its function does.
+static void socket_ring_complete( struct s_socket_ring_entry* entry, int32 res )
+{
+	int32 fd = entry->fd;
+
+	entry->completed = true;
+
+	switch( entry->op ){
+		case SOCKET_RING_SEND:
+			if( !session_isValid( fd ) )
+				break;
+
+			if( res < 0 ){
+				if( res != -EAGAIN && res != -EWOULDBLOCK ){
+					send_from_fifo_failed( fd );
+				}
+				break;
+			}
+
+			send_from_fifo_sent( fd, res );
+			break;
+
+		case SOCKET_RING_RECV:
+			if( !session_isActive( fd ) )
+				break;
+
+			if( res < 0 ){
+				if( res != -EAGAIN && res != -EWOULDBLOCK ){
+					set_eof( fd );
+				}
+				break;
+			}
+
+			recv_to_fifo_received( fd, res );
+			break;
+
+		case SOCKET_RING_ACCEPT:
+			if( res >= 0 ){
+				connect_client_accepted( res, &entry->addr );
+			}else if( res == -EINVAL ){
+				// The kernel does not know IORING_ACCEPT_DONTWAIT, accepting through the ring could block the server
+				socket_ring.accept = false;
+				connect_client( fd );
+			}else if( res != -EAGAIN && res != -EWOULDBLOCK ){
+				ShowError( "connect_client: accept failed (%s)!\n", strerror( -res ) );
+			}
+			break;
+	}
+}
+
+/// Applies all completions that are currently posted to the completion queue.
+/// @return amount of completions that were applied
+static uint32 socket_ring_reap(void)
+{
+	uint32 head = *socket_ring.cq_head;
+	uint32 tail = __atomic_load_n( socket_ring.cq_tail, __ATOMIC_ACQUIRE );
+	uint32 count = 0;
+
+	for( ; head != tail; head++, count++ ){
+		struct io_uring_cqe* cqe = &socket_ring.cqes[head & *socket_ring.cq_mask];
+
+		socket_ring_complete( &socket_ring.batch[cqe->user_data], cqe->res );
+	}
+
+	__atomic_store_n( socket_ring.cq_head, head, __ATOMIC_RELEASE );
+
+	return count;
+}
+
+/// Queues an operation for a session in the current batch of the socket ring.
+/// @param tail: submission queue tail of the batch, advanced by one
+/// @param batch: amount of operations in the batch, advanced by one
+static void socket_ring_queue( uint32& tail, uint32& batch, int32 fd, e_socket_ring_op op )
+{
+	uint32 index = tail & *socket_ring.sq_mask;
+	struct io_uring_sqe* sqe = &socket_ring.sqes[index];
+	struct s_socket_ring_entry* entry = &socket_ring.batch[batch];
+
+	entry->fd = fd;
+	entry->op = op;
+	entry->completed = false;
+
+	memset( sqe, 0, sizeof( struct io_uring_sqe ) );
+	sqe->fd = fd;
+	sqe->user_data = batch;
+
+	switch( op ){
+		case SOCKET_RING_SEND:
+			sqe->opcode = IORING_OP_SEND;
+			sqe->addr = (uintptr_t)session[fd]->wdata;
+			sqe->len = (uint32)session[fd]->wdata_size;
+			// Complete with EAGAIN on a full socket buffer instead of waiting inside the kernel, like a nonblocking send()
+			sqe->msg_flags = MSG_NOSIGNAL|MSG_DONTWAIT;
+			break;
+
+		case SOCKET_RING_RECV:
+			sqe->addr = (uintptr_t)( session[fd]->rdata + session[fd]->rdata_size );
+			sqe->len = (uint32)RFIFOSPACE( fd );
+
+			if( socket_ring.fixed_buffers && socket_ring.registered[fd] ){
+				// The pages of the read fifo are already pinned, which saves mapping them on every receive
+				sqe->opcode = IORING_OP_READ_FIXED;
+				sqe->buf_index = (uint16)fd;
+				sqe->rw_flags = RWF_NOWAIT;
+			}else{
+				sqe->opcode = IORING_OP_RECV;
+				sqe->msg_flags = MSG_DONTWAIT;
+			}
+			break;
+
+		case SOCKET_RING_ACCEPT:
+			entry->addrlen = sizeof( entry->addr );
+			sqe->opcode = IORING_OP_ACCEPT;
+			sqe->addr = (uintptr_t)&entry->addr;
+			sqe->addr2 = (uintptr_t)&entry->addrlen;
+			sqe->ioprio = IORING_ACCEPT_DONTWAIT;
+			break;
+	}
+
+	socket_ring.sq_array[index] = index;
+	tail++;
+	batch++;
+}
+
+/// Submits the current batch of the socket ring and applies the results of all its operations with a single io_uring_enter call.
+/// If io_uring_enter fails, the sessions of the batch without a result are handled with their own functions and the ring is released.
+/// @param tail: submission queue tail after the batch
+/// @param batch: amount of operations in the batch
+static void socket_ring_submit( uint32 tail, uint32 batch )
+{
+	__atomic_store_n( socket_ring.sq_tail, tail, __ATOMIC_RELEASE );
+
+	uint32 submitted = 0;
+	uint32 reaped = 0;
+
+	while( reaped < batch ){
+		int32 ret = (int32)syscall( __NR_io_uring_enter, socket_ring.fd, batch - submitted, batch - reaped, IORING_ENTER_GETEVENTS, nullptr, 0 );
+
+		if( ret < 0 && errno != EINTR && errno != EAGAIN ){
+			ShowError( "socket_ring_submit: io_uring_enter failed, falling back to send(), recv() and accept(): %s\n", error_msg() );
+			break;
+		}
+
+		if( ret > 0 )
+			submitted += ret;
+
+		reaped += socket_ring_reap();
+	}
+
+	if( reaped == batch )
+		return;
+
+	// All operations are nonblocking and complete while they are submitted, so an operation without a result was never submitted
+	for( uint32 i = 0; i < batch; i++ ){
+		struct s_socket_ring_entry* entry = &socket_ring.batch[i];
+
+		if( entry->completed || !session_isValid( entry->fd ) )
+			continue;
+
+		switch( entry->op ){
+			case SOCKET_RING_SEND:
+				send_from_fifo( entry->fd );
+				break;
+			case SOCKET_RING_RECV:
+				recv_to_fifo( entry->fd );
+				break;
+			case SOCKET_RING_ACCEPT:
+				connect_client( entry->fd );
+				break;
+		}
+	}
+
+	socket_ring_final();
+}
+
+/// Flushes the write fifos of the given sessions through the socket ring.
+/// Each batch of up to io_uring_entries sessions is submitted and reaped with a single io_uring_enter call,
+/// instead of one send call per session.
+/// @param fds: sessions with send_from_fifo as send function and pending data
+/// @param count: amount of sessions
+static void socket_ring_do_sends( const int32* fds, size_t count )
+{
+	size_t next = 0;
+
+	while( next < count && socket_ring.fd != SOCKET_ERROR ){
+		uint32 tail = *socket_ring.sq_tail;
+		uint32 batch = 0;
+
+		for( ; next < count && batch < socket_ring.entries; next++ ){
+			int32 fd = fds[next];
+
+			// The session might have been closed since it was queued
+			if( !session_isValid( fd ) || session[fd]->wdata_size == 0 || session[fd]->wref_count > 0 )
+				continue;
+
+			socket_ring_queue( tail, batch, fd, SOCKET_RING_SEND );
+		}
+
+		if( batch == 0 )
+			break;
+
+		socket_ring_submit( tail, batch );
+	}
+
+	// Send all remaining sessions the usual way
+	for( ; next < count; next++ ){
+		if( session_isValid( fds[next] ) )
+			send_from_fifo( fds[next] );
+	}
+}
+
+/// Receives on the given ready sessions through the socket ring, in batches like socket_ring_do_sends.
+/// Listening sockets accept a single connection, like connect_client.
+/// @param fds: sessions that passed socket_ring_can_recv
+/// @param count: amount of sessions
+static void socket_ring_do_recvs( const int32* fds, size_t count )
+{
+	size_t next = 0;
+
+	while( next < count && socket_ring.fd != SOCKET_ERROR ){
+		uint32 tail = *socket_ring.sq_tail;
+		uint32 batch = 0;
+
+		for( ; next < count && batch < socket_ring.entries; next++ ){
+			int32 fd = fds[next];
+
+			if( session[fd]->func_recv == connect_client ){
+				if( !socket_ring.accept )
+					break;
+
+				socket_ring_queue( tail, batch, fd, SOCKET_RING_ACCEPT );
+			}else if( session_isActive( fd ) ){
+				socket_ring_queue( tail, batch, fd, SOCKET_RING_RECV );
+			}
+		}
+
+		if( batch == 0 )
+			break;
+
+		socket_ring_submit( tail, batch );
+	}
+
+	// Receive on all remaining sessions the usual way
+	for( ; next < count; next++ ){
+		if( session[fds[next]] != nullptr )
+			session[fds[next]]->func_recv( fds[next] );
+	}
+}
+#endif
+
 /*======================================
  *	CORE : Connection functions
  *--------------------------------------*/
@@ -483,6 +1121,14 @@ int32 connect_client(int32 listen_fd)
 		ShowError("connect_client: accept failed (%s)!\n", error_msg());
 		return -1;
 	}
+
+	return connect_client_accepted(fd, &client_address);
+}
+
+/// Sets up the session of a connection that was accepted on a listening socket.
+/// @return the new session or -1 if the connection was refused
+static int32 connect_client_accepted(int32 fd, struct sockaddr_in* client_address)
+{
 	if( fd == 0 )
 	{// reserved
 		ShowError("connect_client: Socket #0 is reserved - Please report this!!!\n");
@@ -500,7 +1146,7 @@ int32 connect_client(int32 listen_fd)
 	set_nonblocking(fd, 1);
 
 #ifndef MINICORE
-	if( ip_rules && !connect_check(ntohl(client_address.sin_addr.s_addr)) ) {
+	if( ip_rules && !connect_check(ntohl(client_address->sin_addr.s_addr)) ) {
 		do_close(fd);
 		return -1;
 	}
@@ -524,7 +1170,7 @@ int32 connect_client(int32 listen_fd)
 	if( fd_max <= fd ) fd_max = fd + 1;
 
 	create_session(fd, recv_to_fifo, send_from_fifo, default_func_parse);
-	session[fd]->client_addr = ntohl(client_address.sin_addr.s_addr);
+	session[fd]->client_addr = ntohl(client_address->sin_addr.s_addr);
 
 	return fd;
 }
@@ -735,6 +1381,9 @@ static int32 create_session(int32 fd, RecvFunc func_recv, SendFunc func_send, Pa
 	session[fd]->func_parse = func_parse;
 	session[fd]->rdata_tick = last_tick;
 	session[fd]->wdata_tick = last_tick;
+#ifdef SOCKET_IO_URING
+	socket_ring_register(fd);
+#endif
 	return 0;
 }
 
@@ -744,13 +1393,18 @@ static void delete_session(int32 fd)
 	{
 #ifdef SHOW_SERVER_STATS
 		socket_data_qi -= session[fd]->rdata_size - session[fd]->rdata_pos;
-		socket_data_qo -= session[fd]->wdata_size;
+		socket_data_qo -= session[fd]->wdata_size + session[fd]->wdata_shared;
 #endif
+		send_refs_clear(fd);
+		aFree(session[fd]->wrefs);
 		aFree(session[fd]->rdata);
 		aFree(session[fd]->wdata);
 		aFree(session[fd]->session_data);
 		aFree(session[fd]);
 		session[fd] = nullptr;
+#ifdef SOCKET_IO_URING
+		socket_ring_register(fd);
+#endif
 	}
 }
 
@@ -761,6 +1415,9 @@ int32 _realloc_fifo( int32 fd, uint32 rfifo_size, uint32 wfifo_size, const char*
 	if( session[fd]->max_rdata != rfifo_size && session[fd]->rdata_size < rfifo_size) {
 		RECREATE2( session[fd]->rdata, unsigned char, rfifo_size, file, line, func );
 		session[fd]->max_rdata  = rfifo_size;
+#ifdef SOCKET_IO_URING
+		socket_ring_register(fd);
+#endif
 	}
 
 	if( session[fd]->max_wdata != wfifo_size && session[fd]->wdata_size < wfifo_size) {
@@ -860,7 +1517,7 @@ int32 WFIFOSET(int32 fd, size_t len)
 			return 0;
 		}
 
-		if( s->wdata_size+len > WFIFO_MAX ) {// reached maximum write fifo size
+		if( s->wdata_size+s->wdata_shared+len > WFIFO_MAX ) {// reached maximum write fifo size
 			ShowError("WFIFOSET: Maximum write buffer size for client connection %d exceeded, most likely caused by packet 0x%04x (len=%" PRIuPTR ", ip=%lu.%lu.%lu.%lu).\n", fd, WFIFOW(fd,0), len, CONVIP(s->client_addr));
 			set_eof(fd);
 			return 0;
@@ -889,11 +1546,60 @@ int32 WFIFOSET(int32 fd, size_t len)
 	return 0;
 }
 
+/// Queues a shared buffer in the send queue of a session, the counterpart of WFIFOSET for packets sent to many sessions.
+/// The session takes its own reference, the data is not copied.
+int32 WFIFOSHARE(int32 fd, struct s_send_buffer* buffer)
+{
+	struct socket_data* s = session[fd];
+
+	if( !session_isValid(fd) || s->wdata == nullptr )
+		return 0;
+
+	if( !s->flag.server ) {
+		if( buffer->len > socket_max_client_packet ) {// see declaration of socket_max_client_packet for details
+			ShowError("WFIFOSHARE: Dropped too large client packet 0x%04x (length=%" PRIuPTR ", max=%" PRIuPTR ").\n", RBUFW(buffer->data,0), buffer->len, socket_max_client_packet);
+			return 0;
+		}
+
+		if( s->wdata_size+s->wdata_shared+buffer->len > WFIFO_MAX ) {// reached maximum write fifo size
+			ShowError("WFIFOSHARE: Maximum write buffer size for client connection %d exceeded, most likely caused by packet 0x%04x (len=%" PRIuPTR ", ip=%lu.%lu.%lu.%lu).\n", fd, RBUFW(buffer->data,0), buffer->len, CONVIP(s->client_addr));
+			set_eof(fd);
+			return 0;
+		}
+	}
+
+	if( s->wref_count == s->max_wrefs ){
+		s->max_wrefs = s->max_wrefs ? 2 * s->max_wrefs : 8;
+		RECREATE( s->wrefs, struct s_send_ref, s->max_wrefs );
+	}
+
+	struct s_send_ref* ref = &s->wrefs[s->wref_count++];
+
+	ref->pos = s->wdata_size;
+	ref->offset = 0;
+	ref->buffer = buffer;
+	buffer->refcount++;
+	s->wdata_shared += buffer->len;
+#ifdef SHOW_SERVER_STATS
+	socket_data_qo += buffer->len;
+#endif
+
+#ifdef SEND_SHORTLIST
+	send_shortlist_add_fd(fd);
+#endif
+
+	return 0;
+}
+
 int32 do_sockets(t_tick next)
 {
 #ifndef SOCKET_EPOLL
 	fd_set rfd;
 	struct timeval timeout;
+#endif
+#ifdef SOCKET_IO_URING
+	static int32 ring_fds[MAXCONN];
+	size_t ring_count = 0;
 #endif
 	int32 ret,i;
 
@@ -907,7 +1613,7 @@ int32 do_sockets(t_tick next)
 		if(!session[i])
 			continue;
 
-		if(session[i]->wdata_size)
+		if(session[i]->wdata_size || session[i]->wref_count)
 			session[i]->func_send(i);
 	}
 #endif
@@ -972,6 +1678,13 @@ int32 do_sockets(t_tick next)
 			// Got Error on this connection
 			set_eof( fd );
 		}else if( it->events & EPOLLIN ){
+#ifdef SOCKET_IO_URING
+			// Defer plain fifo receives and accepts, so that they can be submitted together
+			if( socket_ring_can_recv( fd ) ){
+				ring_fds[ring_count++] = fd;
+				continue;
+			}
+#endif
 			// data waiting
 			sock->func_recv( fd );
 		}
@@ -982,12 +1695,22 @@ int32 do_sockets(t_tick next)
 	{
 		if(sFD_ISSET(i,&rfd) && session[i])
 		{
+#ifdef SOCKET_IO_URING
+			// Defer plain fifo receives and accepts, so that they can be submitted together
+			if( socket_ring_can_recv( i ) )
+				ring_fds[ring_count++] = i;
+			else
+#endif
 			session[i]->func_recv(i);
 			--ret;
 		}
 	}
 #endif
 
+#ifdef SOCKET_IO_URING
+	socket_ring_do_recvs( ring_fds, ring_count );
+#endif
+
 	// POSTSEND Send remaining data and handle eof sessions.
 #ifdef SEND_SHORTLIST
 	send_shortlist_do_sends();
@@ -997,7 +1720,7 @@ int32 do_sockets(t_tick next)
 		if(!session[i])
 			continue;
 
-		if(session[i]->wdata_size)
+		if(session[i]->wdata_size || session[i]->wref_count)
 			session[i]->func_send(i);
 
 		if(session[i]->flag.eof) //func_send can't free a session, this is safe.
@@ -1358,6 +2081,19 @@ int32 socket_config_read(const char* cfgName)
 			}
 		}
 #endif
+#ifdef SOCKET_IO_URING
+		else if( !strcmpi( w1, "io_uring_entries" ) ){
+			io_uring_entries = atoi(w2);
+
+			if( io_uring_entries < 16 ){
+				ShowWarning( "socket_config_read: io_uring_entries is set too low. Defaulting to 16...\n" );
+				io_uring_entries = 16;
+			}else if( io_uring_entries > 4096 ){
+				ShowWarning( "socket_config_read: io_uring_entries is set too high. Defaulting to 4096...\n" );
+				io_uring_entries = 4096;
+			}
+		}
+#endif
 #endif
 		else if (!strcmpi(w1, "import"))
 			socket_config_read(w2);
@@ -1418,6 +2154,10 @@ void socket_final(void)
 		epevents = nullptr;
 	}
 #endif
+
+#ifdef SOCKET_IO_URING
+	socket_ring_final();
+#endif
 }
 
 /// Closes a socket.
@@ -1607,6 +2347,14 @@ void socket_init(void)
 
 	socket_config_read(SOCKET_CONF_FILENAME);
 
+#ifdef SOCKET_IO_URING
+	// Sends, receives and accepts are batched through io_uring, if the kernel supports it
+	if( socket_ring_init( io_uring_entries ) )
+		ShowInfo( "Server uses '" CL_WHITE "io_uring" CL_RESET "' to submit up to " CL_WHITE "%u" CL_RESET " sends and receives per cycle%s\n", socket_ring.entries, socket_ring.fixed_buffers ? " into registered buffers" : "" );
+	else
+		ShowWarning( "Failed to set up io_uring, falling back to send(), recv() and accept() for every session.\n" );
+#endif
+
 	// initialise last send-receive tick
 	last_tick = time(nullptr);
 
@@ -1718,6 +2466,11 @@ void send_shortlist_add_fd(int32 fd)
 // Do pending network sends and eof handling from the shortlist.
 void send_shortlist_do_sends()
 {
+#ifdef SOCKET_IO_URING
+	static int32 ring_fds[MAXCONN];
+	size_t ring_count = 0;
+
+#endif
 	for( int32 i = static_cast<int32>( send_shortlist_count - 1 ); i >= 0; --i ){
 		int32 fd = send_shortlist_array[i];
 		int32 idx = fd/32;
@@ -1743,8 +2496,16 @@ void send_shortlist_do_sends()
 		// check for the eof state.
 		if( session[fd] )
 		{
+#ifdef SOCKET_IO_URING
+			// Defer plain fifo sends, so that they can be submitted together
+			if( socket_ring.fd != SOCKET_ERROR && session[fd]->wdata_size && session[fd]->wref_count == 0 && session[fd]->func_send == send_from_fifo ){
+				ring_fds[ring_count++] = fd;
+				continue;
+			}
+#endif
+
 			// Send data
-			if( session[fd]->wdata_size )
+			if( session[fd]->wdata_size || session[fd]->wref_count )
 				session[fd]->func_send(fd);
 
 			// If it's been marked as eof, call the parse func on it so that
@@ -1754,9 +2515,30 @@ void send_shortlist_do_sends()
 
 			// If the session still exists, is not eof and has things left to
 			// be sent from it we'll re-add it to the shortlist.
-			if( session_isActive(fd) && session[fd]->wdata_size )
+			if( session_isActive(fd) && ( session[fd]->wdata_size || session[fd]->wref_count ) )
 				send_shortlist_add_fd(fd);
 		}
 	}
+
+#ifdef SOCKET_IO_URING
+	if( ring_count == 0 )
+		return;
+
+	socket_ring_do_sends( ring_fds, ring_count );
+
+	// Same eof handling as above, now that the deferred sends are done
+	for( size_t i = 0; i < ring_count; i++ ){
+		int32 fd = ring_fds[i];
+
+		if( session[fd] == nullptr )
+			continue;
+
+		if( session[fd]->flag.eof )
+			session[fd]->func_parse(fd);
+
+		if( session_isActive(fd) && ( session[fd]->wdata_size || session[fd]->wref_count ) )
+			send_shortlist_add_fd(fd);
+	}
+#endif
 }
 #endif
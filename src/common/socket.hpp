@@ -84,11 +84,29 @@
 #define TOL(n) ((uint32)((n)&UINT32_MAX))
 
 
+// Packets of at least this size are queued as a reference to a shared copy by WFIFOSHARE users,
+// below it copying into every write fifo is cheaper than the gathered send
+#define WFIFO_SHARE_MIN 2048
+
 // Struct declaration
 typedef int32 (*RecvFunc)(int32 fd);
 typedef int32 (*SendFunc)(int32 fd);
 typedef int32 (*ParseFunc)(int32 fd);
 
+/// Packet that the send queues of several sessions reference instead of copying it
+struct s_send_buffer {
+	int32 refcount;
+	size_t len;
+	uint8* data; // Follows the struct in the same allocation
+};
+
+/// Shared buffer in the send queue of a session
+struct s_send_ref {
+	size_t pos; // Amount of bytes of wdata that are sent before the buffer
+	size_t offset; // Amount of bytes of the buffer that were already sent
+	struct s_send_buffer* buffer;
+};
+
 struct socket_data
 {
 	struct {
@@ -103,6 +121,9 @@ struct socket_data
 	size_t max_rdata, max_wdata;
 	size_t rdata_size, wdata_size;
 	size_t rdata_pos;
+	struct s_send_ref* wrefs; // Shared buffers queued between the bytes of wdata, ordered by pos
+	size_t wref_count, max_wrefs;
+	size_t wdata_shared; // Unsent bytes of the shared buffers
 	time_t rdata_tick; // time of last recv (for detecting timeouts); zero when timeout is disabled
 	time_t wdata_tick; // time of last send (for detecting timeouts);
 
@@ -138,6 +159,9 @@ int32 make_connection(uint32 ip, uint16 port, bool silent, int32 timeout);
 int32 _realloc_fifo( int32 fd, uint32 rfifo_size, uint32 wfifo_size, const char* file, int32 line, const char* func );
 int32 _realloc_writefifo( int32 fd, size_t addition, const char* file, int32 line, const char* func );
 int32 WFIFOSET(int32 fd, size_t len);
+struct s_send_buffer* send_buffer_create(const void* data, size_t len);
+void send_buffer_release(struct s_send_buffer* buffer);
+int32 WFIFOSHARE(int32 fd, struct s_send_buffer* buffer);
 int32 RFIFOSKIP(int32 fd, size_t len);
 
 int32 do_sockets(t_tick next);
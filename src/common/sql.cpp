@@ -3,7 +3,14 @@
 
 #include "sql.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>// strtoul
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #include "cbasetypes.hpp"
 #include "cli.hpp"
@@ -68,21 +75,11 @@ uint32 Sql_GetError( Sql* self ){
 
 static int32 Sql_P_Keepalive(Sql* self);
 
-/**
- * Establishes a connection to schema
- * @param self : sql handle
- * @param user : username to access
- * @param passwd : password
- * @param host : hostname
- * @param port : port
- * @param db : schema name
- * @return 
- */
-int32 Sql_Connect(Sql* self, const char* user, const char* passwd, const char* host, uint16 port, const char* db)
+/// Establishes the connection without setting up the keepalive timer.
+///
+/// @private
+static int32 Sql_P_Connect(Sql* self, const char* user, const char* passwd, const char* host, uint16 port, const char* db)
 {
-	if( self == nullptr )
-		return SQL_ERROR;
-
 	StringBuf_Clear(&self->buf);
 
 #if !defined(MARIADB_BASE_VERSION) && !defined(MARIADB_VERSION_ID) && MYSQL_VERSION_ID >= 50710
@@ -99,6 +96,27 @@ int32 Sql_Connect(Sql* self, const char* user, const char* passwd, const char* h
 		return SQL_ERROR;
 	}
 
+	return SQL_SUCCESS;
+}
+
+/**
+ * Establishes a connection to schema
+ * @param self : sql handle
+ * @param user : username to access
+ * @param passwd : password
+ * @param host : hostname
+ * @param port : port
+ * @param db : schema name
+ * @return 
+ */
+int32 Sql_Connect(Sql* self, const char* user, const char* passwd, const char* host, uint16 port, const char* db)
+{
+	if( self == nullptr )
+		return SQL_ERROR;
+
+	if( Sql_P_Connect(self, user, passwd, host, port, db) == SQL_ERROR )
+		return SQL_ERROR;
+
 	self->keepalive = Sql_P_Keepalive(self);
 	if( self->keepalive == INVALID_TIMER )
 	{
@@ -957,6 +975,366 @@ SqlStmt::~SqlStmt(){
 
 
 
+///////////////////////////////////////////////////////////////////////////////
+// Asynchronous Queries
+///////////////////////////////////////////////////////////////////////////////
+
+
+
+/// Interval in which finished queries are handed back to the main thread [ms]
+#define SQL_ASYNC_DISPATCH_INTERVAL 10
+
+/// Asynchronous query job
+struct s_sql_async_job{
+	std::string query;
+	SqlAsyncCallback callback;
+	std::chrono::steady_clock::time_point queued;
+	std::chrono::steady_clock::time_point started;
+	std::chrono::steady_clock::time_point finished;
+	std::string error_msg;
+	s_sql_async_result result;
+};
+
+/// Asynchronous query queue
+struct SqlAsync{
+	std::string name;
+	std::vector<Sql*> connections;
+	std::vector<std::thread> workers;
+	uint32 ping_interval;// seconds an idle worker waits before pinging its connection
+	int32 timer;
+
+	// shared with the workers, guarded by mutex
+	std::mutex mutex;
+	std::condition_variable cond;
+	std::condition_variable idle;
+	std::deque<std::unique_ptr<s_sql_async_job>> pending;
+	std::deque<std::unique_ptr<s_sql_async_job>> done;
+	size_t running;
+	bool stopping;
+
+	// statistics, main thread only
+	uint64 queued;
+	uint64 completed;
+	uint64 failed;
+	size_t pending_max;
+	uint64 wait_total;// time spent in the queue [us]
+	uint64 wait_max;
+	uint64 exec_total;// time spent executing [us]
+	uint64 exec_max;
+};
+
+
+
+/// Executes a job on the connection of a worker.
+/// Runs on a worker thread, so it must neither allocate through the memory
+/// manager nor print anything.
+///
+/// @private
+static void Sql_P_AsyncExecute(Sql* sql, s_sql_async_job& job)
+{
+	MYSQL* handle = &sql->handle;
+	s_sql_async_result& result = job.result;
+
+	job.started = std::chrono::steady_clock::now();
+	result.status = SQL_ERROR;
+	result.error = 0;
+	result.affected_rows = 0;
+	result.insert_id = 0;
+	result.num_columns = 0;
+
+	if( mysql_real_query(handle, job.query.c_str(), (unsigned long)job.query.length()) == 0 )
+	{
+		MYSQL_RES* res = mysql_store_result(handle);
+
+		if( mysql_errno(handle) == 0 )
+		{
+			result.status = SQL_SUCCESS;
+			result.affected_rows = (uint64)mysql_affected_rows(handle);
+			result.insert_id = (uint64)mysql_insert_id(handle);
+
+			if( res != nullptr )
+			{
+				MYSQL_ROW row;
+
+				result.num_columns = (uint32)mysql_num_fields(res);
+				result.rows.reserve((size_t)mysql_num_rows(res));
+				while( ( row = mysql_fetch_row(res) ) != nullptr )
+				{
+					unsigned long* lengths = mysql_fetch_lengths(res);
+					std::vector<std::string>& columns = result.rows.emplace_back();
+
+					columns.reserve(result.num_columns);
+					for( uint32 i = 0; i < result.num_columns; i++ )
+					{
+						if( row[i] != nullptr )
+							columns.emplace_back(row[i], lengths[i]);
+						else
+							columns.emplace_back();
+					}
+				}
+			}
+		}
+
+		if( res != nullptr )
+			mysql_free_result(res);
+	}
+
+	if( result.status == SQL_ERROR )
+	{
+		result.error = mysql_errno(handle);
+		job.error_msg = mysql_error(handle);
+	}
+
+	job.finished = std::chrono::steady_clock::now();
+}
+
+
+
+/// Worker thread main loop.
+/// Pings the connection whenever it was idle for a whole keepalive interval.
+///
+/// @private
+static void Sql_P_AsyncWorker(SqlAsync* self, Sql* sql)
+{
+	mysql_thread_init();
+
+	std::unique_lock<std::mutex> lock(self->mutex);
+
+	for(;;)
+	{
+		if( self->pending.empty() )
+		{
+			if( self->stopping )
+				break;
+
+			if( self->cond.wait_for(lock, std::chrono::seconds(self->ping_interval)) == std::cv_status::timeout && self->pending.empty() && !self->stopping )
+			{
+				lock.unlock();
+				mysql_ping(&sql->handle);
+				lock.lock();
+			}
+			continue;
+		}
+
+		std::unique_ptr<s_sql_async_job> job = std::move(self->pending.front());
+		self->pending.pop_front();
+		self->running++;
+
+		lock.unlock();
+		Sql_P_AsyncExecute(sql, *job);
+		lock.lock();
+
+		self->done.push_back(std::move(job));
+		if( --self->running == 0 && self->pending.empty() )
+			self->idle.notify_all();
+	}
+
+	lock.unlock();
+	mysql_thread_end();
+}
+
+
+
+/// Hands the finished jobs to the main thread, updates the statistics and
+/// invokes the callbacks.
+///
+/// @private
+static void Sql_P_AsyncDispatch(SqlAsync* self, bool callbacks)
+{
+	std::deque<std::unique_ptr<s_sql_async_job>> done;
+
+	{
+		std::lock_guard<std::mutex> lock(self->mutex);
+		done.swap(self->done);
+	}
+
+	for( std::unique_ptr<s_sql_async_job>& job : done )
+	{
+		uint64 wait = (uint64)std::chrono::duration_cast<std::chrono::microseconds>(job->started - job->queued).count();
+		uint64 exec = (uint64)std::chrono::duration_cast<std::chrono::microseconds>(job->finished - job->started).count();
+
+		self->completed++;
+		self->wait_total += wait;
+		self->wait_max = std::max(self->wait_max, wait);
+		self->exec_total += exec;
+		self->exec_max = std::max(self->exec_max, exec);
+
+		if( job->result.status == SQL_ERROR )
+		{
+			self->failed++;
+			ShowSQL("DB error (%s) - %s\n", self->name.c_str(), job->error_msg.c_str());
+			ShowDebug("at async query - %s\n", job->query.c_str());
+			ra_mysql_error_handler(job->result.error);
+		}
+
+		if( callbacks && job->callback )
+			job->callback(job->result);
+	}
+}
+
+
+
+/// Wrapper function for Sql_P_AsyncDispatch.
+///
+/// @private
+static TIMER_FUNC(Sql_P_AsyncDispatchTimer){
+	Sql_P_AsyncDispatch((SqlAsync*)data, true);
+	return 0;
+}
+
+
+
+/// Creates a queue with the given amount of workers and connects them.
+SqlAsync* Sql_AsyncCreate(const char* name, const char* user, const char* passwd, const char* host, uint16 port, const char* db, const char* encoding, int32 workers)
+{
+	if( workers < 1 )
+		return nullptr;
+
+	SqlAsync* self = new SqlAsync();
+
+	self->name = name;
+	self->ping_interval = 28800 - 30;
+	self->timer = INVALID_TIMER;
+	self->running = 0;
+	self->stopping = false;
+	self->queued = self->completed = self->failed = 0;
+	self->pending_max = 0;
+	self->wait_total = self->wait_max = self->exec_total = self->exec_max = 0;
+
+	// connections are established on the main thread, before any worker runs
+	for( int32 i = 0; i < workers; i++ )
+	{
+		Sql* sql = Sql_Malloc();
+
+		self->connections.push_back(sql);
+
+		if( Sql_P_Connect(sql, user, passwd, host, port, db) == SQL_ERROR ||
+			( encoding != nullptr && encoding[0] != '\0' && Sql_SetEncoding(sql, encoding) == SQL_ERROR ) )
+		{
+			Sql_ShowDebug(sql);
+			Sql_AsyncFree(self);
+			return nullptr;
+		}
+	}
+
+	uint32 timeout = 28800;
+
+	Sql_GetTimeout(self->connections.front(), &timeout);
+	self->ping_interval = std::max<uint32>(timeout, 60) - 30; // 30-second reserve
+
+	for( Sql* sql : self->connections )
+		self->workers.emplace_back(Sql_P_AsyncWorker, self, sql);
+
+	self->timer = add_timer_interval(gettick() + SQL_ASYNC_DISPATCH_INTERVAL, Sql_P_AsyncDispatchTimer, 0, (intptr_t)self, SQL_ASYNC_DISPATCH_INTERVAL);
+
+	return self;
+}
+
+
+
+/// Queues a query.
+int32 Sql_AsyncQueryStr(SqlAsync* self, const char* query, SqlAsyncCallback callback)
+{
+	if( self == nullptr || self->workers.empty() )
+		return SQL_ERROR;
+
+	std::unique_ptr<s_sql_async_job> job = std::make_unique<s_sql_async_job>();
+
+	job->query = query;
+	job->callback = std::move(callback);
+	job->queued = std::chrono::steady_clock::now();
+
+	{
+		std::lock_guard<std::mutex> lock(self->mutex);
+
+		self->pending.push_back(std::move(job));
+		self->pending_max = std::max(self->pending_max, self->pending.size());
+	}
+
+	self->cond.notify_one();
+	self->queued++;
+
+	return SQL_SUCCESS;
+}
+
+
+
+/// Returns the number of queries that were queued but not yet executed.
+size_t Sql_AsyncPending(SqlAsync* self)
+{
+	if( self == nullptr )
+		return 0;
+
+	std::lock_guard<std::mutex> lock(self->mutex);
+
+	return self->pending.size();
+}
+
+
+
+/// Blocks until all queued queries were executed and invokes their callbacks.
+void Sql_AsyncWait(SqlAsync* self)
+{
+	if( self == nullptr )
+		return;
+
+	{
+		std::unique_lock<std::mutex> lock(self->mutex);
+		self->idle.wait(lock, [self]{ return self->pending.empty() && self->running == 0; });
+	}
+
+	Sql_P_AsyncDispatch(self, true);
+}
+
+
+
+/// Shows the queue and latency statistics of the queue.
+void Sql_AsyncReport(SqlAsync* self)
+{
+	if( self == nullptr )
+		return;
+
+	size_t pending = Sql_AsyncPending(self);
+	uint64 completed = std::max<uint64>(self->completed, 1);
+
+	ShowInfo("SQL queue '" CL_WHITE "%s" CL_RESET "' (%" PRIuPTR " workers):\n", self->name.c_str(), self->workers.size());
+	ShowMessage("\tqueries: %" PRIu64 " queued, %" PRIu64 " completed, %" PRIu64 " failed\n", self->queued, self->completed, self->failed);
+	ShowMessage("\tbacklog: %" PRIuPTR " pending, %" PRIuPTR " peak\n", pending, self->pending_max);
+	ShowMessage("\twait:    %.3f ms avg, %.3f ms max\n", self->wait_total / 1000.0 / completed, self->wait_max / 1000.0);
+	ShowMessage("\texecute: %.3f ms avg, %.3f ms max\n", self->exec_total / 1000.0 / completed, self->exec_max / 1000.0);
+}
+
+
+
+/// Stops the workers and frees the queue.
+void Sql_AsyncFree(SqlAsync* self)
+{
+	if( self == nullptr )
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(self->mutex);
+		self->stopping = true;
+	}
+	self->cond.notify_all();
+
+	for( std::thread& worker : self->workers )
+		worker.join();
+
+	if( self->timer != INVALID_TIMER )
+		delete_timer(self->timer, Sql_P_AsyncDispatchTimer);
+
+	// report the errors of the remaining queries, but do not call back into freed modules
+	Sql_P_AsyncDispatch(self, false);
+
+	for( Sql* sql : self->connections )
+		Sql_Free(sql);
+
+	delete self;
+}
+
+
+
 /// Receives MySQL error codes during runtime (not on first-time-connects).
 void ra_mysql_error_handler(uint32 ecode) {
 	switch( ecode ) {
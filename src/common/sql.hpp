@@ -5,7 +5,10 @@
 #define SQL_HPP
 
 #include <cstdarg>// va_list
+#include <functional>
 #include <stdexcept>
+#include <string>
+#include <vector>
 
 #ifdef WIN32
 #include "winapi.hpp"
@@ -339,6 +342,59 @@ public:
 #define SqlStmt_ShowDebug(self) (self).ShowDebug_( __FILE__, __LINE__ )
 #endif
 
+///////////////////////////////////////////////////////////////////////////////
+// Asynchronous Queries
+///////////////////////////////////////////////////////////////////////////////
+// A queue owns a pool of worker threads, each with its own connection.
+// Queries are built and escaped on the main thread, executed by the workers
+// and their results are handed back to the main thread by a timer, so the
+// callbacks run in the same context as every other timer callback.
+//
+// A queue with a single worker executes its queries in submission order.
+
+struct SqlAsync;// async query queue (private access)
+
+/// Result of an asynchronous query.
+/// Column values of NULL are returned as empty strings.
+struct s_sql_async_result{
+	int32 status;// SQL_SUCCESS or SQL_ERROR
+	uint32 error;// MySQL error number, 0 on success
+	uint64 affected_rows;
+	uint64 insert_id;
+	uint32 num_columns;
+	std::vector<std::vector<std::string>> rows;
+};
+
+/// Callback invoked on the main thread once an asynchronous query completed.
+typedef std::function<void( s_sql_async_result& result )> SqlAsyncCallback;
+
+/// Creates a queue with the given amount of workers and connects them.
+/// The encoding is skipped if it is nullptr or empty.
+///
+/// @return The queue or nullptr if any connection failed
+SqlAsync* Sql_AsyncCreate( const char* name, const char* user, const char* passwd, const char* host, uint16 port, const char* db, const char* encoding, int32 workers );
+
+/// Queues a query.
+/// The query is used directly.
+/// The callback may be nullptr for fire-and-forget queries.
+///
+/// @return SQL_SUCCESS or SQL_ERROR
+int32 Sql_AsyncQueryStr( SqlAsync* self, const char* query, SqlAsyncCallback callback = nullptr );
+
+/// Returns the number of queries that were queued but not yet executed.
+size_t Sql_AsyncPending( SqlAsync* self );
+
+/// Blocks until all queued queries were executed and invokes their callbacks.
+/// Used before reading data back that queued queries may still be writing.
+void Sql_AsyncWait( SqlAsync* self );
+
+/// Shows the queue and latency statistics of the queue.
+void Sql_AsyncReport( SqlAsync* self );
+
+/// Stops the workers and frees the queue.
+/// Queued queries are still executed, but their callbacks are not invoked anymore.
+void Sql_AsyncFree( SqlAsync* self );
+
 void Sql_Init(void);
 
 #endif /* SQL_HPP */
@@ -3,9 +3,15 @@
 
 #include "timer.hpp"
 
+#include <algorithm>
+#include <chrono>
 #include <cstdlib>
 #include <cstring>
+#include <unordered_map>
 #include <utility>
+#include <vector>
+
+#include <sys/stat.h>
 
 #include "cbasetypes.hpp"
 #include "db.hpp"
@@ -35,17 +41,36 @@ static int32 free_timer_list_max = 0;
 static int32 free_timer_list_pos = 0;
 
 
-/// Comparator for the timer heap. (minimum tick at top)
-/// Returns negative if tid1's tick is smaller, positive if tid2's tick is smaller, 0 if equal.
-///
-/// @param tid1 First timer
-/// @param tid2 Second timer
-/// @return negative if tid1 is top, positive if tid2 is top, 0 if equal
-#define DIFFTICK_MINTOPCMP(tid1,tid2) DIFF_TICK(timer_data[tid1].tick,timer_data[tid2].tick)
-
-// timer heap (binary heap of tid's)
-static BHEAP_VAR(int32, timer_heap);
-
+// Timer wheel
+// Level 0 holds the timers of the next 256ms with one slot per millisecond,
+// every further level covers 64 times the range of the previous one (~49 days in total).
+// Timers of the higher levels are moved down ("cascaded") whenever level 0 completes a revolution,
+// so adding, moving and removing a timer is O(1) and the next expired timer is found with a bit scan.
+#define TIMER_WHEEL_BITS 8
+#define TIMER_WHEEL_SIZE (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+#define TIMER_WHEEL_LEVEL_BITS 6
+#define TIMER_WHEEL_LEVEL_SIZE (1 << TIMER_WHEEL_LEVEL_BITS)
+#define TIMER_WHEEL_LEVEL_MASK (TIMER_WHEEL_LEVEL_SIZE - 1)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOTS (TIMER_WHEEL_SIZE + TIMER_WHEEL_LEVELS * TIMER_WHEEL_LEVEL_SIZE)
+#define TIMER_WHEEL_RANGE ((int64)1 << (TIMER_WHEEL_BITS + TIMER_WHEEL_LEVELS * TIMER_WHEEL_LEVEL_BITS))
+
+// position of a timer inside the wheel (array, indexed by tid)
+struct timer_node {
+	int32 prev;
+	int32 next;
+	int32 slot; // -1 if the timer is not queued
+};
+static struct timer_node* timer_node = nullptr;
+
+// first timer of each slot, the timers of a slot form a circular list in insertion order
+static int32 timer_wheel[TIMER_WHEEL_SLOTS];
+// non-empty slots of level 0 and the higher levels
+static uint64 timer_wheel_used[TIMER_WHEEL_SIZE / 64];
+static uint64 timer_wheel_level_used[TIMER_WHEEL_LEVELS];
+// next millisecond to be processed by the wheel
+static t_tick timer_wheel_tick = 0;
 
 // server startup time
 time_t start_time;
@@ -94,6 +119,141 @@ const char* search_timer_func_list(TimerFunc func)
 	return "unknown timer function";
 }
 
+/*----------------------------
+ * 	Timer statistics
+ *----------------------------*/
+struct s_timer_stats {
+	uint64 calls;
+	uint64 total_time; // microseconds spent in the callback
+	uint64 max_time;
+	uint64 total_late; // milliseconds between the scheduled and the actual tick
+	uint64 max_late;
+};
+
+static bool timer_stats_enabled = false;
+static time_t timer_stats_start; // start of the current sampling period
+static std::unordered_map<TimerFunc, s_timer_stats> timer_stats;
+
+/// Starts or stops collecting per-callback statistics in do_timer.
+void timer_stats_enable(bool enable)
+{
+	if( enable && !timer_stats_enabled )
+		timer_stats_reset();
+
+	timer_stats_enabled = enable;
+}
+
+/// Returns true if per-callback statistics are collected.
+bool timer_stats_isenabled(void)
+{
+	return timer_stats_enabled;
+}
+
+/// Discards the collected statistics and starts a new sampling period.
+void timer_stats_reset(void)
+{
+	timer_stats.clear();
+	time(&timer_stats_start);
+}
+
+/// Adds a single execution of a timer callback to the statistics.
+static void timer_stats_add(TimerFunc func, uint64 time, t_tick late)
+{
+	s_timer_stats& stats = timer_stats[func];
+
+	if( late < 0 )
+		late = 0;
+
+	stats.calls++;
+	stats.total_time += time;
+	stats.max_time = std::max( stats.max_time, time );
+	stats.total_late += late;
+	stats.max_late = std::max( stats.max_late, (uint64)late );
+}
+
+/// Returns the collected statistics, the most expensive callbacks first.
+static std::vector<std::pair<TimerFunc, s_timer_stats>> timer_stats_sorted(void)
+{
+	std::vector<std::pair<TimerFunc, s_timer_stats>> sorted( timer_stats.begin(), timer_stats.end() );
+
+	std::sort( sorted.begin(), sorted.end(), []( const auto& a, const auto& b ){
+		return a.second.total_time > b.second.total_time;
+	} );
+
+	return sorted;
+}
+
+/// Prints the collected statistics to the console.
+void timer_stats_report(void)
+{
+	if( !timer_stats_enabled && timer_stats.empty() ){
+		ShowInfo("Timer statistics are disabled.\n");
+		return;
+	}
+
+	ShowInfo("Timer statistics of the last " CL_WHITE "%.0f" CL_RESET " seconds:\n", difftime(time(nullptr), timer_stats_start));
+	ShowMessage("%-40s %10s %12s %10s %10s %10s %10s\n", "callback", "calls", "total (ms)", "avg (us)", "max (us)", "avg late", "max late");
+
+	for( const auto& it : timer_stats_sorted() ){
+		const s_timer_stats& stats = it.second;
+
+		ShowMessage("%-40s %10" PRIu64 " %12.1f %10" PRIu64 " %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "\n",
+			search_timer_func_list(it.first), stats.calls, stats.total_time / 1000.,
+			stats.total_time / stats.calls, stats.max_time, stats.total_late / stats.calls, stats.max_late);
+	}
+}
+
+/// Writes the collected statistics to a file.
+/// Files ending in .json are overwritten with a snapshot, any other file gets CSV rows appended.
+/// @param filename File to write to
+/// @return true on success
+bool timer_stats_export(const char* filename)
+{
+	const char* ext = strrchr(filename, '.');
+	bool json = ext != nullptr && strcmpi(ext, ".json") == 0;
+	struct stat file_stat;
+	// The position of a file opened for appending is not reliable before the first write, so check the size up front
+	bool header = !json && ( stat(filename, &file_stat) != 0 || file_stat.st_size == 0 );
+	FILE* fp = fopen(filename, json ? "w" : "a");
+
+	if( fp == nullptr ){
+		ShowError("timer_stats_export: Failed to open '%s' for writing.\n", filename);
+		return false;
+	}
+
+	time_t now = time(nullptr);
+	char timestamp[24];
+
+	timestamp2string(timestamp, sizeof(timestamp), now, "%Y-%m-%d %H:%M:%S");
+
+	if( json ){
+		bool first = true;
+
+		fprintf(fp, "{\n\t\"timestamp\": \"%s\",\n\t\"period\": %.0f,\n\t\"timers\": [", timestamp, difftime(now, timer_stats_start));
+		for( const auto& it : timer_stats_sorted() ){
+			const s_timer_stats& stats = it.second;
+
+			fprintf(fp, "%s\n\t\t{ \"name\": \"%s\", \"calls\": %" PRIu64 ", \"total_us\": %" PRIu64 ", \"max_us\": %" PRIu64 ", \"total_late_ms\": %" PRIu64 ", \"max_late_ms\": %" PRIu64 " }",
+				first ? "" : ",", search_timer_func_list(it.first), stats.calls, stats.total_time, stats.max_time, stats.total_late, stats.max_late);
+			first = false;
+		}
+		fprintf(fp, "\n\t]\n}\n");
+	}else{
+		if( header )
+			fprintf(fp, "timestamp,period,name,calls,total_us,max_us,total_late_ms,max_late_ms\n");
+
+		for( const auto& it : timer_stats_sorted() ){
+			const s_timer_stats& stats = it.second;
+
+			fprintf(fp, "%s,%.0f,%s,%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+				timestamp, difftime(now, timer_stats_start), search_timer_func_list(it.first), stats.calls, stats.total_time, stats.max_time, stats.total_late, stats.max_late);
+		}
+	}
+
+	fclose(fp);
+	return true;
+}
+
 /*----------------------------
  * 	Get tick time
  *----------------------------*/
@@ -202,14 +362,167 @@ t_tick gettick(void)
 //////////////////////////////////////////////////////////////////////////
 
 /*======================================
- * 	CORE : Timer Heap
+ * 	CORE : Timer Wheel
  *--------------------------------------*/
 
-/// Adds a timer to the timer_heap
-static void push_timer_heap(int32 tid)
+/// Returns the index of the lowest set bit.
+/// @param bits Bits to scan, must not be 0
+static inline uint32 timer_wheel_lowbit(uint64 bits)
 {
-	BHEAP_ENSURE(timer_heap, 1, 256);
-	BHEAP_PUSH(timer_heap, tid, DIFFTICK_MINTOPCMP);
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+
+	_BitScanForward64(&index, bits);
+	return index;
+#elif defined(__GNUC__)
+	return __builtin_ctzll(bits);
+#else
+	uint32 index = 0;
+
+	for( ; !(bits & 1); bits >>= 1 )
+		index++;
+	return index;
+#endif
+}
+
+/// Marks a slot of the wheel as (non-)empty.
+static void timer_wheel_mark(int32 slot, bool used)
+{
+	uint64* bits;
+	uint64 mask;
+
+	if( slot < TIMER_WHEEL_SIZE ) {
+		bits = &timer_wheel_used[slot / 64];
+		mask = (uint64)1 << (slot % 64);
+	} else {
+		slot -= TIMER_WHEEL_SIZE;
+		bits = &timer_wheel_level_used[slot / TIMER_WHEEL_LEVEL_SIZE];
+		mask = (uint64)1 << (slot % TIMER_WHEEL_LEVEL_SIZE);
+	}
+
+	if( used )
+		*bits |= mask;
+	else
+		*bits &= ~mask;
+}
+
+/// Returns the slot a timer expiring at tick belongs to.
+static int32 timer_wheel_slot(t_tick tick)
+{
+	t_tick delta = DIFF_TICK(tick, timer_wheel_tick);
+
+	if( delta < 0 ) // already expired, process it with the current slot
+		return (int32)(timer_wheel_tick & TIMER_WHEEL_MASK);
+	if( delta < TIMER_WHEEL_SIZE )
+		return (int32)(tick & TIMER_WHEEL_MASK);
+	if( delta >= TIMER_WHEEL_RANGE ) // out of range, keep it in the last slot until it comes closer
+		tick = timer_wheel_tick + TIMER_WHEEL_RANGE - 1;
+
+	for( int32 level = 0, shift = TIMER_WHEEL_BITS; ; level++, shift += TIMER_WHEEL_LEVEL_BITS ) {
+		if( level == TIMER_WHEEL_LEVELS - 1 || delta < ((t_tick)1 << (shift + TIMER_WHEEL_LEVEL_BITS)) )
+			return TIMER_WHEEL_SIZE + level * TIMER_WHEEL_LEVEL_SIZE + (int32)((tick >> shift) & TIMER_WHEEL_LEVEL_MASK);
+	}
+}
+
+/// Adds a timer to the timer wheel
+static void push_timer_wheel(int32 tid)
+{
+	int32 slot = timer_wheel_slot(timer_data[tid].tick);
+	int32 head = timer_wheel[slot];
+
+	if( head == INVALID_TIMER ) {
+		timer_node[tid].prev = tid;
+		timer_node[tid].next = tid;
+		timer_wheel[slot] = tid;
+		timer_wheel_mark(slot, true);
+	} else {// append, so timers of the same tick run in the order they were added
+		int32 tail = timer_node[head].prev;
+
+		timer_node[tid].prev = tail;
+		timer_node[tid].next = head;
+		timer_node[tail].next = tid;
+		timer_node[head].prev = tid;
+	}
+	timer_node[tid].slot = slot;
+}
+
+/// Removes a timer from the timer wheel
+static void pop_timer_wheel(int32 tid)
+{
+	int32 slot = timer_node[tid].slot;
+
+	if( timer_node[tid].next == tid ) {
+		timer_wheel[slot] = INVALID_TIMER;
+		timer_wheel_mark(slot, false);
+	} else {
+		timer_node[timer_node[tid].prev].next = timer_node[tid].next;
+		timer_node[timer_node[tid].next].prev = timer_node[tid].prev;
+		if( timer_wheel[slot] == tid )
+			timer_wheel[slot] = timer_node[tid].next;
+	}
+	timer_node[tid].slot = -1;
+}
+
+/// Moves the timers of the higher level slots that start at the current tick down the wheel.
+/// Has to be called whenever level 0 starts a new revolution.
+static void cascade_timer_wheel(void)
+{
+	for( int32 level = 0, shift = TIMER_WHEEL_BITS; level < TIMER_WHEEL_LEVELS; level++, shift += TIMER_WHEEL_LEVEL_BITS ) {
+		int32 index = (int32)((timer_wheel_tick >> shift) & TIMER_WHEEL_LEVEL_MASK);
+		int32 slot = TIMER_WHEEL_SIZE + level * TIMER_WHEEL_LEVEL_SIZE + index;
+		int32 head = timer_wheel[slot];
+
+		if( head != INVALID_TIMER ) {
+			int32 tid = head;
+
+			timer_wheel[slot] = INVALID_TIMER;
+			timer_wheel_mark(slot, false);
+			do {
+				int32 next = timer_node[tid].next;
+
+				push_timer_wheel(tid);
+				tid = next;
+			} while( tid != head );
+		}
+
+		if( index != 0 )
+			break; // the next level did not complete a revolution yet
+	}
+}
+
+/// Returns the first non-empty level 0 slot from index up to the end of the current revolution, or -1 if there is none.
+static int32 next_timer_wheel(int32 index)
+{
+	for( int32 i = index / 64; i < TIMER_WHEEL_SIZE / 64; i++ ) {
+		uint64 bits = timer_wheel_used[i];
+
+		if( i == index / 64 )
+			bits &= ~(uint64)0 << (index % 64);
+		if( bits )
+			return i * 64 + timer_wheel_lowbit(bits);
+	}
+
+	return -1;
+}
+
+/// Returns the earliest tick at which the wheel might have expired timers.
+/// Timers in the higher levels are only looked at once they are cascaded at the next revolution.
+static t_tick next_tick_timer_wheel(void)
+{
+	int32 index = (int32)(timer_wheel_tick & TIMER_WHEEL_MASK);
+	int32 slot = next_timer_wheel(index);
+
+	if( slot >= 0 )
+		return timer_wheel_tick + slot - index;
+
+	for( int32 i = 0; i < TIMER_WHEEL_SIZE / 64; i++ )
+		if( timer_wheel_used[i] )
+			return timer_wheel_tick + TIMER_WHEEL_SIZE - index;
+	for( int32 i = 0; i < TIMER_WHEEL_LEVELS; i++ )
+		if( timer_wheel_level_used[i] )
+			return timer_wheel_tick + TIMER_WHEEL_SIZE - index;
+
+	return INFINITE_TICK;
 }
 
 /*==========================
@@ -240,6 +553,9 @@ static int32 acquire_timer(void)
 		else
 			CREATE(timer_data, struct TimerData, timer_data_max);
 		memset(timer_data + (timer_data_max - 256), 0, sizeof(struct TimerData)*256);
+		RECREATE(timer_node, struct timer_node, timer_data_max);
+		for( int32 i = timer_data_max - 256; i < timer_data_max; i++ )
+			timer_node[i].slot = -1;
 	}
 
 	if( tid >= timer_data_num )
@@ -261,7 +577,7 @@ int32 add_timer(t_tick tick, TimerFunc func, int32 id, intptr_t data)
 	timer_data[tid].data     = data;
 	timer_data[tid].type     = TIMER_ONCE_AUTODEL;
 	timer_data[tid].interval = 1000;
-	push_timer_heap(tid);
+	push_timer_wheel(tid);
 
 	return tid;
 }
@@ -285,7 +601,7 @@ int32 add_timer_interval(t_tick tick, TimerFunc func, int32 id, intptr_t data, i
 	timer_data[tid].data     = data;
 	timer_data[tid].type     = TIMER_INTERVAL;
 	timer_data[tid].interval = interval;
-	push_timer_heap(tid);
+	push_timer_wheel(tid);
 
 	return tid;
 }
@@ -329,11 +645,7 @@ t_tick addtick_timer(int32 tid, t_tick tick)
 /// Returns the new tick value, or -1 if it fails.
 t_tick settick_timer(int32 tid, t_tick tick)
 {
-	size_t i;
-
-	// search timer position
-	ARR_FIND(0, BHEAP_LENGTH(timer_heap), i, BHEAP_DATA(timer_heap)[i] == tid);
-	if( i == BHEAP_LENGTH(timer_heap) )
+	if( tid < 0 || tid >= timer_data_num || timer_node[tid].slot == -1 )
 	{
 		ShowError("settick_timer: no such timer %d (%p(%s))\n", tid, timer_data[tid].func, search_timer_func_list(timer_data[tid].func));
 		return -1;
@@ -346,69 +658,113 @@ t_tick settick_timer(int32 tid, t_tick tick)
 		return tick;// nothing to do, already in propper position
 
 	// pop and push adjusted timer
-	BHEAP_POPINDEX(timer_heap, i, DIFFTICK_MINTOPCMP);
+	pop_timer_wheel(tid);
 	timer_data[tid].tick = tick;
-	BHEAP_PUSH(timer_heap, tid, DIFFTICK_MINTOPCMP);
+	push_timer_wheel(tid);
 	return tick;
 }
 
+/// Executes a timer that was removed from the wheel and releases or restarts it afterwards.
+static void run_timer(int32 tid, t_tick tick)
+{
+	t_tick diff = DIFF_TICK(timer_data[tid].tick, tick);
+
+	timer_data[tid].type |= TIMER_REMOVE_HEAP;
+
+	if( timer_data[tid].func )
+	{
+		TimerFunc func = timer_data[tid].func;
+		bool stats = timer_stats_enabled; // the callback might toggle it
+		std::chrono::steady_clock::time_point start;
+
+		if( stats )
+			start = std::chrono::steady_clock::now();
+
+		if( diff < -1000 )
+			// timer was delayed for more than 1 second, use current tick instead
+			func(tid, tick, timer_data[tid].id, timer_data[tid].data);
+		else
+			func(tid, timer_data[tid].tick, timer_data[tid].id, timer_data[tid].data);
+
+		if( stats )
+			timer_stats_add(func, std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count(), -diff);
+	}
+
+	// in the case the function didn't change anything...
+	if( timer_data[tid].type & TIMER_REMOVE_HEAP )
+	{
+		timer_data[tid].type &= ~TIMER_REMOVE_HEAP;
+
+		switch( timer_data[tid].type )
+		{
+		default:
+		case TIMER_ONCE_AUTODEL:
+			timer_data[tid].type = 0;
+			if (free_timer_list_pos >= free_timer_list_max) {
+				free_timer_list_max += 256;
+				RECREATE(free_timer_list,int32,free_timer_list_max);
+				memset(free_timer_list + (free_timer_list_max - 256), 0, 256 * sizeof(int32));
+			}
+			free_timer_list[free_timer_list_pos++] = tid;
+		break;
+		case TIMER_INTERVAL:
+			if( DIFF_TICK(timer_data[tid].tick, tick) < -1000 )
+				timer_data[tid].tick = tick + timer_data[tid].interval;
+			else
+				timer_data[tid].tick += timer_data[tid].interval;
+			push_timer_wheel(tid);
+		break;
+		}
+	}
+}
+
 /// Executes all expired timers.
 /// Returns the value of the smallest non-expired timer (or 1 second if there aren't any).
 t_tick do_timer(t_tick tick)
 {
-	t_tick diff = TIMER_MAX_INTERVAL; // return value
+	t_tick next;
 
-	// process all timers one by one
-	while( BHEAP_LENGTH(timer_heap) )
+	// process all expired slots in order of their tick
+	while( DIFF_TICK(timer_wheel_tick, tick) <= 0 )
 	{
-		int32 tid = BHEAP_PEEK(timer_heap);// top element in heap (smallest tick)
+		int32 index = (int32)(timer_wheel_tick & TIMER_WHEEL_MASK);
 
-		diff = DIFF_TICK(timer_data[tid].tick, tick);
-		if( diff > 0 )
-			break; // no more expired timers to process
+		if( index == 0 )
+			cascade_timer_wheel();
 
-		// remove timer
-		BHEAP_POP(timer_heap, DIFFTICK_MINTOPCMP);
-		timer_data[tid].type |= TIMER_REMOVE_HEAP;
+		int32 slot = next_timer_wheel(index);
 
-		if( timer_data[tid].func )
-		{
-			if( diff < -1000 )
-				// timer was delayed for more than 1 second, use current tick instead
-				timer_data[tid].func(tid, tick, timer_data[tid].id, timer_data[tid].data);
-			else
-				timer_data[tid].func(tid, timer_data[tid].tick, timer_data[tid].id, timer_data[tid].data);
+		if( slot < 0 )
+		{// nothing left in this revolution, but never move past the current tick
+			next = timer_wheel_tick + TIMER_WHEEL_SIZE - index;
+			timer_wheel_tick = ( DIFF_TICK(next, tick) > 0 ) ? tick + 1 : next;
+			continue;
 		}
 
-		// in the case the function didn't change anything...
-		if( timer_data[tid].type & TIMER_REMOVE_HEAP )
-		{
-			timer_data[tid].type &= ~TIMER_REMOVE_HEAP;
-
-			switch( timer_data[tid].type )
-			{
-			default:
-			case TIMER_ONCE_AUTODEL:
-				timer_data[tid].type = 0;
-				if (free_timer_list_pos >= free_timer_list_max) {
-					free_timer_list_max += 256;
-					RECREATE(free_timer_list,int32,free_timer_list_max);
-					memset(free_timer_list + (free_timer_list_max - 256), 0, 256 * sizeof(int32));
-				}
-				free_timer_list[free_timer_list_pos++] = tid;
+		next = timer_wheel_tick + slot - index;
+		if( DIFF_TICK(next, tick) > 0 )
+		{// no more expired timers to process
+			timer_wheel_tick = tick + 1;
 			break;
-			case TIMER_INTERVAL:
-				if( DIFF_TICK(timer_data[tid].tick, tick) < -1000 )
-					timer_data[tid].tick = tick + timer_data[tid].interval;
-				else
-					timer_data[tid].tick += timer_data[tid].interval;
-				push_timer_heap(tid);
-			break;
-			}
 		}
+
+		// timers added for this or an earlier tick by the callbacks are appended to this slot
+		timer_wheel_tick = next;
+		while( timer_wheel[slot] != INVALID_TIMER )
+		{
+			int32 tid = timer_wheel[slot];
+
+			pop_timer_wheel(tid);
+			run_timer(tid, tick);
+		}
+		timer_wheel_tick++;
 	}
 
-	return cap_value(diff, TIMER_MIN_INTERVAL, TIMER_MAX_INTERVAL);
+	next = next_tick_timer_wheel();
+	if( next == INFINITE_TICK )
+		return TIMER_MAX_INTERVAL;
+
+	return cap_value(DIFF_TICK(next, tick), TIMER_MIN_INTERVAL, TIMER_MAX_INTERVAL);
 }
 
 unsigned long get_uptime(void)
@@ -521,6 +877,10 @@ void timer_init(void)
 #endif
 
 	time(&start_time);
+
+	for( int32 i = 0; i < TIMER_WHEEL_SLOTS; i++ )
+		timer_wheel[i] = INVALID_TIMER;
+	timer_wheel_tick = gettick_nocache();
 }
 
 void timer_final(void)
@@ -534,7 +894,9 @@ void timer_final(void)
 		aFree(tfl);
 	}
 
+	timer_stats.clear();
+
 	if (timer_data) aFree(timer_data);
-	BHEAP_CLEAR(timer_heap);
+	if (timer_node) aFree(timer_node);
 	if (free_timer_list) aFree(free_timer_list);
 }
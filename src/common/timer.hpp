@@ -61,6 +61,12 @@ t_tick settick_timer(int32 tid, t_tick tick);
 
 int32 add_timer_func_list(TimerFunc func, const char* name);
 
+void timer_stats_enable(bool enable);
+bool timer_stats_isenabled(void);
+void timer_stats_reset(void);
+void timer_stats_report(void);
+bool timer_stats_export(const char* filename);
+
 unsigned long get_uptime(void);
 
 //transform a timestamp to string
@@ -161,3 +161,14 @@ std::string rathena::util::base62_encode( uint32 val ){
 	}
 	return result;
 }
+
+uint64 rathena::util::hash_fnv1a( const void* data, size_t length, uint64 hash ){
+	const uint8* bytes = static_cast<const uint8*>( data );
+
+	for( size_t i = 0; i < length; i++ ){
+		hash ^= bytes[i];
+		hash *= 0x100000001b3ULL;
+	}
+
+	return hash;
+}
@@ -333,6 +333,15 @@ std::string string_left_pad(const std::string& original, char padding, size_t nu
 */
 int32 strtoint32def(const char* str, int32 def = 0);
 
+/**
+* Hashes data with 64-bit FNV-1a, e.g. to detect changes of files
+* @param data: Data to hash
+* @param length: Length of the data in bytes
+* @param hash: Hash to continue from, to hash multiple pieces of data
+* @return Hash of the data
+*/
+uint64 hash_fnv1a( const void* data, size_t length, uint64 hash = 0xcbf29ce484222325ULL );
+
 /**
 * Encode base10 number to base62. Originally by lututui
 * @param val: Base10 Number
@@ -329,6 +329,15 @@ int32 MakeLongLE(int32 val)
 	return *((int32*)buf);
 }
 
+// Converts an uint64 from current machine order to little-endian
+uint64 MakeUInt64LE(uint64 val)
+{
+	unsigned char buf[8];
+	for( int32 i = 0; i < 8; i++ )
+		buf[i] = (unsigned char)( val >> ( i * 0x08 ) );
+	return *((uint64*)buf);
+}
+
 // Reads an uint16 in little-endian from the buffer
 uint16 GetUShort(const unsigned char* buf)
 {
@@ -351,6 +360,13 @@ int32 GetLong(const unsigned char* buf)
 	return (int32)GetULong(buf);
 }
 
+// Reads an uint64 in little-endian from the buffer
+uint64 GetUInt64(const unsigned char* buf)
+{
+	return	 ( ((uint64)GetULong(buf))            )
+			|( ((uint64)GetULong(buf + 4)) << 0x20 );
+}
+
 // Reads a float (32 bits) from the buffer
 float GetFloat(const unsigned char* buf)
 {
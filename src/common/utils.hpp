@@ -43,9 +43,11 @@ extern uint32 MakeDWord(uint16 word0, uint16 word1);
 //////////////////////////////////////////////////////////////////////////
 extern int16 MakeShortLE(int16 val);
 extern int32 MakeLongLE(int32 val);
+extern uint64 MakeUInt64LE(uint64 val);
 extern uint16 GetUShort(const unsigned char* buf);
 extern uint32 GetULong(const unsigned char* buf);
 extern int32 GetLong(const unsigned char* buf);
+extern uint64 GetUInt64(const unsigned char* buf);
 extern float GetFloat(const unsigned char* buf);
 
 #endif /* UTILS_HPP */
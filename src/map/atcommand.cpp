@@ -4384,6 +4384,13 @@ ACMD_FUNC(reloadskilldb){
 ACMD_FUNC(reloadscript){
 	nullpo_retr(-1, sd);
 
+	if( message != nullptr && strcmpi( message, "changed" ) == 0 ){
+		map_reloadnpc(true); // reload config files seeking for npcs
+		sprintf( atcmd_output, msg_txt( sd, 1541 ), npc_reload_changed() ); // %d changed NPC files have been reloaded.
+		clif_displaymessage( fd, atcmd_output );
+		return 0;
+	}
+
 	struct s_mapiterator* iter;
 	map_session_data* pl_sd;
 	//atcommand_broadcast( fd, sd, "@broadcast", "Server is reloading scripts..." );
@@ -398,44 +398,58 @@ static bool clif_session_isValid(const map_session_data* sd) {
  * - AREA_WOS (AREA WITHOUT SELF) : Not run for self
  * - AREA_CHAT_WOC : Everyone in the area of your chat without a chat
  *------------------------------------------*/
-static int32 clif_send_sub(block_list *bl, va_list ap)
-{
-	block_list *src_bl;
-	map_session_data *sd;
-	unsigned char *buf;
-	int32 len, type, fd;
+/**
+ * Queues a packet of clif_send for one of its receivers.
+ * Larger packets are copied once into a buffer that the send queues of all receivers share.
+ * @param fd: Session of the receiver
+ * @param buf: Packet
+ * @param len: Length of the packet
+ * @param shared: Shared copy of the packet, created by the first receiver that needs it
+ */
+static void clif_send_fd( int32 fd, const void* buf, int32 len, s_send_buffer*& shared ){
+	if( len < WFIFO_SHARE_MIN ){
+		WFIFOHEAD( fd, len );
+		memcpy( WFIFOP( fd, 0 ), buf, len );
+		WFIFOSET( fd, len );
+		return;
+	}
 
-	nullpo_ret(bl);
-	nullpo_ret(sd = (map_session_data *)bl);
+	if( shared == nullptr ){
+		shared = send_buffer_create( buf, len );
+	}
+
+	WFIFOSHARE( fd, shared );
+}
+
+static int32 clif_send_sub( map_session_data* sd, const void* buf, int32 len, const block_list* src_bl, int32 type, s_send_buffer*& shared ){
+	int32 fd;
+
+	nullpo_ret(sd);
+	nullpo_ret(src_bl);
 
 	// Don't send to disconnected clients.
 	if( !session_isActive( fd = sd->fd ) ){
 		return 0;
 	}
 
-	buf = va_arg(ap,unsigned char*);
-	len = va_arg(ap,int32);
-	nullpo_ret(src_bl = va_arg(ap,block_list*));
-	type = va_arg(ap,int32);
-
 	switch(type) {
 	case AREA_WOS:
-		if (bl == src_bl)
+		if (sd == src_bl)
 			return 0;
 	break;
 	case AREA_WOC:
-		if (sd->chatID || bl == src_bl)
+		if (sd->chatID || sd == src_bl)
 			return 0;
 	break;
 	case AREA_WOSC:
 	{
 		if(src_bl->type == BL_PC) {
-			map_session_data *ssd = (map_session_data *)src_bl;
+			const map_session_data *ssd = (const map_session_data *)src_bl;
 			if (ssd && sd->chatID && (sd->chatID == ssd->chatID))
 			return 0;
 		}
 		else if(src_bl->type == BL_NPC) {
-			npc_data *nd = (npc_data *)src_bl;
+			const npc_data *nd = (const npc_data *)src_bl;
 			if (nd && sd->chatID && (sd->chatID == nd->chat_id))
 			return 0;
 		}
@@ -443,7 +457,7 @@ static int32 clif_send_sub(block_list *bl, va_list ap)
 	break;
 	}
 
-	if( src_bl->type == BL_NPC && npc_is_hidden_dynamicnpc( *( (npc_data*)src_bl ), *sd ) ){
+	if( src_bl->type == BL_NPC && npc_is_hidden_dynamicnpc( *( (const npc_data*)src_bl ), *sd ) ){
 		// Do not send anything
 		return 0;
 	}
@@ -453,7 +467,6 @@ static int32 clif_send_sub(block_list *bl, va_list ap)
 		!sd->sc.getSCE(SC_INTRAVISION) && battle_check_target(src_bl,sd,BCT_ENEMY) > 0)
 		return 0;
 
-	WFIFOHEAD(fd, len);
 	if (WFIFOP(fd,0) == buf) {
 		ShowError("WARNING: Invalid use of clif_send function\n");
 		ShowError("         Packet x%4x use a WFIFO of a player instead of to use a buffer.\n", WBUFW(buf,0));
@@ -464,8 +477,7 @@ static int32 clif_send_sub(block_list *bl, va_list ap)
 		return 0;
 	}
 
-	memcpy(WFIFOP(fd,0), buf, len);
-	WFIFOSET(fd,len);
+	clif_send_fd( fd, buf, len, shared );
 
 	return 0;
 }
@@ -482,6 +494,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 	std::shared_ptr<s_battleground_data> bg;
 	int32 x0 = 0, x1 = 0, y0 = 0, y1 = 0, fd;
 	struct s_mapiterator* iter;
+	s_send_buffer* shared = nullptr;
 
 	if( type != ALL_CLIENT )
 		nullpo_ret(bl);
@@ -494,9 +507,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 		iter = mapit_getallusers();
 		while( ( tsd = static_cast<const map_session_data*>(mapit_next( iter )) ) != nullptr ){
 			if( session_isActive( fd = tsd->fd ) ){
-				WFIFOHEAD( fd, len );
-				memcpy( WFIFOP( fd, 0 ), buf, len );
-				WFIFOSET( fd, len );
+				clif_send_fd( fd, buf, len, shared );
 			}
 		}
 		mapit_free(iter);
@@ -506,9 +517,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 		iter = mapit_getallusers();
 		while( ( tsd = static_cast<const map_session_data*>(mapit_next( iter )) ) != nullptr ){
 			if( bl->m == tsd->m && session_isActive( fd = tsd->fd ) ){
-				WFIFOHEAD( fd, len );
-				memcpy( WFIFOP( fd, 0 ), buf, len );
-				WFIFOSET( fd, len );
+				clif_send_fd( fd, buf, len, shared );
 			}
 		}
 		mapit_free(iter);
@@ -521,12 +530,14 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 		[[fallthrough]];
 	case AREA_WOC:
 	case AREA_WOS:
-		map_foreachinallarea(clif_send_sub, bl->m, bl->x-AREA_SIZE, bl->y-AREA_SIZE, bl->x+AREA_SIZE, bl->y+AREA_SIZE,
-			BL_PC, buf, len, bl, type);
+		map_foreachinallarea( bl->m, bl->x-AREA_SIZE, bl->y-AREA_SIZE, bl->x+AREA_SIZE, bl->y+AREA_SIZE, BL_PC, [&]( block_list* tbl ) -> int32 {
+			return clif_send_sub( static_cast<map_session_data*>( tbl ), buf, len, bl, type, shared );
+		} );
 		break;
 	case AREA_CHAT_WOC:
-		map_foreachinallarea(clif_send_sub, bl->m, bl->x-(AREA_SIZE-5), bl->y-(AREA_SIZE-5),
-			bl->x+(AREA_SIZE-5), bl->y+(AREA_SIZE-5), BL_PC, buf, len, bl, AREA_WOC);
+		map_foreachinallarea( bl->m, bl->x-(AREA_SIZE-5), bl->y-(AREA_SIZE-5), bl->x+(AREA_SIZE-5), bl->y+(AREA_SIZE-5), BL_PC, [&]( block_list* tbl ) -> int32 {
+			return clif_send_sub( static_cast<map_session_data*>( tbl ), buf, len, bl, AREA_WOC, shared );
+		} );
 		break;
 
 	case CHAT:
@@ -544,9 +555,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 				if (type == CHAT_WOS && cd->usersd[i] == sd)
 					continue;
 				if( session_isActive( fd = cd->usersd[i]->fd ) ){
-					WFIFOHEAD(fd,len);
-					memcpy(WFIFOP(fd,0), buf, len);
-					WFIFOSET(fd,len);
+					clif_send_fd( fd, buf, len, shared );
 				}
 			}
 		}
@@ -583,9 +592,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 				if( (type == PARTY_AREA || type == PARTY_AREA_WOS) && (sd->x < x0 || sd->y < y0 || sd->x > x1 || sd->y > y1) )
 					continue;
 
-				WFIFOHEAD(fd, len);
-				memcpy(WFIFOP(fd, 0), buf, len);
-				WFIFOSET(fd, len);
+				clif_send_fd( fd, buf, len, shared );
 			}
 			if (!enable_spy) //Skip unnecessary parsing. [Skotlex]
 				break;
@@ -593,9 +600,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 			iter = mapit_getallusers();
 			while( ( tsd = static_cast<const map_session_data*>(mapit_next( iter )) ) != nullptr ){
 				if( tsd->partyspy == p->party.party_id && session_isActive( fd = tsd->fd ) ){
-					WFIFOHEAD( fd, len );
-					memcpy( WFIFOP( fd, 0 ), buf, len );
-					WFIFOSET( tsd->fd, len );
+					clif_send_fd( fd, buf, len, shared );
 				}
 			}
 			mapit_free(iter);
@@ -611,9 +616,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 			if( type == DUEL_WOS && bl->id == tsd->id )
 				continue;
 			if( sd->duel_group == tsd->duel_group && session_isActive( fd = tsd->fd ) ){
-				WFIFOHEAD( fd, len );
-				memcpy( WFIFOP( fd, 0 ), buf, len );
-				WFIFOSET( fd, len );
+				clif_send_fd( fd, buf, len, shared );
 			}
 		}
 		mapit_free(iter);
@@ -662,9 +665,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 				if( (type == GUILD_AREA || type == GUILD_AREA_WOS) && (sd->x < x0 || sd->y < y0 || sd->x > x1 || sd->y > y1) )
 					continue;
 
-				WFIFOHEAD(fd,len);
-				memcpy(WFIFOP(fd,0), buf, len);
-				WFIFOSET(fd,len);
+				clif_send_fd( fd, buf, len, shared );
 			}
 		}
 		if (!enable_spy) //Skip unnecessary parsing. [Skotlex]
@@ -673,9 +674,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 		iter = mapit_getallusers();
 		while( ( tsd = static_cast<const map_session_data*>(mapit_next( iter )) ) != nullptr ){
 			if( tsd->guildspy == g.guild_id && session_isActive( fd = tsd->fd ) ){
-				WFIFOHEAD( fd, len );
-				memcpy( WFIFOP( fd, 0 ), buf, len );
-				WFIFOSET( fd, len );
+				clif_send_fd( fd, buf, len, shared );
 			}
 		}
 		mapit_free(iter);
@@ -703,9 +702,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 					continue;
 				if( (type == BG_AREA || type == BG_AREA_WOS) && (sd->x < x0 || sd->y < y0 || sd->x > x1 || sd->y > y1) )
 					continue;
-				WFIFOHEAD(fd,len);
-				memcpy(WFIFOP(fd,0), buf, len);
-				WFIFOSET(fd,len);
+				clif_send_fd( fd, buf, len, shared );
 			}
 		}
 		break;
@@ -718,9 +715,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 					continue;
 				}
 
-				WFIFOHEAD(fd,len);
-				memcpy(WFIFOP(fd,0), buf, len);
-				WFIFOSET(fd,len);
+				clif_send_fd( fd, buf, len, shared );
 			}
 
 			if (!enable_spy) //Skip unnecessary parsing. [Skotlex]
@@ -729,9 +724,7 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 			iter = mapit_getallusers();
 			while( ( tsd = static_cast<const map_session_data*>(mapit_next( iter )) ) != nullptr ){
 				if( tsd->clanspy == clan->id && session_isActive( fd = tsd->fd ) ){
-					WFIFOHEAD(fd, len);
-					memcpy(WFIFOP(fd, 0), buf, len);
-					WFIFOSET(fd, len);
+					clif_send_fd( fd, buf, len, shared );
 				}
 			}
 			mapit_free(iter);
@@ -743,6 +736,10 @@ int32 clif_send(const void* buf, int32 len, const block_list* bl, enum send_targ
 		return -1;
 	}
 
+	if( shared != nullptr ){
+		send_buffer_release( shared );
+	}
+
 	return 0;
 }
 
@@ -5599,16 +5596,21 @@ static int32 clif_getareachar(block_list* bl,va_list ap)
 /*==========================================
  * tbl has gone out of view-size of bl
  *------------------------------------------*/
-int32 clif_outsight(block_list *bl,va_list ap)
+static int32 clif_outsight_sub(block_list *bl, block_list *tbl)
 {
-	block_list *tbl;
 	struct view_data *vd;
 	TBL_PC *sd, *tsd;
-	tbl=va_arg(ap,block_list*);
 	if(bl == tbl) return 0;
 	sd = BL_CAST(BL_PC, bl);
 	tsd = BL_CAST(BL_PC, tbl);
 
+	if (visibility_sets) {
+		if (sd && tbl->type&BL_VISIBLE)
+			sd->visible_units.erase(tbl->id);
+		if (tsd && bl->type&BL_VISIBLE)
+			tsd->visible_units.erase(bl->id);
+	}
+
 	if (clif_session_isValid(tsd)) { //tsd has lost sight of the bl object.
 		nullpo_ret(bl);
 		switch(bl->type){
@@ -5654,20 +5656,70 @@ int32 clif_outsight(block_list *bl,va_list ap)
 	return 0;
 }
 
+int32 clif_outsight(block_list *bl,va_list ap)
+{
+	return clif_outsight_sub(bl, va_arg(ap, block_list*));
+}
+
+/**
+ * Sends the outsight packets for a unit that is about to move by dx,dy.
+ * With visibility_sets a player takes the units leaving its view from its set,
+ * only floor items and skill units are still looked up by area.
+ * @param bl: Unit at its position before the move
+ * @param dx: Movement along the x axis
+ * @param dy: Movement along the y axis
+ */
+void clif_outsight_move(block_list *bl, int16 dx, int16 dy)
+{
+	map_session_data *sd = BL_CAST(BL_PC, bl);
+
+	if (!visibility_sets || sd == nullptr) {
+		map_foreachinmovearea(clif_outsight, bl, AREA_SIZE, dx, dy, sd ? BL_ALL : BL_PC, bl);
+		return;
+	}
+
+	map_foreachinmovearea(clif_outsight, bl, AREA_SIZE, dx, dy, BL_ALL&~BL_VISIBLE, bl);
+
+	int16 x = bl->x + dx, y = bl->y + dy;
+	std::vector<block_list*>& blocks = map_getblockbuffer();
+	size_t blockcount = blocks.size();
+
+	for (auto it = sd->visible_units.begin(); it != sd->visible_units.end();) {
+		block_list *tbl = map_id2bl(*it);
+
+		if (tbl == nullptr || tbl->prev == nullptr || tbl->m != bl->m) {
+			// Left the map, the area got the vanish packet back then
+			it = sd->visible_units.erase(it);
+			continue;
+		}
+
+		if (abs(tbl->x - x) > AREA_SIZE || abs(tbl->y - y) > AREA_SIZE)
+			blocks.push_back(tbl);
+		++it;
+	}
+
+	map_foreachblock(blocks, blockcount, [bl](block_list *tbl) { return clif_outsight_sub(tbl, bl); });
+}
+
 /*==========================================
  * tbl has come into view of bl
  *------------------------------------------*/
-int32 clif_insight(block_list *bl,va_list ap)
+static int32 clif_insight_sub(block_list *bl, block_list *tbl)
 {
-	block_list *tbl;
 	TBL_PC *sd, *tsd;
-	tbl=va_arg(ap,block_list*);
 
 	if (bl == tbl) return 0;
 
 	sd = BL_CAST(BL_PC, bl);
 	tsd = BL_CAST(BL_PC, tbl);
 
+	if (visibility_sets) {
+		if (sd && tbl->type&BL_VISIBLE)
+			sd->visible_units.insert(tbl->id);
+		if (tsd && bl->type&BL_VISIBLE)
+			tsd->visible_units.insert(bl->id);
+	}
+
 	if (clif_session_isValid(tsd)) { //Tell tsd that bl entered into his view
 		switch(bl->type){
 		case BL_ITEM:
@@ -5687,6 +5739,11 @@ int32 clif_insight(block_list *bl,va_list ap)
 	return 0;
 }
 
+int32 clif_insight(block_list *bl,va_list ap)
+{
+	return clif_insight_sub(bl, va_arg(ap, block_list*));
+}
+
 
 /// Updates whole skill tree.
 /// 010f <packet len>.W { <skill id>.W <type>.L <level>.W <sp cost>.W <attack range>.W <skill name>.24B <upgradable>.B }* (ZC_SKILLINFO_LIST)
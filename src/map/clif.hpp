@@ -970,6 +970,7 @@ void clif_storageclose( const map_session_data& sd );
 
 int32 clif_insight(block_list *bl,va_list ap);	// map_forallinmovearea callback
 int32 clif_outsight(block_list *bl,va_list ap);	// map_forallinmovearea callback
+void clif_outsight_move(block_list *bl, int16 dx, int16 dy);
 
 void clif_class_change( const block_list& bl, int32 class_, enum send_target target = AREA, const map_session_data* sd = nullptr );
 
@@ -1057,6 +1057,8 @@ uint64 ItemDatabase::parseBodyNode(const ryml::NodeRef& node) {
 		}
 	}
 
+	int32 warnings = script_parser_warnings();
+
 	if (this->nodeExists(node, "Script")) {
 		std::string script;
 
@@ -1108,6 +1110,9 @@ uint64 ItemDatabase::parseBodyNode(const ryml::NodeRef& node) {
 			item->unequip_script = nullptr;
 	}
 
+	if (script_parser_warnings() != warnings)
+		this->scriptWarnings = true;
+
 	if (!exists)
 		this->put(nameid, item);
 
@@ -1218,6 +1223,108 @@ void ItemDatabase::loadingFinished(){
 	hasPriceValue.clear();
 }
 
+bool ItemDatabase::writeSnapshot(BinaryWriter& writer) {
+	// Items loaded from SQL are not covered by the snapshot key
+	if (db_use_sqldbs || this->scriptWarnings)
+		return false;
+
+	writer.write<uint32>((uint32)this->size());
+
+	for (const auto &it : *this) {
+		const std::shared_ptr<item_data> &item = it.second;
+		const s_pricevalue &price = this->hasPriceValue[item->nameid];
+
+		writer.write(item->nameid);
+		writer.writeString(item->name);
+		writer.writeString(item->ename);
+		writer.write(item->value_buy);
+		writer.write(item->value_sell);
+		writer.write(item->type);
+		writer.write(item->subtype);
+		writer.write(item->maxchance);
+		writer.write(item->sex);
+		writer.write(item->equip);
+		writer.write(item->weight);
+		writer.write(item->atk);
+		writer.write(item->def);
+		writer.write(item->range);
+		writer.write(item->slots);
+		writer.write(item->look);
+		writer.write(item->elv);
+		writer.write(item->weapon_level);
+		writer.write(item->armor_level);
+		writer.write(item->view_id);
+		writer.write(item->elvmax);
+#ifdef RENEWAL
+		writer.write(item->matk);
+#endif
+		writer.write(item->class_base);
+		writer.write(item->class_upper);
+		writer.write(item->flag);
+		writer.write(item->stack);
+		writer.write(item->item_usage);
+		writer.write(item->gm_lv_trade_override);
+		writer.write(item->delay);
+		writer.write(price.has_buy);
+		writer.write(price.has_sell);
+		script_write_code(writer, item->script);
+		script_write_code(writer, item->equip_script);
+		script_write_code(writer, item->unequip_script);
+	}
+
+	return true;
+}
+
+bool ItemDatabase::readSnapshot(BinaryReader& reader) {
+	uint32 items;
+
+	if (db_use_sqldbs || !reader.read(items))
+		return false;
+
+	for (uint32 i = 0; i < items; i++) {
+		std::shared_ptr<item_data> item = std::make_shared<item_data>();
+		s_pricevalue price;
+
+		if (!reader.read(item->nameid) || !reader.readString(item->name) || !reader.readString(item->ename) || !reader.read(item->value_buy) || !reader.read(item->value_sell)
+			|| !reader.read(item->type) || !reader.read(item->subtype) || !reader.read(item->maxchance) || !reader.read(item->sex) || !reader.read(item->equip)
+			|| !reader.read(item->weight) || !reader.read(item->atk) || !reader.read(item->def) || !reader.read(item->range) || !reader.read(item->slots)
+			|| !reader.read(item->look) || !reader.read(item->elv) || !reader.read(item->weapon_level) || !reader.read(item->armor_level) || !reader.read(item->view_id)
+			|| !reader.read(item->elvmax)
+#ifdef RENEWAL
+			|| !reader.read(item->matk)
+#endif
+			|| !reader.read(item->class_base) || !reader.read(item->class_upper) || !reader.read(item->flag) || !reader.read(item->stack) || !reader.read(item->item_usage)
+			|| !reader.read(item->gm_lv_trade_override) || !reader.read(item->delay) || !reader.read(price.has_buy) || !reader.read(price.has_sell))
+			return false;
+
+		if (item->type >= IT_MAX)
+			return false;
+
+		if (!script_read_code(reader, item->script) || !script_read_code(reader, item->equip_script) || !script_read_code(reader, item->unequip_script))
+			return false;
+
+		std::string aegisname = item->name;
+		std::string ename = item->ename;
+
+		util::tolower(aegisname);
+		util::tolower(ename);
+
+		this->aegisNameToItemDataMap[aegisname] = item;
+		this->nameToItemDataMap[ename] = item;
+		this->hasPriceValue[item->nameid] = price;
+		this->put(item->nameid, item);
+	}
+
+	return true;
+}
+
+uint64 ItemDatabase::hashSnapshotDependencies(uint64 key) {
+	// The scripts are stored as bytecode, which depends on the constants and functions of the script engine
+	uint64 engine = script_cache_engine_key();
+
+	return util::hash_fnv1a(&engine, sizeof(engine), key);
+}
+
 /**
  * Applies gender restrictions according to settings.
  * @param node: YAML node containing the entry.
@@ -3763,6 +3870,108 @@ void ItemGroupDatabase::loadingFinished() {
 	TypesafeYamlDatabase::loadingFinished();
 }
 
+bool ItemGroupDatabase::writeSnapshot(BinaryWriter& writer) {
+	// Items loaded from SQL are not covered by the snapshot key
+	if (db_use_sqldbs)
+		return false;
+
+	writer.write<uint32>((uint32)this->size());
+
+	for (const auto &group : *this) {
+		writer.write(group.second->id);
+		writer.write<uint32>((uint32)group.second->random.size());
+
+		for (const auto &random : group.second->random) {
+			writer.write(random.first);
+			writer.write(random.second->algorithm);
+			writer.write<uint32>((uint32)random.second->data.size());
+
+			for (const auto &it : random.second->data) {
+				const std::shared_ptr<s_item_group_entry> &entry = it.second;
+
+				writer.write(it.first);
+				writer.write(entry->nameid);
+				writer.write(entry->rate);
+				writer.write(entry->duration);
+				writer.write(entry->amount);
+				writer.write(entry->isAnnounced);
+				writer.write(entry->GUID);
+				writer.write(entry->isStacked);
+				writer.write(entry->isNamed);
+				writer.write(entry->bound);
+				writer.write<uint16>(entry->randomOptionGroup != nullptr ? entry->randomOptionGroup->id : 0);
+				writer.write(entry->randomOptionGroup != nullptr);
+				writer.write(entry->refineMinimum);
+				writer.write(entry->refineMaximum);
+				writer.write(entry->minimumEnchantgrade);
+				writer.write(entry->maximumEnchantgrade);
+			}
+		}
+	}
+
+	return true;
+}
+
+bool ItemGroupDatabase::readSnapshot(BinaryReader& reader) {
+	uint32 groups;
+
+	if (db_use_sqldbs || !reader.read(groups))
+		return false;
+
+	for (uint32 i = 0; i < groups; i++) {
+		std::shared_ptr<s_item_group_db> group = std::make_shared<s_item_group_db>();
+		uint32 subgroups;
+
+		if (!reader.read(group->id) || !reader.read(subgroups))
+			return false;
+
+		for (uint32 j = 0; j < subgroups; j++) {
+			std::shared_ptr<s_item_group_random> random = std::make_shared<s_item_group_random>();
+			uint16 subgroup;
+			uint32 entries;
+
+			if (!reader.read(subgroup) || !reader.read(random->algorithm) || random->algorithm > GROUP_ALGORITHM_SHAREDPOOL || !reader.read(entries))
+				return false;
+
+			for (uint32 k = 0; k < entries; k++) {
+				std::shared_ptr<s_item_group_entry> entry = std::make_shared<s_item_group_entry>();
+				uint32 index;
+				uint16 option_group;
+				bool has_option_group;
+
+				if (!reader.read(index) || !reader.read(entry->nameid) || !reader.read(entry->rate) || !reader.read(entry->duration) || !reader.read(entry->amount)
+					|| !reader.read(entry->isAnnounced) || !reader.read(entry->GUID) || !reader.read(entry->isStacked) || !reader.read(entry->isNamed) || !reader.read(entry->bound)
+					|| !reader.read(option_group) || !reader.read(has_option_group) || !reader.read(entry->refineMinimum) || !reader.read(entry->refineMaximum)
+					|| !reader.read(entry->minimumEnchantgrade) || !reader.read(entry->maximumEnchantgrade))
+					return false;
+
+				if (entry->bound >= BOUND_MAX)
+					return false;
+
+				if (has_option_group) {
+					entry->randomOptionGroup = random_option_group.find(option_group);
+
+					if (entry->randomOptionGroup == nullptr)
+						return false;
+				}
+
+				// Depends on the configuration, so it is not part of the snapshot
+				entry->adj_rate = (entry->rate * battle_config.item_group_rate) / 100;
+				entry->adj_rate = cap_value(entry->adj_rate, battle_config.item_group_drop_min, battle_config.item_group_drop_max);
+				entry->given = 0;
+
+				random->data[index] = entry;
+			}
+
+			group->random[subgroup] = random;
+		}
+
+		this->put(group->id, group);
+	}
+
+	return true;
+}
+
 /** Read item forbidden by mapflag (can't equip item)
 * Structure: <nameid>,<mode>
 */
@@ -4911,15 +5120,17 @@ static void itemdb_read(void) {
 		aFree(dbsubpath2);
 	}
 
-	random_option_db.load();
-	random_option_group.load();
-	itemdb_group.load();
-	itemdb_combo.load();
-	laphine_synthesis_db.load();
-	laphine_upgrade_db.load();
-	item_reform_db.load();
-	item_enchant_db.load();
-	item_package_db.load();
+	database_load_group( {
+		{ &random_option_db },
+		{ &random_option_group, { &random_option_db } },
+		{ &itemdb_group, { &random_option_group } },
+		{ &itemdb_combo },
+		{ &laphine_synthesis_db, { &itemdb_group } },
+		{ &laphine_upgrade_db, { &random_option_group } },
+		{ &item_reform_db, { &random_option_group } },
+		{ &item_enchant_db },
+		{ &item_package_db, { &random_option_group } },
+	} );
 
 	if (battle_config.feature_roulette)
 		itemdb_parse_roulette_db();
@@ -3378,6 +3378,9 @@ public:
 
 	const std::string getDefaultLocation() override;
 	uint64 parseBodyNode(const ryml::NodeRef& node) override;
+	bool canLoadInParallel() override{
+		return true;
+	}
 
 	// Additional
 	bool add_option(const ryml::NodeRef& node, std::shared_ptr<s_random_opt_group_entry> &entry);
@@ -3543,6 +3546,7 @@ private:
 	};
 
 	std::unordered_map<t_itemid, s_pricevalue> hasPriceValue;
+	bool scriptWarnings{false}; ///< A script showed a warning while parsing, the snapshot would hide it
 
 public:
 	ItemDatabase() : TypesafeCachedYamlDatabase("ITEM_DB", 3, 1) {
@@ -3557,8 +3561,14 @@ public:
 
 		this->nameToItemDataMap.clear();
 		this->aegisNameToItemDataMap.clear();
+		this->hasPriceValue.clear();
+		this->scriptWarnings = false;
 	}
 
+	bool writeSnapshot(BinaryWriter& writer) override;
+	bool readSnapshot(BinaryReader& reader) override;
+	uint64 hashSnapshotDependencies(uint64 key) override;
+
 	// Additional
 	std::shared_ptr<item_data> searchname( const char* name );
 	std::shared_ptr<item_data> search_aegisname( const char *name );
@@ -3578,7 +3588,12 @@ public:
 
 	const std::string getDefaultLocation() override;
 	uint64 parseBodyNode(const ryml::NodeRef& node) override;
+	bool canLoadInParallel() override{
+		return true;
+	}
 	void loadingFinished() override;
+	bool writeSnapshot(BinaryWriter& writer) override;
+	bool readSnapshot(BinaryReader& reader) override;
 
 	// Additional
 	bool item_exists(uint16 group_id, t_itemid nameid);
@@ -3615,6 +3630,9 @@ public:
 
 	const std::string getDefaultLocation();
 	uint64 parseBodyNode( const ryml::NodeRef& node );
+	bool canLoadInParallel(){
+		return true;
+	}
 };
 
 extern LaphineSynthesisDatabase laphine_synthesis_db;
@@ -3640,6 +3658,9 @@ public:
 
 	const std::string getDefaultLocation();
 	uint64 parseBodyNode( const ryml::NodeRef& node );
+	bool canLoadInParallel(){
+		return true;
+	}
 };
 
 extern LaphineUpgradeDatabase laphine_upgrade_db;
@@ -3671,6 +3692,9 @@ public:
 
 	const std::string getDefaultLocation();
 	uint64 parseBodyNode( const ryml::NodeRef& node );
+	bool canLoadInParallel(){
+		return true;
+	}
 };
 
 extern ItemReformDatabase item_reform_db;
@@ -3741,6 +3765,9 @@ public:
 
 	const std::string getDefaultLocation();
 	uint64 parseBodyNode( const ryml::NodeRef& node );
+	bool canLoadInParallel(){
+		return true;
+	}
 };
 
 extern ItemEnchantDatabase item_enchant_db;
@@ -3772,6 +3799,9 @@ public:
 
 	const std::string getDefaultLocation();
 	uint64 parseBodyNode( const ryml::NodeRef& node );
+	bool canLoadInParallel(){
+		return true;
+	}
 };
 
 extern ItemPackageDatabase item_package_db;
@@ -3,13 +3,18 @@
 
 #include "log.hpp"
 
+#include <cstdarg>
 #include <cstdlib>
+#include <ctime>
+#include <string>
 
 #include <common/cbasetypes.hpp>
 #include <common/nullpo.hpp>
 #include <common/showmsg.hpp>
 #include <common/sql.hpp> // SQL_INNODB
 #include <common/strlib.hpp>
+#include <common/timer.hpp>
+#include <common/utils.hpp>
 
 #include "battle.hpp"
 #include "homunculus.hpp"
@@ -55,6 +60,152 @@ struct Log_Config log_config;
 #endif
 
 
+/// Executes a log query.
+/// The query is handed to the log workers when they are running, otherwise it
+/// is executed synchronously on the main log connection.
+static void log_sql_querystr( const char* query )
+{
+	if( logmysql_async != nullptr && SQL_SUCCESS == Sql_AsyncQueryStr( logmysql_async, query ) )
+		return;
+
+	if( SQL_ERROR == Sql_QueryStr( logmysql_handle, query ) )
+		Sql_ShowDebug( logmysql_handle );
+}
+
+/// Executes a log query.
+/// The query is constructed as if it was sprintf.
+static void log_sql_query( const char* query, ... )
+{
+	StringBuf buf;
+	va_list args;
+
+	StringBuf_Init( &buf );
+	va_start( args, query );
+	StringBuf_Vprintf( &buf, query, args );
+	va_end( args );
+
+	log_sql_querystr( StringBuf_Value( &buf ) );
+}
+
+
+/// Maximum size of the VALUES list of a single buffered INSERT
+#define LOG_BUFFER_MAX_BYTES (256 * 1024)
+
+/// Log tables with buffered rows
+enum e_log_buffer : uint8 {
+	LOG_BUFFER_PICK = 0,
+	LOG_BUFFER_ZENY,
+	LOG_BUFFER_MVPDROP,
+	LOG_BUFFER_CHAT,
+	LOG_BUFFER_CASH,
+	LOG_BUFFER_FEEDING,
+	LOG_BUFFER_MAX
+};
+
+/// Rows of a log table waiting to be written with a single multi-row INSERT
+struct s_log_buffer {
+	std::string table;
+	const char* columns;
+	std::string values;
+	uint32 rows;
+	// statistics
+	uint64 flushed;
+	uint64 dropped;
+	uint64 batches;
+};
+
+static s_log_buffer log_buffers[LOG_BUFFER_MAX];
+static int32 log_buffer_timer_id = INVALID_TIMER;
+
+/// Writes the buffered rows of a log table.
+/// When the log workers are lagging behind by more than buffer_max_pending
+/// batches, the rows are either dropped or written synchronously, depending on buffer_drop.
+static void log_buffer_flush( s_log_buffer& buffer )
+{
+	if( buffer.rows == 0 )
+		return;
+
+	StringBuf buf;
+
+	StringBuf_Init( &buf );
+	StringBuf_Printf( &buf, LOG_QUERY " INTO `%s` %s VALUES ", buffer.table.c_str(), buffer.columns );
+	StringBuf_AppendStr( &buf, buffer.values.c_str() );
+
+	if( logmysql_async != nullptr && Sql_AsyncPending( logmysql_async ) >= (size_t)log_config.buffer_max_pending ){
+		if( log_config.buffer_drop ){
+			buffer.dropped += buffer.rows;
+		}else{
+			// back-pressure: make the main thread wait for the database instead of growing the queue
+			if( SQL_ERROR == Sql_QueryStr( logmysql_handle, StringBuf_Value( &buf ) ) )
+				Sql_ShowDebug( logmysql_handle );
+			buffer.flushed += buffer.rows;
+			buffer.batches++;
+		}
+	}else{
+		log_sql_querystr( StringBuf_Value( &buf ) );
+		buffer.flushed += buffer.rows;
+		buffer.batches++;
+	}
+
+	buffer.values.clear();
+	buffer.rows = 0;
+}
+
+/// Appends a row to the buffer of a log table.
+/// The row is constructed as if it was sprintf and must contain the parenthesized values.
+static void log_buffer_add( e_log_buffer type, const char* table, const char* columns, const char* row, ... )
+{
+	s_log_buffer& buffer = log_buffers[type];
+	StringBuf buf;
+	va_list args;
+
+	if( buffer.rows > 0 && buffer.table != table ) // table was changed by a config reload
+		log_buffer_flush( buffer );
+
+	StringBuf_Init( &buf );
+	va_start( args, row );
+	StringBuf_Vprintf( &buf, row, args );
+	va_end( args );
+
+	if( buffer.rows > 0 )
+		buffer.values += ',';
+	buffer.values += StringBuf_Value( &buf );
+	buffer.table = table;
+	buffer.columns = columns;
+	buffer.rows++;
+
+	if( buffer.rows >= (uint32)log_config.buffer_rows || buffer.values.length() >= LOG_BUFFER_MAX_BYTES )
+		log_buffer_flush( buffer );
+}
+
+/// Writes the buffered rows of all log tables.
+void log_flush( void )
+{
+	for( s_log_buffer& buffer : log_buffers )
+		log_buffer_flush( buffer );
+}
+
+/// Periodically writes the buffered rows, so quiet tables do not hold their rows forever.
+static TIMER_FUNC( log_buffer_timer ){
+	log_flush();
+	log_buffer_timer_id = add_timer( gettick() + log_config.buffer_interval, log_buffer_timer, 0, 0 );
+	return 0;
+}
+
+/// Shows the statistics of the log buffers.
+void log_report( void )
+{
+	static const char* names[LOG_BUFFER_MAX] = { "pick", "zeny", "mvpdrop", "chat", "cash", "feeding" };
+
+	ShowInfo( "Log buffers (%d rows, %d ms, %s when %d batches are pending):\n", log_config.buffer_rows, log_config.buffer_interval, log_config.buffer_drop ? "drop" : "block", log_config.buffer_max_pending );
+	for( int32 i = 0; i < LOG_BUFFER_MAX; i++ ){
+		const s_log_buffer& buffer = log_buffers[i];
+
+		ShowMessage( "\t%-8s %" PRIu64 " rows flushed in %" PRIu64 " batches, %" PRIu64 " dropped, %u buffered\n", names[i], buffer.flushed, buffer.batches, buffer.dropped, buffer.rows );
+	}
+}
+
+
 /// obtain log type character for item/zeny logs
 static char log_picktype2char(e_log_pick_type type)
 {
@@ -178,15 +329,10 @@ void log_branch( map_session_data* sd )
 		return;
 
 	if( log_config.sql_logs ) {
-		SqlStmt stmt{ *logmysql_handle };
+		char esc_name[NAME_LENGTH*2+1];
 
-		if( SQL_SUCCESS != stmt.Prepare(LOG_QUERY " INTO `%s` (`branch_date`, `account_id`, `char_id`, `char_name`, `map`) VALUES (NOW(), '%d', '%d', ?, '%s')", log_config.log_branch, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex) )
-		||  SQL_SUCCESS != stmt.BindParam(0, SQLDT_STRING, sd->status.name, strnlen(sd->status.name, NAME_LENGTH))
-		||  SQL_SUCCESS != stmt.Execute() )
-		{
-			SqlStmt_ShowDebug(stmt);
-			return;
-		}
+		Sql_EscapeStringLen(logmysql_handle, esc_name, sd->status.name, strnlen(sd->status.name, NAME_LENGTH));
+		log_sql_query(LOG_QUERY " INTO `%s` (`branch_date`, `account_id`, `char_id`, `char_name`, `map`) VALUES (NOW(), '%d', '%d', '%s', '%s')", log_config.log_branch, sd->status.account_id, sd->status.char_id, esc_name, mapindex_id2name(sd->mapindex));
 	}
 	else
 	{
@@ -217,21 +363,25 @@ void log_pick( int32 id, int16 m, e_log_pick_type type, int32 amount, const item
 
 	if( log_config.sql_logs )
 	{
+		static std::string columns;
 		int32 i;
-		SqlStmt stmt{ *logmysql_handle };
 		StringBuf buf;
 		StringBuf_Init(&buf);
 
-		StringBuf_Printf(&buf, "%s INTO `%s` (`time`, `char_id`, `type`, `nameid`, `amount`, `refine`, `map`, `unique_id`, `bound`, `enchantgrade`", LOG_QUERY, log_config.log_pick);
-		for (i = 0; i < MAX_SLOTS; ++i)
-			StringBuf_Printf(&buf, ", `card%d`", i);
-		for (i = 0; i < MAX_ITEM_RDM_OPT; ++i) {
-			StringBuf_Printf(&buf, ", `option_id%d`", i);
-			StringBuf_Printf(&buf, ", `option_val%d`", i);
-			StringBuf_Printf(&buf, ", `option_parm%d`", i);
+		if( columns.empty() ){
+			columns = "(`time`, `char_id`, `type`, `nameid`, `amount`, `refine`, `map`, `unique_id`, `bound`, `enchantgrade`";
+			for (i = 0; i < MAX_SLOTS; ++i)
+				columns += ", `card" + std::to_string(i) + "`";
+			for (i = 0; i < MAX_ITEM_RDM_OPT; ++i) {
+				columns += ", `option_id" + std::to_string(i) + "`";
+				columns += ", `option_val" + std::to_string(i) + "`";
+				columns += ", `option_parm" + std::to_string(i) + "`";
+			}
+			columns += ")";
 		}
-		StringBuf_Printf(&buf, ") VALUES(NOW(),'%u','%c','%u','%d','%d','%s','%" PRIu64 "','%d','%d'",
-			id, log_picktype2char(type), itm->nameid, amount, itm->refine, map_getmapdata(m)->name[0] ? map_getmapdata(m)->name : "", itm->unique_id, itm->bound, itm->enchantgrade);
+
+		StringBuf_Printf(&buf, "(FROM_UNIXTIME('%" PRId64 "'),'%u','%c','%u','%d','%d','%s','%" PRIu64 "','%d','%d'",
+			(int64)time(nullptr), id, log_picktype2char(type), itm->nameid, amount, itm->refine, map_getmapdata(m)->name[0] ? map_getmapdata(m)->name : "", itm->unique_id, itm->bound, itm->enchantgrade);
 
 		for (i = 0; i < MAX_SLOTS; i++)
 			StringBuf_Printf(&buf, ",'%u'", itm->card[i]);
@@ -239,8 +389,7 @@ void log_pick( int32 id, int16 m, e_log_pick_type type, int32 amount, const item
 			StringBuf_Printf(&buf, ",'%d','%d','%d'", itm->option[i].id, itm->option[i].value, itm->option[i].param);
 		StringBuf_Printf(&buf, ")");
 
-		if (SQL_SUCCESS != stmt.PrepareStr(StringBuf_Value(&buf)) || SQL_SUCCESS != stmt.Execute())
-			SqlStmt_ShowDebug(stmt);
+		log_buffer_add(LOG_BUFFER_PICK, log_config.log_pick, columns.c_str(), "%s", StringBuf_Value(&buf));
 	}
 	else
 	{
@@ -281,12 +430,8 @@ void log_zeny( const map_session_data &target_sd, e_log_pick_type type, uint32 s
 
 	if( log_config.sql_logs )
 	{
-		if (SQL_ERROR == Sql_Query(logmysql_handle, LOG_QUERY " INTO `%s` (`time`, `char_id`, `src_id`, `type`, `amount`, `map`) VALUES (NOW(), '%d', '%d', '%c', '%d', '%s')",
-			log_config.log_zeny, target_sd.status.char_id, src_id, log_picktype2char(type), amount, mapindex_id2name(target_sd.mapindex)))
-		{
-			Sql_ShowDebug(logmysql_handle);
-			return;
-		}
+		log_buffer_add(LOG_BUFFER_ZENY, log_config.log_zeny, "(`time`, `char_id`, `src_id`, `type`, `amount`, `map`)", "(FROM_UNIXTIME('%" PRId64 "'), '%d', '%d', '%c', '%d', '%s')",
+			(int64)time(nullptr), target_sd.status.char_id, src_id, log_picktype2char(type), amount, mapindex_id2name(target_sd.mapindex));
 	}
 	else
 	{
@@ -314,12 +459,8 @@ void log_mvpdrop( const map_session_data* sd, int32 monster_id, t_itemid nameid,
 
 	if( log_config.sql_logs )
 	{
-		if( SQL_ERROR == Sql_Query(logmysql_handle, LOG_QUERY " INTO `%s` (`mvp_date`, `kill_char_id`, `monster_id`, `prize`, `mvpexp`, `map`) VALUES (NOW(), '%d', '%d', '%u', '%" PRIu64 "', '%s') ",
-			log_config.log_mvpdrop, sd->status.char_id, monster_id, nameid, exp, mapindex_id2name(sd->mapindex)) )
-		{
-			Sql_ShowDebug(logmysql_handle);
-			return;
-		}
+		log_buffer_add(LOG_BUFFER_MVPDROP, log_config.log_mvpdrop, "(`mvp_date`, `kill_char_id`, `monster_id`, `prize`, `mvpexp`, `map`)", "(FROM_UNIXTIME('%" PRId64 "'), '%d', '%d', '%u', '%" PRIu64 "', '%s')",
+			(int64)time(nullptr), sd->status.char_id, monster_id, nameid, exp, mapindex_id2name(sd->mapindex));
 	}
 	else
 	{
@@ -348,16 +489,12 @@ void log_atcommand( map_session_data* sd, const char* message )
 
 	if( log_config.sql_logs )
 	{
-		SqlStmt stmt{ *logmysql_handle };
+		char esc_name[NAME_LENGTH*2+1];
+		char esc_message[255*2+1];
 
-		if( SQL_SUCCESS != stmt.Prepare(LOG_QUERY " INTO `%s` (`atcommand_date`, `account_id`, `char_id`, `char_name`, `map`, `command`) VALUES (NOW(), '%d', '%d', ?, '%s', ?)", log_config.log_gm, sd->status.account_id, sd->status.char_id, sd->mapindex == 0 ? "" : mapindex_id2name(sd->mapindex))
-		||  SQL_SUCCESS != stmt.BindParam(0, SQLDT_STRING, sd->status.name, strnlen(sd->status.name, NAME_LENGTH))
-		||  SQL_SUCCESS != stmt.BindParam(1, SQLDT_STRING, (char*)message, safestrnlen(message, 255))
-		||  SQL_SUCCESS != stmt.Execute() )
-		{
-			SqlStmt_ShowDebug(stmt);
-			return;
-		}
+		Sql_EscapeStringLen(logmysql_handle, esc_name, sd->status.name, strnlen(sd->status.name, NAME_LENGTH));
+		Sql_EscapeStringLen(logmysql_handle, esc_message, message, safestrnlen(message, 255));
+		log_sql_query(LOG_QUERY " INTO `%s` (`atcommand_date`, `account_id`, `char_id`, `char_name`, `map`, `command`) VALUES (NOW(), '%d', '%d', '%s', '%s', '%s')", log_config.log_gm, sd->status.account_id, sd->status.char_id, esc_name, sd->mapindex == 0 ? "" : mapindex_id2name(sd->mapindex), esc_message);
 	}
 	else
 	{
@@ -383,16 +520,12 @@ void log_npc( npc_data* nd, const char* message ){
 
 	if( log_config.sql_logs )
 	{
-		SqlStmt stmt{ *logmysql_handle };
+		char esc_name[NAME_LENGTH*2+1];
+		char esc_message[255*2+1];
 
-		if( SQL_SUCCESS != stmt.Prepare(LOG_QUERY " INTO `%s` (`npc_date`, `char_name`, `map`, `mes`) VALUES (NOW(), ?, '%s', ?)", log_config.log_npc, map_mapid2mapname(nd->m) )
-		||  SQL_SUCCESS != stmt.BindParam(0, SQLDT_STRING, nd->name, strnlen(nd->name, NAME_LENGTH))
-		||  SQL_SUCCESS != stmt.BindParam(1, SQLDT_STRING, (char*)message, safestrnlen(message, 255))
-		||  SQL_SUCCESS != stmt.Execute() )
-		{
-			SqlStmt_ShowDebug(stmt);
-			return;
-		}
+		Sql_EscapeStringLen(logmysql_handle, esc_name, nd->name, strnlen(nd->name, NAME_LENGTH));
+		Sql_EscapeStringLen(logmysql_handle, esc_message, message, safestrnlen(message, 255));
+		log_sql_query(LOG_QUERY " INTO `%s` (`npc_date`, `char_name`, `map`, `mes`) VALUES (NOW(), '%s', '%s', '%s')", log_config.log_npc, esc_name, map_mapid2mapname(nd->m), esc_message);
 	}
 	else
 	{
@@ -419,16 +552,12 @@ void log_npc( map_session_data* sd, const char* message )
 
 	if( log_config.sql_logs )
 	{
-		SqlStmt stmt{ *logmysql_handle };
+		char esc_name[NAME_LENGTH*2+1];
+		char esc_message[255*2+1];
 
-		if( SQL_SUCCESS != stmt.Prepare(LOG_QUERY " INTO `%s` (`npc_date`, `account_id`, `char_id`, `char_name`, `map`, `mes`) VALUES (NOW(), '%d', '%d', ?, '%s', ?)", log_config.log_npc, sd->status.account_id, sd->status.char_id, mapindex_id2name(sd->mapindex) )
-		||  SQL_SUCCESS != stmt.BindParam(0, SQLDT_STRING, sd->status.name, strnlen(sd->status.name, NAME_LENGTH))
-		||  SQL_SUCCESS != stmt.BindParam(1, SQLDT_STRING, (char*)message, safestrnlen(message, 255))
-		||  SQL_SUCCESS != stmt.Execute() )
-		{
-			SqlStmt_ShowDebug(stmt);
-			return;
-		}
+		Sql_EscapeStringLen(logmysql_handle, esc_name, sd->status.name, strnlen(sd->status.name, NAME_LENGTH));
+		Sql_EscapeStringLen(logmysql_handle, esc_message, message, safestrnlen(message, 255));
+		log_sql_query(LOG_QUERY " INTO `%s` (`npc_date`, `account_id`, `char_id`, `char_name`, `map`, `mes`) VALUES (NOW(), '%d', '%d', '%s', '%s', '%s')", log_config.log_npc, sd->status.account_id, sd->status.char_id, esc_name, mapindex_id2name(sd->mapindex), esc_message);
 	}
 	else
 	{
@@ -464,16 +593,12 @@ void log_chat( e_log_chat_type type, int32 type_id, int32 src_charid, int32 src_
 	}
 
 	if( log_config.sql_logs ) {
-		SqlStmt stmt{ *logmysql_handle };
+		char esc_dst_charname[NAME_LENGTH*2+1];
+		char esc_message[CHAT_SIZE_MAX*2+1];
 
-		if( SQL_SUCCESS != stmt.Prepare(LOG_QUERY " INTO `%s` (`time`, `type`, `type_id`, `src_charid`, `src_accountid`, `src_map`, `src_map_x`, `src_map_y`, `dst_charname`, `message`) VALUES (NOW(), '%c', '%d', '%d', '%d', '%s', '%d', '%d', ?, ?)", log_config.log_chat, log_chattype2char(type), type_id, src_charid, src_accid, mapname, x, y)
-		||  SQL_SUCCESS != stmt.BindParam(0, SQLDT_STRING, (char*)dst_charname, safestrnlen(dst_charname, NAME_LENGTH))
-		||  SQL_SUCCESS != stmt.BindParam(1, SQLDT_STRING, (char*)message, safestrnlen(message, CHAT_SIZE_MAX))
-		||  SQL_SUCCESS != stmt.Execute() )
-		{
-			SqlStmt_ShowDebug(stmt);
-			return;
-		}
+		Sql_EscapeStringLen(logmysql_handle, esc_dst_charname, dst_charname, safestrnlen(dst_charname, NAME_LENGTH));
+		Sql_EscapeStringLen(logmysql_handle, esc_message, message, safestrnlen(message, CHAT_SIZE_MAX));
+		log_buffer_add(LOG_BUFFER_CHAT, log_config.log_chat, "(`time`, `type`, `type_id`, `src_charid`, `src_accountid`, `src_map`, `src_map_x`, `src_map_y`, `dst_charname`, `message`)", "(FROM_UNIXTIME('%" PRId64 "'), '%c', '%d', '%d', '%d', '%s', '%d', '%d', '%s', '%s')", (int64)time(nullptr), log_chattype2char(type), type_id, src_charid, src_accid, mapname, x, y, esc_dst_charname, esc_message);
 	}
 	else
 	{
@@ -498,12 +623,8 @@ void log_cash( const map_session_data* sd, e_log_pick_type type, e_log_cash_type
 		return;
 
 	if( log_config.sql_logs ){
-		if( SQL_ERROR == Sql_Query( logmysql_handle, LOG_QUERY " INTO `%s` ( `time`, `char_id`, `type`, `cash_type`, `amount`, `map` ) VALUES ( NOW(), '%d', '%c', '%c', '%d', '%s' )",
-			log_config.log_cash, sd->status.char_id, log_picktype2char( type ), log_cashtype2char( cash_type ), amount, mapindex_id2name( sd->mapindex ) ) )
-		{
-			Sql_ShowDebug( logmysql_handle );
-			return;
-		}
+		log_buffer_add( LOG_BUFFER_CASH, log_config.log_cash, "( `time`, `char_id`, `type`, `cash_type`, `amount`, `map` )", "( FROM_UNIXTIME('%" PRId64 "'), '%d', '%c', '%c', '%d', '%s' )",
+			(int64)time( nullptr ), sd->status.char_id, log_picktype2char( type ), log_cashtype2char( cash_type ), amount, mapindex_id2name( sd->mapindex ) );
 	}else{
 		char timestring[255];
 		time_t curtime;
@@ -551,12 +672,8 @@ void log_feeding( const map_session_data* sd, e_log_feeding_type type, t_itemid
 	}
 
 	if (log_config.sql_logs) {
-		if (SQL_ERROR == Sql_Query(logmysql_handle, LOG_QUERY " INTO `%s` (`time`, `char_id`, `target_id`, `target_class`, `type`, `intimacy`, `item_id`, `map`, `x`, `y`) VALUES ( NOW(), '%" PRIu32 "', '%" PRIu32 "', '%hu', '%c', '%" PRIu32 "', '%u', '%s', '%hu', '%hu' )",
-			log_config.log_feeding, sd->status.char_id, target_id, target_class, log_feedingtype2char(type), intimacy, nameid, mapindex_id2name(sd->mapindex), sd->x, sd->y))
-		{
-			Sql_ShowDebug(logmysql_handle);
-			return;
-		}
+		log_buffer_add(LOG_BUFFER_FEEDING, log_config.log_feeding, "(`time`, `char_id`, `target_id`, `target_class`, `type`, `intimacy`, `item_id`, `map`, `x`, `y`)", "( FROM_UNIXTIME('%" PRId64 "'), '%" PRIu32 "', '%" PRIu32 "', '%hu', '%c', '%" PRIu32 "', '%u', '%s', '%hu', '%hu' )",
+			(int64)time(nullptr), sd->status.char_id, target_id, target_class, log_feedingtype2char(type), intimacy, nameid, mapindex_id2name(sd->mapindex), sd->x, sd->y);
 	} else {
 		char timestring[255];
 		time_t curtime;
@@ -582,6 +699,11 @@ void log_set_defaults(void)
 	log_config.amount_items_log = 100;
 
 	safestrncpy(log_timestamp_format, "%m/%d/%Y %H:%M:%S", sizeof(log_timestamp_format));
+
+	log_config.buffer_rows = 100;
+	log_config.buffer_interval = 1000;
+	log_config.buffer_max_pending = 64;
+	log_config.buffer_drop = false;
 }
 
 
@@ -659,6 +781,14 @@ int32 log_config_read( const char* cfgName )
 				safestrncpy( log_config.log_cash, w2, sizeof( log_config.log_cash ) );
 			else if( strcmpi( w1, "log_feeding_db" ) == 0 )
 				safestrncpy( log_config.log_feeding, w2, sizeof( log_config.log_feeding ) );
+			else if( strcmpi( w1, "log_buffer_rows" ) == 0 )
+				log_config.buffer_rows = cap_value( atoi( w2 ), 1, 1000 );
+			else if( strcmpi( w1, "log_buffer_interval" ) == 0 )
+				log_config.buffer_interval = cap_value( atoi( w2 ), 100, 60000 );
+			else if( strcmpi( w1, "log_buffer_max_pending" ) == 0 )
+				log_config.buffer_max_pending = max( 1, atoi( w2 ) );
+			else if( strcmpi( w1, "log_buffer_drop" ) == 0 )
+				log_config.buffer_drop = config_switch( w2 ) > 0;
 			// log file timestamp format
 			else if( strcmpi( w1, "log_timestamp_format" ) == 0 )
 				safestrncpy(log_timestamp_format, w2, sizeof(log_timestamp_format));
@@ -714,3 +844,20 @@ int32 log_config_read( const char* cfgName )
 
 	return 0;
 }
+
+void do_init_log( void ){
+	add_timer_func_list( log_buffer_timer, "log_buffer_timer" );
+
+	if( log_config.sql_logs )
+		log_buffer_timer_id = add_timer( gettick() + log_config.buffer_interval, log_buffer_timer, 0, 0 );
+}
+
+void do_final_log( void ){
+	if( log_buffer_timer_id != INVALID_TIMER ){
+		delete_timer( log_buffer_timer_id, log_buffer_timer );
+		log_buffer_timer_id = INVALID_TIMER;
+	}
+
+	if( log_config.sql_logs )
+		log_flush();
+}
@@ -92,6 +92,11 @@ void log_branch( map_session_data* sd );
 void log_mvpdrop( const map_session_data* sd, int32 monster_id, t_itemid nameid, t_exp exp );
 
 int32 log_config_read( const char* cfgName );
+void log_flush( void );
+void log_report( void );
+
+void do_init_log( void );
+void do_final_log( void );
 
 extern struct Log_Config
 {
@@ -105,6 +110,10 @@ extern struct Log_Config
 	unsigned feeding : 2;
 	char log_branch[64], log_pick[64], log_zeny[64], log_mvpdrop[64], log_gm[64], log_npc[64], log_chat[64], log_cash[64];
 	char log_feeding[64];
+	int32 buffer_rows; // rows buffered per table before they are written
+	int32 buffer_interval; // ms after which buffered rows are written anyway
+	int32 buffer_max_pending; // log batches the workers may lag behind before buffer_drop applies
+	bool buffer_drop; // drop rows instead of writing them synchronously when the workers lag behind
 } log_config;
 
 #endif /* LOG_HPP */
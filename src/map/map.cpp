@@ -3,17 +3,30 @@
 
 #include "map.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <cstdlib>
 #include <cmath>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
 
 #include <config/core.hpp>
 
 #include <common/cbasetypes.hpp>
 #include <common/cli.hpp>
 #include <common/core.hpp>
+#include <common/database.hpp>
 #include <common/ers.hpp>
 #include <common/grfio.hpp>
 #include <common/malloc.hpp>
+#include <common/mapcache.hpp>
 #include <common/nullpo.hpp>
 #include <common/random.hpp>
 #include <common/showmsg.hpp>
@@ -65,6 +78,9 @@ std::string map_server_pw = "";
 std::string map_server_db = "ragnarok";
 Sql* mmysql_handle;
 Sql* qsmysql_handle; /// For query_sql
+int32 query_sql_workers = 2; // Worker connections for query_sql_async, 0 to run it synchronously
+SqlAsync* qsmysql_async; /// For query_sql_async
+SqlAsync* mapregmysql_async; /// For the mapreg saves
 
 int32 db_use_sqldbs = 0;
 char barter_table[32] = "barter";
@@ -99,7 +115,9 @@ uint16 log_db_port = 3306;
 std::string log_db_id = "ragnarok";
 std::string log_db_pw = "";
 std::string log_db_db = "log";
+int32 log_db_workers = 1; // Worker connections writing the logs, 0 to write them synchronously
 Sql* logmysql_handle;
+SqlAsync* logmysql_async;
 
 // inter config
 struct inter_conf inter_config {};
@@ -117,14 +135,23 @@ static DBMap* map_msg_db=nullptr;
 
 static int32 map_users=0;
 
-#define BLOCK_SIZE 8
+#ifndef BLOCK_SIZE
+	#define BLOCK_SIZE 8
+#endif
 #define block_free_max 1048576
 block_list *block_free[block_free_max];
 static int32 block_free_count = 0, block_free_lock = 0;
 
-#define BL_LIST_MAX 1048576
-static block_list *bl_list[BL_LIST_MAX];
-static int32 bl_list_count = 0;
+/// Object types that are linked into a block chain of their own, see map_getblockchain
+#define BL_OWNCHAIN (BL_PC|BL_MOB|BL_SKILL)
+
+/// Type masks of the block chains of a map, in the order the map_foreach* family visits them
+static const int32 block_chain_types[] = { BL_ALL&~BL_OWNCHAIN, BL_PC, BL_SKILL, BL_MOB };
+
+/// Scratch buffer of the map_foreach* family.
+/// Every query appends its results behind the ones of the query it is nested in
+/// and shrinks the buffer back once done, so a single one per thread is enough.
+static thread_local std::vector<block_list*> bl_list;
 
 #ifndef MAP_MAX_MSG
 	#define MAP_MAX_MSG 1550
@@ -166,6 +193,21 @@ struct map_cache_map_info {
 	int32 len;
 };
 
+// A map cache file loaded into memory
+struct s_map_cache {
+	char* buffer;
+	size_t size;
+	bool mapped; // buffer is a read-only mapping of the file
+	bool v2;
+};
+
+// Location of the cells of a map inside a loaded map cache
+struct s_map_cache_cells {
+	const char* data;
+	size_t len; // compressed length for v1, cell count for v2
+	bool v2;
+};
+
 char motd_txt[256] = "conf/motd.txt";
 char charhelp_txt[256] = "conf/charhelp.txt";
 char channel_conf[256] = "conf/channels.conf";
@@ -185,6 +227,15 @@ char wisp_server_name[NAME_LENGTH] = "Server"; // can be modified in char-server
 int32 console = 0;
 int32 enable_spy = 0; //To enable/disable @spy commands, which consume too much cpu time when sending packets. [Skotlex]
 int32 enable_grf = 0;	//To enable/disable reading maps from GRF files, bypassing mapcache [blackhole89]
+int32 map_load_workers = 0; // Threads decoding the map cells at startup, 0 to use one per core
+int32 map_zone_workers = 0; // Threads scanning the zones for the monster AI, 0 to scan all maps on the main thread
+int32 visibility_sets = 0; // Keep the units in view of every player in a set
+int32 yaml_load_workers = 4; // Threads parsing the YAML databases at startup and loading independent ones, 0 to do everything on the main thread
+int32 yaml_snapshot = 0; // Load databases from binary snapshots of their records at startup
+char yaml_snapshot_path[256] = "db/snapshot"; // Directory of the database snapshots
+
+char timer_stats_file[256] = "./log/timer_stats.csv"; // File the timer statistics are exported to
+int32 timer_stats_interval = 0; // Seconds between automatic timer statistics exports, 0 to disable
 
 #ifdef MAP_GENERATOR
 struct s_generator_options {
@@ -400,11 +451,83 @@ static void map_delblcell(block_list *bl)
 }
 #endif
 
+/**
+ * Returns the block chains holding objects of the given type.
+ * Players, monsters and skill units each have their own chain, so area queries for
+ * one of them (e.g. AREA packets sent to BL_PC) do not have to skip over everything else.
+ * @param mapdata: Map data
+ * @param type: One of the types in BL_OWNCHAIN or any combination of the other types
+ * @return Array with one chain per block
+ */
+static block_list** map_getblockchain( struct map_data* mapdata, int32 type ){
+	switch( type ){
+		case BL_PC:
+			return mapdata->block_pc;
+		case BL_MOB:
+			return mapdata->block_mob;
+		case BL_SKILL:
+			return mapdata->block_skill;
+		default:
+			return mapdata->block;
+	}
+}
+
+/**
+ * Puts a unit that was added to a map into the visibility sets of the players in view.
+ * A player that was added gets all units in view as its set.
+ * @param bl: Unit that was added
+ */
+static void map_visibility_add(block_list* bl){
+	if( !visibility_sets || !(bl->type&BL_VISIBLE) )
+		return;
+
+	map_session_data* sd = BL_CAST(BL_PC, bl);
+	std::vector<block_list*>& blocks = map_getblockbuffer();
+	size_t blockcount = blocks.size();
+
+	map_getblocksinrange(blocks, bl, AREA_SIZE, sd != nullptr ? BL_VISIBLE : BL_PC, false);
+
+	for( size_t i = blockcount; i < blocks.size(); i++ ){
+		if( blocks[i] == bl )
+			continue;
+
+		if( blocks[i]->type == BL_PC )
+			static_cast<map_session_data*>(blocks[i])->visible_units.insert(bl->id);
+		if( sd != nullptr )
+			sd->visible_units.insert(blocks[i]->id);
+	}
+
+	blocks.resize(blockcount);
+}
+
+/**
+ * Takes a unit that is removed from a map out of the visibility sets of the players in view.
+ * A player that is removed loses its whole set.
+ * @param bl: Unit that is removed, still linked to the block list
+ */
+static void map_visibility_remove(block_list* bl){
+	if( !visibility_sets || !(bl->type&BL_VISIBLE) )
+		return;
+
+	std::vector<block_list*>& blocks = map_getblockbuffer();
+	size_t blockcount = blocks.size();
+
+	map_getblocksinrange(blocks, bl, AREA_SIZE, BL_PC, false);
+
+	for( size_t i = blockcount; i < blocks.size(); i++ )
+		static_cast<map_session_data*>(blocks[i])->visible_units.erase(bl->id);
+
+	blocks.resize(blockcount);
+
+	if( map_session_data* sd = BL_CAST(BL_PC, bl); sd != nullptr )
+		sd->visible_units.clear();
+}
+
 /*==========================================
- * Adds a block to the map.
+ * Links a block into the block list of its cell.
  * Returns 0 on success, 1 on failure (illegal coordinates).
  *------------------------------------------*/
-int32 map_addblock(block_list* bl)
+static int32 map_addblock_sub(block_list* bl)
 {
 	int16 m, x, y;
 	int32 pos;
@@ -439,17 +562,12 @@ int32 map_addblock(block_list* bl)
 
 	pos = x/BLOCK_SIZE+(y/BLOCK_SIZE)*mapdata->bxs;
 
-	if (bl->type == BL_MOB) {
-		bl->next = mapdata->block_mob[pos];
-		bl->prev = &bl_head;
-		if (bl->next) bl->next->prev = bl;
-		mapdata->block_mob[pos] = bl;
-	} else {
-		bl->next = mapdata->block[pos];
-		bl->prev = &bl_head;
-		if (bl->next) bl->next->prev = bl;
-		mapdata->block[pos] = bl;
-	}
+	block_list** chain = map_getblockchain( mapdata, bl->type );
+
+	bl->next = chain[pos];
+	bl->prev = &bl_head;
+	if (bl->next) bl->next->prev = bl;
+	chain[pos] = bl;
 
 #ifdef CELL_NOSTACK
 	map_addblcell(bl);
@@ -459,9 +577,22 @@ int32 map_addblock(block_list* bl)
 }
 
 /*==========================================
- * Removes a block from the map.
+ * Adds a block to the map.
+ * Returns 0 on success, 1 on failure (illegal coordinates).
  *------------------------------------------*/
-int32 map_delblock(block_list* bl)
+int32 map_addblock(block_list* bl)
+{
+	if( map_addblock_sub(bl) )
+		return 1;
+
+	map_visibility_add(bl);
+	return 0;
+}
+
+/*==========================================
+ * Unlinks a block from the block list of its cell.
+ *------------------------------------------*/
+static int32 map_delblock_sub(block_list* bl)
 {
 	int32 pos;
 	nullpo_ret(bl);
@@ -489,13 +620,10 @@ int32 map_delblock(block_list* bl)
 		bl->next->prev = bl->prev;
 	if (bl->prev == &bl_head) {
 	//Since the head of the list, update the block_list map of []
-		if (bl->type == BL_MOB) {
-			nullpo_ret(mapdata->block_mob);
-			mapdata->block_mob[pos] = bl->next;
-		} else {
-			nullpo_ret(mapdata->block);
-			mapdata->block[pos] = bl->next;
-		}
+		block_list** chain = map_getblockchain( mapdata, bl->type );
+
+		nullpo_ret(chain);
+		chain[pos] = bl->next;
 	} else {
 		bl->prev->next = bl->next;
 	}
@@ -505,6 +633,19 @@ int32 map_delblock(block_list* bl)
 	return 0;
 }
 
+/*==========================================
+ * Removes a block from the map.
+ *------------------------------------------*/
+int32 map_delblock(block_list* bl)
+{
+	nullpo_ret(bl);
+
+	if( bl->prev != nullptr )
+		map_visibility_remove(bl);
+
+	return map_delblock_sub(bl);
+}
+
 /**
  * Moves a block a x/y target position. [Skotlex]
  * Pass flag as 1 to prevent doing skill_unit_move checks
@@ -553,14 +694,14 @@ int32 map_moveblock(block_list *bl, int32 x1, int32 y1, t_tick tick)
 	if (bl->type == BL_NPC)
 		npc_unsetcells((TBL_NPC*)bl);
 
-	if (moveblock) map_delblock(bl);
+	if (moveblock) map_delblock_sub(bl);
 #ifdef CELL_NOSTACK
 	else map_delblcell(bl);
 #endif
 	bl->x = x1;
 	bl->y = y1;
 	if (moveblock) {
-		if(map_addblock(bl))
+		if(map_addblock_sub(bl))
 			return 1;
 	}
 #ifdef CELL_NOSTACK
@@ -651,8 +792,11 @@ int32 map_count_oncell(int16 m, int16 x, int16 y, int32 type, int32 flag)
 	bx = x/BLOCK_SIZE;
 	by = y/BLOCK_SIZE;
 
-	if (type&~BL_MOB)
-		for( bl = mapdata->block[bx+by*mapdata->bxs] ; bl != nullptr ; bl = bl->next )
+	for( int32 chain_type : block_chain_types ){
+		if( !(type&chain_type) )
+			continue;
+
+		for( bl = map_getblockchain(mapdata, chain_type)[bx+by*mapdata->bxs] ; bl != nullptr ; bl = bl->next )
 			if(bl->x == x && bl->y == y && bl->type&type) {
 				if (bl->type == BL_NPC) {	// Don't count hidden or invisible npc. Cloaked npc are counted
 					npc_data *nd = BL_CAST(BL_NPC, bl);
@@ -667,18 +811,7 @@ int32 map_count_oncell(int16 m, int16 x, int16 y, int32 type, int32 flag)
 					count++;
 				}
 			}
-
-	if (type&BL_MOB)
-		for( bl = mapdata->block_mob[bx+by*mapdata->bxs] ; bl != nullptr ; bl = bl->next )
-			if(bl->x == x && bl->y == y) {
-				if(flag&1) {
-					struct unit_data *ud = unit_bl2ud(bl);
-					if(!ud || ud->walktimer == INVALID_TIMER)
-						count++;
-				} else {
-					count++;
-				}
-			}
+	}
 
 	return count;
 }
@@ -699,9 +832,9 @@ skill_unit* map_find_skill_unit_oncell(block_list* target,int16 x,int16 y,uint16
 	bx = x/BLOCK_SIZE;
 	by = y/BLOCK_SIZE;
 
-	for( bl = mapdata->block[bx+by*mapdata->bxs] ; bl != nullptr ; bl = bl->next )
+	for( bl = mapdata->block_skill[bx+by*mapdata->bxs] ; bl != nullptr ; bl = bl->next )
 	{
-		if (bl->x != x || bl->y != y || bl->type != BL_SKILL)
+		if (bl->x != x || bl->y != y)
 			continue;
 
 		unit = (skill_unit *) bl;
@@ -713,23 +846,34 @@ skill_unit* map_find_skill_unit_oncell(block_list* target,int16 x,int16 y,uint16
 	return nullptr;
 }
 
-/*==========================================
- * Adapted from foreachinarea for an easier invocation. [Skotlex]
- *------------------------------------------*/
-int32 map_foreachinrangeV(int32 (*func)(block_list*,va_list),const block_list* center, int16 range, int32 type, va_list ap, bool wall_check)
-{
-	int32 bx, by, m;
-	int32 returnCount = 0;	//total sum of returned values of func() [Skotlex]
-	block_list *bl;
-	int32 blockcount = bl_list_count, i;
+/**
+ * Returns the scratch buffer of the map_foreach* family for the calling thread.
+ * Used by the typed map_foreach* templates, see map_foreachblock.
+ */
+std::vector<block_list*>& map_getblockbuffer(){
+	return bl_list;
+}
+
+/**
+ * Collects all objects of the given type around a center object.
+ * The objects are appended to the caller's buffer, existing entries are kept.
+ * @param out: Buffer to append the found objects to
+ * @param center: Object in the middle of the search area
+ * @param range: Radius around the center
+ * @param type: Type of bl to search for
+ * @param wall_check: Whether objects behind walls should be skipped
+ * @return Number of objects appended to out
+ */
+size_t map_getblocksinrange( std::vector<block_list*>& out, const block_list* center, int16 range, int32 type, bool wall_check ){
+	int32 bx, by;
 	int32 x0, x1, y0, y1;
-	va_list ap_copy;
+	block_list *bl;
+	size_t blockcount = out.size();
 
-	m = center->m;
-	if( m < 0 )
+	if( center->m < 0 )
 		return 0;
 
-	struct map_data *mapdata = map_getmapdata(m);
+	struct map_data *mapdata = map_getmapdata(center->m);
 
 	if( mapdata == nullptr || mapdata->block == nullptr ){
 		return 0;
@@ -740,45 +884,107 @@ int32 map_foreachinrangeV(int32 (*func)(block_list*,va_list),const block_list* c
 	x1 = i16min(center->x + range, mapdata->xs - 1);
 	y1 = i16min(center->y + range, mapdata->ys - 1);
 
-	if ( type&~BL_MOB ) {
+	for( int32 chain_type : block_chain_types ){
+		if( !(type&chain_type) )
+			continue;
+
+		block_list** chain = map_getblockchain( mapdata, chain_type );
+
 		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
 			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				for(bl = mapdata->block[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
+				for(bl = chain[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
 					if( bl->type&type
 						&& bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
 #ifdef CIRCULAR_AREA
 						&& check_distance_bl(center, bl, range)
 #endif
-						&& ( !wall_check || path_search_long(nullptr, center->m, center->x, center->y, bl->x, bl->y, CELL_CHKWALL) )
-					  	&& bl_list_count < BL_LIST_MAX )
-						bl_list[ bl_list_count++ ] = bl;
+						&& ( !wall_check || path_search_long(nullptr, center->m, center->x, center->y, bl->x, bl->y, CELL_CHKWALL) ) )
+						out.push_back( bl );
 				}
 			}
 		}
 	}
 
-	if ( type&BL_MOB ) {
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				for(bl = mapdata->block_mob[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-					if( bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
-#ifdef CIRCULAR_AREA
-						&& check_distance_bl(center, bl, range)
-#endif
-						&& ( !wall_check || path_search_long(nullptr, center->m, center->x, center->y, bl->x, bl->y, CELL_CHKWALL) )
-					  	&& bl_list_count < BL_LIST_MAX )
-						bl_list[ bl_list_count++ ] = bl;
+	return out.size() - blockcount;
+}
+
+/**
+ * Collects all objects of the given type inside a rectangular area.
+ * The objects are appended to the caller's buffer, existing entries are kept.
+ * @param out: Buffer to append the found objects to
+ * @param m: ID of map
+ * @param x0: West end of area
+ * @param y0: South end of area
+ * @param x1: East end of area
+ * @param y1: North end of area
+ * @param type: Type of bl to search for
+ * @param wall_check: Whether objects behind walls (seen from the middle of the area) should be skipped
+ * @return Number of objects appended to out
+ */
+size_t map_getblocksinarea( std::vector<block_list*>& out, int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 type, bool wall_check ){
+	int32 bx, by, cx, cy;
+	block_list *bl;
+	size_t blockcount = out.size();
+
+	if (m < 0)
+		return 0;
+
+	if (x1 < x0)
+		std::swap(x0, x1);
+	if (y1 < y0)
+		std::swap(y0, y1);
+
+	struct map_data *mapdata = map_getmapdata(m);
+
+	if( mapdata == nullptr || mapdata->block == nullptr ){
+		return 0;
+	}
+
+	x0 = i16max(x0, 0);
+	y0 = i16max(y0, 0);
+	x1 = i16min(x1, mapdata->xs - 1);
+	y1 = i16min(y1, mapdata->ys - 1);
+
+	if( wall_check ) {
+		cx = x0 + (x1 - x0) / 2;
+		cy = y0 + (y1 - y0) / 2;
+	}
+
+	for( int32 chain_type : block_chain_types ){
+		if( !(type&chain_type) )
+			continue;
+
+		block_list** chain = map_getblockchain( mapdata, chain_type );
+
+		for (by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++) {
+			for (bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++) {
+				for(bl = chain[bx + by * mapdata->bxs]; bl != nullptr; bl = bl->next) {
+					if ( bl->type&type
+						&& bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
+						&& ( !wall_check || path_search_long(nullptr, m, cx, cy, bl->x, bl->y, CELL_CHKWALL) ) )
+						out.push_back( bl );
 				}
 			}
 		}
 	}
 
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_foreachinrange: block count too many!\n");
+	return out.size() - blockcount;
+}
+
+/*==========================================
+ * Adapted from foreachinarea for an easier invocation. [Skotlex]
+ *------------------------------------------*/
+int32 map_foreachinrangeV(int32 (*func)(block_list*,va_list),const block_list* center, int16 range, int32 type, va_list ap, bool wall_check)
+{
+	int32 returnCount = 0;	//total sum of returned values of func() [Skotlex]
+	size_t blockcount = bl_list.size(), i;
+	va_list ap_copy;
+
+	map_getblocksinrange( bl_list, center, range, type, wall_check );
 
 	FreeBlockLock freeLock;
 
-	for( i = blockcount; i < bl_list_count; i++ ) {
+	for( i = blockcount; i < bl_list.size(); i++ ) {
 		if( bl_list[ i ]->prev ) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_copy(ap_copy, ap);
 			returnCount += func(bl_list[i], ap_copy);
@@ -786,7 +992,7 @@ int32 map_foreachinrangeV(int32 (*func)(block_list*,va_list),const block_list* c
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize( blockcount );
 	return returnCount;	//[Skotlex]
 }
 
@@ -836,69 +1042,15 @@ int32 map_foreachinshootrange(int32 (*func)(block_list*,va_list), const block_li
 *------------------------------------------*/
 int32 map_foreachinareaV(int32 (*func)(block_list*, va_list), int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 type, va_list ap, bool wall_check)
 {
-	int32 bx, by, cx, cy;
 	int32 returnCount = 0;	//total sum of returned values of func()
-	block_list *bl;
-	int32 blockcount = bl_list_count, i;
+	size_t blockcount = bl_list.size(), i;
 	va_list ap_copy;
 
-	if (m < 0)
-		return 0;
-
-	if (x1 < x0)
-		std::swap(x0, x1);
-	if (y1 < y0)
-		std::swap(y0, y1);
-
-	struct map_data *mapdata = map_getmapdata(m);
-
-	if( mapdata == nullptr || mapdata->block == nullptr ){
-		return 0;
-	}
-
-	x0 = i16max(x0, 0);
-	y0 = i16max(y0, 0);
-	x1 = i16min(x1, mapdata->xs - 1);
-	y1 = i16min(y1, mapdata->ys - 1);
-
-	if( wall_check ) {
-		cx = x0 + (x1 - x0) / 2;
-		cy = y0 + (y1 - y0) / 2;
-	}
-
-	if( type&~BL_MOB ) {
-		for (by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++) {
-			for (bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++) {
-				for(bl = mapdata->block[bx + by * mapdata->bxs]; bl != nullptr; bl = bl->next) {
-					if ( bl->type&type
-						&& bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
-						&& ( !wall_check || path_search_long(nullptr, m, cx, cy, bl->x, bl->y, CELL_CHKWALL) )
-						&& bl_list_count < BL_LIST_MAX )
-						bl_list[bl_list_count++] = bl;
-				}
-			}
-		}
-	}
-
-	if( type&BL_MOB ) {
-		for (by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++) {
-			for (bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++) {
-				for(bl = mapdata->block_mob[bx + by * mapdata->bxs]; bl != nullptr; bl = bl->next) {
-					if ( bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
-						&& ( !wall_check || path_search_long(nullptr, m, cx, cy, bl->x, bl->y, CELL_CHKWALL) )
-						&& bl_list_count < BL_LIST_MAX )
-						bl_list[bl_list_count++] = bl;
-				}
-			}
-		}
-	}
-
-	if (bl_list_count >= BL_LIST_MAX)
-		ShowWarning("map_foreachinarea: block count too many!\n");
+	map_getblocksinarea( bl_list, m, x0, y0, x1, y1, type, wall_check );
 
 	FreeBlockLock freeLock;
 
-	for (i = blockcount; i < bl_list_count; i++) {
+	for (i = blockcount; i < bl_list.size(); i++) {
 		if (bl_list[i]->prev) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_copy(ap_copy, ap);
 			returnCount += func(bl_list[i], ap_copy);
@@ -906,7 +1058,7 @@ int32 map_foreachinareaV(int32 (*func)(block_list*, va_list), int16 m, int16 x0,
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize( blockcount );
 	return returnCount;
 }
 
@@ -944,60 +1096,15 @@ int32 map_foreachinarea(int32 (*func)(block_list*, va_list), int16 m, int16 x0,
  *------------------------------------------*/
 int32 map_forcountinrange(int32 (*func)(block_list*,va_list), const block_list* center, int16 range, int32 count, int32 type, ...)
 {
-	int32 bx, by, m;
 	int32 returnCount = 0;	//total sum of returned values of func() [Skotlex]
-	block_list *bl;
-	int32 blockcount = bl_list_count, i;
-	int32 x0, x1, y0, y1;
-	struct map_data *mapdata;
+	size_t blockcount = bl_list.size(), i;
 	va_list ap;
 
-	m = center->m;
-	mapdata = map_getmapdata(m);
-
-	if( mapdata == nullptr || mapdata->block == nullptr ){
-		return 0;
-	}
-
-	x0 = i16max(center->x - range, 0);
-	y0 = i16max(center->y - range, 0);
-	x1 = i16min(center->x + range, mapdata->xs - 1);
-	y1 = i16min(center->y + range, mapdata->ys - 1);
-
-	if ( type&~BL_MOB )
-		for ( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				for( bl = mapdata->block[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-					if( bl->type&type
-						&& bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
-#ifdef CIRCULAR_AREA
-						&& check_distance_bl(center, bl, range)
-#endif
-					  	&& bl_list_count < BL_LIST_MAX )
-						bl_list[ bl_list_count++ ] = bl;
-				}
-			}
-		}
-	if( type&BL_MOB )
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ){
-				for( bl = mapdata->block_mob[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-					if( bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1
-#ifdef CIRCULAR_AREA
-						&& check_distance_bl(center, bl, range)
-#endif
-						&& bl_list_count < BL_LIST_MAX )
-						bl_list[ bl_list_count++ ] = bl;
-				}
-			}
-		}
-
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_forcountinrange: block count too many!\n");
+	map_getblocksinrange( bl_list, center, range, type, false );
 
 	FreeBlockLock freeLock;
 
-	for( i = blockcount; i < bl_list_count; i++ ) {
+	for( i = blockcount; i < bl_list.size(); i++ ) {
 		if( bl_list[ i ]->prev ) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_start(ap, type);
 			returnCount += func(bl_list[ i ], ap);
@@ -1007,56 +1114,20 @@ int32 map_forcountinrange(int32 (*func)(block_list*,va_list), const block_list*
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize( blockcount );
 	return returnCount;	//[Skotlex]
-}
-int32 map_forcountinarea(int32 (*func)(block_list*,va_list), int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 count, int32 type, ...)
-{
-	int32 bx, by;
-	int32 returnCount = 0;	//total sum of returned values of func() [Skotlex]
-	block_list *bl;
-	int32 blockcount = bl_list_count, i;
-	va_list ap;
-
-	if ( m < 0 )
-		return 0;
-
-	if ( x1 < x0 )
-		std::swap(x0, x1);
-	if ( y1 < y0 )
-		std::swap(y0, y1);
-
-	struct map_data *mapdata = map_getmapdata(m);
-
-	if( mapdata == nullptr || mapdata->block == nullptr ){
-		return 0;
-	}
-
-	x0 = i16max(x0, 0);
-	y0 = i16max(y0, 0);
-	x1 = i16min(x1, mapdata->xs - 1);
-	y1 = i16min(y1, mapdata->ys - 1);
-
-	if ( type&~BL_MOB )
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ )
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ )
-				for( bl = mapdata->block[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next )
-					if( bl->type&type && bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1 && bl_list_count < BL_LIST_MAX )
-						bl_list[ bl_list_count++ ] = bl;
-
-	if( type&BL_MOB )
-		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ )
-			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ )
-				for( bl = mapdata->block_mob[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next )
-					if( bl->x >= x0 && bl->x <= x1 && bl->y >= y0 && bl->y <= y1 && bl_list_count < BL_LIST_MAX )
-						bl_list[ bl_list_count++ ] = bl;
+}
+int32 map_forcountinarea(int32 (*func)(block_list*,va_list), int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 count, int32 type, ...)
+{
+	int32 returnCount = 0;	//total sum of returned values of func() [Skotlex]
+	size_t blockcount = bl_list.size(), i;
+	va_list ap;
 
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_forcountinarea: block count too many!\n");
+	map_getblocksinarea( bl_list, m, x0, y0, x1, y1, type, false );
 
 	FreeBlockLock freeLock;
 
-	for( i = blockcount; i < bl_list_count; i++ ) {
+	for( i = blockcount; i < bl_list.size(); i++ ) {
 		if(bl_list[ i ]->prev) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_start(ap, type);
 			returnCount += func(bl_list[ i ], ap);
@@ -1066,7 +1137,7 @@ int32 map_forcountinarea(int32 (*func)(block_list*,va_list), int16 m, int16 x0,
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize( blockcount );
 	return returnCount;	//[Skotlex]
 }
 
@@ -1079,7 +1150,7 @@ int32 map_foreachinmovearea(int32 (*func)(block_list*,va_list), const block_list
 	int32 bx, by, m;
 	int32 returnCount = 0;  //total sum of returned values of func() [Skotlex]
 	block_list *bl;
-	int32 blockcount = bl_list_count, i;
+	size_t blockcount = bl_list.size(), i;
 	int16 x0, x1, y0, y1;
 	va_list ap;
 
@@ -1094,6 +1165,11 @@ int32 map_foreachinmovearea(int32 (*func)(block_list*,va_list), const block_list
 		return 0;
 	}
 
+	// Only players are interested in the view change and there are none on this map
+	if( !(type&~BL_PC) && mapdata->users <= 0 ){
+		return 0;
+	}
+
 	x0 = center->x - range;
 	x1 = center->x + range;
 	y0 = center->y - range;
@@ -1125,21 +1201,15 @@ int32 map_foreachinmovearea(int32 (*func)(block_list*,va_list), const block_list
 
 		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
 			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				if ( type&~BL_MOB ) {
-					for( bl = mapdata->block[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
+				for( int32 chain_type : block_chain_types ) {
+					if( !(type&chain_type) )
+						continue;
+
+					for( bl = map_getblockchain(mapdata, chain_type)[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
 						if( bl->type&type &&
 							bl->x >= x0 && bl->x <= x1 &&
-							bl->y >= y0 && bl->y <= y1 &&
-							bl_list_count < BL_LIST_MAX )
-							bl_list[ bl_list_count++ ] = bl;
-					}
-				}
-				if ( type&BL_MOB ) {
-					for( bl = mapdata->block_mob[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-						if( bl->x >= x0 && bl->x <= x1 &&
-							bl->y >= y0 && bl->y <= y1 &&
-							bl_list_count < BL_LIST_MAX )
-							bl_list[ bl_list_count++ ] = bl;
+							bl->y >= y0 && bl->y <= y1 )
+							bl_list.push_back( bl );
 					}
 				}
 			}
@@ -1152,29 +1222,19 @@ int32 map_foreachinmovearea(int32 (*func)(block_list*,va_list), const block_list
 
 		for( by = y0 / BLOCK_SIZE; by <= y1 / BLOCK_SIZE; by++ ) {
 			for( bx = x0 / BLOCK_SIZE; bx <= x1 / BLOCK_SIZE; bx++ ) {
-				if ( type & ~BL_MOB ) {
-					for( bl = mapdata->block[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
+				for( int32 chain_type : block_chain_types ) {
+					if( !(type&chain_type) )
+						continue;
+
+					for( bl = map_getblockchain(mapdata, chain_type)[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
 						if( bl->type&type &&
 							bl->x >= x0 && bl->x <= x1 &&
-							bl->y >= y0 && bl->y <= y1 &&
-							bl_list_count < BL_LIST_MAX )
-						if( ( dx > 0 && bl->x < x0 + dx) ||
-							( dx < 0 && bl->x > x1 + dx) ||
-							( dy > 0 && bl->y < y0 + dy) ||
-							( dy < 0 && bl->y > y1 + dy) )
-							bl_list[ bl_list_count++ ] = bl;
-					}
-				}
-				if ( type&BL_MOB ) {
-					for( bl = mapdata->block_mob[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-						if( bl->x >= x0 && bl->x <= x1 &&
-							bl->y >= y0 && bl->y <= y1 &&
-							bl_list_count < BL_LIST_MAX)
+							bl->y >= y0 && bl->y <= y1 )
 						if( ( dx > 0 && bl->x < x0 + dx) ||
 							( dx < 0 && bl->x > x1 + dx) ||
 							( dy > 0 && bl->y < y0 + dy) ||
 							( dy < 0 && bl->y > y1 + dy) )
-							bl_list[ bl_list_count++ ] = bl;
+							bl_list.push_back( bl );
 					}
 				}
 			}
@@ -1182,12 +1242,9 @@ int32 map_foreachinmovearea(int32 (*func)(block_list*,va_list), const block_list
 
 	}
 
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_foreachinmovearea: block count too many!\n");
-
 	FreeBlockLock freeLock;
 
-	for( i = blockcount; i < bl_list_count; i++ ) {
+	for( i = blockcount; i < bl_list.size(); i++ ) {
 		if( bl_list[ i ]->prev ) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_start(ap, type);
 			returnCount += func(bl_list[ i ], ap);
@@ -1195,7 +1252,7 @@ int32 map_foreachinmovearea(int32 (*func)(block_list*,va_list), const block_list
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize( blockcount );
 	return returnCount;
 }
 
@@ -1208,7 +1265,7 @@ int32 map_foreachincell(int32 (*func)(block_list*,va_list), int16 m, int16 x, in
 	int32 bx, by;
 	int32 returnCount = 0;  //total sum of returned values of func() [Skotlex]
 	block_list *bl;
-	int32 blockcount = bl_list_count, i;
+	size_t blockcount = bl_list.size(), i;
 	struct map_data *mapdata = map_getmapdata(m);
 	va_list ap;
 
@@ -1221,21 +1278,19 @@ int32 map_foreachincell(int32 (*func)(block_list*,va_list), int16 m, int16 x, in
 	by = y / BLOCK_SIZE;
 	bx = x / BLOCK_SIZE;
 
-	if( type&~BL_MOB )
-		for( bl = mapdata->block[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next )
-			if( bl->type&type && bl->x == x && bl->y == y && bl_list_count < BL_LIST_MAX )
-				bl_list[ bl_list_count++ ] = bl;
-	if( type&BL_MOB )
-		for( bl = mapdata->block_mob[ bx + by * mapdata->bxs]; bl != nullptr; bl = bl->next )
-			if( bl->x == x && bl->y == y && bl_list_count < BL_LIST_MAX)
-				bl_list[ bl_list_count++ ] = bl;
-
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_foreachincell: block count too many!\n");
+	for( int32 chain_type : block_chain_types ){
+		if( !(type&chain_type) )
+			continue;
+
+		for( bl = map_getblockchain(mapdata, chain_type)[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next )
+			if( bl->type&type && bl->x == x && bl->y == y )
+				bl_list.push_back( bl );
+	}
+
 	
 	FreeBlockLock freeLock;
 
-	for( i = blockcount; i < bl_list_count; i++ ) {
+	for( i = blockcount; i < bl_list.size(); i++ ) {
 		if( bl_list[ i ]->prev ) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_start(ap, type);
 			returnCount += func(bl_list[ i ], ap);
@@ -1243,7 +1298,7 @@ int32 map_foreachincell(int32 (*func)(block_list*,va_list), int16 m, int16 x, in
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize( blockcount );
 	return returnCount;
 }
 
@@ -1287,7 +1342,7 @@ int32 map_foreachinpath(int32 (*func)(block_list*,va_list),int16 m,int16 x0,int1
 // kRO.
 
 	//Generic map_foreach* variables.
-	int32 i, blockcount = bl_list_count;
+	size_t i, blockcount = bl_list.size();
 	block_list *bl;
 	int32 bx, by;
 	//method specific variables
@@ -1348,11 +1403,16 @@ int32 map_foreachinpath(int32 (*func)(block_list*,va_list),int16 m,int16 x0,int1
 
 	range *= range << 8; //Values are shifted later on for higher precision using int32 math.
 
-	if ( type&~BL_MOB )
+	for( int32 chain_type : block_chain_types ){
+		if( !(type&chain_type) )
+			continue;
+
+		block_list** chain = map_getblockchain( mapdata, chain_type );
+
 		for ( by = my0 / BLOCK_SIZE; by <= my1 / BLOCK_SIZE; by++ ) {
 			for( bx = mx0 / BLOCK_SIZE; bx <= mx1 / BLOCK_SIZE; bx++ ) {
-				for( bl = mapdata->block[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-					if( bl->prev && bl->type&type && bl_list_count < BL_LIST_MAX ) {
+				for( bl = chain[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
+					if( bl->prev && bl->type&type ) {
 						xi = bl->x;
 						yi = bl->y;
 
@@ -1377,49 +1437,16 @@ int32 map_foreachinpath(int32 (*func)(block_list*,va_list),int16 m,int16 x0,int1
 						if ( k > range )
 							continue;
 
-						bl_list[ bl_list_count++ ] = bl;
-					}
-				}
-			}
-		}
-	 if( type&BL_MOB )
-		for( by = my0 / BLOCK_SIZE; by <= my1 / BLOCK_SIZE; by++ ) {
-			for( bx = mx0 / BLOCK_SIZE; bx <= mx1 / BLOCK_SIZE; bx++ ) {
-				for( bl = mapdata->block_mob[ bx + by * mapdata->bxs ]; bl != nullptr; bl = bl->next ) {
-					if( bl->prev && bl_list_count < BL_LIST_MAX ) {
-						xi = bl->x;
-						yi = bl->y;
-						k = ( xi - x0 ) * ( x1 - x0 ) + ( yi - y0 ) * ( y1 - y0 );
-
-						if ( k < 0 || k > len_limit )
-							continue;
-
-						if ( k > magnitude2 && !path_search_long(nullptr, m, x0, y0, xi, yi, CELL_CHKWALL) )
-							continue; //Targets beyond the initial ending point need the wall check.
-
-						k  = ( k << 4 ) / magnitude2; //k will be between 1~16 instead of 0~1
-						xi <<= 4;
-						yi <<= 4;
-						xu = ( x0 << 4 ) + k * ( x1 - x0 );
-						yu = ( y0 << 4 ) + k * ( y1 - y0 );
-						k  = MAGNITUDE2(xi, yi, xu, yu);
-
-						//If all dot coordinates were <<4 the square of the magnitude is <<8
-						if ( k > range )
-							continue;
-
-						bl_list[ bl_list_count++ ] = bl;
+						bl_list.push_back( bl );
 					}
 				}
 			}
 		}
-
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_foreachinpath: block count too many!\n");
+	}
 
 	FreeBlockLock freeLock;
 
-	for( i = blockcount; i < bl_list_count; i++ ) {
+	for( i = blockcount; i < bl_list.size(); i++ ) {
 		if( bl_list[ i ]->prev ) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_start(ap, type);
 			returnCount += func(bl_list[ i ], ap);
@@ -1427,7 +1454,7 @@ int32 map_foreachinpath(int32 (*func)(block_list*,va_list),int16 m,int16 x0,int1
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize( blockcount );
 	return returnCount;	//[Skotlex]
 
 }
@@ -1451,7 +1478,7 @@ int32 map_foreachindir(int32 (*func)(block_list*, va_list), int16 m, int16 x0, i
 {
 	int32 returnCount = 0;  //Total sum of returned values of func()
 
-	int32 i, blockcount = bl_list_count;
+	size_t i, blockcount = bl_list.size();
 	block_list *bl;
 	int32 bx, by;
 	int32 mx0, mx1, my0, my1, rx, ry;
@@ -1507,11 +1534,16 @@ int32 map_foreachindir(int32 (*func)(block_list*, va_list), int16 m, int16 x0, i
 	mx1 = min(mx1, mapdata->xs - 1);
 	my1 = min(my1, mapdata->ys - 1);
 
-	if (type&~BL_MOB) {
+	for( int32 chain_type : block_chain_types ){
+		if( !(type&chain_type) )
+			continue;
+
+		block_list** chain = map_getblockchain( mapdata, chain_type );
+
 		for (by = my0 / BLOCK_SIZE; by <= my1 / BLOCK_SIZE; by++) {
 			for (bx = mx0 / BLOCK_SIZE; bx <= mx1 / BLOCK_SIZE; bx++) {
-				for (bl = mapdata->block[bx + by * mapdata->bxs]; bl != nullptr; bl = bl->next) {
-					if (bl->prev && bl->type&type && bl_list_count < BL_LIST_MAX) {
+				for (bl = chain[bx + by * mapdata->bxs]; bl != nullptr; bl = bl->next) {
+					if (bl->prev && bl->type&type) {
 						//Check if inside search area
 						if (bl->x < mx0 || bl->x > mx1 || bl->y < my0 || bl->y > my1)
 							continue;
@@ -1537,55 +1569,16 @@ int32 map_foreachindir(int32 (*func)(block_list*, va_list), int16 m, int16 x0, i
 						if (!path_search_long(nullptr, m, x0, y0, bl->x, bl->y, CELL_CHKWALL))
 							continue;
 						//All checks passed, add to list
-						bl_list[bl_list_count++] = bl;
-					}
-				}
-			}
-		}
-	}
-	if (type&BL_MOB) {
-		for (by = my0 / BLOCK_SIZE; by <= my1 / BLOCK_SIZE; by++) {
-			for (bx = mx0 / BLOCK_SIZE; bx <= mx1 / BLOCK_SIZE; bx++) {
-				for (bl = mapdata->block_mob[bx + by * mapdata->bxs]; bl != nullptr; bl = bl->next) {
-					if (bl->prev && bl_list_count < BL_LIST_MAX) {
-						//Check if inside search area
-						if (bl->x < mx0 || bl->x > mx1 || bl->y < my0 || bl->y > my1)
-							continue;
-						//What matters now is the relative x and y from the start point
-						rx = (bl->x - x0);
-						ry = (bl->y - y0);
-						//Do not hit source cell
-						if (battle_config.skill_eightpath_same_cell == 0 && rx == 0 && ry == 0)
-							continue;
-						//This turns it so that the area that is hit is always with positive rx and ry
-						rx *= dx;
-						ry *= dy;
-						//These checks only need to be done for diagonal paths
-						if( direction_diagonal( (directions)dir ) ){
-							//Check for length
-							if ((rx + ry < offset) || (rx + ry > 2 * (length + (offset / 2) - 1)))
-								continue;
-							//Check for width
-							if (abs(rx - ry) > 2 * range)
-								continue;
-						}
-						//Everything else ok, check for line of sight from source
-						if (!path_search_long(nullptr, m, x0, y0, bl->x, bl->y, CELL_CHKWALL))
-							continue;
-						//All checks passed, add to list
-						bl_list[bl_list_count++] = bl;
+						bl_list.push_back( bl );
 					}
 				}
 			}
 		}
 	}
 
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_foreachindir: block count too many!\n");
-
 	FreeBlockLock freeLock;
 
-	for( i = blockcount; i < bl_list_count; i++ ) {
+	for( i = blockcount; i < bl_list.size(); i++ ) {
 		if( bl_list[ i ]->prev ) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_start(ap, type);
 			returnCount += func(bl_list[ i ], ap);
@@ -1593,7 +1586,7 @@ int32 map_foreachindir(int32 (*func)(block_list*, va_list), int16 m, int16 x0, i
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize( blockcount );
 	return returnCount;
 }
 
@@ -1603,7 +1596,7 @@ int32 map_foreachinmap(int32 (*func)(block_list*,va_list), int16 m, int32 type,.
 	int32 b, bsize;
 	int32 returnCount = 0;  //total sum of returned values of func() [Skotlex]
 	block_list *bl;
-	int32 blockcount = bl_list_count, i;
+	size_t blockcount = bl_list.size(), i;
 	struct map_data *mapdata = map_getmapdata(m);
 	va_list ap;
 
@@ -1613,24 +1606,21 @@ int32 map_foreachinmap(int32 (*func)(block_list*,va_list), int16 m, int32 type,.
 
 	bsize = mapdata->bxs * mapdata->bys;
 
-	if( type&~BL_MOB )
-		for( b = 0; b < bsize; b++ )
-			for( bl = mapdata->block[ b ]; bl != nullptr; bl = bl->next )
-				if( bl->type&type && bl_list_count < BL_LIST_MAX )
-					bl_list[ bl_list_count++ ] = bl;
+	for( int32 chain_type : block_chain_types ){
+		if( !(type&chain_type) )
+			continue;
 
-	if( type&BL_MOB )
-		for( b = 0; b < bsize; b++ )
-			for( bl = mapdata->block_mob[ b ]; bl != nullptr; bl = bl->next )
-				if( bl_list_count < BL_LIST_MAX )
-					bl_list[ bl_list_count++ ] = bl;
+		block_list** chain = map_getblockchain( mapdata, chain_type );
 
-	if( bl_list_count >= BL_LIST_MAX )
-		ShowWarning("map_foreachinmap: block count too many!\n");
+		for( b = 0; b < bsize; b++ )
+			for( bl = chain[ b ]; bl != nullptr; bl = bl->next )
+				if( bl->type&type )
+					bl_list.push_back( bl );
+	}
 
 	FreeBlockLock freeLock;
 
-	for( i = blockcount; i < bl_list_count ; i++ ) {
+	for( i = blockcount; i < bl_list.size() ; i++ ) {
 		if( bl_list[ i ]->prev ) { //func() may delete this bl_list[] slot, checking for prev ensures it wasn't queued for deletion.
 			va_start(ap, type);
 			returnCount += func(bl_list[ i ], ap);
@@ -1638,7 +1628,7 @@ int32 map_foreachinmap(int32 (*func)(block_list*,va_list), int16 m, int32 type,.
 		}
 	}
 
-	bl_list_count = blockcount;
+	bl_list.resize( blockcount );
 	return returnCount;
 }
 
@@ -2515,6 +2505,80 @@ void map_foreachpc(int32 (*func)(map_session_data* sd, va_list args), ...)
 	dbi_destroy(iter);
 }
 
+static std::vector<std::thread> map_zone_threads;
+static std::mutex map_zone_mutex;
+static std::condition_variable map_zone_start;
+static std::condition_variable map_zone_done;
+static const std::function<void(int32)>* map_zone_task = nullptr;
+static uint32 map_zone_round = 0;
+static int32 map_zone_pending = 0;
+static bool map_zone_stopping = false;
+
+/// Worker thread of a zone, runs the task of every round after the given one for its own zone
+static void map_zone_worker(int32 zone, uint32 round){
+	std::unique_lock<std::mutex> lock(map_zone_mutex);
+
+	while( true ){
+		map_zone_start.wait(lock, [&round]() { return map_zone_stopping || map_zone_round != round; });
+
+		if( map_zone_stopping )
+			return;
+
+		round = map_zone_round;
+		lock.unlock();
+		(*map_zone_task)(zone);
+		lock.lock();
+
+		if( --map_zone_pending == 0 )
+			map_zone_done.notify_one();
+	}
+}
+
+/**
+ * Runs a task once for every zone and waits until all zones are done.
+ * With map_zone_workers set the zones are run at the same time by one thread each,
+ * so the task may only read the map data and write to storage owned by its zone.
+ * Otherwise the task is called for the single zone 0 on the main thread.
+ * @param task: Called as task(zone), the maps of a zone are those with map_getzone(m) == zone
+ */
+void map_zone_run(const std::function<void(int32 zone)>& task){
+	if( map_zone_workers <= 0 ){
+		task(0);
+		return;
+	}
+
+	if( map_zone_threads.empty() ){
+		for( int32 zone = 0; zone < map_zone_workers; zone++ )
+			map_zone_threads.emplace_back(map_zone_worker, zone, map_zone_round);
+	}
+
+	std::unique_lock<std::mutex> lock(map_zone_mutex);
+
+	map_zone_task = &task;
+	map_zone_pending = static_cast<int32>(map_zone_threads.size());
+	map_zone_round++;
+	map_zone_start.notify_all();
+	map_zone_done.wait(lock, []() { return map_zone_pending == 0; });
+	map_zone_task = nullptr;
+}
+
+/// Stops the zone workers
+void map_zone_final(){
+	{
+		std::lock_guard<std::mutex> lock(map_zone_mutex);
+
+		map_zone_stopping = true;
+	}
+
+	map_zone_start.notify_all();
+
+	for( std::thread& thread : map_zone_threads )
+		thread.join();
+
+	map_zone_threads.clear();
+	map_zone_stopping = false;
+}
+
 /// Applies func to all the mobs in the db.
 /// Stops iterating if func returns -1.
 void map_foreachmob(int32 (*func)(mob_data* md, va_list args), ...)
@@ -2877,6 +2941,8 @@ int32 map_addinstancemap(int32 src_m, int32 instance_id, bool no_mapflag)
 
 	dst_map->block = (block_list **)aCalloc(1,size);
 	dst_map->block_mob = (block_list **)aCalloc(1,size);
+	dst_map->block_pc = (block_list **)aCalloc(1,size);
+	dst_map->block_skill = (block_list **)aCalloc(1,size);
 
 	dst_map->index = mapindex_addmap(-1, dst_map->name);
 	dst_map->channel = nullptr;
@@ -2967,6 +3033,12 @@ int32 map_delinstancemap(int32 m)
 	if (mapdata->block_mob)
 		aFree(mapdata->block_mob);
 	mapdata->block_mob = nullptr;
+	if (mapdata->block_pc)
+		aFree(mapdata->block_pc);
+	mapdata->block_pc = nullptr;
+	if (mapdata->block_skill)
+		aFree(mapdata->block_skill);
+	mapdata->block_skill = nullptr;
 
 	map_free_questinfo(mapdata);
 	mapdata->damage_adjust = {};
@@ -3052,6 +3124,15 @@ int32 map_removemobs_sub(block_list *bl, va_list ap)
 	return 1;
 }
 
+/*==========================================
+ * Periodically exports the timer statistics and starts a new sampling period
+ *------------------------------------------*/
+TIMER_FUNC(map_timer_stats_timer){
+	timer_stats_export(timer_stats_file);
+	timer_stats_reset();
+	return 0;
+}
+
 TIMER_FUNC(map_removemobs_timer){
 	int32 count;
 	const int16 m = id;
@@ -3634,44 +3715,148 @@ int32 map_eraseipport(uint16 mapindex, uint32 ip, uint16 port)
 	return 0;
 }
 
+static void map_final_mapcache(struct s_map_cache& cache);
+
 /*==========================================
  * [Shinryo]: Init the mapcache
+ * The file is mapped into memory where possible and read otherwise.
  *------------------------------------------*/
-static char *map_init_mapcache(FILE *fp)
+static bool map_init_mapcache(FILE *fp, struct s_map_cache& cache)
 {
 	size_t size = 0;
-	char *buffer;
 
 	// No file open? Return..
-	nullpo_ret(fp);
+	nullpo_retr(false, fp);
+
+	cache.buffer = nullptr;
+	cache.mapped = false;
+	cache.v2 = false;
 
 	// Get file size
 	fseek(fp, 0, SEEK_END);
 	size = ftell(fp);
 	fseek(fp, 0, SEEK_SET);
 
-	// Allocate enough space
-	CREATE(buffer, char, size);
+	if( size < sizeof(struct map_cache_main_header) ){
+		ShowError("map_init_mapcache: Mapcache file is too small\n");
+		return false;
+	}
 
-	// No memory? Return..
-	nullpo_ret(buffer);
+#ifndef WIN32
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
 
-	// Read file into buffer..
-	if(fread(buffer, 1, size, fp) != size) {
-		ShowError("map_init_mapcache: Could not read entire mapcache file\n");
-		return nullptr;
+	if( mapping != MAP_FAILED ){
+		cache.buffer = (char*)mapping;
+		cache.mapped = true;
+	}
+#endif
+
+	if( cache.buffer == nullptr ){
+		// Allocate enough space
+		CREATE(cache.buffer, char, size);
+
+		// Read file into buffer..
+		if(fread(cache.buffer, 1, size, fp) != size) {
+			ShowError("map_init_mapcache: Could not read entire mapcache file\n");
+			aFree(cache.buffer);
+			cache.buffer = nullptr;
+			return false;
+		}
+	}
+
+	cache.size = size;
+
+	if( size >= sizeof(struct map_cache_v2_header) && memcmp(cache.buffer, MAP_CACHE_V2_MAGIC, 4) == 0 ){
+		uint32 version = GetULong((unsigned char*)cache.buffer + offsetof(struct map_cache_v2_header, version));
+		uint32 map_count = GetULong((unsigned char*)cache.buffer + offsetof(struct map_cache_v2_header, map_count));
+
+		if( version != MAP_CACHE_V2_VERSION || size < sizeof(struct map_cache_v2_header) + (size_t)map_count * sizeof(struct map_cache_v2_index) ){
+			ShowError("map_init_mapcache: Unsupported or damaged mapcache file (version %u)\n", version);
+			map_final_mapcache(cache);
+			return false;
+		}
+
+		cache.v2 = true;
+	}
+
+	return true;
+}
+
+/*==========================================
+ * Releases a map cache loaded by map_init_mapcache
+ *------------------------------------------*/
+static void map_final_mapcache(struct s_map_cache& cache)
+{
+	if( cache.buffer == nullptr )
+		return;
+
+#ifndef WIN32
+	if( cache.mapped )
+		munmap(cache.buffer, cache.size);
+	else
+#endif
+		aFree(cache.buffer);
+
+	cache.buffer = nullptr;
+}
+
+/*==========================================
+ * Map cache lookup (v2)
+ * Binary search on the sorted index.
+ *==========================================*/
+static bool map_findincache_v2(struct map_data *m, struct s_map_cache& cache, struct s_map_cache_cells& cells)
+{
+	uint32 map_count = GetULong((unsigned char*)cache.buffer + offsetof(struct map_cache_v2_header, map_count));
+	struct map_cache_v2_index *first = (struct map_cache_v2_index *)(cache.buffer + sizeof(struct map_cache_v2_header));
+	struct map_cache_v2_index *last = first + map_count;
+	struct map_cache_v2_index *info = std::lower_bound(first, last, m->name, []( const map_cache_v2_index& entry, const char* name ){
+		return strncmp(entry.name, name, MAP_NAME_LENGTH) < 0;
+	});
+
+	if( info == last || strncmp(info->name, m->name, MAP_NAME_LENGTH) != 0 )
+		return false; // Not found
+
+	// The numbers of the index are stored in little-endian
+	int16 xs = (int16)GetUShort((unsigned char*)&info->xs);
+	int16 ys = (int16)GetUShort((unsigned char*)&info->ys);
+	uint64 offset = GetUInt64((unsigned char*)&info->offset);
+
+	if( xs <= 0 || ys <= 0 )
+		return false;// Invalid
+
+	size_t size = (size_t)xs * (size_t)ys;
+
+	if( size > MAX_MAP_SIZE ){
+		ShowWarning("map_findincache: %s exceeded MAX_MAP_SIZE of %d\n", m->name, MAX_MAP_SIZE);
+		return false; // Say not found to remove it from list.. [Shinryo]
+	}
+
+	if( offset > cache.size || size > cache.size - offset ){
+		ShowWarning("map_findincache: cells of %s are outside of the mapcache file\n", m->name);
+		return false;
 	}
 
-	return buffer;
+	m->xs = xs;
+	m->ys = ys;
+	cells.data = cache.buffer + offset;
+	cells.len = size;
+	cells.v2 = true;
+
+	return true;
 }
 
 /*==========================================
- * Map cache reading
+ * Map cache lookup
+ * Finds the cells of a map and sets its size, decoding is done by map_decodecache.
  * [Shinryo]: Optimized some behaviour to speed this up
  *==========================================*/
-int32 map_readfromcache(struct map_data *m, char *buffer, char *decode_buffer)
+static bool map_findincache(struct map_data *m, struct s_map_cache& cache, struct s_map_cache_cells& cells)
 {
+	if( cache.v2 )
+		return map_findincache_v2(m, cache, cells);
+
 	int32 i;
+	char *buffer = cache.buffer;
 	struct map_cache_main_header *header = (struct map_cache_main_header *)buffer;
 	struct map_cache_map_info *info = nullptr;
 	char *p = buffer + sizeof(struct map_cache_main_header);
@@ -3687,33 +3872,52 @@ int32 map_readfromcache(struct map_data *m, char *buffer, char *decode_buffer)
 	}
 
 	if( info && i < header->map_count ) {
-		unsigned long size, xy;
-
 		if( info->xs <= 0 || info->ys <= 0 )
-			return 0;// Invalid
+			return false;// Invalid
+
+		if( (size_t)info->xs * (size_t)info->ys > MAX_MAP_SIZE ) {
+			ShowWarning("map_findincache: %s exceeded MAX_MAP_SIZE of %d\n", info->name, MAX_MAP_SIZE);
+			return false; // Say not found to remove it from list.. [Shinryo]
+		}
 
 		m->xs = info->xs;
 		m->ys = info->ys;
-		size = (unsigned long)info->xs*(unsigned long)info->ys;
-
-		if(size > MAX_MAP_SIZE) {
-			ShowWarning("map_readfromcache: %s exceeded MAX_MAP_SIZE of %d\n", info->name, MAX_MAP_SIZE);
-			return 0; // Say not found to remove it from list.. [Shinryo]
-		}
+		cells.data = p + sizeof(struct map_cache_map_info);
+		cells.len = info->len;
+		cells.v2 = false;
 
-		// TO-DO: Maybe handle the scenario, if the decoded buffer isn't the same size as expected? [Shinryo]
-		decode_zip(decode_buffer, &size, p+sizeof(struct map_cache_map_info), info->len);
+		return true;
+	}
 
-		CREATE(m->cell, struct mapcell, size);
+	return false; // Not found
+}
 
+/*==========================================
+ * Map cache decoding
+ * Fills the already allocated cells of a map, safe to run on any thread.
+ *==========================================*/
+static void map_decodecache(struct map_data *m, const struct s_map_cache_cells& cells, char *decode_buffer)
+{
+	size_t size = (size_t)m->xs * (size_t)m->ys;
 
-		for( xy = 0; xy < size; ++xy )
-			m->cell[xy] = map_gat2cell(decode_buffer[xy]);
+	if( cells.v2 ){
+		const uint8* flags = (const uint8*)cells.data;
 
-		return 1;
+		for( size_t xy = 0; xy < size; ++xy ){
+			m->cell[xy].walkable = ( flags[xy] & MAP_CACHE_CELL_WALKABLE ) != 0;
+			m->cell[xy].shootable = ( flags[xy] & MAP_CACHE_CELL_SHOOTABLE ) != 0;
+			m->cell[xy].water = ( flags[xy] & MAP_CACHE_CELL_WATER ) != 0;
+		}
+		return;
 	}
 
-	return 0; // Not found
+	unsigned long len = (unsigned long)size;
+
+	// TO-DO: Maybe handle the scenario, if the decoded buffer isn't the same size as expected? [Shinryo]
+	decode_zip(decode_buffer, &len, cells.data, (unsigned long)cells.len);
+
+	for( size_t xy = 0; xy < size; ++xy )
+		m->cell[xy] = map_gat2cell(decode_buffer[xy]);
 }
 
 int32 map_addmap(char* mapname)
@@ -3834,7 +4038,7 @@ void map_data_copyall (void) {
  * Assumed path for file is data/mapname.rsw
  * Credits to LittleWolf
  */
-int32 map_waterheight(char* mapname)
+int32 map_waterheight(const char* mapname)
 {
 	char fn[256];
  	char *found;
@@ -3849,47 +4053,58 @@ int32 map_waterheight(char* mapname)
 	return grfio_read_rsw_water_level( fn );
 }
 
+/// Cells of a map read from the GRF files, before they are handed to the map
+struct s_map_grf_cells {
+	bool success;
+	int16 xs, ys;
+	std::vector<mapcell> cells;
+};
+
 /*==================================
  * .GAT format
+ * Does not use the memory manager, so the maps can be read by several threads.
  *----------------------------------*/
-int32 map_readgat (struct map_data* m)
+static bool map_readgat(const char* mapname, s_map_grf_cells& result)
 {
 	char filename[256];
-	uint8* gat;
+	std::vector<uint8> gat;
 	int32 water_height;
 	size_t xy, off, num_cells;
 
-	sprintf(filename, "data\\%s.gat", m->name);
+	sprintf(filename, "data\\%s.gat", mapname);
 
-	gat = (uint8 *) grfio_reads(filename);
-	if (gat == nullptr)
-		return 0;
+	if (!grfio_read(filename, gat) || gat.size() < 14)
+		return false;
+
+	result.xs = *(int32*)(gat.data()+6);
+	result.ys = *(int32*)(gat.data()+10);
+	num_cells = result.xs * result.ys;
+
+	if (gat.size() < 14 + num_cells * 20) {
+		ShowError("map_readgat: Truncated gat file %s\n", filename);
+		return false;
+	}
 
-	m->xs = *(int32*)(gat+6);
-	m->ys = *(int32*)(gat+10);
-	num_cells = m->xs * m->ys;
-	CREATE(m->cell, struct mapcell, num_cells);
+	result.cells.resize(num_cells);
 
-	water_height = map_waterheight(m->name);
+	water_height = map_waterheight(mapname);
 
 	// Set cell properties
 	off = 14;
 	for( xy = 0; xy < num_cells; ++xy )
 	{
 		// read cell data
-		float height = *(float*)( gat + off      );
-		uint32 type = *(uint32*)( gat + off + 16 );
+		float height = *(float*)( gat.data() + off      );
+		uint32 type = *(uint32*)( gat.data() + off + 16 );
 		off += 20;
 
 		if( type == 0 && water_height != RSW_NO_WATER && height > water_height )
 			type = 3; // Cell is 0 (walkable) but under water level, set to 3 (walkable water)
 
-		m->cell[xy] = map_gat2cell(type);
+		result.cells[xy] = map_gat2cell(type);
 	}
 
-	aFree(gat);
-
-	return 1;
+	return true;
 }
 
 /*======================================
@@ -3911,8 +4126,8 @@ void map_removemapdb(struct map_data *m)
 int32 map_readallmaps (void)
 {
 	FILE* fp;
-	// Has the uncompressed gat data of all maps, so just one allocation has to be made
-	std::vector<char *> map_cache_buffer = {};
+	// Has the gat data of all maps, so just one allocation has to be made
+	std::vector<s_map_cache> map_cache_buffer = {};
 
 	if( enable_grf )
 		ShowStatus("Loading maps (using GRF files)...\n");
@@ -3933,27 +4148,60 @@ int32 map_readallmaps (void)
 			}
 
 			// Init mapcache data. [Shinryo]
-			map_cache_buffer.push_back(map_init_mapcache(fp));
+			s_map_cache cache;
 
-			if( !map_cache_buffer.back() ) {
+			if( !map_init_mapcache(fp, cache) ) {
 				ShowFatalError( "Failed to initialize mapcache data (%s)..\n", mapdat.c_str());
 				exit(EXIT_FAILURE);
 			}
 
+			map_cache_buffer.push_back(cache);
+
 			fclose(fp);
 		}
 	}
 
 	int32 maps_removed = 0;
+	// Cells to decode for every map kept in the list, in the same order
+	std::vector<s_map_cache_cells> map_cells;
+	// Cells read from the GRF files for every map in the list, before any map was removed
+	std::vector<s_map_grf_cells> map_grf_cells;
+	std::unordered_set<uint16> map_indexes;
+	int32 workers = 0;
+	auto phase_start = std::chrono::steady_clock::now();
 
 	ShowStatus("Loading %d maps.\n", map_num);
 
+	// Read phase: with GRF files the .gat and .rsw files of the maps are read and decoded in parallel
+	if( enable_grf && map_num > 0 ) {
+		std::atomic<int32> next_map(0);
+		auto read = [&next_map, &map_grf_cells]() {
+			for (int32 i = next_map++; i < map_num; i = next_map++)
+				map_grf_cells[i].success = map_readgat(map[i].name, map_grf_cells[i]);
+		};
+
+		map_grf_cells.resize(map_num);
+		workers = map_load_workers > 0 ? map_load_workers : (int32)std::thread::hardware_concurrency();
+		workers = cap_value(workers, 1, map_num);
+
+		std::vector<std::thread> threads;
+
+		for (int32 i = 1; i < workers; i++)
+			threads.emplace_back(read);
+		read();
+		for (auto &thread : threads)
+			thread.join();
+	}
+
+	auto phase_read = std::chrono::steady_clock::now();
+
+	// Lookup phase: find each map and allocate its memory, since the memory manager is not thread safe
 	for (int32 i = 0; i < map_num; i++) {
 		size_t size;
 		bool success = false;
 		uint16 idx = 0;
 		struct map_data *mapdata = &map[i];
-		char map_cache_decode_buffer[MAX_MAP_SIZE];
+		s_map_cache_cells cells = {};
 
 #ifdef DETAILED_LOADING_OUTPUT
 		// show progress
@@ -3961,27 +4209,38 @@ int32 map_readallmaps (void)
 #endif
 
 		if( enable_grf ){
-			// try to load the map
-			success = map_readgat(mapdata) != 0;
+			// Every removed map shifted the list, so this map was read at i + maps_removed
+			s_map_grf_cells& grf = map_grf_cells[i + maps_removed];
+
+			success = grf.success;
+			if (success) {
+				mapdata->xs = grf.xs;
+				mapdata->ys = grf.ys;
+				CREATE(mapdata->cell, struct mapcell, grf.cells.size());
+				memcpy(mapdata->cell, grf.cells.data(), grf.cells.size() * sizeof(struct mapcell));
+				std::vector<mapcell>().swap(grf.cells);
+			}
 		}else{
 			// try to load the map
-			for (const auto &cache : map_cache_buffer) {
-				if ((success = map_readfromcache(mapdata, cache, map_cache_decode_buffer)) != 0)
+			for (auto &cache : map_cache_buffer) {
+				if ((success = map_findincache(mapdata, cache, cells)) != 0)
 					break;
 			}
 		}
 
 		// The map was not found - remove it
 		if (!(idx = mapindex_name2id(mapdata->name)) || !success) {
+			if (mapdata->cell) {
+				aFree(mapdata->cell);
+				mapdata->cell = nullptr;
+			}
 			map_delmapid(i);
 			maps_removed++;
 			i--;
 			continue;
 		}
 
-		mapdata->index = idx;
-
-		if (uidb_get(map_db,(uint32)mapdata->index) != nullptr) {
+		if (!map_indexes.insert(idx).second || uidb_get(map_db,(uint32)idx) != nullptr) {
 			ShowWarning("Map %s already loaded!" CL_CLL "\n", mapdata->name);
 			if (mapdata->cell) {
 				aFree(mapdata->cell);
@@ -3993,11 +4252,10 @@ int32 map_readallmaps (void)
 			continue;
 		}
 
-		map_addmap2db(mapdata);
+		mapdata->index = idx;
 
-		mapdata->m = i;
-		memset(mapdata->moblist, 0, sizeof(mapdata->moblist));	//Initialize moblist [Skotlex]
-		mapdata->mob_delete_timer = INVALID_TIMER;	//Initialize timer [Skotlex]
+		if (!enable_grf)
+			CREATE(mapdata->cell, struct mapcell, (size_t)mapdata->xs * (size_t)mapdata->ys);
 
 		mapdata->bxs = (mapdata->xs + BLOCK_SIZE - 1) / BLOCK_SIZE;
 		mapdata->bys = (mapdata->ys + BLOCK_SIZE - 1) / BLOCK_SIZE;
@@ -4005,6 +4263,47 @@ int32 map_readallmaps (void)
 		size = mapdata->bxs * mapdata->bys * sizeof(block_list*);
 		mapdata->block = (block_list**)aCalloc(size, 1);
 		mapdata->block_mob = (block_list**)aCalloc(size, 1);
+		mapdata->block_pc = (block_list**)aCalloc(size, 1);
+		mapdata->block_skill = (block_list**)aCalloc(size, 1);
+
+		map_cells.push_back(cells);
+	}
+
+	auto phase_lookup = std::chrono::steady_clock::now();
+
+	// Decode phase: the cells of the maps are decoded in parallel
+	if( !enable_grf && map_num > 0 ) {
+		std::atomic<int32> next_map(0);
+		auto decode = [&next_map, &map_cells]() {
+			std::vector<char> decode_buffer(MAX_MAP_SIZE);
+
+			for (int32 i = next_map++; i < map_num; i = next_map++)
+				map_decodecache(&map[i], map_cells[i], decode_buffer.data());
+		};
+
+		workers = map_load_workers > 0 ? map_load_workers : (int32)std::thread::hardware_concurrency();
+		workers = cap_value(workers, 1, map_num);
+
+		std::vector<std::thread> threads;
+
+		for (int32 i = 1; i < workers; i++)
+			threads.emplace_back(decode);
+		decode();
+		for (auto &thread : threads)
+			thread.join();
+	}
+
+	auto phase_decode = std::chrono::steady_clock::now();
+
+	// Commit phase: register the maps
+	for (int32 i = 0; i < map_num; i++) {
+		struct map_data *mapdata = &map[i];
+
+		map_addmap2db(mapdata);
+
+		mapdata->m = i;
+		memset(mapdata->moblist, 0, sizeof(mapdata->moblist));	//Initialize moblist [Skotlex]
+		mapdata->mob_delete_timer = INVALID_TIMER;	//Initialize timer [Skotlex]
 
 		memset(&mapdata->save, 0, sizeof(struct point));
 		mapdata->damage_adjust = {};
@@ -4014,14 +4313,13 @@ int32 map_readallmaps (void)
 	// intialization and configuration-dependent adjustments of mapflags
 	map_flags_init();
 
+	auto phase_commit = std::chrono::steady_clock::now();
+
 	if( !enable_grf ) {
 		// The cache isn't needed anymore, so free it. [Shinryo]
-		auto it = map_cache_buffer.begin();
-
-		while (it != map_cache_buffer.end()) {
-			aFree(*it);
-			it = map_cache_buffer.erase(it);
-		}
+		for (auto &cache : map_cache_buffer)
+			map_final_mapcache(cache);
+		map_cache_buffer.clear();
 	}
 
 	if (maps_removed)
@@ -4029,6 +4327,11 @@ int32 map_readallmaps (void)
 
 	// finished map loading
 	ShowInfo("Successfully loaded '" CL_WHITE "%d" CL_RESET "' maps." CL_CLL "\n",map_num);
+	ShowInfo("Map loading took %" PRId64 "ms (lookup: %" PRId64 "ms, decode: %" PRId64 "ms on %d threads, commit: %" PRId64 "ms).\n",
+		(int64)std::chrono::duration_cast<std::chrono::milliseconds>(phase_commit - phase_start).count(),
+		(int64)std::chrono::duration_cast<std::chrono::milliseconds>(phase_lookup - phase_read).count(),
+		(int64)std::chrono::duration_cast<std::chrono::milliseconds>((phase_read - phase_start) + (phase_decode - phase_lookup)).count(), workers,
+		(int64)std::chrono::duration_cast<std::chrono::milliseconds>(phase_commit - phase_decode).count());
 
 	return 0;
 }
@@ -4097,12 +4400,61 @@ int32 parse_console(const char* buf){
 	else if( strcmpi("ers_report", type) == 0 ){
 		ers_report();
 	}
+	else if( strcmpi("timer_stats", type) == 0 ){
+		if( n < 2 || strcmpi("show", command) == 0 )
+			timer_stats_report();
+		else if( strcmpi("on", command) == 0 ){
+			timer_stats_enable(true);
+			ShowInfo("Timer statistics enabled.\n");
+		}else if( strcmpi("off", command) == 0 ){
+			timer_stats_enable(false);
+			ShowInfo("Timer statistics disabled.\n");
+		}else if( strcmpi("reset", command) == 0 )
+			timer_stats_reset();
+		else if( strcmpi("export", command) == 0 ){
+			if( timer_stats_export(timer_stats_file) )
+				ShowInfo("Timer statistics exported to '%s'.\n", timer_stats_file);
+		}else
+			ShowInfo("Console: Invalid timer_stats command.\n");
+	}
+	else if( strcmpi("script_profile", type) == 0 ){
+		if( n < 2 || strcmpi("show", command) == 0 )
+			script_profile_report();
+		else if( strcmpi("exact", command) == 0 ){
+			script_profile_enable(SCRIPT_PROFILE_EXACT);
+			ShowInfo("Script profiler enabled, measuring every script.\n");
+		}else if( strcmpi("sample", command) == 0 ){
+			script_profile_enable(SCRIPT_PROFILE_SAMPLE);
+			ShowInfo("Script profiler enabled, measuring 1 of %d scripts.\n", script_config.script_profile_sample_rate);
+		}else if( strcmpi("off", command) == 0 ){
+			script_profile_enable(SCRIPT_PROFILE_OFF);
+			ShowInfo("Script profiler disabled.\n");
+		}else if( strcmpi("reset", command) == 0 )
+			script_profile_reset();
+		else if( strcmpi("export", command) == 0 ){
+			if( script_profile_export(script_config.script_profile_file) )
+				ShowInfo("Script profile exported to '%s'.\n", script_config.script_profile_file);
+		}else
+			ShowInfo("Console: Invalid script_profile command.\n");
+	}
+	else if( strcmpi("sql_stats", type) == 0 ){
+		if( qsmysql_async == nullptr && mapregmysql_async == nullptr && logmysql_async == nullptr )
+			ShowInfo("No asynchronous SQL queue is running.\n");
+		Sql_AsyncReport(qsmysql_async);
+		Sql_AsyncReport(mapregmysql_async);
+		Sql_AsyncReport(logmysql_async);
+		if( log_config.sql_logs )
+			log_report();
+	}
 	else if( strcmpi("help", type) == 0 ) {
 		ShowInfo("Available commands:\n");
 		ShowInfo("\t admin:@<atcommand> => Uses an atcommand. Do NOT use commands requiring an attached player.\n");
 		ShowInfo("\t admin:map:<map> <x> <y> => Changes the map from which console commands are executed.\n");
 		ShowInfo("\t server:shutdown => Stops the server.\n");
 		ShowInfo("\t ers_report => Displays database usage.\n");
+		ShowInfo("\t timer_stats[:show|on|off|reset|export] => Displays or controls the timer callback statistics.\n");
+		ShowInfo("\t script_profile[:show|exact|sample|off|reset|export] => Displays or controls the script profiler.\n");
+		ShowInfo("\t sql_stats => Displays the asynchronous SQL queue and log buffer statistics.\n");
 	}
 
 	return 0;
@@ -4199,10 +4551,26 @@ int32 map_config_read(const char *cfgName)
 			enable_spy = config_switch(w2);
 		else if (strcmpi(w1, "use_grf") == 0)
 			enable_grf = config_switch(w2);
+		else if (strcmpi(w1, "map_load_workers") == 0)
+			map_load_workers = cap_value(atoi(w2), 0, 64);
+		else if (strcmpi(w1, "map_zone_workers") == 0)
+			map_zone_workers = cap_value(atoi(w2), 0, 64);
+		else if (strcmpi(w1, "visibility_sets") == 0)
+			visibility_sets = config_switch(w2);
+		else if (strcmpi(w1, "yaml_load_workers") == 0)
+			yaml_load_workers = cap_value(atoi(w2), 0, 64);
+		else if (strcmpi(w1, "yaml_snapshot") == 0)
+			yaml_snapshot = config_switch(w2);
+		else if (strcmpi(w1, "yaml_snapshot_path") == 0)
+			safestrncpy(yaml_snapshot_path, w2, sizeof(yaml_snapshot_path));
 		else if (strcmpi(w1, "console_msg_log") == 0)
 			console_msg_log = atoi(w2);//[Ind]
 		else if (strcmpi(w1, "console_log_filepath") == 0)
 			safestrncpy(console_log_filepath, w2, sizeof(console_log_filepath));
+		else if (strcmpi(w1, "timer_stats_file") == 0)
+			safestrncpy(timer_stats_file, w2, sizeof(timer_stats_file));
+		else if (strcmpi(w1, "timer_stats_interval") == 0)
+			timer_stats_interval = max(0, atoi(w2));
 		else if (strcmpi(w1, "import") == 0)
 			map_config_read(w2);
 		else
@@ -4345,6 +4713,9 @@ int32 inter_config_read(const char *cfgName)
 		if(strcmpi(w1,"map_server_db")==0)
 			map_server_db = w2;
 		else
+		if(strcmpi(w1,"query_sql_workers")==0)
+			query_sql_workers = cap_value(atoi(w2), 0, 8);
+		else
 		if(strcmpi(w1,"default_codepage")==0)
 			default_codepage = w2;
 		else
@@ -4367,6 +4738,9 @@ int32 inter_config_read(const char *cfgName)
 		if(strcmpi(w1,"log_db_db")==0)
 			log_db_db = w2;
 		else
+		if(strcmpi(w1,"log_db_workers")==0)
+			log_db_workers = cap_value(atoi(w2), 0, 8);
+		else
 		if(strcmpi(w1,"start_status_points")==0)
 			inter_config.start_status_points=atoi(w2);
 		else
@@ -4419,12 +4793,29 @@ int32 map_sql_init(void)
 		if ( SQL_ERROR == Sql_SetEncoding(qsmysql_handle, default_codepage.c_str()) )
 			Sql_ShowDebug(qsmysql_handle);
 	}
+
+	// a single worker, so the saves of a variable are written in order
+	mapregmysql_async = Sql_AsyncCreate("mapreg", map_server_id.c_str(), map_server_pw.c_str(), map_server_ip.c_str(), map_server_port, map_server_db.c_str(), default_codepage.c_str(), 1);
+	if( mapregmysql_async == nullptr ){
+		ShowError("Couldn't connect the mapreg worker, mapregs will be saved synchronously.\n");
+	}
+
+	if( query_sql_workers > 0 ){
+		qsmysql_async = Sql_AsyncCreate("query_sql", map_server_id.c_str(), map_server_pw.c_str(), map_server_ip.c_str(), map_server_port, map_server_db.c_str(), default_codepage.c_str(), query_sql_workers);
+		if( qsmysql_async == nullptr ){
+			ShowError("Couldn't connect the query_sql workers, query_sql_async will block.\n");
+		}
+	}
 	return 0;
 }
 
 int32 map_sql_close(void)
 {
 	ShowStatus("Close Map DB Connection....\n");
+	Sql_AsyncFree(qsmysql_async);
+	qsmysql_async = nullptr;
+	Sql_AsyncFree(mapregmysql_async);
+	mapregmysql_async = nullptr;
 	Sql_Free(mmysql_handle);
 	Sql_Free(qsmysql_handle);
 	mmysql_handle = nullptr;
@@ -4433,6 +4824,8 @@ int32 map_sql_close(void)
 	if (log_config.sql_logs)
 	{
 		ShowStatus("Close Log DB Connection....\n");
+		Sql_AsyncFree(logmysql_async);
+		logmysql_async = nullptr;
 		Sql_Free(logmysql_handle);
 		logmysql_handle = nullptr;
 	}
@@ -4459,6 +4852,14 @@ int32 log_sql_init(void)
 		if ( SQL_ERROR == Sql_SetEncoding(logmysql_handle, default_codepage.c_str()) )
 			Sql_ShowDebug(logmysql_handle);
 
+	// the logs are written by the workers, the handle above is kept for escaping and synchronous fallback
+	if( log_db_workers > 0 ){
+		logmysql_async = Sql_AsyncCreate("log", log_db_id.c_str(), log_db_pw.c_str(), log_db_ip.c_str(), log_db_port, log_db_db.c_str(), default_codepage.c_str(), log_db_workers);
+		if( logmysql_async == nullptr ){
+			ShowError("Couldn't connect the log database workers, logs will be written synchronously.\n");
+		}
+	}
+
 	return 0;
 }
 
@@ -5072,6 +5473,7 @@ void MapServer::finalize(){
 	do_final_vending();
 	do_final_buyingstore();
 	do_final_path();
+	map_zone_final();
 
 	map_db->destroy(map_db, map_db_final);
 
@@ -5081,6 +5483,8 @@ void MapServer::finalize(){
 		if(mapdata->cell) aFree(mapdata->cell);
 		if(mapdata->block) aFree(mapdata->block);
 		if(mapdata->block_mob) aFree(mapdata->block_mob);
+		if(mapdata->block_pc) aFree(mapdata->block_pc);
+		if(mapdata->block_skill) aFree(mapdata->block_skill);
 		if(battle_config.dynamic_mobs) { //Dynamic mobs flag by [random]
 			if(mapdata->mob_delete_timer != INVALID_TIMER)
 				delete_timer(mapdata->mob_delete_timer, map_removemobs_timer);
@@ -5103,6 +5507,7 @@ void MapServer::finalize(){
 	iwall_db->destroy(iwall_db, nullptr);
 	regen_db->destroy(regen_db, nullptr);
 
+	do_final_log();
 	map_sql_close();
 
 	ShowStatus("Finished.\n");
@@ -5390,19 +5795,26 @@ bool MapServer::initialize( int32 argc, char *argv[] ){
 	inter_config_read(INTER_CONF_NAME);
 	log_config_read(LOG_CONF_NAME);
 
-	id_db = idb_alloc(DB_OPT_BASE);
-	pc_db = idb_alloc(DB_OPT_BASE);	//Added for reliable map_id2sd() use. [Skotlex]
-	mobid_db = idb_alloc(DB_OPT_BASE);	//Added to lower the load of the lazy mob ai. [Skotlex]
+	// Parse the YAML databases in the background while the maps are loaded
+	auto db_start = std::chrono::steady_clock::now();
+	if (yaml_snapshot)
+		database_snapshot_start(yaml_snapshot_path);
+	database_preload_start(yaml_load_workers);
+
+	id_db = idb_alloc(DB_OPT_OPEN_HASH);
+	pc_db = idb_alloc(DB_OPT_OPEN_HASH);	//Added for reliable map_id2sd() use. [Skotlex]
+	mobid_db = idb_alloc(DB_OPT_OPEN_HASH);	//Added to lower the load of the lazy mob ai. [Skotlex]
 	bossid_db = idb_alloc(DB_OPT_BASE); // Used for Convex Mirror quick MVP search
 	map_db = uidb_alloc(DB_OPT_BASE);
 	nick_db = idb_alloc(DB_OPT_BASE);
-	charid_db = uidb_alloc(DB_OPT_BASE);
+	charid_db = uidb_alloc(DB_OPT_OPEN_HASH);
 	regen_db = idb_alloc(DB_OPT_BASE); // efficient status_natural_heal processing
 	iwall_db = strdb_alloc(DB_OPT_RELEASE_DATA,2*NAME_LENGTH+2+1); // [Zephyrus] Invisible Walls
 
 	map_sql_init();
 	if (log_config.sql_logs)
 		log_sql_init();
+	do_init_log();
 
 	mapindex_init();
 	if(enable_grf)
@@ -5412,6 +5824,12 @@ bool MapServer::initialize( int32 argc, char *argv[] ){
 
 	add_timer_func_list(map_clearflooritem_timer, "map_clearflooritem_timer");
 	add_timer_func_list(map_removemobs_timer, "map_removemobs_timer");
+	add_timer_func_list(map_timer_stats_timer, "map_timer_stats_timer");
+
+	if( timer_stats_interval > 0 ){ // collect timer statistics from the start
+		timer_stats_enable(true);
+		add_timer_interval(gettick() + timer_stats_interval * 1000, map_timer_stats_timer, 0, 0, timer_stats_interval * 1000);
+	}
 	
 	map_do_init_msg();
 	do_init_path();
@@ -5447,6 +5865,10 @@ bool MapServer::initialize( int32 argc, char *argv[] ){
 	do_init_vending();
 	do_init_buyingstore();
 
+	database_preload_final();
+	database_snapshot_final();
+	ShowInfo("Maps and databases loaded in %" PRId64 "ms.\n", (int64)std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - db_start).count());
+
 	npc_event_do_oninit();	// Init npcs (OnInit)
 
 	if (battle_config.pk_mode)
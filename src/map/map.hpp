@@ -6,6 +6,7 @@
 
 #include <algorithm>
 #include <cstdarg>
+#include <functional>
 #include <string>
 #include <type_traits>
 #include <unordered_map>
@@ -308,6 +309,9 @@ enum bl_type : uint16{
 /// For common mapforeach calls. Since pets cannot be affected, they aren't included here yet.
 #define BL_CHAR (BL_PC|BL_MOB|BL_HOM|BL_MER|BL_ELEM)
 
+/// Objects kept in the visibility sets of players, floor items and skill units are always looked up by area
+#define BL_VISIBLE (BL_ALL&~(BL_ITEM|BL_SKILL))
+
 /// NPC Subtype
 enum npc_subtype : uint8{
 	NPCTYPE_WARP, /// Warp
@@ -820,8 +824,10 @@ struct map_data {
 	char name[MAP_NAME_LENGTH];
 	uint16 index; // The map index used by the mapindex* functions.
 	struct mapcell* cell; // Holds the information of each map cell (nullptr if the map is not on this map-server).
-	block_list **block;
+	block_list **block; // Objects without a chain of their own
 	block_list **block_mob;
+	block_list **block_pc;
+	block_list **block_skill;
 	int16 m;
 	int16 xs,ys; // map dimensions (in cells)
 	int16 bxs,bys; // map dimensions (in blocks)
@@ -917,6 +923,15 @@ extern int32 minsave_interval;
 extern int16 save_settings;
 extern int32 night_flag; // 0=day, 1=night [Yor]
 extern int32 enable_spy; //Determines if @spy commands are active.
+extern int32 map_zone_workers;
+extern int32 visibility_sets;
+
+/// Zone of a map for map_zone_run, every zone is a disjoint set of maps
+inline int32 map_getzone(int16 m) {
+	return map_zone_workers > 0 ? m % map_zone_workers : 0;
+}
+void map_zone_run(const std::function<void(int32 zone)>& task);
+void map_zone_final();
 
 // Agit Flags
 extern bool agit_flag;
@@ -1145,6 +1160,8 @@ int32 map_freeblock_unlock(void);
 int32 map_addblock(block_list* bl);
 int32 map_delblock(block_list* bl);
 int32 map_moveblock(block_list *, int32, int32, t_tick);
+size_t map_getblocksinrange(std::vector<block_list*>& out, const block_list* center, int16 range, int32 type, bool wall_check);
+size_t map_getblocksinarea(std::vector<block_list*>& out, int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 type, bool wall_check);
 int32 map_foreachinrange(int32 (*func)(block_list*,va_list), const block_list* center, int16 range, int32 type, ...);
 int32 map_foreachinallrange(int32 (*func)(block_list*,va_list), const block_list* center, int16 range, int32 type, ...);
 int32 map_foreachinshootrange(int32 (*func)(block_list*,va_list), const block_list* center, int16 range, int32 type, ...);
@@ -1158,6 +1175,70 @@ int32 map_foreachincell(int32 (*func)(block_list*,va_list), int16 m, int16 x, in
 int32 map_foreachinpath(int32 (*func)(block_list*,va_list), int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int16 range, int32 length, int32 type, ...);
 int32 map_foreachindir(int32 (*func)(block_list*,va_list), int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int16 range, int32 length, int32 offset, int32 type, ...);
 int32 map_foreachinmap(int32 (*func)(block_list*,va_list), int16 m, int32 type, ...);
+std::vector<block_list*>& map_getblockbuffer();
+
+/**
+ * Calls func for every object that was appended to the scratch buffer behind blockcount
+ * and shrinks the buffer back to blockcount afterwards.
+ * @param blocks: Scratch buffer of the current thread
+ * @param blockcount: Size of the buffer before the objects were collected
+ * @param func: Callable with signature int32(block_list*)
+ * @return Sum of the values returned by func
+ */
+template <typename F>
+int32 map_foreachblock(std::vector<block_list*>& blocks, size_t blockcount, F&& func) {
+	int32 returnCount = 0;
+	FreeBlockLock freeLock;
+
+	for (size_t i = blockcount; i < blocks.size(); i++) {
+		if (blocks[i]->prev) // func() may delete this slot, checking for prev ensures it wasn't queued for deletion.
+			returnCount += func(blocks[i]);
+	}
+
+	blocks.resize(blockcount);
+	return returnCount;
+}
+
+/// Typed counterpart of the va_list based map_foreachinallrange, func is called as int32 func(block_list* bl)
+template <typename F>
+int32 map_foreachinallrange(const block_list* center, int16 range, int32 type, F&& func) {
+	std::vector<block_list*>& blocks = map_getblockbuffer();
+	size_t blockcount = blocks.size();
+
+	map_getblocksinrange(blocks, center, range, type, false);
+	return map_foreachblock(blocks, blockcount, std::forward<F>(func));
+}
+
+/// Typed counterpart of the va_list based map_foreachinshootrange, func is called as int32 func(block_list* bl)
+template <typename F>
+int32 map_foreachinshootrange(const block_list* center, int16 range, int32 type, F&& func) {
+	std::vector<block_list*>& blocks = map_getblockbuffer();
+	size_t blockcount = blocks.size();
+
+	map_getblocksinrange(blocks, center, range, type, true);
+	return map_foreachblock(blocks, blockcount, std::forward<F>(func));
+}
+
+/// Typed counterpart of the va_list based map_foreachinallarea, func is called as int32 func(block_list* bl)
+template <typename F>
+int32 map_foreachinallarea(int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 type, F&& func) {
+	std::vector<block_list*>& blocks = map_getblockbuffer();
+	size_t blockcount = blocks.size();
+
+	map_getblocksinarea(blocks, m, x0, y0, x1, y1, type, false);
+	return map_foreachblock(blocks, blockcount, std::forward<F>(func));
+}
+
+/// Typed counterpart of the va_list based map_foreachinshootarea, func is called as int32 func(block_list* bl)
+template <typename F>
+int32 map_foreachinshootarea(int16 m, int16 x0, int16 y0, int16 x1, int16 y1, int32 type, F&& func) {
+	std::vector<block_list*>& blocks = map_getblockbuffer();
+	size_t blockcount = blocks.size();
+
+	map_getblocksinarea(blocks, m, x0, y0, x1, y1, type, true);
+	return map_foreachblock(blocks, blockcount, std::forward<F>(func));
+}
+
 //blocklist nb in one cell
 int32 map_count_oncell(int16 m,int16 x,int16 y,int32 type,int32 flag);
 skill_unit *map_find_skill_unit_oncell(block_list *,int16 x,int16 y,uint16 skill_id,skill_unit *, int32 flag);
@@ -1320,7 +1401,10 @@ extern int32 db_use_sqldbs;
 
 extern Sql* mmysql_handle;
 extern Sql* qsmysql_handle;
+extern SqlAsync* qsmysql_async;
+extern SqlAsync* mapregmysql_async;
 extern Sql* logmysql_handle;
+extern SqlAsync* logmysql_async;
 #endif
 
 extern char barter_table[32];
@@ -3,7 +3,10 @@
 
 #include "mapreg.hpp"
 
+#include <algorithm>
 #include <cstdlib>
+#include <unordered_set>
+#include <vector>
 
 #include <common/cbasetypes.hpp>
 #include <common/db.hpp>
@@ -13,8 +16,9 @@
 #include <common/sql.hpp>
 #include <common/strlib.hpp>
 #include <common/timer.hpp>
+#include <common/utils.hpp>
 
-#include "map.hpp" // mmysql_handle
+#include "map.hpp" // mmysql_handle, mapregmysql_async
 #include "script.hpp"
 
 static struct eri *mapreg_ers;
@@ -22,10 +26,36 @@ static struct eri *mapreg_ers;
 bool skip_insert = false;
 
 static char mapreg_table[32] = "mapreg";
-static bool mapreg_dirty = false; // Whether there are modified regs to be saved
+static std::unordered_set<int64> mapreg_dirty; // uids of the permanent regs that were modified since the last save
+static int32 mapreg_save_interval = 60; // seconds between the autosaves
+static int32 mapreg_flush_timer = INVALID_TIMER; // pending save of created or deleted variables
 struct reg_db regs;
 
-#define MAPREG_AUTOSAVE_INTERVAL (300*1000)
+/// Maximum number of rows written by a single statement
+#define MAPREG_SAVE_BATCH 500
+
+
+static TIMER_FUNC(script_flush_mapreg);
+
+/**
+ * Marks a permanent variable as modified, so the next save writes or deletes it.
+ * Variables that were created or deleted are saved right after the current script run,
+ * the changed values of existing ones wait for the autosave.
+ *
+ * @param uid: variable's unique identifier
+ * @param name: variable's name
+ * @param flush: whether the variable was created or deleted
+ */
+static void mapreg_mark_dirty(int64 uid, const char* name, bool flush)
+{
+	if (name[1] == '@' || skip_insert)
+		return;
+
+	mapreg_dirty.insert(uid);
+
+	if (flush && mapreg_flush_timer == INVALID_TIMER)
+		mapreg_flush_timer = add_timer(gettick(), script_flush_mapreg, 0, 0);
+}
 
 
 /**
@@ -65,15 +95,13 @@ bool mapreg_setreg(int64 uid, int64 val)
 	int32 num = script_getvarid(uid);
 	uint32 i = script_getvaridx(uid);
 	const char* name = get_str(num);
+	bool flush = false;
 
 	if (val != 0) {
 		if ((m = static_cast<mapreg_save *>(i64db_get(regs.vars, uid)))) {
 			m->u.i = val;
-			if (name[1] != '@') {
-				m->save = true;
-				mapreg_dirty = true;
-			}
 		} else {
+			flush = true;
 			if (i)
 				script_array_update(&regs, uid, false);
 
@@ -81,15 +109,8 @@ bool mapreg_setreg(int64 uid, int64 val)
 
 			m->u.i = val;
 			m->uid = uid;
-			m->save = false;
 			m->is_string = false;
 
-			if (name[1] != '@' && !skip_insert) {// write new variable to database
-				char esc_name[32 * 2 + 1];
-				Sql_EscapeStringLen(mmysql_handle, esc_name, name, strnlen(name, 32));
-				if (SQL_ERROR == Sql_Query(mmysql_handle, "INSERT INTO `%s`(`varname`,`index`,`value`) VALUES ('%s','%" PRIu32 "','%" PRId64 "')", mapreg_table, esc_name, i, val))
-					Sql_ShowDebug(mmysql_handle);
-			}
 			i64db_put(regs.vars, uid, m);
 		}
 	} else { // val == 0
@@ -97,17 +118,14 @@ bool mapreg_setreg(int64 uid, int64 val)
 			script_array_update(&regs, uid, true);
 		if ((m = static_cast<mapreg_save *>(i64db_get(regs.vars, uid)))) {
 			ers_free(mapreg_ers, m);
+			flush = true;
 		}
 		i64db_remove(regs.vars, uid);
-
-		if (name[1] != '@') {// Remove from database because it is unused.
-			char esc_name[32 * 2 + 1];
-			Sql_EscapeStringLen(mmysql_handle, esc_name, name, strnlen(name, 32));
-			if (SQL_ERROR == Sql_Query(mmysql_handle, "DELETE FROM `%s` WHERE `varname`='%s' AND `index`='%" PRIu32 "'", mapreg_table, esc_name, i))
-				Sql_ShowDebug(mmysql_handle);
-		}
 	}
 
+	// written or removed from the database by the next save
+	mapreg_mark_dirty(uid, name, flush);
+
 	return true;
 }
 
@@ -124,20 +142,16 @@ bool mapreg_setregstr(int64 uid, const char* str)
 	int32 num = script_getvarid(uid);
 	uint32 i = script_getvaridx(uid);
 	const char* name = get_str(num);
+	bool flush = false;
 
 	if (str == nullptr || *str == 0) {
 		if (i)
 			script_array_update(&regs, uid, true);
-		if (name[1] != '@') {
-			char esc_name[32 * 2 + 1];
-			Sql_EscapeStringLen(mmysql_handle, esc_name, name, strnlen(name, 32));
-			if (SQL_ERROR == Sql_Query(mmysql_handle, "DELETE FROM `%s` WHERE `varname`='%s' AND `index`='%" PRIu32 "'", mapreg_table, esc_name, i))
-				Sql_ShowDebug(mmysql_handle);
-		}
 		if ((m = static_cast<mapreg_save *>(i64db_get(regs.vars, uid)))) {
 			if (m->u.str != nullptr)
 				aFree(m->u.str);
 			ers_free(mapreg_ers, m);
+			flush = true;
 		}
 		i64db_remove(regs.vars, uid);
 	} else {
@@ -145,11 +159,8 @@ bool mapreg_setregstr(int64 uid, const char* str)
 			if (m->u.str != nullptr)
 				aFree(m->u.str);
 			m->u.str = aStrdup(str);
-			if (name[1] != '@') {
-				mapreg_dirty = true;
-				m->save = true;
-			}
 		} else {
+			flush = true;
 			if (i)
 				script_array_update(&regs, uid, false);
 
@@ -157,21 +168,15 @@ bool mapreg_setregstr(int64 uid, const char* str)
 
 			m->uid = uid;
 			m->u.str = aStrdup(str);
-			m->save = false;
 			m->is_string = true;
 
-			if (name[1] != '@' && !skip_insert) { //put returned null, so we must insert.
-				char esc_name[32 * 2 + 1];
-				char esc_str[255 * 2 + 1];
-				Sql_EscapeStringLen(mmysql_handle, esc_name, name, strnlen(name, 32));
-				Sql_EscapeStringLen(mmysql_handle, esc_str, str, strnlen(str, 255));
-				if (SQL_ERROR == Sql_Query(mmysql_handle, "INSERT INTO `%s`(`varname`,`index`,`value`) VALUES ('%s','%" PRIu32 "','%s')", mapreg_table, esc_name, i, esc_str))
-					Sql_ShowDebug(mmysql_handle);
-			}
 			i64db_put(regs.vars, uid, m);
 		}
 	}
 
+	// written or removed from the database by the next save
+	mapreg_mark_dirty(uid, name, flush);
+
 	return true;
 }
 
@@ -221,40 +226,108 @@ static void script_load_mapreg(void)
 	}
 
 	skip_insert = false;
-	mapreg_dirty = false;
 }
 
 /**
- * Saves permanent variables to database.
+ * Executes a mapreg save statement, in the background if the mapreg worker is running.
+ *
+ * @param buf: statement to execute, cleared afterwards
+ */
+static void mapreg_save_query(StringBuf* buf)
+{
+	if (mapregmysql_async == nullptr || SQL_ERROR == Sql_AsyncQueryStr(mapregmysql_async, StringBuf_Value(buf))) {
+		// earlier saves of the same variables may still be queued
+		Sql_AsyncWait(mapregmysql_async);
+		if (SQL_ERROR == Sql_QueryStr(mmysql_handle, StringBuf_Value(buf)))
+			Sql_ShowDebug(mmysql_handle);
+	}
+	StringBuf_Clear(buf);
+}
+
+/**
+ * Saves the modified permanent variables to database.
+ * Values are written with batched upserts, cleared variables with batched deletes.
+ * The elements of an array are adjacent in the batches, so its name is only escaped once.
  */
 static void script_save_mapreg(void)
 {
-	if (mapreg_dirty) {
-		DBIterator *iter = db_iterator(regs.vars);
-		struct mapreg_save *m;
-		for (m = static_cast<mapreg_save *>(dbi_first(iter)); dbi_exists(iter); m = static_cast<mapreg_save *>(dbi_next(iter))) {
-			if (m->save) {
-				int32 num = script_getvarid(m->uid);
-				uint32 i = script_getvaridx(m->uid);
-				const char* name = get_str(num);
-				if (!m->is_string) {
-					char esc_name[32 * 2 + 1];
-					Sql_EscapeStringLen(mmysql_handle, esc_name, name, strnlen(name, 32));
-					if (SQL_ERROR == Sql_Query(mmysql_handle, "UPDATE `%s` SET `value`='%" PRId64 "' WHERE `varname`='%s' AND `index`='%" PRIu32 "' LIMIT 1", mapreg_table, m->u.i, esc_name, i))
-						Sql_ShowDebug(mmysql_handle);
-				} else {
-					char esc_str[2 * 255 + 1];
-					char esc_name[32 * 2 + 1];
-					Sql_EscapeStringLen(mmysql_handle, esc_name, name, strnlen(name, 32));
-					Sql_EscapeStringLen(mmysql_handle, esc_str, m->u.str, safestrnlen(m->u.str, 255));
-					if (SQL_ERROR == Sql_Query(mmysql_handle, "UPDATE `%s` SET `value`='%s' WHERE `varname`='%s' AND `index`='%" PRIu32 "' LIMIT 1", mapreg_table, esc_str, esc_name, i))
-						Sql_ShowDebug(mmysql_handle);
-				}
-				m->save = false;
+	if (mapreg_dirty.empty())
+		return;
+
+	std::vector<int64> uids(mapreg_dirty.begin(), mapreg_dirty.end());
+	StringBuf upsert, remove;
+	size_t upsert_rows = 0, remove_rows = 0;
+	int32 last_num = -1;
+	char esc_name[32 * 2 + 1];
+
+	mapreg_dirty.clear();
+
+	// group by variable, then by index
+	std::sort(uids.begin(), uids.end(), [](int64 a, int64 b) {
+		int32 a_num = script_getvarid(a), b_num = script_getvarid(b);
+		return a_num != b_num ? a_num < b_num : script_getvaridx(a) < script_getvaridx(b);
+	});
+
+	StringBuf_Init(&upsert);
+	StringBuf_Init(&remove);
+
+	for (int64 uid : uids) {
+		int32 num = script_getvarid(uid);
+		uint32 i = script_getvaridx(uid);
+		struct mapreg_save *m = static_cast<mapreg_save *>(i64db_get(regs.vars, uid));
+
+		if (num != last_num) {
+			const char* name = get_str(num);
+
+			Sql_EscapeStringLen(mmysql_handle, esc_name, name, strnlen(name, 32));
+			last_num = num;
+		}
+
+		if (m == nullptr) {
+			StringBuf_Printf(&remove, "%s('%s','%" PRIu32 "')", remove_rows ? "," : "", esc_name, i);
+			if (++remove_rows == MAPREG_SAVE_BATCH) {
+				StringBuf query;
+
+				StringBuf_Init(&query);
+				StringBuf_Printf(&query, "DELETE FROM `%s` WHERE (`varname`,`index`) IN (%s)", mapreg_table, StringBuf_Value(&remove));
+				mapreg_save_query(&query);
+				StringBuf_Clear(&remove);
+				remove_rows = 0;
 			}
+			continue;
 		}
-		dbi_destroy(iter);
-		mapreg_dirty = false;
+
+		if (!upsert_rows)
+			StringBuf_Printf(&upsert, "INSERT INTO `%s`(`varname`,`index`,`value`) VALUES ", mapreg_table);
+		else
+			StringBuf_AppendStr(&upsert, ",");
+
+		if (!m->is_string) {
+			StringBuf_Printf(&upsert, "('%s','%" PRIu32 "','%" PRId64 "')", esc_name, i, m->u.i);
+		} else {
+			char esc_str[2 * 255 + 1];
+
+			Sql_EscapeStringLen(mmysql_handle, esc_str, m->u.str, safestrnlen(m->u.str, 255));
+			StringBuf_Printf(&upsert, "('%s','%" PRIu32 "','%s')", esc_name, i, esc_str);
+		}
+
+		if (++upsert_rows == MAPREG_SAVE_BATCH) {
+			StringBuf_AppendStr(&upsert, " ON DUPLICATE KEY UPDATE `value`=VALUES(`value`)");
+			mapreg_save_query(&upsert);
+			upsert_rows = 0;
+		}
+	}
+
+	if (upsert_rows) {
+		StringBuf_AppendStr(&upsert, " ON DUPLICATE KEY UPDATE `value`=VALUES(`value`)");
+		mapreg_save_query(&upsert);
+	}
+	if (remove_rows) {
+		StringBuf query;
+
+		StringBuf_Init(&query);
+		StringBuf_Printf(&query, "DELETE FROM `%s` WHERE (`varname`,`index`) IN (%s)", mapreg_table, StringBuf_Value(&remove));
+		mapreg_save_query(&query);
 	}
 }
 
@@ -266,6 +339,15 @@ static TIMER_FUNC(script_autosave_mapreg){
 	return 0;
 }
 
+/**
+ * Timer event to save permanent variables that were created or deleted.
+ */
+static TIMER_FUNC(script_flush_mapreg){
+	mapreg_flush_timer = INVALID_TIMER;
+	script_save_mapreg();
+	return 0;
+}
+
 /**
  * Destroys a mapreg_save structure, freeing the contained string, if any.
  *
@@ -298,6 +380,8 @@ int32 mapreg_destroyreg(DBKey key, DBData *data, va_list ap)
 void mapreg_reload(void)
 {
 	script_save_mapreg();
+	// the saves have to be written before the variables are read back
+	Sql_AsyncWait(mapregmysql_async);
 
 	regs.vars->clear(regs.vars, mapreg_destroyreg);
 
@@ -314,6 +398,11 @@ void mapreg_reload(void)
  */
 void mapreg_final(void)
 {
+	if (mapreg_flush_timer != INVALID_TIMER) {
+		delete_timer(mapreg_flush_timer, script_flush_mapreg);
+		mapreg_flush_timer = INVALID_TIMER;
+	}
+
 	script_save_mapreg();
 
 	regs.vars->destroy(regs.vars, mapreg_destroyreg);
@@ -338,7 +427,8 @@ void mapreg_init(void)
 	script_load_mapreg();
 
 	add_timer_func_list(script_autosave_mapreg, "script_autosave_mapreg");
-	add_timer_interval(gettick() + MAPREG_AUTOSAVE_INTERVAL, script_autosave_mapreg, 0, 0, MAPREG_AUTOSAVE_INTERVAL);
+	add_timer_func_list(script_flush_mapreg, "script_flush_mapreg");
+	add_timer_interval(gettick() + mapreg_save_interval * 1000, script_autosave_mapreg, 0, 0, mapreg_save_interval * 1000);
 }
 
 /**
@@ -348,6 +438,8 @@ bool mapreg_config_read(const char* w1, const char* w2)
 {
 	if(!strcmpi(w1, "mapreg_table"))
 		safestrncpy(mapreg_table, w2, sizeof(mapreg_table));
+	else if(!strcmpi(w1, "mapreg_save_interval"))
+		mapreg_save_interval = cap_value(atoi(w2), 1, 3600);
 	else
 		return false;
 
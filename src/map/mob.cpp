@@ -1311,17 +1311,10 @@ int32 mob_target(mob_data *md,block_list *bl,int32 dist)
 /*==========================================
  * The ?? routine of an active monster
  *------------------------------------------*/
-static int32 mob_ai_sub_hard_activesearch(block_list *bl,va_list ap)
-{
-	mob_data *md;
-	block_list **target;
-	enum e_mode mode;
+static int32 mob_ai_sub_hard_activesearch( block_list* bl, mob_data* md, block_list** target, int32 mode ){
 	int32 dist;
 
 	nullpo_ret(bl);
-	md=va_arg(ap,mob_data *);
-	target= va_arg(ap,block_list**);
-	mode= static_cast<enum e_mode>(va_arg(ap, int32));
 
 	//If can't seek yet, not an enemy, or you can't attack it, skip.
 	if ((*target) == bl || !status_check_skilluse(md, bl, 0, 0))
@@ -1366,14 +1359,8 @@ static int32 mob_ai_sub_hard_activesearch(block_list *bl,va_list ap)
 /*==========================================
  * chase target-change routine.
  *------------------------------------------*/
-static int32 mob_ai_sub_hard_changechase(block_list *bl,va_list ap)
-{
-	mob_data *md;
-	block_list **target;
-
+static int32 mob_ai_sub_hard_changechase( block_list* bl, mob_data* md, block_list** target ){
 	nullpo_ret(bl);
-	md=va_arg(ap,mob_data *);
-	target= va_arg(ap,block_list**);
 
 	//If can't seek yet, not an enemy, or you can't attack it, skip.
 	if ((*target) == bl ||
@@ -1409,15 +1396,9 @@ static int32 mob_ai_sub_hard_bg_ally(block_list *bl,va_list ap) {
 /*==========================================
  * loot monster item search
  *------------------------------------------*/
-static int32 mob_ai_sub_hard_lootsearch(block_list *bl,va_list ap)
-{
-	mob_data* md;
-	block_list **target;
+static int32 mob_ai_sub_hard_lootsearch( block_list* bl, mob_data* md, block_list** target ){
 	int32 dist;
 
-	md = va_arg(ap,mob_data *);
-	target = va_arg(ap,block_list**);
-
 	dist = distance_bl(md, bl);
 	if (mob_can_reach(md, bl, battle_config.loot_range) && (
 		(*target) == nullptr ||
@@ -2011,20 +1992,26 @@ static bool mob_ai_sub_hard(mob_data *md, t_tick tick)
 	{
 		if (tbl == nullptr) {
 			// Search for items in loot range
-			map_foreachinshootrange(mob_ai_sub_hard_lootsearch, md, battle_config.loot_range, BL_ITEM, md, &tbl);
+			map_foreachinshootrange( md, battle_config.loot_range, BL_ITEM, [md, &tbl]( block_list* bl ) -> int32 {
+				return mob_ai_sub_hard_lootsearch( bl, md, &tbl );
+			} );
 		}
 		else if (tbl->type == BL_ITEM && battle_config.monster_loot_search_type == 0) {
 			// Looter already has a target item, but we want to check if there is an item that's closer
 			int16 dist = distance_bl(md, tbl) - 1;
 			if (dist > 0)
-				map_foreachinshootrange(mob_ai_sub_hard_lootsearch, md, dist, BL_ITEM, md, &tbl);
+				map_foreachinshootrange( md, dist, BL_ITEM, [md, &tbl]( block_list* bl ) -> int32 {
+					return mob_ai_sub_hard_lootsearch( bl, md, &tbl );
+				} );
 		}
 	}
 
 	if ((mode&MD_AGGRESSIVE && (!tbl || slave_lost_target)) || md->state.skillstate == MSS_FOLLOW)
 	{
 		int32 prev_id = md->target_id;
-		map_foreachinallrange (mob_ai_sub_hard_activesearch, md, view_range, DEFAULT_ENEMY_TYPE(md), md, &tbl, mode);
+		map_foreachinallrange( md, view_range, DEFAULT_ENEMY_TYPE(md), [md, &tbl, mode]( block_list* bl ) -> int32 {
+			return mob_ai_sub_hard_activesearch( bl, md, &tbl, mode );
+		} );
 		// If a monster finds a new target that is already in attack range it immediately switches to rush mode
 		// This behavior overrides even angry mode and other mode-specific behavior
 		if (tbl != nullptr && prev_id != md->target_id && battle_check_range(md, tbl, md->status.rhw.range)) {
@@ -2037,7 +2024,9 @@ static bool mob_ai_sub_hard(mob_data *md, t_tick tick)
 	{
 		int32 search_size;
 		search_size = view_range<md->status.rhw.range ? view_range:md->status.rhw.range;
-		map_foreachinallrange (mob_ai_sub_hard_changechase, md, search_size, DEFAULT_ENEMY_TYPE(md), md, &tbl);
+		map_foreachinallrange( md, search_size, DEFAULT_ENEMY_TYPE(md), [md, &tbl]( block_list* bl ) -> int32 {
+			return mob_ai_sub_hard_changechase( bl, md, &tbl );
+		} );
 	}
 
 	if (!tbl) { //No targets available.
@@ -2342,6 +2331,67 @@ static int32 mob_ai_sub_hard_timer(block_list *bl,va_list ap)
 	return 0;
 }
 
+/// Player processed by the hard AI with the monsters the zone workers found around them
+struct s_mob_ai_client {
+	uint32 char_id;
+	const block_list* center;
+	std::vector<block_list*> mobs;
+};
+
+static std::vector<s_mob_ai_client> mob_ai_clients;
+static size_t mob_ai_client_count = 0;
+
+static int32 mob_ai_sub_addclient(map_session_data *sd, va_list ap)
+{
+	if (sd->m < 0)
+		return 0;
+
+	if (mob_ai_client_count == mob_ai_clients.size())
+		mob_ai_clients.emplace_back();
+
+	s_mob_ai_client& client = mob_ai_clients[mob_ai_client_count++];
+
+	client.char_id = sd->status.char_id;
+	client.center = sd;
+	client.mobs.clear();
+	return 0;
+}
+
+/*==========================================
+ * Hard AI with the monsters around the players looked up by the zone workers.
+ * The lookup only reads the block lists, the monsters are then processed
+ * on the main thread in the same order as mob_ai_sub_foreachclient does.
+ *------------------------------------------*/
+static void mob_ai_hard_zones(t_tick tick)
+{
+	mob_ai_client_count = 0;
+	map_foreachpc(mob_ai_sub_addclient);
+
+	map_zone_run([](int32 zone) {
+		for (size_t i = 0; i < mob_ai_client_count; i++) {
+			s_mob_ai_client& client = mob_ai_clients[i];
+
+			if (map_getzone(client.center->m) == zone)
+				map_getblocksinrange(client.mobs, client.center, AREA_SIZE + ACTIVE_AI_RANGE, BL_MOB, false);
+		}
+	});
+
+	FreeBlockLock freeLock;
+
+	for (size_t i = 0; i < mob_ai_client_count; i++) {
+		for (block_list* bl : mob_ai_clients[i].mobs) {
+			if (bl->prev == nullptr) // Removed while an earlier monster was processed
+				continue;
+
+			mob_data *md = (mob_data*)bl;
+
+			mob_add_spotted(md, mob_ai_clients[i].char_id);
+			if (mob_ai_sub_hard(md, tick))
+				md->last_pcneartime = tick;
+		}
+	}
+}
+
 /*==========================================
  * Serious processing for mob in PC field of view (foreachclient)
  *------------------------------------------*/
@@ -2469,6 +2519,8 @@ static TIMER_FUNC(mob_ai_hard){
 
 	if (battle_config.mob_ai&0x20)
 		map_foreachmob(mob_ai_sub_lazy,tick);
+	else if (map_zone_workers > 0)
+		mob_ai_hard_zones(tick);
 	else
 		map_foreachpc(mob_ai_sub_foreachclient,tick);
 
@@ -5595,6 +5647,115 @@ void MobDatabase::loadingFinished() {
 	TypesafeCachedYamlDatabase::loadingFinished();
 }
 
+static void mob_write_drops(BinaryWriter& writer, const std::vector<std::shared_ptr<s_mob_drop>>& drops) {
+	writer.write<uint32>((uint32)drops.size());
+
+	for (const auto &drop : drops) {
+		writer.write(drop->nameid);
+		writer.write(drop->rate);
+		writer.write(drop->randomopt_group);
+		writer.write(drop->steal_protected);
+	}
+}
+
+static bool mob_read_drops(BinaryReader& reader, std::vector<std::shared_ptr<s_mob_drop>>& drops, uint32 max) {
+	uint32 count;
+
+	if (!reader.read(count) || count > max)
+		return false;
+
+	for (uint32 i = 0; i < count; i++) {
+		std::shared_ptr<s_mob_drop> drop = std::make_shared<s_mob_drop>();
+
+		if (!reader.read(drop->nameid) || !reader.read(drop->rate) || !reader.read(drop->randomopt_group) || !reader.read(drop->steal_protected))
+			return false;
+
+		drops.push_back(drop);
+	}
+
+	return true;
+}
+
+/**
+ * Writes everything parsed from the monster database into its snapshot.
+ * The skills are not part of it, they are filled in by the monster skill database afterwards.
+ */
+bool MobDatabase::writeSnapshot(BinaryWriter& writer) {
+	writer.write<uint32>((uint32)this->size());
+
+	for (const auto &it : *this) {
+		const std::shared_ptr<s_mob_db> &mob = it.second;
+
+		writer.write(mob->id);
+		writer.writeString(mob->sprite);
+		writer.writeString(mob->name);
+		writer.writeString(mob->jname);
+		writer.write(mob->base_exp);
+		writer.write(mob->job_exp);
+		writer.write(mob->mexp);
+		writer.write(mob->range2);
+		writer.write(mob->range3);
+		writer.write<uint32>((uint32)mob->race2.size());
+		for (const auto &race : mob->race2)
+			writer.write(race);
+		writer.write(mob->lv);
+		mob_write_drops(writer, mob->dropitem);
+		mob_write_drops(writer, mob->mvpitem);
+		writer.write(mob->status);
+		writer.write(mob->vd);
+		writer.write(mob->option);
+		writer.write(mob->damagetaken);
+		writer.write(mob->group_id);
+		writer.writeString(mob->title);
+	}
+
+	return true;
+}
+
+bool MobDatabase::readSnapshot(BinaryReader& reader) {
+	uint32 mobs;
+
+	if (!reader.read(mobs))
+		return false;
+
+	for (uint32 i = 0; i < mobs; i++) {
+		std::shared_ptr<s_mob_db> mob = std::make_shared<s_mob_db>();
+		uint32 races;
+
+		if (!reader.read(mob->id) || !reader.readString(mob->sprite) || !reader.readString(mob->name) || !reader.readString(mob->jname)
+			|| !reader.read(mob->base_exp) || !reader.read(mob->job_exp) || !reader.read(mob->mexp) || !reader.read(mob->range2) || !reader.read(mob->range3)
+			|| !reader.read(races) || races >= RC2_MAX)
+			return false;
+
+		mob->race2.resize(races);
+
+		for (auto &race : mob->race2) {
+			if (!reader.read(race))
+				return false;
+		}
+
+		if (!reader.read(mob->lv) || !mob_read_drops(reader, mob->dropitem, MAX_MOB_DROP) || !mob_read_drops(reader, mob->mvpitem, MAX_MVP_DROP)
+			|| !reader.read(mob->status) || !reader.read(mob->vd) || !reader.read(mob->option) || !reader.read(mob->damagetaken) || !reader.read(mob->group_id)
+			|| !reader.readString(mob->title))
+			return false;
+
+		this->put(mob->id, mob);
+	}
+
+	return true;
+}
+
+uint64 MobDatabase::hashSnapshotDependencies(uint64 key) {
+	// Rates applied while parsing, the others are applied in loadingFinished
+	int32 rates[] = { battle_config.base_exp_rate, battle_config.job_exp_rate, battle_config.mvp_exp_rate, battle_config.monster_damage_delay_rate };
+	// The names of sizes, races, elements and modes are resolved through script constants
+	uint64 engine = script_cache_engine_key();
+
+	key = util::hash_fnv1a(rates, sizeof(rates), key);
+
+	return util::hash_fnv1a(&engine, sizeof(engine), key);
+}
+
 MobDatabase mob_db;
 
 /**
@@ -7210,10 +7371,12 @@ static void mob_load(void)
 		aFree(dbsubpath2);
 	}
 
-	mob_item_drop_ratio.load();
-	mob_avail_db.load();
-	mob_summon_db.load();
-	map_drop_db.load();
+	database_load_group( {
+		{ &mob_item_drop_ratio },
+		{ &mob_avail_db },
+		{ &mob_summon_db },
+		{ &map_drop_db },
+	} );
 
 	mob_drop_ratio_adjust();
 	mob_skill_db_set();
@@ -237,6 +237,9 @@ public:
 
 	const std::string getDefaultLocation() override;
 	uint64 parseBodyNode(const ryml::NodeRef& node) override;
+	bool canLoadInParallel() override{
+		return true;
+	}
 };
 
 struct spawn_info {
@@ -296,6 +299,9 @@ public:
 	const std::string getDefaultLocation() override;
 	uint64 parseBodyNode(const ryml::NodeRef& node) override;
 	void loadingFinished() override;
+	bool writeSnapshot(BinaryWriter& writer) override;
+	bool readSnapshot(BinaryReader& reader) override;
+	uint64 hashSnapshotDependencies(uint64 key) override;
 };
 
 extern MobDatabase mob_db;
@@ -432,6 +438,9 @@ public:
 
 	const std::string getDefaultLocation() override;
 	uint64 parseBodyNode(const ryml::NodeRef& node) override;
+	bool canLoadInParallel() override{
+		return true;
+	}
 };
 
 enum e_mob_skill_target {
@@ -4,8 +4,11 @@
 #include "npc.hpp"
 
 #include <cerrno>
+#include <chrono>
 #include <cstdlib>
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include <common/cbasetypes.hpp>
@@ -41,6 +44,7 @@ npc_data* fake_nd;
 
 
 std::vector<std::string> npc_src_files;
+static std::unordered_map<std::string, uint64> npc_src_hashes; // loaded npc source file -> hash of the content it was loaded from
 
 static int32 npc_id=START_NPC_NUM;
 static int32 npc_warp=0;
@@ -3645,12 +3649,14 @@ void npc_delsrcfile(const char* name)
  */
 void npc_loadsrcfiles() {
 	ShowStatus("Loading NPCs...\n");
+	auto start = std::chrono::steady_clock::now();
 	for (const auto& file : npc_src_files) {
 #ifdef DETAILED_LOADING_OUTPUT
 		ShowStatus("Loading NPC file: %s" CL_CLL "\r", file.c_str());
 #endif
 		npc_parsesrcfile(file.c_str());
 	}
+	script_cache_report( std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start ).count() );
 	int32 npc_total = npc_warp + npc_shop + npc_script;
 
 	ShowInfo ("Done loading '" CL_WHITE "%d" CL_RESET "' NPCs:" CL_CLL "\n"
@@ -5681,6 +5687,9 @@ int32 npc_parsesrcfile(const char* filepath)
 		return 0;
 	}
 
+	npc_src_hashes[filepath] = util::hash_fnv1a( buffer, len );
+	script_cache_begin( filepath, buffer, len );
+
 	int32 lines = 0;
 
 	// parse buffer
@@ -5816,6 +5825,7 @@ int32 npc_parsesrcfile(const char* filepath)
 			p = strchr(p,'\n');// skip and continue
 		}
 	}
+	script_cache_end();
 	aFree(buffer);
 
 	return 1;
@@ -6122,6 +6132,7 @@ int32 npc_reload(void) {
 	// reset mapflags
 	map_flags_init();
 
+	npc_src_hashes.clear();
 	npc_loadsrcfiles();
 
 	stylist_db.reload();
@@ -6152,8 +6163,8 @@ int32 npc_reload(void) {
 	return 0;
 }
 
-//Unload all npc in the given file
-bool npc_unloadfile( const char* path ) {
+/// Unloads all npcs and mob spawns of the given file, without removing it from the source files
+static bool npc_unloadfile_sub( const char* path ) {
 	DBIterator * iter = db_iterator(npcname_db);
 	npc_data* nd = nullptr;
 	bool found = false;
@@ -6172,6 +6183,15 @@ bool npc_unloadfile( const char* path ) {
 		found = true;
 	}
 
+	npc_src_hashes.erase( path );
+
+	return found;
+}
+
+//Unload all npc in the given file
+bool npc_unloadfile( const char* path ) {
+	bool found = npc_unloadfile_sub( path );
+
 	if( found ) /* refresh event cache */
 		npc_read_event_script();
 
@@ -6180,6 +6200,119 @@ bool npc_unloadfile( const char* path ) {
 	return found;
 }
 
+/// Hashes the current content of a npc source file
+static bool npc_hash_srcfile( const char* path, uint64& hash ){
+	FILE* fp = fopen( path, "rb" );
+
+	if( fp == nullptr )
+		return false;
+
+	std::vector<char> buffer;
+
+	fseek( fp, 0, SEEK_END );
+	buffer.resize( ftell( fp ) );
+	fseek( fp, 0, SEEK_SET );
+	buffer.resize( fread( buffer.data(), 1, buffer.size(), fp ) );
+
+	bool error = ferror( fp ) != 0;
+
+	fclose( fp );
+
+	if( error )
+		return false;
+
+	hash = util::hash_fnv1a( buffer.data(), buffer.size() );
+
+	return true;
+}
+
+/**
+ * Reloads only the npc source files that changed since they were loaded, the rest of the world stays untouched.
+ * The source file list has to be read again before calling this.
+ * Npcs of changed and removed files are unloaded, changed and new files are parsed again and run their OnInit events.
+ * Files that duplicate npcs of a changed file are reloaded as well, because unloading the source npc removes the duplicates.
+ * Mapflags set by the unloaded files are not reset.
+ * @return Number of source files that were reloaded or unloaded
+ */
+int32 npc_reload_changed( void ){
+	std::unordered_set<std::string> changed;
+
+	// Files that are no longer listed
+	for( const auto& it : npc_src_hashes ){
+		if( !util::vector_exists( npc_src_files, it.first ) )
+			changed.insert( it.first );
+	}
+
+	// Files that are new or whose content changed
+	for( const auto& file : npc_src_files ){
+		auto it = npc_src_hashes.find( file );
+		uint64 hash;
+
+		if( it == npc_src_hashes.end() || !npc_hash_srcfile( file.c_str(), hash ) || hash != it->second )
+			changed.insert( file );
+	}
+
+	if( changed.empty() )
+		return 0;
+
+	// Files with duplicates of npcs from changed files
+	for( bool added = true; added; ){
+		DBIterator* iter = db_iterator( npcname_db );
+
+		added = false;
+
+		for( npc_data* nd = (npc_data*)dbi_first( iter ); dbi_exists( iter ); nd = (npc_data*)dbi_next( iter ) ){
+			if( nd->src_id == 0 || nd->path == nullptr || changed.find( nd->path ) != changed.end() )
+				continue;
+
+			npc_data* src_nd = map_id2nd( nd->src_id );
+
+			if( src_nd != nullptr && src_nd->path != nullptr && changed.find( src_nd->path ) != changed.end() ){
+				changed.insert( nd->path );
+				added = true;
+			}
+		}
+
+		dbi_destroy( iter );
+	}
+
+	// Close the dialogs of players talking to npcs that are unloaded
+	struct s_mapiterator* iter = mapit_getallusers();
+
+	for( map_session_data* sd = (map_session_data*)mapit_first( iter ); mapit_exists( iter ); sd = (map_session_data*)mapit_next( iter ) ){
+		npc_data* nd = map_id2nd( sd->npc_id );
+
+		if( nd != nullptr && nd->path != nullptr && changed.find( nd->path ) != changed.end() )
+			pc_close_npc( sd, 1 );
+	}
+
+	mapit_free( iter );
+
+	for( const auto& file : changed ){
+		npc_unloadfile_sub( file.c_str() );
+	}
+
+	// Parse in the order of the source file list
+	std::vector<std::string> reloaded;
+
+	for( const auto& file : npc_src_files ){
+		if( changed.find( file ) != changed.end() && npc_parsesrcfile( file.c_str() ) )
+			reloaded.push_back( file );
+	}
+
+	npc_read_event_script();
+
+	for( const auto& file : reloaded ){
+		ShowStatus( "NPC file '" CL_WHITE "%s" CL_RESET "' was reloaded.\n", file.c_str() );
+		npc_event_doall_path( script_config.init_event_name, file.c_str() );
+
+		if( !CheckForCharServer() )
+			npc_event_doall_path( script_config.inter_init_event_name, file.c_str() );
+	}
+
+	return (int32)changed.size();
+}
+
 bool npc_remove_mob_spawns(const char* path) {
 	int32 spawn_count = {};
 	int32 unit_count = {};
@@ -6277,6 +6410,7 @@ void do_final_npc(void) {
 	ers_destroy(timer_event_ers);
 	ers_destroy(npc_sc_display_ers);
 	npc_src_files.clear();
+	npc_src_hashes.clear();
 }
 
 static void npc_debug_warps_sub(npc_data* nd)
@@ -6,6 +6,7 @@
 
 #include <bitset>
 #include <memory>
+#include <unordered_set>
 #include <vector>
 
 #include <common/cbasetypes.hpp>
@@ -501,6 +502,7 @@ public:
 	int32 npc_id,npc_shopid; //for script follow scriptoid;   ,npcid
 	std::vector<int32> npc_id_dynamic;
 	std::vector<int32> areanpc, npc_ontouch_;	///< Array of OnTouch and OnTouch_ NPC ID
+	std::unordered_set<int32> visible_units; ///< IDs of the units in view, only kept with visibility_sets
 	int32 npc_item_flag; //Marks the npc_id with which you can use items during interactions with said npc (see script command enable_itemuse)
 	int32 npc_menu; // internal variable, used in npc menu handling
 	int32 npc_amount;
@@ -9,10 +9,16 @@
 
 #include "script.hpp"
 
+#include <algorithm>
 #include <cerrno>
+#include <chrono>
 #include <cmath>
 #include <csetjmp>
 #include <cstdlib> // atoi, strtol, strtoll, exit
+#include <filesystem>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
 
 #ifdef PCRE_SUPPORT
 #include <pcre.h> // preg_match
@@ -208,6 +214,18 @@ static inline void SETVALUE(unsigned char* buf, int32 i, int32 n)
 	buf[i+2] = GetByte(n, 2);
 }
 
+/// Scope of a variable, derived from the prefix of its name
+enum e_script_var_scope : uint8 {
+	SCRIPT_VAR_CHAR = 0, ///< permanent character variable (no prefix), also used for constants and params
+	SCRIPT_VAR_CHAR_TEMP, ///< temporary character variable (@)
+	SCRIPT_VAR_SERVER, ///< permanent global variable ($)
+	SCRIPT_VAR_ACCOUNT, ///< permanent local account variable (#)
+	SCRIPT_VAR_ACCOUNT_GLOBAL, ///< permanent global account variable (##)
+	SCRIPT_VAR_NPC, ///< npc variable (.)
+	SCRIPT_VAR_SCOPE, ///< scope variable (.@)
+	SCRIPT_VAR_INSTANCE, ///< instance variable (')
+};
+
 // String buffer structures.
 // str_data stores string information
 static struct str_data_struct {
@@ -220,6 +238,10 @@ static struct str_data_struct {
 	int32 next;
 	const char *name;
 	bool deprecated;
+	// Set by add_str, variables stay untyped C_NAME references in the bytecode and are resolved through these
+	e_script_var_scope var_scope; // scope of the variable with this name
+	bool var_string; // the variable with this name holds a string
+	bool var_length_valid; // the name is short enough to be used as a variable
 } *str_data = nullptr;
 static int32 str_data_size = 0; // size of the data
 static int32 str_num = LABEL_START; // next id to be assigned
@@ -230,6 +252,11 @@ static int32 str_size = 0; // size of the buffer
 static int32 str_pos = 0; // next position to be assigned
 
 
+// Threaded dispatch in run_script_main, needs the labels as values extension of GCC and Clang
+#if defined(__GNUC__) || defined(__clang__)
+	#define SCRIPT_COMPUTED_GOTO
+#endif
+
 // Using a prime number for SCRIPT_HASH_SIZE should give better distributions
 #define SCRIPT_HASH_SIZE 1021
 int32 str_hash[SCRIPT_HASH_SIZE];
@@ -249,6 +276,7 @@ static int32 buildin_set_ref = 0;
 static int32 buildin_callsub_ref = 0;
 static int32 buildin_callfunc_ref = 0;
 static int32 buildin_getelementofarray_ref = 0;
+static int32 buildin_jump_zero_ref = 0;
 
 // Caches compiled autoscript item code.
 // Note: This is not cleared when reloading itemdb.
@@ -258,6 +286,10 @@ struct Script_Config script_config = {
 	1, // warn_func_mismatch_argtypes
 	1, 65535, 2048, //warn_func_mismatch_paramnum/check_cmdcount/check_gotocount
 	0, INT_MAX, // input_min_value/input_max_value
+	4, 10000, // query_sql_async_limit/query_sql_async_timeout
+	0, "db/snapshot/scripts", // script_cache/script_cache_path
+	1, // script_optimize
+	SCRIPT_PROFILE_OFF, 100, "log/script_profile.folded", // script_profile/script_profile_sample_rate/script_profile_file
 	// NOTE: None of these event labels should be longer than <EVENT_NAME_LENGTH> characters
 	// PC related
 	"OnPCDieEvent", //die_event_name
@@ -320,6 +352,11 @@ static int32         error_report; // if the error should produce output
 static const char* parser_current_src;
 static const char* parser_current_file;
 static int32         parser_current_line;
+static int32         parser_warnings = 0; // number of warnings and errors shown while parsing, scripts with warnings are not cached
+static int32         parser_last_eol = -1; // script position after the last end of line, used to skip empty lines
+static std::vector<std::string> parser_userfuncs; // global functions called by name from the script being parsed
+static bool          script_cache_engine_key_valid = false;
+static uint64        script_cache_engine_key_value;
 
 // for advanced scripting support ( nested if, switch, while, for, do-while, function, etc )
 // [Eoe / jA 1080, 1081, 1094, 1164]
@@ -610,6 +647,7 @@ static void disp_error_message2(const char *mes,const char *pos,int32 report)
 #define disp_error_message(mes,pos) disp_error_message2(mes,pos,1)
 
 static void disp_warning_message(const char *mes, const char *pos) {
+	parser_warnings++;
 	script_warning(parser_current_src,parser_current_file,parser_current_line,mes,pos);
 }
 
@@ -698,6 +736,32 @@ static int32 search_str(const char* p)
 	return -1;
 }
 
+/// Returns the scope of the variable with the given name.
+/// Names are classified once when they are added, so variable accesses do not have to look at the name.
+static e_script_var_scope script_var_scope(const char* name)
+{
+	switch( name[0] ){
+		case '@':
+			return SCRIPT_VAR_CHAR_TEMP;
+		case '$':
+			return SCRIPT_VAR_SERVER;
+		case '#':
+			return ( name[1] == '#' ) ? SCRIPT_VAR_ACCOUNT_GLOBAL : SCRIPT_VAR_ACCOUNT;
+		case '.':
+			return ( name[1] == '@' ) ? SCRIPT_VAR_SCOPE : SCRIPT_VAR_NPC;
+		case '\'':
+			return SCRIPT_VAR_INSTANCE;
+		default:
+			return SCRIPT_VAR_CHAR;
+	}
+}
+
+/// Returns if a variable of this scope needs an attached player
+static inline bool script_var_needs_player(e_script_var_scope scope)
+{
+	return scope != SCRIPT_VAR_SERVER && scope != SCRIPT_VAR_NPC && scope != SCRIPT_VAR_SCOPE && scope != SCRIPT_VAR_INSTANCE;
+}
+
 /// Stores a copy of the string and returns its id.
 /// If an identical string is already present, returns its id instead.
 int32 add_str(const char* p)
@@ -751,6 +815,9 @@ int32 add_str(const char* p)
 	str_data[str_num].func = nullptr;
 	str_data[str_num].backpatch = -1;
 	str_data[str_num].label = -1;
+	str_data[str_num].var_scope = script_var_scope(p);
+	str_data[str_num].var_string = len > 0 && p[len - 1] == '$';
+	str_data[str_num].var_length_valid = script_check_RegistryVariableLength(0, p, nullptr);
 	str_pos += len+1;
 
 	return str_num++;
@@ -971,6 +1038,7 @@ const char* parse_callfunc(const char* p, int32 require_paren, int32 is_custom)
 		arg = buildin_func[str_data[func].val].arg;
 #if defined(SCRIPT_COMMAND_DEPRECATION)
 		if( str_data[func].deprecated ){
+			parser_warnings++;
 			ShowWarning( "Usage of deprecated script function '%s'.\n", get_str(func) );
 			ShowWarning( "This function was deprecated on '%s' and could become unavailable anytime soon.\n", buildin_func[str_data[func].val].deprecated );
 		}
@@ -990,6 +1058,8 @@ const char* parse_callfunc(const char* p, int32 require_paren, int32 is_custom)
 		if( !is_custom && strdb_get(userfunc_db, name) == nullptr ) {
 			disp_error_message("parse_line: expect command, missing function name or calling undeclared function",p);
 		} else {;
+			// The script only parses as long as the function exists, a cached copy has to check it again
+			parser_userfuncs.emplace_back( name );
 			add_scriptl(buildin_callfunc_ref);
 			add_scriptc(C_ARG);
 			add_scriptc(C_STR);
@@ -1063,7 +1133,10 @@ static void parse_nextline(bool first, const char* p)
 {
 	if( !first )
 	{
-		add_scriptc(C_EOL);  // mark end of line for stack cleanup
+		// nothing was added since the last end of line, the stack is already clean
+		if( !script_config.script_optimize || parser_last_eol != script_pos )
+			add_scriptc(C_EOL);  // mark end of line for stack cleanup
+		parser_last_eol = script_pos;
 		set_label(LABEL_NEXTLINE, script_pos, p);  // fix up '-' labels
 	}
 
@@ -1287,6 +1360,242 @@ bool is_number(const char *p) {
 	return false;
 }
 
+/*==========================================
+ * Constant folding
+ *------------------------------------------*/
+
+/// Returns if the code from the given position to the end of the script buffer is a single integer constant.
+/// Constants are stored as C_INT with their absolute value, followed by C_NEG if they are negative.
+static bool parse_getconstant(int32 start, int64& value)
+{
+	int32 pos = start;
+
+	if( !script_config.script_optimize || start >= script_pos || script_buf[start] < 0x80 )
+		return false; // not C_INT
+
+	value = get_num(script_buf, &pos);
+
+	if( pos == script_pos )
+		return true;
+
+	if( pos + 1 == script_pos && script_buf[pos] == C_NEG ){
+		value = -value;
+		return true;
+	}
+
+	return false;
+}
+
+/// Replaces the code from the given position to the end of the script buffer with an integer constant
+static void parse_setconstant(int32 start, int64 value)
+{
+	script_pos = start;
+	add_scripti(std::abs(value));
+	if( value < 0 )
+		add_scriptc(C_NEG);
+}
+
+/// Calculates a binary operator on two constants like op_2num.
+/// @return false if the result can not be calculated at parse time, the operator is then executed at runtime and shows its errors
+static bool parse_foldop2(int32 op, int64 i1, int64 i2, int64& ret)
+{
+	switch( op ){
+		case C_AND:  ret = i1 & i2;		break;
+		case C_OR:   ret = i1 | i2;		break;
+		case C_XOR:  ret = i1 ^ i2;		break;
+		case C_LAND: ret = (i1 && i2);	break;
+		case C_LOR:  ret = (i1 || i2);	break;
+		case C_EQ:   ret = (i1 == i2);	break;
+		case C_NE:   ret = (i1 != i2);	break;
+		case C_GT:   ret = (i1 >  i2);	break;
+		case C_GE:   ret = (i1 >= i2);	break;
+		case C_LT:   ret = (i1 <  i2);	break;
+		case C_LE:   ret = (i1 <= i2);	break;
+		case C_R_SHIFT:
+		case C_L_SHIFT:
+			if( i2 < 0 || i2 > 62 )
+				return false;
+			ret = ( op == C_R_SHIFT ) ? i1 >> i2 : i1 << i2;
+			break;
+		case C_DIV:
+		case C_MOD:
+			if( i2 == 0 )
+				return false; // division by zero
+			ret = ( op == C_DIV ) ? i1 / i2 : i1 % i2;
+			break;
+		case C_ADD:
+			if( util::safe_addition( i1, i2, ret ) )
+				return false;
+			break;
+		case C_SUB:
+			if( util::safe_substraction( i1, i2, ret ) )
+				return false;
+			break;
+		case C_MUL:
+			if( util::safe_multiplication( i1, i2, ret ) )
+				return false;
+			break;
+		default:
+			return false;
+	}
+
+	return ret != INT64_MIN; // can not be stored as a negated absolute value
+}
+
+/// Folds the last unary operator if its operand is a constant
+static void parse_foldop1(int32 op, int32 start)
+{
+	int64 value;
+	int32 end = script_pos;
+
+	// The operator was already added, check the operand without it
+	script_pos = end - 1;
+
+	if( parse_getconstant(start, value) && value != INT64_MIN ){
+		switch( op ){
+			case C_NEG: value = -value; break;
+			case C_NOT: value = ~value; break;
+			case C_LNOT: value = !value; break;
+		}
+
+		if( value != INT64_MIN ){
+			parse_setconstant(start, value);
+			return;
+		}
+	}
+
+	script_pos = end;
+}
+
+/// Folds the last binary or ternary operator if all operands are constants
+static void parse_foldop(int32 op, int32 start, int32 start2, int32 start3)
+{
+	int64 i1, i2, i3, ret;
+	int32 end = script_pos;
+
+	// The operator was already added, check the operands without it
+	script_pos = end - 1;
+
+	if( op == C_OP3 ){
+		if( !parse_getconstant(start3, i3) ){
+			script_pos = end;
+			return;
+		}
+		script_pos = start3;
+		ret = i3;
+	}
+
+	if( parse_getconstant(start2, i2) ){
+		script_pos = start2;
+
+		if( parse_getconstant(start, i1) ){
+			if( op == C_OP3 ){
+				parse_setconstant(start, i1 ? i2 : ret);
+				return;
+			}else if( parse_foldop2(op, i1, i2, ret) ){
+				parse_setconstant(start, ret);
+				return;
+			}
+		}
+	}
+
+	script_pos = end;
+}
+
+/**
+ * Replaces the conditional jump of if, else if, for, while and do-while, if its condition is a constant.
+ * @param start: position of the jump_zero call
+ * @param condition: position of the condition
+ * @return true if the jump was removed, because the condition is always true
+ */
+static bool parse_foldjump(int32 start, int32 condition)
+{
+	int64 value;
+
+	if( !parse_getconstant(condition, value) )
+		return false;
+
+	script_pos = start;
+
+	if( value != 0 )
+		return true;
+
+	// Always false, jump without checking the condition
+	add_scriptl(add_str("goto"));
+	add_scriptc(C_ARG);
+	return false;
+}
+
+/**
+ * Jump threading: jumps to a label that only jumps to another label go to the final label directly.
+ * Only the label arguments of goto and jump_zero are changed, the size of the code stays the same.
+ */
+static void parse_threadjumps()
+{
+	int32 goto_id = add_str("goto");
+	int32 jump_zero_id = add_str("jump_zero");
+	std::vector<int32> calls; // functions of the calls that are currently open
+
+	// Returns the target of the goto at the given position or -1
+	auto goto_target = [&]( int32 pos ) -> int32 {
+		while( pos < script_pos && script_buf[pos] == C_EOL )
+			pos++;
+
+		if( pos + 10 > script_pos || script_buf[pos] != C_NAME || GETVALUE( script_buf, pos + 1 ) != goto_id
+			|| script_buf[pos + 4] != C_ARG || script_buf[pos + 5] != C_POS || script_buf[pos + 9] != C_FUNC )
+			return -1;
+
+		return GETVALUE( script_buf, pos + 6 );
+	};
+
+	for( int32 i = 0; i < script_pos; ){
+		switch( get_com( script_buf, &i ) ){
+			case C_INT:
+				get_num( script_buf, &i );
+				break;
+			case C_NAME:
+				// A function call starts with the name of the function followed by C_ARG
+				if( i + 3 < script_pos && script_buf[i + 3] == C_ARG )
+					calls.push_back( GETVALUE( script_buf, i ) );
+				i += 3;
+				break;
+			case C_POS:
+				if( i + 3 < script_pos && script_buf[i + 3] == C_FUNC && !calls.empty() && ( calls.back() == goto_id || calls.back() == jump_zero_id ) ){
+					int32 target = GETVALUE( script_buf, i );
+					int32 threaded = target;
+					bool cleanup = false; // an end of line was skipped, which clears the values left on the stack
+
+					// Limit the hops, in case of loops made of gotos
+					for( int32 hops = 0, next; hops < 16 && ( next = goto_target( target ) ) >= 0 && next != target; hops++ ){
+						if( script_buf[target] == C_EOL )
+							cleanup = true;
+						target = next;
+
+						// Only jump past an end of line if the new target clears the stack as well
+						if( !cleanup || script_buf[target] == C_EOL )
+							threaded = target;
+					}
+
+					SETVALUE( script_buf, i, threaded );
+				}
+				i += 3;
+				break;
+			case C_USERFUNC_POS:
+				i += 3;
+				break;
+			case C_FUNC:
+				if( !calls.empty() )
+					calls.pop_back();
+				break;
+			case C_STR:
+				while( script_buf[i++] );
+				break;
+			default:
+				break;
+		}
+	}
+}
+
 /*==========================================
  * Analysis section
  *------------------------------------------*/
@@ -1430,11 +1739,14 @@ const char* parse_subexpr(const char* p,int32 limit)
 		}
 	}
 
+	int32 start = script_pos;
+
 	if( (op = C_ADD_PRE, p[0] == '+' && p[1] == '+') || (op = C_SUB_PRE, p[0] == '-' && p[1] == '-') ) // Pre ++ -- operators
 		p = parse_variable(p);
 	else if( (op = C_NEG, *p == '-') || (op = C_LNOT, *p == '!') || (op = C_NOT, *p == '~') ) { // Unary - ! ~ operators
 		p = parse_subexpr(p + 1, 11);
 		add_scriptc(op);
+		parse_foldop1(op, start);
 	} else
 		p = parse_simpleexpr(p);
 	p = skip_space(p);
@@ -1458,17 +1770,21 @@ const char* parse_subexpr(const char* p,int32 limit)
 			(op=C_L_SHIFT,opl=8,len=2,*p=='<' && p[1]=='<') ||
 			(op=C_LE,opl=7,len=2,*p=='<' && p[1]=='=') ||
 			(op=C_LT,opl=7,len=1,*p=='<')) && opl>limit){
+		int32 start2 = script_pos, start3 = -1;
+
 		p+=len;
 		if(op == C_OP3) {
 			p=parse_subexpr(p,-1);
 			p=skip_space(p);
 			if( *(p++) != ':')
 				disp_error_message("parse_subexpr: expected ':'", p-1);
+			start3 = script_pos;
 			p=parse_subexpr(p,-1);
 		} else {
 			p=parse_subexpr(p,opl);
 		}
 		add_scriptc(op);
+		parse_foldop(op, start, start2, start3);
 		p=skip_space(p);
 	}
 
@@ -1846,12 +2162,16 @@ const char* parse_syntax(const char* p)
 			} else {
 				// Skip to the end point if the condition is false
 				sprintf(label,"__FR%x_FIN",syntax.curly[pos].index);
+				int32 jump = script_pos;
 				add_scriptl(add_str("jump_zero"));
 				add_scriptc(C_ARG);
+				int32 condition = script_pos;
 				p=parse_expr(p);
 				p=skip_space(p);
-				add_scriptl(add_str(label));
-				add_scriptc(C_FUNC);
+				if( !parse_foldjump(jump, condition) ){
+					add_scriptl(add_str(label));
+					add_scriptc(C_FUNC);
+				}
 			}
 			if(*p != ';')
 				disp_error_message("parse_syntax: expected ';'",p);
@@ -1966,12 +2286,16 @@ const char* parse_syntax(const char* p)
 			syntax.curly[syntax.curly_count].flag  = 0;
 			sprintf(label,"__IF%x_%x",syntax.curly[syntax.curly_count].index,syntax.curly[syntax.curly_count].count);
 			syntax.curly_count++;
+			int32 jump = script_pos;
 			add_scriptl(add_str("jump_zero"));
 			add_scriptc(C_ARG);
+			int32 condition = script_pos;
 			p=parse_expr(p);
 			p=skip_space(p);
-			add_scriptl(add_str(label));
-			add_scriptc(C_FUNC);
+			if( !parse_foldjump(jump, condition) ){
+				add_scriptl(add_str(label));
+				add_scriptc(C_FUNC);
+			}
 			return p;
 		}
 		break;
@@ -2023,12 +2347,16 @@ const char* parse_syntax(const char* p)
 			// Skip to the end point if the condition is false
 			sprintf(label,"__WL%x_FIN",syntax.curly[syntax.curly_count].index);
 			syntax.curly_count++;
+			int32 jump = script_pos;
 			add_scriptl(add_str("jump_zero"));
 			add_scriptc(C_ARG);
+			int32 condition = script_pos;
 			p=parse_expr(p);
 			p=skip_space(p);
-			add_scriptl(add_str(label));
-			add_scriptc(C_FUNC);
+			if( !parse_foldjump(jump, condition) ){
+				add_scriptl(add_str(label));
+				add_scriptc(C_FUNC);
+			}
 			return p;
 		}
 		break;
@@ -2091,12 +2419,16 @@ const char* parse_syntax_close_sub(const char* p,int32* flag)
 					disp_error_message("need '('",p);
 				}
 				sprintf(label,"__IF%x_%x",syntax.curly[pos].index,syntax.curly[pos].count);
+				int32 jump = script_pos;
 				add_scriptl(add_str("jump_zero"));
 				add_scriptc(C_ARG);
+				int32 condition = script_pos;
 				p=parse_expr(p);
 				p=skip_space(p);
-				add_scriptl(add_str(label));
-				add_scriptc(C_FUNC);
+				if( !parse_foldjump(jump, condition) ){
+					add_scriptl(add_str(label));
+					add_scriptc(C_FUNC);
+				}
 				*flag = 0;
 				return p;
 			} else {
@@ -2146,12 +2478,16 @@ const char* parse_syntax_close_sub(const char* p,int32* flag)
 		parse_nextline(false, p);
 
 		sprintf(label2,"__DO%x_FIN",syntax.curly[pos].index);
+		int32 jump = script_pos;
 		add_scriptl(add_str("jump_zero"));
 		add_scriptc(C_ARG);
+		int32 condition = script_pos;
 		p=parse_expr(p);
 		p=skip_space(p);
-		add_scriptl(add_str(label2));
-		add_scriptc(C_FUNC);
+		if( !parse_foldjump(jump, condition) ){
+			add_scriptl(add_str(label2));
+			add_scriptc(C_FUNC);
+		}
 
 		// Skip to the starting point
 		sprintf(label2,"goto __DO%x_BGN;",syntax.curly[pos].index);
@@ -2260,6 +2596,7 @@ static void add_buildin_func(void)
 			else if (!strcmp(buildin_func[i].name, "callsub")) buildin_callsub_ref = n;
 			else if (!strcmp(buildin_func[i].name, "callfunc")) buildin_callfunc_ref = n;
 			else if( !strcmp(buildin_func[i].name, "getelementofarray") ) buildin_getelementofarray_ref = n;
+			else if( !strcmp(buildin_func[i].name, "jump_zero") ) buildin_jump_zero_ref = n;
 		}
 	}
 }
@@ -2337,6 +2674,8 @@ bool script_get_constant(const char* name, int64* value)
 /// Creates new constant or parameter with given value.
 void script_set_constant_(const char* name, int64 value, const char* constant_name, bool isparameter, bool deprecated)
 {
+	script_cache_engine_key_valid = false;
+
 	int32 n = add_str(name);
 
 	if( str_data[n].type == C_NOP )
@@ -2472,95 +2811,582 @@ void script_warning(const char* src, const char* file, int32 start_line, const c
 /*==========================================
  * Analysis of the script
  *------------------------------------------*/
-struct script_code* parse_script_( const char *src, const char *file, int32 line, int32 options, const char* src_file, int32 src_line, const char* src_func ){
-	const char *p,*tmpp;
-	int32 i;
-	struct script_code* code = nullptr;
-	char end;
-	bool unresolved_names = false;
+/*==========================================
+ * Script cache
+ * Keeps the compiled scripts of every NPC source file on disk, so unchanged files do not have to be parsed again.
+ * The scripts of a file are identified by their position in the file and the parse options.
+ * References to str_data are stored by name, as the ids differ between runs.
+ *------------------------------------------*/
+#define SCRIPT_CACHE_MAGIC "RASC"
+#define SCRIPT_CACHE_VERSION 3 // Increase whenever the bytecode or the parser changes
+
+struct s_script_cache_entry {
+	std::vector<uint8> code;
+	std::vector<std::pair<uint32, std::string>> names; // position of a C_NAME reference in the code, referenced name
+	std::vector<std::pair<std::string, int32>> labels; // labels of the script if parsed with SCRIPT_USE_LABEL_DB
+	std::vector<std::string> userfuncs; // global functions from other scripts the script calls by name, they have to exist when it is loaded
+};
 
-	parser_current_src = src;
-	parser_current_file = file;
-	parser_current_line = line;
+static struct {
+	bool active;
+	bool dirty;
+	std::string path;
+	const char* buffer;
+	size_t length;
+	uint64 hash;
+	std::map<std::pair<uint32, int32>, s_script_cache_entry> entries; // (offset in the file, options) -> script
+	uint32 hits, misses;
+} script_cache;
+
+/// Hash of everything outside of a source file that influences the bytecode: parser settings, constants, parameters and built-in functions
+uint64 script_cache_engine_key(){
+	if( script_cache_engine_key_valid )
+		return script_cache_engine_key_value;
+
+	uint32 version = SCRIPT_CACHE_VERSION;
+	uint64 key = util::hash_fnv1a( &version, sizeof( version ) );
+
+	key = util::hash_fnv1a( get_git_hash(), strlen( get_git_hash() ), key );
+	key = util::hash_fnv1a( &script_config.script_optimize, sizeof( script_config.script_optimize ), key );
+
+	// A cache made with other warning settings is not reused, warn_func_mismatch_paramnum decides if missing arguments fail the parse
+	uint8 warnings[] = { (uint8)script_config.warn_func_mismatch_paramnum, (uint8)script_config.warn_func_mismatch_argtypes };
+
+	key = util::hash_fnv1a( warnings, sizeof( warnings ), key );
+
+	for( int32 i = LABEL_START; i < str_num; i++ ){
+		if( str_data[i].type != C_INT && str_data[i].type != C_PARAM && str_data[i].type != C_FUNC )
+			continue;
 
-	if( src == nullptr )
-		return nullptr;// empty script
+		const char* name = get_str( i );
 
-	memset(&syntax,0,sizeof(syntax));
+		key = util::hash_fnv1a( name, strlen( name ) + 1, key );
+		key = util::hash_fnv1a( &str_data[i].type, sizeof( str_data[i].type ), key );
+		key = util::hash_fnv1a( &str_data[i].val, sizeof( str_data[i].val ), key );
+		key = util::hash_fnv1a( &str_data[i].deprecated, sizeof( str_data[i].deprecated ), key );
+	}
 
-	script_buf=(unsigned char *)aMalloc(SCRIPT_BLOCK_SIZE*sizeof(unsigned char));
-	script_pos=0;
-	script_size=SCRIPT_BLOCK_SIZE;
-	parse_nextline(true, nullptr);
+	script_cache_engine_key_value = key;
+	script_cache_engine_key_valid = true;
 
-	// who called parse_script is responsible for clearing the database after using it, but just in case... lets clear it here
-	if( options&SCRIPT_USE_LABEL_DB )
-		db_clear(scriptlabel_db);
-	parse_options = options;
+	return key;
+}
 
-	if( setjmp( error_jump ) != 0 ) {
-		//Restore program state when script has problems. [from jA]
-		int32 j;
-		const int32 size = ARRAYLENGTH(syntax.curly);
-		if( error_report )
-			script_error(src,file,line,error_msg,error_pos);
-		aFree( error_msg );
-		aFree( script_buf );
-		script_pos  = 0;
-		script_size = 0;
-		script_buf  = nullptr;
-		for(j=LABEL_START;j<str_num;j++)
-			if(str_data[j].type == C_NOP) str_data[j].type = C_NAME;
-		for(j=0; j<size; j++)
-			linkdb_final(&syntax.curly[j].case_label);
-		return nullptr;
-	}
+/// Reads a script written by script_cache_entry_write
+static bool script_cache_entry_read( BinaryReader& reader, s_script_cache_entry& entry ){
+	uint32 size, names, labels, userfuncs;
 
-	parse_syntax_for_flag=0;
-	p=src;
-	p=skip_space(p);
-	if( options&SCRIPT_IGNORE_EXTERNAL_BRACKETS )
-	{// does not require brackets around the script
-		if( *p == '\0' && !(options&SCRIPT_RETURN_EMPTY_SCRIPT) )
-		{// empty script and can return nullptr
-			aFree( script_buf );
-			script_pos  = 0;
-			script_size = 0;
-			script_buf  = nullptr;
-			return nullptr;
-		}
-		end = '\0';
+	if( !reader.read( size ) || size == 0 )
+		return false;
+
+	entry.code.resize( size );
+
+	if( !reader.readBytes( entry.code.data(), size ) || !reader.read( names ) )
+		return false;
+
+	entry.names.resize( names );
+
+	for( auto& name : entry.names ){
+		if( !reader.read( name.first ) || !reader.readString( name.second ) || name.first + 3 > size )
+			return false;
 	}
-	else
-	{// requires brackets around the script
-		if( *p != '{' )
-			disp_error_message("not found '{'",p);
-		p = skip_space(p+1);
-		if( *p == '}' && !(options&SCRIPT_RETURN_EMPTY_SCRIPT) )
-		{// empty script and can return nullptr
-			aFree( script_buf );
-			script_pos  = 0;
-			script_size = 0;
-			script_buf  = nullptr;
-			return nullptr;
-		}
-		end = '}';
+
+	if( !reader.read( labels ) )
+		return false;
+
+	entry.labels.resize( labels );
+
+	for( auto& label : entry.labels ){
+		if( !reader.readString( label.first ) || !reader.read( label.second ) )
+			return false;
 	}
 
-	// clear references of labels, variables and internal functions
-	for(i=LABEL_START;i<str_num;i++){
-		if(
-			str_data[i].type==C_POS || str_data[i].type==C_NAME ||
-			str_data[i].type==C_USERFUNC || str_data[i].type == C_USERFUNC_POS
-		){
-			str_data[i].type=C_NOP;
-			str_data[i].backpatch=-1;
-			str_data[i].label=-1;
-		}
+	if( !reader.read( userfuncs ) )
+		return false;
+
+	entry.userfuncs.resize( userfuncs );
+
+	for( auto& userfunc : entry.userfuncs ){
+		if( !reader.readString( userfunc ) )
+			return false;
 	}
 
-	while( syntax.curly_count != 0 || *p != end )
-	{
+	return true;
+}
+
+static void script_cache_entry_write( BinaryWriter& writer, const s_script_cache_entry& entry ){
+	writer.write<uint32>( (uint32)entry.code.size() );
+	writer.writeBytes( entry.code.data(), entry.code.size() );
+	writer.write<uint32>( (uint32)entry.names.size() );
+	for( const auto& name : entry.names ){
+		writer.write( name.first );
+		writer.writeString( name.second );
+	}
+	writer.write<uint32>( (uint32)entry.labels.size() );
+	for( const auto& label : entry.labels ){
+		writer.writeString( label.first );
+		writer.write( label.second );
+	}
+	writer.write<uint32>( (uint32)entry.userfuncs.size() );
+	for( const auto& userfunc : entry.userfuncs )
+		writer.writeString( userfunc );
+}
+
+/// Copies the bytecode of a script and replaces the ids in it by names, they differ between runs
+static void script_cache_entry_fill( s_script_cache_entry& entry, const struct script_code* code ){
+	entry.code.assign( code->script_buf, code->script_buf + code->script_size );
+
+	// Walk the bytecode to find all references by id
+	for( int32 i = 0; i < code->script_size; ){
+		switch( get_com( code->script_buf, &i ) ){
+			case C_INT:
+				get_num( code->script_buf, &i );
+				break;
+			case C_POS:
+			case C_USERFUNC_POS:
+				i += 3;
+				break;
+			case C_NAME:
+				entry.names.emplace_back( i, get_str( GETVALUE( code->script_buf, i ) ) );
+				i += 3;
+				break;
+			case C_STR:
+				while( code->script_buf[i++] );
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+/// Creates a script from its cached bytecode, the names are resolved to the ids of this run
+static struct script_code* script_cache_entry_create( const s_script_cache_entry& entry, const char* src_file, int32 src_line, const char* src_func ){
+	struct script_code* code;
+	unsigned char* buf = (unsigned char *)aMalloc( entry.code.size() );
+
+	memcpy( buf, entry.code.data(), entry.code.size() );
+
+	for( const auto& name : entry.names ){
+		int32 l = add_str( name.second.c_str() );
+
+		if( str_data[l].type == C_NOP || str_data[l].type == C_POS || str_data[l].type == C_USERFUNC || str_data[l].type == C_USERFUNC_POS ){
+			// default unknown references to variables, like parse_script does
+			str_data[l].type = C_NAME;
+			str_data[l].label = l;
+		}
+
+		SETVALUE( buf, name.first, l );
+	}
+
+	CREATE2( code, struct script_code, 1, src_file, src_line, src_func );
+	code->script_buf = buf;
+	code->script_size = (int32)entry.code.size();
+	code->local.vars = nullptr;
+	code->local.arrays = nullptr;
+
+	return code;
+}
+
+static std::string script_cache_filename( const std::string& path ){
+	char name[32];
+
+	safesnprintf( name, sizeof( name ), "%016" PRIx64 ".bin", util::hash_fnv1a( path.c_str(), path.length() ) );
+
+	return std::string( script_config.script_cache_path ) + "/" + name;
+}
+
+/// Reads the cache of the current source file, it is only used if the source and the engine did not change
+static void script_cache_read(){
+	std::string filename = script_cache_filename( script_cache.path );
+	FILE* fp = fopen( filename.c_str(), "rb" );
+
+	if( fp == nullptr )
+		return;
+
+	std::vector<uint8> buf;
+
+	fseek( fp, 0, SEEK_END );
+	buf.resize( ftell( fp ) );
+	fseek( fp, 0, SEEK_SET );
+	buf.resize( fread( buf.data(), 1, buf.size(), fp ) );
+	fclose( fp );
+
+	BinaryReader reader( buf.data(), buf.size() );
+	char magic[4];
+	uint64 engine, hash;
+	std::string path;
+	uint32 count;
+
+	if( !reader.read( magic ) || memcmp( magic, SCRIPT_CACHE_MAGIC, 4 ) != 0 || !reader.read( engine ) || engine != script_cache_engine_key()
+		|| !reader.readString( path ) || path != script_cache.path || !reader.read( hash ) || hash != script_cache.hash || !reader.read( count ) )
+		return;
+
+	for( uint32 i = 0; i < count; i++ ){
+		uint32 offset;
+		int32 options;
+		s_script_cache_entry entry;
+
+		if( !reader.read( offset ) || !reader.read( options ) || !script_cache_entry_read( reader, entry ) ){
+			script_cache.entries.clear();
+			return;
+		}
+
+		script_cache.entries[std::make_pair( offset, options )] = std::move( entry );
+	}
+}
+
+/// Writes the cache of the current source file
+static void script_cache_write(){
+	BinaryWriter writer;
+	char magic[4];
+
+	memcpy( magic, SCRIPT_CACHE_MAGIC, sizeof( magic ) );
+	writer.write( magic );
+	writer.write( script_cache_engine_key() );
+	writer.writeString( script_cache.path );
+	writer.write( script_cache.hash );
+	writer.write<uint32>( (uint32)script_cache.entries.size() );
+
+	for( const auto& it : script_cache.entries ){
+		writer.write( it.first.first );
+		writer.write( it.first.second );
+		script_cache_entry_write( writer, it.second );
+	}
+
+	std::string filename = script_cache_filename( script_cache.path );
+	std::string temporary = filename + ".tmp";
+	std::error_code error;
+
+	std::filesystem::create_directories( script_config.script_cache_path, error );
+
+	FILE* fp = fopen( temporary.c_str(), "wb" );
+
+	if( fp == nullptr ){
+		ShowWarning( "script_cache_write: Could not write the script cache of '%s' to '%s'.\n", script_cache.path.c_str(), filename.c_str() );
+		return;
+	}
+
+	const std::vector<uint8>& buffer = writer.getBuffer();
+	bool written = fwrite( buffer.data(), 1, buffer.size(), fp ) == buffer.size();
+
+	written = fclose( fp ) == 0 && written;
+
+	if( written ){
+		std::filesystem::rename( temporary, filename, error );
+		written = !error;
+	}
+
+	if( !written ){
+		ShowWarning( "script_cache_write: Could not write the script cache of '%s' to '%s'.\n", script_cache.path.c_str(), filename.c_str() );
+		std::filesystem::remove( temporary, error );
+	}
+}
+
+/**
+ * Starts caching the scripts parsed from a NPC source file.
+ * @param path: Path of the source file
+ * @param buffer: Content of the source file, the scripts are parsed from it
+ * @param length: Length of the content
+ */
+void script_cache_begin( const char* path, const char* buffer, size_t length ){
+	script_cache.active = script_config.script_cache != 0;
+
+	if( !script_cache.active )
+		return;
+
+	// Without the git hash a cache of another build of the server could be used
+	if( get_git_hash()[0] == UNKNOWN_VERSION ){
+		static bool warned = false;
+
+		if( !warned ){
+			ShowWarning( "script_cache_begin: The git hash of the server is unknown, the script cache is disabled.\n" );
+			warned = true;
+		}
+
+		script_cache.active = false;
+		return;
+	}
+
+	script_cache.dirty = false;
+	script_cache.path = path;
+	script_cache.buffer = buffer;
+	script_cache.length = length;
+	script_cache.hash = util::hash_fnv1a( buffer, length );
+	script_cache.entries.clear();
+
+	script_cache_read();
+}
+
+/**
+ * Stops caching the current NPC source file and saves its cache if new scripts were parsed.
+ */
+void script_cache_end(){
+	if( !script_cache.active )
+		return;
+
+	if( script_cache.dirty )
+		script_cache_write();
+
+	script_cache.active = false;
+	script_cache.entries.clear();
+}
+
+/**
+ * Shows how many scripts were loaded from the cache since the last call.
+ * @param duration: Time it took to load the NPC files in milliseconds
+ */
+void script_cache_report( t_tick duration ){
+	if( script_config.script_cache )
+		ShowInfo( "Loaded the NPC scripts in %" PRtf "ms ('" CL_WHITE "%u" CL_RESET "' from the script cache, '" CL_WHITE "%u" CL_RESET "' parsed).\n", duration, script_cache.hits, script_cache.misses );
+	else
+		ShowInfo( "Loaded the NPC scripts in %" PRtf "ms.\n", duration );
+
+	script_cache.hits = 0;
+	script_cache.misses = 0;
+}
+
+/// Returns the offset of a script in the current source file or -1 if it does not belong to it
+static int64 script_cache_offset( const char* src ){
+	if( !script_cache.active || src < script_cache.buffer || src >= script_cache.buffer + script_cache.length )
+		return -1;
+
+	return src - script_cache.buffer;
+}
+
+/// Creates the script from the cache if it has been cached before
+static struct script_code* script_cache_load( const char* src, int32 options, const char* src_file, int32 src_line, const char* src_func ){
+	int64 offset = script_cache_offset( src );
+
+	if( offset < 0 )
+		return nullptr;
+
+	auto it = script_cache.entries.find( std::make_pair( (uint32)offset, options ) );
+
+	if( it == script_cache.entries.end() ){
+		script_cache.misses++;
+		return nullptr;
+	}
+
+	const s_script_cache_entry& entry = it->second;
+
+	// A function the script calls might have been removed from another file, parsing reports it
+	for( const auto& userfunc : entry.userfuncs ){
+		if( strdb_get( userfunc_db, userfunc.c_str() ) == nullptr ){
+			script_cache.misses++;
+			return nullptr;
+		}
+	}
+
+	if( options&SCRIPT_USE_LABEL_DB ){
+		db_clear( scriptlabel_db );
+
+		for( const auto& label : entry.labels )
+			strdb_iput( scriptlabel_db, label.first.c_str(), label.second );
+	}
+
+	script_cache.hits++;
+
+	return script_cache_entry_create( entry, src_file, src_line, src_func );
+}
+
+/// Adds a freshly parsed script to the cache of the current source file
+static void script_cache_store( const char* src, int32 options, struct script_code* code ){
+	int64 offset = script_cache_offset( src );
+
+	if( offset < 0 )
+		return;
+
+	s_script_cache_entry entry;
+
+	script_cache_entry_fill( entry, code );
+	entry.userfuncs.assign( parser_userfuncs.begin(), parser_userfuncs.end() );
+	std::sort( entry.userfuncs.begin(), entry.userfuncs.end() );
+	entry.userfuncs.erase( std::unique( entry.userfuncs.begin(), entry.userfuncs.end() ), entry.userfuncs.end() );
+
+	if( options&SCRIPT_USE_LABEL_DB ){
+		DBIterator* iter = db_iterator( scriptlabel_db );
+		DBKey key;
+
+		for( DBData* data = iter->first( iter, &key ); iter->exists( iter ); data = iter->next( iter, &key ) )
+			entry.labels.emplace_back( key.str, db_data2i( data ) );
+
+		dbi_destroy( iter );
+	}
+
+	script_cache.entries[std::make_pair( (uint32)offset, options )] = std::move( entry );
+	script_cache.dirty = true;
+}
+
+/// Remembers where a script was parsed from, so the profiler can name it.
+/// The file names are shared by all scripts of the same file.
+static void script_setsource( struct script_code* code, const char* file, int32 line ){
+	static std::unordered_set<std::string> files;
+
+	if( file == nullptr )
+		return;
+
+	code->source_file = files.emplace( file ).first->c_str();
+	code->source_line = line;
+}
+
+/**
+ * Returns how many warnings and errors the parser has shown so far.
+ * Databases compare it before and after parsing their scripts, as a snapshot of them would hide the messages.
+ */
+int32 script_parser_warnings(){
+	return parser_warnings;
+}
+
+/**
+ * Writes a script into a database snapshot in the format of the script cache.
+ * @param writer: Snapshot
+ * @param code: Script, can be nullptr
+ */
+void script_write_code( BinaryWriter& writer, const struct script_code* code ){
+	writer.write( code != nullptr );
+
+	if( code == nullptr )
+		return;
+
+	s_script_cache_entry entry;
+
+	script_cache_entry_fill( entry, code );
+	script_cache_entry_write( writer, entry );
+	writer.writeString( code->source_file != nullptr ? code->source_file : "" );
+	writer.write( code->source_line );
+}
+
+/**
+ * Reads a script written by script_write_code.
+ * Database scripts are parsed before any NPC file, so they cannot call global functions by name and no check for them is needed.
+ * @param reader: Snapshot
+ * @param code: Script or nullptr if none was written
+ * @return false if the snapshot is damaged
+ */
+bool script_read_code( BinaryReader& reader, struct script_code*& code ){
+	bool exists;
+	s_script_cache_entry entry;
+	std::string file;
+	int32 line;
+
+	code = nullptr;
+
+	if( !reader.read( exists ) )
+		return false;
+
+	if( !exists )
+		return true;
+
+	if( !script_cache_entry_read( reader, entry ) || !entry.labels.empty() || !entry.userfuncs.empty() || !reader.readString( file ) || !reader.read( line ) )
+		return false;
+
+	code = script_cache_entry_create( entry, ALC_MARK );
+	script_setsource( code, file.empty() ? nullptr : file.c_str(), line );
+
+	return true;
+}
+
+struct script_code* parse_script_( const char *src, const char *file, int32 line, int32 options, const char* src_file, int32 src_line, const char* src_func ){
+	const char *p,*tmpp;
+	int32 i;
+	struct script_code* code = nullptr;
+	char end;
+	bool unresolved_names = false;
+
+	parser_current_src = src;
+	parser_current_file = file;
+	parser_current_line = line;
+
+	if( src == nullptr )
+		return nullptr;// empty script
+
+	if( ( code = script_cache_load( src, options, src_file, src_line, src_func ) ) != nullptr ){
+		script_setsource( code, file, line );
+		return code;
+	}
+
+	int32 warnings = parser_warnings;
+
+	parser_last_eol = -1;
+	parser_userfuncs.clear();
+
+	memset(&syntax,0,sizeof(syntax));
+
+	script_buf=(unsigned char *)aMalloc(SCRIPT_BLOCK_SIZE*sizeof(unsigned char));
+	script_pos=0;
+	script_size=SCRIPT_BLOCK_SIZE;
+	parse_nextline(true, nullptr);
+
+	// who called parse_script is responsible for clearing the database after using it, but just in case... lets clear it here
+	if( options&SCRIPT_USE_LABEL_DB )
+		db_clear(scriptlabel_db);
+	parse_options = options;
+
+	if( setjmp( error_jump ) != 0 ) {
+		//Restore program state when script has problems. [from jA]
+		int32 j;
+		const int32 size = ARRAYLENGTH(syntax.curly);
+		if( error_report ){
+			script_error(src,file,line,error_msg,error_pos);
+			parser_warnings++;
+		}
+		aFree( error_msg );
+		aFree( script_buf );
+		script_pos  = 0;
+		script_size = 0;
+		script_buf  = nullptr;
+		for(j=LABEL_START;j<str_num;j++)
+			if(str_data[j].type == C_NOP) str_data[j].type = C_NAME;
+		for(j=0; j<size; j++)
+			linkdb_final(&syntax.curly[j].case_label);
+		return nullptr;
+	}
+
+	parse_syntax_for_flag=0;
+	p=src;
+	p=skip_space(p);
+	if( options&SCRIPT_IGNORE_EXTERNAL_BRACKETS )
+	{// does not require brackets around the script
+		if( *p == '\0' && !(options&SCRIPT_RETURN_EMPTY_SCRIPT) )
+		{// empty script and can return nullptr
+			aFree( script_buf );
+			script_pos  = 0;
+			script_size = 0;
+			script_buf  = nullptr;
+			return nullptr;
+		}
+		end = '\0';
+	}
+	else
+	{// requires brackets around the script
+		if( *p != '{' )
+			disp_error_message("not found '{'",p);
+		p = skip_space(p+1);
+		if( *p == '}' && !(options&SCRIPT_RETURN_EMPTY_SCRIPT) )
+		{// empty script and can return nullptr
+			aFree( script_buf );
+			script_pos  = 0;
+			script_size = 0;
+			script_buf  = nullptr;
+			return nullptr;
+		}
+		end = '}';
+	}
+
+	// clear references of labels, variables and internal functions
+	for(i=LABEL_START;i<str_num;i++){
+		if(
+			str_data[i].type==C_POS || str_data[i].type==C_NAME ||
+			str_data[i].type==C_USERFUNC || str_data[i].type == C_USERFUNC_POS
+		){
+			str_data[i].type=C_NOP;
+			str_data[i].backpatch=-1;
+			str_data[i].label=-1;
+		}
+	}
+
+	while( syntax.curly_count != 0 || *p != end )
+	{
 		if( *p == '\0' )
 			disp_error_message("unexpected end of script",p);
 		// Special handling only label
@@ -2612,6 +3438,9 @@ struct script_code* parse_script_( const char *src, const char *file, int32 line
 		disp_error_message("parse_script: unresolved function references", p);
 	}
 
+	if( script_config.script_optimize )
+		parse_threadjumps();
+
 #ifdef DEBUG_DISP
 	for(i=0;i<script_pos;i++){
 		if((i&15)==0) ShowMessage("%04x : ",i);
@@ -2657,6 +3486,12 @@ struct script_code* parse_script_( const char *src, const char *file, int32 line
 	code->script_size = script_size;
 	code->local.vars = nullptr;
 	code->local.arrays = nullptr;
+	script_setsource( code, file, line );
+
+	// Scripts with warnings are parsed again on the next start, so the warnings are shown again
+	if( parser_warnings == warnings )
+		script_cache_store( src, options, code );
+
 	return code;
 }
 
@@ -2684,26 +3519,20 @@ static bool script_rid2sd_( struct script_state *st, map_session_data** sd, cons
  */
 struct script_data *get_val_(struct script_state* st, struct script_data* data, map_session_data *sd)
 {
-	const char* name;
-	char prefix;
-	char postfix;
-
 	if( !data_isreference(data) )
 		return data;// not a variable/constant
 
-	name = reference_getname(data);
-	prefix = name[0];
-	postfix = name[strlen(name) - 1];
+	const struct str_data_struct& var = str_data[reference_getid(data)];
 
 	//##TODO use reference_tovariable(data) when it's confirmed that it works [FlavioJS]
-	if( !reference_toconstant(data) && not_server_variable(prefix) ) {
+	if( var.type != C_INT && script_var_needs_player(var.var_scope) ) {
 		if( sd == nullptr && !script_rid2sd(sd) ) {// needs player attached
-			if( postfix == '$' ) {// string variable
-				ShowWarning("script:get_val: cannot access player variable '%s', defaulting to \"\"\n", name);
+			if( var.var_string ) {// string variable
+				ShowWarning("script:get_val: cannot access player variable '%s', defaulting to \"\"\n", reference_getname(data));
 				data->type = C_CONSTSTR;
 				data->u.str = const_cast<char *>("");
 			} else {// integer variable
-				ShowWarning("script:get_val: cannot access player variable '%s', defaulting to 0\n", name);
+				ShowWarning("script:get_val: cannot access player variable '%s', defaulting to 0\n", reference_getname(data));
 				data->type = C_INT;
 				data->u.num = 0;
 			}
@@ -2711,25 +3540,26 @@ struct script_data *get_val_(struct script_state* st, struct script_data* data,
 		}
 	}
 
-	if( postfix == '$' ) {// string variable
+	if( var.var_string ) {// string variable
 
-		switch( prefix ) {
-			case '@':
+		switch( var.var_scope ) {
+			case SCRIPT_VAR_CHAR_TEMP:
 				data->u.str = pc_readregstr(sd, data->u.num);
 				break;
-			case '$':
+			case SCRIPT_VAR_SERVER:
 				data->u.str = mapreg_readregstr(data->u.num);
 				break;
-			case '#':
-				if( name[1] == '#' )
-					data->u.str = pc_readaccountreg2str(sd, data->u.num);// global
-				else
-					data->u.str = pc_readaccountregstr(sd, data->u.num);// local
+			case SCRIPT_VAR_ACCOUNT_GLOBAL:
+				data->u.str = pc_readaccountreg2str(sd, data->u.num);
 				break;
-			case '.':
+			case SCRIPT_VAR_ACCOUNT:
+				data->u.str = pc_readaccountregstr(sd, data->u.num);
+				break;
+			case SCRIPT_VAR_NPC:
+			case SCRIPT_VAR_SCOPE:
 				{
 					struct DBMap* n = data->ref ?
-							data->ref->vars : name[1] == '@' ?
+							data->ref->vars : var.var_scope == SCRIPT_VAR_SCOPE ?
 							st->stack->scope.vars : // instance/scope variable
 							st->script->local.vars; // npc variable
 					if( n )
@@ -2738,7 +3568,7 @@ struct script_data *get_val_(struct script_state* st, struct script_data* data,
 						data->u.str = nullptr;
 				}
 				break;
-			case '\'':
+			case SCRIPT_VAR_INSTANCE:
 				{
 					struct DBMap* n = nullptr;
 					if (data->ref)
@@ -2752,7 +3582,7 @@ struct script_data *get_val_(struct script_state* st, struct script_data* data,
 					if (n)
 						data->u.str = (char*)i64db_get(n,reference_getuid(data));
 					else {
-						ShowWarning("script:get_val: cannot access instance variable '%s', defaulting to \"\"\n", name);
+						ShowWarning("script:get_val: cannot access instance variable '%s', defaulting to \"\"\n", reference_getname(data));
 						data->u.str = nullptr;
 					}
 					break;
@@ -2774,28 +3604,29 @@ struct script_data *get_val_(struct script_state* st, struct script_data* data,
 
 		data->type = C_INT;
 
-		if( reference_toconstant(data) ) {
-			data->u.num = reference_getconstant(data);
-		} else if( reference_toparam(data) ) {
-			data->u.num = pc_readparam(sd, reference_getparamtype(data));
+		if( var.type == C_INT ) {
+			data->u.num = var.val;
+		} else if( var.type == C_PARAM ) {
+			data->u.num = pc_readparam(sd, var.val);
 		} else
-			switch( prefix ) {
-				case '@':
+			switch( var.var_scope ) {
+				case SCRIPT_VAR_CHAR_TEMP:
 					data->u.num = pc_readreg(sd, data->u.num);
 					break;
-				case '$':
+				case SCRIPT_VAR_SERVER:
 					data->u.num = mapreg_readreg(data->u.num);
 					break;
-				case '#':
-					if( name[1] == '#' )
-						data->u.num = pc_readaccountreg2(sd, data->u.num);// global
-					else
-						data->u.num = pc_readaccountreg(sd, data->u.num);// local
+				case SCRIPT_VAR_ACCOUNT_GLOBAL:
+					data->u.num = pc_readaccountreg2(sd, data->u.num);
 					break;
-				case '.':
+				case SCRIPT_VAR_ACCOUNT:
+					data->u.num = pc_readaccountreg(sd, data->u.num);
+					break;
+				case SCRIPT_VAR_NPC:
+				case SCRIPT_VAR_SCOPE:
 					{
 						struct DBMap* n = data->ref ?
-								data->ref->vars : name[1] == '@' ?
+								data->ref->vars : var.var_scope == SCRIPT_VAR_SCOPE ?
 								st->stack->scope.vars : // instance/scope variable
 								st->script->local.vars; // npc variable
 						if( n )
@@ -2804,7 +3635,7 @@ struct script_data *get_val_(struct script_state* st, struct script_data* data,
 							data->u.num = 0;
 					}
 					break;
-				case '\'':
+				case SCRIPT_VAR_INSTANCE:
 					{
 						struct DBMap* n = nullptr;
 						if (data->ref)
@@ -2818,7 +3649,7 @@ struct script_data *get_val_(struct script_state* st, struct script_data* data,
 						if (n)
 							data->u.num = i64db_i64get(n,reference_getuid(data));
 						else {
-							ShowWarning("script:get_val: cannot access instance variable '%s', defaulting to 0\n", name);
+							ShowWarning("script:get_val: cannot access instance variable '%s', defaulting to 0\n", reference_getname(data));
 							data->u.num = 0;
 						}
 						break;
@@ -2913,9 +3744,8 @@ void script_array_ensure_zero(struct script_state *st, map_session_data *sd, int
 	if (src && src->arrays) {
 		struct script_array *sa = static_cast<script_array *>(idb_get(src->arrays, script_getvarid(uid)));
 		if (sa) {
-			uint32 i;
+			uint32 i = script_array_find_member(sa, 0);
 
-			ARR_FIND(0, sa->size, i, sa->members[i] == 0);
 			if( i != sa->size ) {
 				if( !insert )
 					script_array_remove_member(src,sa,i);
@@ -2957,14 +3787,7 @@ uint32 script_array_highest_key(struct script_state *st, map_session_data *sd, c
 		script_array_ensure_zero(st,sd,reference_uid(key, 0), ref);
 
 		if( ( sa = static_cast<script_array *>(idb_get(src->arrays, key)) ) ) {
-			uint32 i, highest_key = 0;
-
-			for(i = 0; i < sa->size; i++) {
-				if( sa->members[i] > highest_key )
-					highest_key = sa->members[i];
-			}
-
-			return sa->size ? highest_key + 1 : 0;
+			return sa->size ? sa->highest + 1 : 0;
 		}
 	}
 	
@@ -2975,6 +3798,7 @@ int32 script_free_array_db(DBKey key, DBData *data, va_list ap)
 {
 	struct script_array *sa = static_cast<script_array *>(db_data2ptr(data));
 	aFree(sa->members);
+	aFree(sa->positions);
 	ers_free(array_ers, sa);
 	return SCRIPT_CMD_SUCCESS;
 }
@@ -2985,6 +3809,7 @@ int32 script_free_array_db(DBKey key, DBData *data, va_list ap)
 void script_array_delete(struct reg_db *src, struct script_array *sa)
 {
 	aFree(sa->members);
+	aFree(sa->positions);
 	idb_remove(src->arrays, sa->id);
 	ers_free(array_ers, sa);
 }
@@ -2996,7 +3821,7 @@ void script_array_delete(struct reg_db *src, struct script_array *sa)
  **/
 void script_array_remove_member(struct reg_db *src, struct script_array *sa, uint32 idx)
 {
-	uint32 i, cursor;
+	uint32 index, last;
 
 	// it's the only member left, no need to do anything other than delete the array data
 	if( sa->size == 1 ) {
@@ -3004,17 +3829,57 @@ void script_array_remove_member(struct reg_db *src, struct script_array *sa, uin
 		return;
 	}
 
-	sa->members[idx] = UINT_MAX;
+	index = sa->members[idx];
+	last = sa->members[--sa->size];
 
-	for(i = 0, cursor = 0; i < sa->size; i++) {
-		if( sa->members[i] == UINT_MAX )
-			continue;
-		if( i != cursor )
-			sa->members[cursor] = sa->members[i];
-		cursor++;
+	// the last member fills the gap, the order of the member list does not matter
+	sa->members[idx] = last;
+	if( last < sa->dense_size )
+		sa->positions[last] = idx;
+	if( index < sa->dense_size )
+		sa->positions[index] = UINT_MAX;
+
+	if( index == sa->highest ) {
+		if( index < sa->dense_size ) {
+			// all remaining members are below it, so they are in the position list
+			do {
+				index--;
+			} while( sa->positions[index] == UINT_MAX );
+			sa->highest = index;
+		} else {
+			uint32 i;
+
+			sa->highest = 0;
+			for( i = 0; i < sa->size; i++ ) {
+				if( sa->members[i] > sa->highest )
+					sa->highest = sa->members[i];
+			}
+		}
+	}
+}
+
+/**
+ * Extends the position list of script_array, so it covers the given array index
+ *
+ * @param idx the index of the array member being inserted
+ **/
+static void script_array_grow_positions(struct script_array *sa, uint32 idx)
+{
+	uint32 i, dense_size = max( max( idx + 1, sa->dense_size * 2 ), 32U );
+
+	if( dense_size > SCRIPT_ARRAY_DENSE_MAX )
+		dense_size = SCRIPT_ARRAY_DENSE_MAX;
+
+	RECREATE(sa->positions, uint32, dense_size);
+	memset(sa->positions + sa->dense_size, 0xFF, sizeof(uint32) * ( dense_size - sa->dense_size ));
+
+	// members that were searched in the member list until now
+	for( i = 0; i < sa->size; i++ ) {
+		if( sa->members[i] >= sa->dense_size && sa->members[i] < dense_size )
+			sa->positions[sa->members[i]] = i;
 	}
 
-	sa->size = cursor;
+	sa->dense_size = dense_size;
 }
 
 /**
@@ -3024,9 +3889,41 @@ void script_array_remove_member(struct reg_db *src, struct script_array *sa, uin
  **/
 void script_array_add_member(struct script_array *sa, uint32 idx)
 {
-	RECREATE(sa->members, uint32, ++sa->size);
+	if( sa->size == sa->capacity ) {
+		sa->capacity = max( sa->capacity * 2, 8U );
+		RECREATE(sa->members, uint32, sa->capacity);
+	}
+
+	// Indices are kept in the position list as long as at least a quarter of it is used,
+	// huge or scattered indices are searched in the member list instead
+	if( idx >= sa->dense_size && idx < SCRIPT_ARRAY_DENSE_MAX && idx < ( (uint64)sa->size + 16 ) * 4 )
+		script_array_grow_positions(sa, idx);
+
+	if( idx < sa->dense_size )
+		sa->positions[idx] = sa->size;
+	if( sa->size == 0 || idx > sa->highest )
+		sa->highest = idx;
+
+	sa->members[sa->size++] = idx;
+}
+
+/**
+ * Searches an array index in the list of script_array
+ *
+ * @param idx the index of the array member
+ * @return the position of the member in script_array struct list, or sa->size if it is not a member
+ **/
+uint32 script_array_find_member(struct script_array *sa, uint32 idx)
+{
+	uint32 i;
+
+	if( idx < sa->dense_size ) {
+		i = sa->positions[idx];
+		return ( i != UINT_MAX ) ? i : sa->size;
+	}
 
-	sa->members[sa->size - 1] = idx;
+	ARR_FIND(0, sa->size, i, sa->members[i] == idx);
+	return i;
 }
 
 /**
@@ -3096,13 +3993,7 @@ void script_array_update(struct reg_db *src, int64 num, bool empty)
 	}
 
 	if( sa ) {
-		uint32 i;
-
-		// search
-		for(i = 0; i < sa->size; i++) {
-			if( sa->members[i] == index )
-				break;
-		}
+		uint32 i = script_array_find_member(sa, index);
 
 		// if existent
 		if( i != sa->size ) {
@@ -3119,6 +4010,10 @@ void script_array_update(struct reg_db *src, int64 num, bool empty)
 		sa->id = id;
 		sa->members = nullptr;
 		sa->size = 0;
+		sa->capacity = 0;
+		sa->positions = nullptr;
+		sa->dense_size = 0;
+		sa->highest = 0;
 		script_array_add_member(sa,index);
 		idb_put(src->arrays, id, sa);
 	}
@@ -3138,29 +4033,31 @@ void script_array_update(struct reg_db *src, int64 num, bool empty)
  * TODO: return values are screwed up, have been for some time (reaad: years), e.g. some functions return 1 failure and success.
  *------------------------------------------*/
 bool set_reg_str( struct script_state* st, map_session_data* sd, int64 num, const char* name, const char* value, struct reg_db *ref ){
-	char prefix = name[0];
-	size_t vlen = 0;
+	const struct str_data_struct& var = str_data[script_getvarid( num )];
 
-	if( !script_check_RegistryVariableLength( 0, name, &vlen ) ){
-		ShowError( "set_reg: Variable name length is too long (aid: %d, cid: %d): '%s' sz=%" PRIuPTR "\n", sd ? sd->status.account_id : -1, sd ? sd->status.char_id : -1, name, vlen );
+	if( !var.var_length_valid ){
+		ShowError( "set_reg: Variable name length is too long (aid: %d, cid: %d): '%s' sz=%" PRIuPTR "\n", sd ? sd->status.account_id : -1, sd ? sd->status.char_id : -1, name, strlen( name ) );
 		return false;
 	}
 
-	if( !is_string_variable( name ) ){
+	if( !var.var_string ){
 		// integer variable
 		return false;
 	}
 
-	switch( prefix ){
-		case '@':
+	switch( var.var_scope ){
+		case SCRIPT_VAR_CHAR_TEMP:
 			pc_setregstr( sd, num, value );
 			return true;
-		case '$':
+		case SCRIPT_VAR_SERVER:
 			return mapreg_setregstr( num, value );
-		case '#':
-			return ( name[1] == '#' ) ? pc_setaccountreg2str( sd, num, value ) : pc_setaccountregstr( sd, num, value );
-		case '.': {
-				struct reg_db *n = ( ref ) ? ref : ( name[1] == '@' ) ? &st->stack->scope : &st->script->local;
+		case SCRIPT_VAR_ACCOUNT_GLOBAL:
+			return pc_setaccountreg2str( sd, num, value );
+		case SCRIPT_VAR_ACCOUNT:
+			return pc_setaccountregstr( sd, num, value );
+		case SCRIPT_VAR_NPC:
+		case SCRIPT_VAR_SCOPE: {
+				struct reg_db *n = ( ref ) ? ref : ( var.var_scope == SCRIPT_VAR_SCOPE ) ? &st->stack->scope : &st->script->local;
 
 				if( n ){
 					if( value[0] ){
@@ -3179,7 +4076,7 @@ bool set_reg_str( struct script_state* st, map_session_data* sd, int64 num, cons
 				}
 			}
 			return true;
-		case '\'': {
+		case SCRIPT_VAR_INSTANCE: {
 				struct reg_db *src = nullptr;
 
 				if( ref ){
@@ -3218,21 +4115,20 @@ bool set_reg_str( struct script_state* st, map_session_data* sd, int64 num, cons
 }
 
 bool set_reg_num( struct script_state* st, map_session_data* sd, int64 num, const char* name, int64 value, struct reg_db *ref ){
-	char prefix = name[0];
-	size_t vlen = 0;
+	const struct str_data_struct& var = str_data[script_getvarid( num )];
 
-	if( !script_check_RegistryVariableLength( 0, name, &vlen ) ){
-		ShowError( "set_reg: Variable name length is too long (aid: %d, cid: %d): '%s' sz=%" PRIuPTR "\n", sd ? sd->status.account_id : -1, sd ? sd->status.char_id : -1, name, vlen );
+	if( !var.var_length_valid ){
+		ShowError( "set_reg: Variable name length is too long (aid: %d, cid: %d): '%s' sz=%" PRIuPTR "\n", sd ? sd->status.account_id : -1, sd ? sd->status.char_id : -1, name, strlen( name ) );
 		return false;
 	}
 
-	if( is_string_variable( name ) ){
+	if( var.var_string ){
 		// string variable
 		return false;
 	}
 
-	if( str_data[script_getvarid(num)].type == C_PARAM ){
-		if( pc_setparam( sd, str_data[script_getvarid(num)].val, value ) == 0 ){
+	if( var.type == C_PARAM ){
+		if( pc_setparam( sd, var.val, value ) == 0 ){
 			if( st != nullptr ) {
 				ShowError( "script_set_reg: failed to set param '%s' to %" PRId64 ".\n", name, value );
 				script_reportsrc( st );
@@ -3245,16 +4141,19 @@ bool set_reg_num( struct script_state* st, map_session_data* sd, int64 num, cons
 		return true;
 	}
 
-	switch( prefix ){
-		case '@':
+	switch( var.var_scope ){
+		case SCRIPT_VAR_CHAR_TEMP:
 			pc_setreg( sd, num, value );
 			return true;
-		case '$':
+		case SCRIPT_VAR_SERVER:
 			return mapreg_setreg( num, value );
-		case '#':
-			return ( name[1] == '#' ) ? pc_setaccountreg2(sd, num, value) :	pc_setaccountreg( sd, num, value );
-		case '.': {
-				struct reg_db *n = ( ref ) ? ref : ( name[1] == '@' ) ? &st->stack->scope : &st->script->local;
+		case SCRIPT_VAR_ACCOUNT_GLOBAL:
+			return pc_setaccountreg2( sd, num, value );
+		case SCRIPT_VAR_ACCOUNT:
+			return pc_setaccountreg( sd, num, value );
+		case SCRIPT_VAR_NPC:
+		case SCRIPT_VAR_SCOPE: {
+				struct reg_db *n = ( ref ) ? ref : ( var.var_scope == SCRIPT_VAR_SCOPE ) ? &st->stack->scope : &st->script->local;
 
 				if( n ){
 					if( value != 0 ){
@@ -3273,7 +4172,7 @@ bool set_reg_num( struct script_state* st, map_session_data* sd, int64 num, cons
 				}
 			}
 			return true;
-		case '\'': {
+		case SCRIPT_VAR_INSTANCE: {
 				struct reg_db *src = nullptr;
 
 				if( ref ){
@@ -3316,7 +4215,7 @@ bool set_var_str( map_session_data* sd, const char* name, const char* val ){
 }
 
 bool clear_reg( struct script_state* st, map_session_data* sd, int64 num, const char* name, struct reg_db *ref ){
-	if( is_string_variable( name ) ){
+	if( str_data[script_getvarid( num )].var_string ){
 		return set_reg_str( st, sd, num, name, "", ref );
 	}else{
 		return set_reg_num( st, sd, num, name, 0, ref );
@@ -4085,6 +4984,264 @@ static void script_check_buildin_argtype(struct script_state* st, int32 func)
 }
 
 
+/*==========================================
+ * Script profiler
+ *------------------------------------------*/
+/// Collected data of a script call stack or of a buildin called by it
+struct s_script_profile_stats {
+	bool buildin; // the last frame of the stack is a buildin
+	uint64 calls; // times the script was started, resumed or called, times the buildin was called
+	uint64 instructions;
+	uint64 buildins; // buildin calls of the script
+	uint64 time; // nanoseconds spent in the script itself or in the buildin
+	uint64 buildin_time; // nanoseconds spent in the buildins of the script
+};
+
+/// Profiling state of a script execution, see run_script_main
+struct s_script_profile_run {
+	uint32 weight; // executions this one stands for, 0 if it is not profiled
+	std::string stack; // call stack of the current segment, in the folded format of flamegraph.pl
+	struct script_code* script; // script of the current segment
+	int32 defsp; // stack base of the current segment, changed by callsub, callfunc and return
+	std::chrono::steady_clock::time_point start; // start of the current segment
+	uint64 instructions; // instruction counter at the start of the current segment
+	uint64 buildins; // buildin calls of the current segment
+	uint64 buildin_time; // nanoseconds spent in buildins, including the scripts they ran
+	uint64 buildin_self_time; // nanoseconds spent in buildins, without the scripts they ran
+};
+
+static time_t script_profile_start; // start of the current profiling period
+static std::unordered_map<std::string, s_script_profile_stats> script_profile_stats; // folded stack -> stats
+static s_script_profile_run* script_profile_current = nullptr; // innermost profiled script execution
+static uint64 script_profile_nested_time = 0; // nanoseconds spent in scripts that were run by a buildin
+static int32 script_profile_counter = 0; // executions since the last sample
+
+/// Starts, changes or stops the script profiler.
+/// Changing the mode discards the collected data.
+void script_profile_enable( e_script_profile mode ){
+	if( mode != script_config.script_profile )
+		script_profile_reset();
+
+	script_config.script_profile = mode;
+}
+
+/// Discards the collected data and starts a new profiling period.
+void script_profile_reset( void ){
+	script_profile_stats.clear();
+	script_profile_counter = 0;
+	time( &script_profile_start );
+}
+
+/// Decides if a script execution is profiled.
+/// @return number of executions the profiled one stands for, 0 if it is not profiled
+static uint32 script_profile_weight( void ){
+	switch( script_config.script_profile ){
+		case SCRIPT_PROFILE_EXACT:
+			return 1;
+		case SCRIPT_PROFILE_SAMPLE:
+			if( ++script_profile_counter < script_config.script_profile_sample_rate )
+				return 0;
+
+			script_profile_counter = 0;
+			return script_config.script_profile_sample_rate;
+		default:
+			return 0;
+	}
+}
+
+/// Returns the name of a script frame.
+/// NPC scripts are named after the NPC and the last label at or before pos, other scripts after their source.
+static std::string script_profile_frame( struct script_state* st, struct script_code* code, int32 pos ){
+	npc_data* nd = map_id2nd( st->oid );
+	std::string name;
+
+	if( nd != nullptr && nd->subtype == NPCTYPE_SCRIPT && nd->u.scr.script == code ){
+		const npc_label_list* label = nullptr;
+
+		for( int32 i = 0; i < nd->u.scr.label_list_num; i++ ){
+			const npc_label_list* it = &nd->u.scr.label_list[i];
+
+			if( it->pos <= pos && ( label == nullptr || it->pos > label->pos ) )
+				label = it;
+		}
+
+		name = nd->exname;
+
+		if( label != nullptr ){
+			name += "::";
+			name += label->name;
+		}
+	}else if( code != nullptr && code->source_file != nullptr ){
+		name = code->source_file;
+		name += ":" + std::to_string( code->source_line );
+	}else
+		name = "unknown";
+
+	// Frames are separated by ';' in the folded format
+	for( char& c : name ){
+		if( c == ';' )
+			c = '_';
+	}
+
+	return name;
+}
+
+/// Starts a new segment of a profiled script execution at the current position of the script.
+/// The call stack is read from the return information of callsub and callfunc on the stack.
+static void script_profile_begin( struct script_state* st, s_script_profile_run& run, uint64 instructions, bool call ){
+	run.stack.clear();
+
+	for( int32 i = 0; i < st->stack->sp; i++ ){
+		if( st->stack->stack_data[i].type != C_RETINFO )
+			continue;
+
+		struct script_retinfo* ri = st->stack->stack_data[i].u.ri;
+
+		run.stack += script_profile_frame( st, ri->script, ri->pos );
+		run.stack += ';';
+	}
+
+	run.stack += script_profile_frame( st, st->script, st->pos );
+	run.script = st->script;
+	run.defsp = st->stack->defsp;
+	run.start = std::chrono::steady_clock::now();
+	run.instructions = instructions;
+	run.buildins = 0;
+	run.buildin_time = 0;
+	run.buildin_self_time = 0;
+
+	if( call )
+		script_profile_stats[run.stack].calls += run.weight;
+}
+
+/// Adds the current segment of a profiled script execution to the collected data.
+static void script_profile_end( s_script_profile_run& run, uint64 instructions ){
+	uint64 time = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - run.start ).count();
+	s_script_profile_stats& stats = script_profile_stats[run.stack];
+
+	stats.instructions += ( instructions - run.instructions ) * run.weight;
+	stats.buildins += run.buildins * run.weight;
+	stats.time += ( time > run.buildin_time ? time - run.buildin_time : 0 ) * run.weight;
+	stats.buildin_time += run.buildin_self_time * run.weight;
+}
+
+/// Adds a buildin call of the innermost profiled script execution to the collected data.
+/// @param func Buildin that was called
+/// @param start Time the buildin was called
+/// @param nested Value of script_profile_nested_time when the buildin was called
+static void script_profile_buildin( int32 func, std::chrono::steady_clock::time_point start, uint64 nested ){
+	s_script_profile_run& run = *script_profile_current;
+	uint64 time = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - start ).count();
+	// Scripts run by the buildin, like an item script run by consumeitem, are profiled on their own
+	uint64 nested_time = script_profile_nested_time - nested;
+	uint64 self_time = time > nested_time ? time - nested_time : 0;
+	size_t length = run.stack.length();
+
+	run.buildins++;
+	run.buildin_time += time;
+	run.buildin_self_time += self_time;
+
+	run.stack += ';';
+	run.stack += get_str( func );
+
+	s_script_profile_stats& stats = script_profile_stats[run.stack];
+
+	run.stack.resize( length );
+
+	stats.buildin = true;
+	stats.calls += run.weight;
+	stats.time += self_time * run.weight;
+}
+
+/// Merges the collected data by the last frame of the stacks and sorts it, the most expensive first.
+static std::vector<std::pair<std::string, s_script_profile_stats>> script_profile_sorted( bool buildin ){
+	std::unordered_map<std::string, s_script_profile_stats> merged;
+
+	for( const auto& it : script_profile_stats ){
+		if( it.second.buildin != buildin )
+			continue;
+
+		size_t pos = it.first.rfind( ';' );
+		s_script_profile_stats& stats = merged[pos == std::string::npos ? it.first : it.first.substr( pos + 1 )];
+
+		stats.calls += it.second.calls;
+		stats.instructions += it.second.instructions;
+		stats.buildins += it.second.buildins;
+		stats.time += it.second.time;
+		stats.buildin_time += it.second.buildin_time;
+	}
+
+	std::vector<std::pair<std::string, s_script_profile_stats>> sorted( merged.begin(), merged.end() );
+
+	std::sort( sorted.begin(), sorted.end(), []( const auto& a, const auto& b ){
+		return a.second.time + a.second.buildin_time > b.second.time + b.second.buildin_time;
+	} );
+
+	return sorted;
+}
+
+/// Prints the scripts and buildins that used the most time to the console.
+void script_profile_report( void ){
+	const size_t lines = 20;
+
+	if( script_config.script_profile == SCRIPT_PROFILE_OFF && script_profile_stats.empty() ){
+		ShowInfo("The script profiler is disabled.\n");
+		return;
+	}
+
+	if( script_config.script_profile == SCRIPT_PROFILE_SAMPLE )
+		ShowInfo("Script profile of the last " CL_WHITE "%.0f" CL_RESET " seconds, sampling " CL_WHITE "1" CL_RESET " of " CL_WHITE "%d" CL_RESET " executions:\n", difftime(time(nullptr), script_profile_start), script_config.script_profile_sample_rate);
+	else
+		ShowInfo("Script profile of the last " CL_WHITE "%.0f" CL_RESET " seconds:\n", difftime(time(nullptr), script_profile_start));
+
+	std::vector<std::pair<std::string, s_script_profile_stats>> scripts = script_profile_sorted( false );
+
+	ShowMessage("%-50s %10s %12s %10s %10s %12s %10s\n", "script", "calls", "instructions", "buildins", "self (ms)", "buildin (ms)", "avg (us)");
+	for( size_t i = 0; i < scripts.size() && i < lines; i++ ){
+		const s_script_profile_stats& stats = scripts[i].second;
+
+		ShowMessage("%-50s %10" PRIu64 " %12" PRIu64 " %10" PRIu64 " %10.1f %12.1f %10.1f\n",
+			scripts[i].first.c_str(), stats.calls, stats.instructions, stats.buildins, stats.time / 1000000., stats.buildin_time / 1000000.,
+			stats.calls > 0 ? ( stats.time + stats.buildin_time ) / 1000. / stats.calls : 0.);
+	}
+	if( scripts.size() > lines )
+		ShowMessage("... and %" PRIuPTR " more scripts\n", scripts.size() - lines);
+
+	std::vector<std::pair<std::string, s_script_profile_stats>> buildins = script_profile_sorted( true );
+
+	ShowMessage("%-50s %10s %12s %10s\n", "buildin", "calls", "total (ms)", "avg (us)");
+	for( size_t i = 0; i < buildins.size() && i < lines; i++ ){
+		const s_script_profile_stats& stats = buildins[i].second;
+
+		ShowMessage("%-50s %10" PRIu64 " %12.1f %10.1f\n",
+			buildins[i].first.c_str(), stats.calls, stats.time / 1000000., stats.calls > 0 ? stats.time / 1000. / stats.calls : 0.);
+	}
+	if( buildins.size() > lines )
+		ShowMessage("... and %" PRIuPTR " more buildins\n", buildins.size() - lines);
+}
+
+/// Writes the collected data in the folded stack format of flamegraph.pl, with the time in microseconds.
+/// @param filename File to write to, it is overwritten
+/// @return true on success
+bool script_profile_export( const char* filename ){
+	FILE* fp = fopen(filename, "w");
+
+	if( fp == nullptr ){
+		ShowError("script_profile_export: Failed to open '%s' for writing.\n", filename);
+		return false;
+	}
+
+	for( const auto& it : script_profile_stats ){
+		uint64 time = it.second.time / 1000;
+
+		if( time > 0 )
+			fprintf(fp, "%s %" PRIu64 "\n", it.first.c_str(), time);
+	}
+
+	fclose(fp);
+	return true;
+}
+
 /// Executes a buildin command.
 /// Stack: C_NAME(<command>) C_ARG <arg0> <arg1> ... <argN>
 int32 run_func(struct script_state *st)
@@ -4131,7 +5288,18 @@ int32 run_func(struct script_state *st)
 		}
 #endif
 
-		if (str_data[func].func(st) == SCRIPT_CMD_FAILURE) {
+		std::chrono::steady_clock::time_point profile_start;
+		uint64 profile_nested = script_profile_nested_time;
+
+		if( script_profile_current != nullptr )
+			profile_start = std::chrono::steady_clock::now();
+
+		int32 result = str_data[func].func(st);
+
+		if( script_profile_current != nullptr )
+			script_profile_buildin( func, profile_start, profile_nested );
+
+		if (result == SCRIPT_CMD_FAILURE) {
 			//Report error
 			ShowWarning("Script command '%s' returned failure.\n", get_str(func));
 			script_reportsrc(st);
@@ -4341,33 +5509,173 @@ static void script_detach_state(struct script_state* st, bool dequeue_event)
 	}
 }
 
-/// Attaches script state to possibly attached character and backups it's previous script, if any.
-///
-/// @param st Script state to attach.
-void script_attach_state(struct script_state* st){
-	map_session_data* sd;
+/// Attaches script state to possibly attached character and backups it's previous script, if any.
+///
+/// @param st Script state to attach.
+void script_attach_state(struct script_state* st){
+	map_session_data* sd;
+
+	if(st->rid && (sd = map_id2sd(st->rid))!=nullptr)
+	{
+		if(st!=sd->st)
+		{
+			if(st->bk_st)
+			{// there is already a backup
+				ShowDebug("script_attach_state: Previous script state lost (rid=%d, oid=%d, state=%d, bk_npcid=%d).\n", st->bk_st->rid, st->bk_st->oid, st->bk_st->state, st->bk_npcid);
+			}
+			st->bk_st = sd->st;
+			st->bk_npcid = sd->npc_id;
+		}
+		sd->st = st;
+		sd->npc_id = st->oid;
+		sd->npc_item_flag = st->npc_item_flag; // load default.
+		sd->state.disable_atcommand_on_npc = battle_config.atcommand_disable_npc && (!pc_has_permission(sd, PC_PERM_ENABLE_COMMAND));
+#ifdef SECURE_NPCTIMEOUT
+		if( sd->npc_idle_timer == INVALID_TIMER && !sd->state.ignoretimeout )
+			sd->npc_idle_timer = add_timer(gettick() + (SECURE_NPCTIMEOUT_INTERVAL*1000),npc_secure_timeout_timer,sd->id,0);
+		sd->npc_idle_tick = gettick();
+#endif
+	}
+}
+
+/// Reads a scope variable (.@) that holds an integer and is used without an index in the code at pos.
+/// @return the id of the variable or 0 if the code is something else
+static int32 script_fused_variable(const unsigned char* buf, int32 pos)
+{
+	if( buf[pos] != C_NAME )
+		return 0;
+
+	int32 id = GETVALUE(buf, pos + 1);
+	const struct str_data_struct& var = str_data[id];
+
+	if( var.type != C_NAME || var.var_scope != SCRIPT_VAR_SCOPE || var.var_string )
+		return 0;
+
+	return id;
+}
+
+/// Superinstruction for increments of a scope variable by an integer literal, such as
+/// ".@i++", "++.@i", ".@i--" or ".@i += 2", compiled to setr(.@i, .@i <int> <+|->{, .@i}).
+/// The value is written directly instead of calling setr through the stack.
+/// Has to be called with st->pos after the command of the setr name.
+/// @return the number of instructions that were run, 0 if the code did not match and nothing was done
+static int32 script_fused_increment(struct script_state* st)
+{
+	const unsigned char* buf = st->script->script_buf;
+	int32 pos = st->pos + 3;
+
+	if( st->op2ref || buf[pos++] != C_ARG )
+		return 0;
+
+	int32 id = script_fused_variable(buf, pos);
+
+	if( id == 0 || script_fused_variable(buf, pos + 4) != id || buf[pos + 8] < 0x80 )
+		return 0;
+
+	pos += 8;
+
+	int64 delta = get_num(st->script->script_buf, &pos);
+	c_op op = (c_op)buf[pos++];
+	int32 count = 7;
+	bool post = false;
+
+	if( op != C_ADD && op != C_SUB )
+		return 0;
+
+	// Post increment, the previous value is the result of the expression
+	if( script_fused_variable(buf, pos) == id ){
+		pos += 4;
+		count++;
+		post = true;
+	}
+
+	if( buf[pos++] != C_FUNC )
+		return 0;
+
+	struct script_data data = {};
+
+	data.type = C_NAME;
+	data.u.num = id;
+	get_val(st, &data);
+
+	int64 value;
+
+	// Overflows are reported by op_2num
+	if( !data_isint(&data) || ( op == C_ADD ? util::safe_addition(data.u.num, delta, value) : util::safe_substraction(data.u.num, delta, value) ) )
+		return 0;
+
+	if( buf[pos] == C_EOL && st->stack->sp == st->stack->defsp ){
+		// The result would be removed by the end of the statement right away
+		pos++;
+		count++;
+	}else if( post ){
+		push_val(st->stack, C_INT, data.u.num);
+	}else{
+		push_val(st->stack, C_NAME, id);
+	}
+
+	set_reg_num(st, nullptr, id, get_str(id), value, nullptr);
+	st->pos = pos;
+
+	return count;
+}
+
+/// Superinstruction for conditions comparing a scope variable to an integer literal,
+/// such as "if( .@i < 10 )" or the condition of a for loop, compiled to
+/// jump_zero(.@i <int> <compare>, <label>).
+/// Has to be called with st->pos after the command of the jump_zero name.
+/// @return the number of instructions that were run, 0 if the code did not match and nothing was done
+static int32 script_fused_jump_zero(struct script_state* st)
+{
+	const unsigned char* buf = st->script->script_buf;
+	int32 pos = st->pos + 3;
 
-	if(st->rid && (sd = map_id2sd(st->rid))!=nullptr)
-	{
-		if(st!=sd->st)
-		{
-			if(st->bk_st)
-			{// there is already a backup
-				ShowDebug("script_attach_state: Previous script state lost (rid=%d, oid=%d, state=%d, bk_npcid=%d).\n", st->bk_st->rid, st->bk_st->oid, st->bk_st->state, st->bk_npcid);
-			}
-			st->bk_st = sd->st;
-			st->bk_npcid = sd->npc_id;
-		}
-		sd->st = st;
-		sd->npc_id = st->oid;
-		sd->npc_item_flag = st->npc_item_flag; // load default.
-		sd->state.disable_atcommand_on_npc = battle_config.atcommand_disable_npc && (!pc_has_permission(sd, PC_PERM_ENABLE_COMMAND));
-#ifdef SECURE_NPCTIMEOUT
-		if( sd->npc_idle_timer == INVALID_TIMER && !sd->state.ignoretimeout )
-			sd->npc_idle_timer = add_timer(gettick() + (SECURE_NPCTIMEOUT_INTERVAL*1000),npc_secure_timeout_timer,sd->id,0);
-		sd->npc_idle_tick = gettick();
-#endif
+	if( st->op2ref || buf[pos++] != C_ARG )
+		return 0;
+
+	int32 id = script_fused_variable(buf, pos);
+
+	if( id == 0 || buf[pos + 4] < 0x80 )
+		return 0;
+
+	pos += 4;
+
+	int64 value = get_num(st->script->script_buf, &pos);
+	c_op op = (c_op)buf[pos++];
+
+	if( op < C_LE || op > C_NE || buf[pos] != C_POS || buf[pos + 4] != C_FUNC )
+		return 0;
+
+	int32 label = GETVALUE(buf, pos + 1);
+	struct script_data data = {};
+
+	data.type = C_NAME;
+	data.u.num = id;
+	get_val(st, &data);
+
+	if( !data_isint(&data) )
+		return 0;
+
+	int64 num = data.u.num;
+	bool result;
+
+	switch( op ){
+		case C_LE: result = num <= value; break;
+		case C_LT: result = num < value; break;
+		case C_GE: result = num >= value; break;
+		case C_GT: result = num > value; break;
+		case C_EQ: result = num == value; break;
+		default:   result = num != value; break;
+	}
+
+	if( result ){
+		st->pos = pos + 5;
+	}else{
+		st->pos = label;
+		st->state = GOTO;
 	}
+
+	return 7;
 }
 
 /*==========================================
@@ -4380,8 +5688,56 @@ void run_script_main(struct script_state *st)
 	TBL_PC *sd;
 	struct script_stack *stack = st->stack;
 
+#ifdef SCRIPT_COMPUTED_GOTO
+	// Jump targets indexed by c_op, the order has to match the enum
+	static void* const targets[] = {
+		&&target_C_NOP, &&target_C_POS, &&target_C_INT, &&target_default, &&target_C_FUNC, &&target_C_STR, &&target_default, &&target_C_ARG,
+		&&target_C_NAME, &&target_C_EOL, &&target_default, &&target_default, &&target_default, &&target_C_REF,
+		&&target_C_OP3, &&target_C_LOR, &&target_C_LAND, &&target_C_LE, &&target_C_LT, &&target_C_GE, &&target_C_GT, &&target_C_EQ, &&target_C_NE,
+		&&target_C_XOR, &&target_C_OR, &&target_C_AND, &&target_C_ADD, &&target_C_SUB, &&target_C_MUL, &&target_C_DIV, &&target_C_MOD,
+		&&target_C_NEG, &&target_C_LNOT, &&target_C_NOT, &&target_C_R_SHIFT, &&target_C_L_SHIFT,
+		&&target_default, &&target_default, &&target_default, &&target_default,
+	};
+	static_assert( ARRAYLENGTH( targets ) == C_SUB_PRE + 1, "run_script_main: the jump targets do not match c_op" );
+
+	// Runs the end of instruction checks and jumps straight to the next instruction
+	#define SCRIPT_TARGET(op) case op: target_##op
+	#define SCRIPT_NEXT() \
+		instructions++; \
+		if( !st->freeloop && cmdcount>0 && (--cmdcount)<=0 ){ \
+			ShowError("script:run_script_main: infinity loop !\n"); \
+			script_reportsrc(st); \
+			st->state=END; \
+		} \
+		if( st->state != RUN ) \
+			goto script_stopped; \
+		c = get_com(st->script->script_buf,&st->pos); \
+		if( c >= 0 && c < (int32)ARRAYLENGTH( targets ) ) \
+			goto *targets[c]; \
+		goto target_default;
+#else
+	#define SCRIPT_TARGET(op) case op
+	#define SCRIPT_NEXT() break;
+#endif
+
+	// Profiler, scripts run by a buildin of a profiled script are always profiled
+	s_script_profile_run profile;
+	s_script_profile_run* profile_outer = script_profile_current;
+	std::chrono::steady_clock::time_point profile_start;
+	uint64 profile_nested = script_profile_nested_time;
+	uint64 instructions = 0;
+
+	profile.weight = profile_outer != nullptr ? profile_outer->weight : script_profile_weight();
+
 	script_attach_state(st);
 
+	if( profile.weight > 0 ){
+		profile_start = std::chrono::steady_clock::now();
+		script_profile_begin(st, profile, instructions, true);
+		script_profile_current = &profile;
+	}else
+		script_profile_current = nullptr;
+
 	if(st->state == RERUNLINE) {
 		run_func(st);
 		if(st->state == GOTO)
@@ -4392,28 +5748,86 @@ void run_script_main(struct script_state *st)
 	while(st->state == RUN) {
 		enum c_op c = get_com(st->script->script_buf,&st->pos);
 		switch(c){
-		case C_EOL:
+		SCRIPT_TARGET(C_EOL):
 			if( stack->defsp > stack->sp )
 				ShowError("script:run_script_main: unexpected stack position (defsp=%d sp=%d). please report this!!!\n", stack->defsp, stack->sp);
 			else
 				pop_stack(st, stack->defsp, stack->sp);// pop unused stack data. (unused return value)
-			break;
-		case C_INT:
-			push_val(stack,C_INT,get_num(st->script->script_buf,&st->pos));
-			break;
-		case C_POS:
-		case C_NAME:
+			SCRIPT_NEXT();
+		SCRIPT_TARGET(C_INT):
+			{
+				int64 value = get_num(st->script->script_buf,&st->pos);
+				// Superinstruction: an integer literal as right operand of a binary operator (<var> <int> <op>),
+				// the literal is applied to the left operand without going through the stack.
+				// Operators are always encoded in a single byte.
+				c_op op = (c_op)st->script->script_buf[st->pos];
+
+				if( op >= C_LOR && op <= C_L_SHIFT && op != C_NEG && op != C_LNOT && op != C_NOT && !st->op2ref && stack->sp > stack->defsp ){
+					struct script_data* left = script_getdatatop(st, -1);
+
+					get_val(st, left);
+
+					if( data_isint(left) ){
+						int64 i1 = left->u.num;
+
+						st->pos++;
+						script_removetop(st, -1, 0);
+						op_2num(st, op, i1, value);
+
+						// Count both instructions for the infinity loop check and the profiler
+						instructions++;
+						if( !st->freeloop && cmdcount > 1 )
+							cmdcount--;
+
+						SCRIPT_NEXT();
+					}
+				}
+
+				push_val(stack,C_INT,value);
+			}
+			SCRIPT_NEXT();
+		SCRIPT_TARGET(C_NAME):
+			// Superinstructions for the increments and conditions of most loops,
+			// the profiler needs the buildin calls so they are not fused while profiling.
+			if( profile.weight == 0 ){
+				int32 name = GETVALUE(st->script->script_buf,st->pos);
+				int32 count = 0;
+
+				if( name == buildin_set_ref )
+					count = script_fused_increment(st);
+				else if( name == buildin_jump_zero_ref )
+					count = script_fused_jump_zero(st);
+
+				if( count > 0 ){
+					// Count every instruction for the infinity loop check and the profiler
+					instructions += count - 1;
+					if( !st->freeloop && cmdcount > 1 )
+						cmdcount = std::max( cmdcount - ( count - 1 ), 1 );
+
+					if( st->state == GOTO ){
+						st->state = RUN;
+						if( !st->freeloop && gotocount>0 && (--gotocount)<=0 ){
+							ShowError("script:run_script_main: infinity loop !\n");
+							script_reportsrc(st);
+							st->state=END;
+						}
+					}
+					SCRIPT_NEXT();
+				}
+			}
+			[[fallthrough]];
+		SCRIPT_TARGET(C_POS):
 			push_val(stack,c,GETVALUE(st->script->script_buf,st->pos));
 			st->pos+=3;
-			break;
-		case C_ARG:
+			SCRIPT_NEXT();
+		SCRIPT_TARGET(C_ARG):
 			push_val(stack,c,0);
-			break;
-		case C_STR:
+			SCRIPT_NEXT();
+		SCRIPT_TARGET(C_STR):
 			push_str(stack,C_CONSTSTR,(char*)(st->script->script_buf+st->pos));
 			while(st->script->script_buf[st->pos++]);
-			break;
-		case C_FUNC:
+			SCRIPT_NEXT();
+		SCRIPT_TARGET(C_FUNC):
 			run_func(st);
 			if(st->state==GOTO){
 				st->state = RUN;
@@ -4423,52 +5837,63 @@ void run_script_main(struct script_state *st)
 					st->state=END;
 				}
 			}
-			break;
+			// Start a new profiler segment when callsub, callfunc or return changed the script or the stack
+			if( profile.weight > 0 && ( st->script != profile.script || stack->defsp != profile.defsp ) ){
+				bool call = stack->defsp > profile.defsp;
 
-		case C_REF:
+				script_profile_end(profile, instructions);
+				script_profile_begin(st, profile, instructions, call);
+			}
+			SCRIPT_NEXT();
+
+		SCRIPT_TARGET(C_REF):
 			st->op2ref = 1;
-			break;
+			SCRIPT_NEXT();
 
-		case C_NEG:
-		case C_NOT:
-		case C_LNOT:
+		SCRIPT_TARGET(C_NEG):
+		SCRIPT_TARGET(C_NOT):
+		SCRIPT_TARGET(C_LNOT):
 			op_1(st ,c);
-			break;
-
-		case C_ADD:
-		case C_SUB:
-		case C_MUL:
-		case C_DIV:
-		case C_MOD:
-		case C_EQ:
-		case C_NE:
-		case C_GT:
-		case C_GE:
-		case C_LT:
-		case C_LE:
-		case C_AND:
-		case C_OR:
-		case C_XOR:
-		case C_LAND:
-		case C_LOR:
-		case C_R_SHIFT:
-		case C_L_SHIFT:
+			SCRIPT_NEXT();
+
+		SCRIPT_TARGET(C_ADD):
+		SCRIPT_TARGET(C_SUB):
+		SCRIPT_TARGET(C_MUL):
+		SCRIPT_TARGET(C_DIV):
+		SCRIPT_TARGET(C_MOD):
+		SCRIPT_TARGET(C_EQ):
+		SCRIPT_TARGET(C_NE):
+		SCRIPT_TARGET(C_GT):
+		SCRIPT_TARGET(C_GE):
+		SCRIPT_TARGET(C_LT):
+		SCRIPT_TARGET(C_LE):
+		SCRIPT_TARGET(C_AND):
+		SCRIPT_TARGET(C_OR):
+		SCRIPT_TARGET(C_XOR):
+		SCRIPT_TARGET(C_LAND):
+		SCRIPT_TARGET(C_LOR):
+		SCRIPT_TARGET(C_R_SHIFT):
+		SCRIPT_TARGET(C_L_SHIFT):
 			op_2(st, c);
-			break;
+			SCRIPT_NEXT();
 
-		case C_OP3:
+		SCRIPT_TARGET(C_OP3):
 			op_3(st, c);
-			break;
+			SCRIPT_NEXT();
 
-		case C_NOP:
+		SCRIPT_TARGET(C_NOP):
 			st->state=END;
-			break;
+			SCRIPT_NEXT();
 
 		default:
+#ifdef SCRIPT_COMPUTED_GOTO
+		target_default:
+#endif
 			ShowError("script:run_script_main:unknown command : %d @ %d\n",c,st->pos);
 			st->state=END;
-			break;
+			SCRIPT_NEXT();
 		}
+		instructions++;
 		if( !st->freeloop && cmdcount>0 && (--cmdcount)<=0 ){
 			ShowError("script:run_script_main: infinity loop !\n");
 			script_reportsrc(st);
@@ -4476,6 +5901,22 @@ void run_script_main(struct script_state *st)
 		}
 	}
 
+#ifdef SCRIPT_COMPUTED_GOTO
+script_stopped:
+#endif
+#undef SCRIPT_TARGET
+#undef SCRIPT_NEXT
+
+	if( profile.weight > 0 ){
+		script_profile_end(profile, instructions);
+
+		// Let the buildin that ran this script exclude its time
+		if( profile_outer != nullptr )
+			script_profile_nested_time = profile_nested + std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - profile_start ).count();
+	}
+
+	script_profile_current = profile_outer;
+
 	if(st->sleep.tick > 0) {
 		//Restore previous script
 		script_detach_state(st, false);
@@ -4529,6 +5970,7 @@ int32 script_config_read(const char *cfgName)
 	char line[1024],w1[1024],w2[1024];
 	FILE *fp;
 
+	script_cache_engine_key_valid = false;
 
 	fp=fopen(cfgName,"r");
 	if(fp==nullptr){
@@ -4558,6 +6000,30 @@ int32 script_config_read(const char *cfgName)
 		else if(strcmpi(w1,"input_max_value")==0) {
 			script_config.input_max_value = config_switch(w2);
 		}
+		else if(strcmpi(w1,"query_sql_async_limit")==0) {
+			script_config.query_sql_async_limit = max(0, atoi(w2));
+		}
+		else if(strcmpi(w1,"query_sql_async_timeout")==0) {
+			script_config.query_sql_async_timeout = max(100, atoi(w2));
+		}
+		else if(strcmpi(w1,"script_cache")==0) {
+			script_config.script_cache = config_switch(w2);
+		}
+		else if(strcmpi(w1,"script_cache_path")==0) {
+			safestrncpy(script_config.script_cache_path, w2, sizeof(script_config.script_cache_path));
+		}
+		else if(strcmpi(w1,"script_optimize")==0) {
+			script_config.script_optimize = config_switch(w2);
+		}
+		else if(strcmpi(w1,"script_profile")==0) {
+			script_profile_enable( (e_script_profile)cap_value( config_switch(w2), SCRIPT_PROFILE_OFF, SCRIPT_PROFILE_SAMPLE ) );
+		}
+		else if(strcmpi(w1,"script_profile_sample_rate")==0) {
+			script_config.script_profile_sample_rate = max(1, atoi(w2));
+		}
+		else if(strcmpi(w1,"script_profile_file")==0) {
+			safestrncpy(script_config.script_profile_file, w2, sizeof(script_config.script_profile_file));
+		}
 		else if(strcmpi(w1,"warn_func_mismatch_argtypes")==0) {
 			script_config.warn_func_mismatch_argtypes = config_switch(w2);
 		}
@@ -4863,6 +6329,8 @@ void do_init_script(void) {
 	active_scripts = 0;
 	next_id = 0;
 
+	script_profile_reset();
+
 	mapreg_init();
 	add_buildin_func();
 	constant_db.load();
@@ -12157,18 +13625,11 @@ BUILDIN_FUNC(getmapusers)
 }
 /*==========================================
  *------------------------------------------*/
-static int32 buildin_getareausers_sub(block_list *bl,va_list ap)
-{
-	int32 *users = va_arg(ap, int32 *);
-	(*users)++;
-	return SCRIPT_CMD_SUCCESS;
-}
-
 BUILDIN_FUNC(getareausers)
 {
 	const char *str;
 	int16 m,x0,y0,x1,y1;
-	int32 users = 0;
+	int32 users;
 	str=script_getstr(st,2);
 	x0=script_getnum(st,3);
 	y0=script_getnum(st,4);
@@ -12178,8 +13639,7 @@ BUILDIN_FUNC(getareausers)
 		script_pushint(st,-1);
 		return SCRIPT_CMD_SUCCESS;
 	}
-	map_foreachinallarea(buildin_getareausers_sub,
-		m,x0,y0,x1,y1,BL_PC,&users);
+	users = map_foreachinallarea(m, x0, y0, x1, y1, BL_PC, [](block_list* bl) { return 1; });
 	script_pushint(st,users);
 	return SCRIPT_CMD_SUCCESS;
 }
@@ -12281,17 +13741,6 @@ BUILDIN_FUNC(getunits)
 
 /*==========================================
  *------------------------------------------*/
-static int32 buildin_getareadropitem_sub(block_list *bl,va_list ap)
-{
-	t_itemid nameid = va_arg(ap, t_itemid);
-	uint16 *amount = (uint16 *)va_arg(ap, int32 *);
-	flooritem_data *drop=(flooritem_data *)bl;
-
-	if(drop->item.nameid==nameid)
-		(*amount)+=drop->item.amount;
-
-	return SCRIPT_CMD_SUCCESS;
-}
 BUILDIN_FUNC(getareadropitem)
 {
 	const char *str;
@@ -12328,8 +13777,14 @@ BUILDIN_FUNC(getareadropitem)
 		script_pushint(st,-1);
 		return SCRIPT_CMD_SUCCESS;
 	}
-	map_foreachinallarea(buildin_getareadropitem_sub,
-		m,x0,y0,x1,y1,BL_ITEM,nameid,&amount);
+	map_foreachinallarea(m, x0, y0, x1, y1, BL_ITEM, [nameid, &amount](block_list* bl) {
+		flooritem_data* drop = static_cast<flooritem_data*>(bl);
+
+		if( drop->item.nameid == nameid )
+			amount += drop->item.amount;
+
+		return 0;
+	});
 	script_pushint(st,amount);
 	return SCRIPT_CMD_SUCCESS;
 }
@@ -18038,37 +19493,50 @@ BUILDIN_FUNC(setd)
 	return SCRIPT_CMD_SUCCESS;
 }
 
-int32 buildin_query_sql_sub(struct script_state* st, Sql* handle)
+/// Checks the target variables of query_sql and its variants.
+/// Attaches the player to sd if any of the variables requires one.
+///
+/// @return The number of target variables or -1 if the script was ended
+static int32 buildin_query_sql_checkvars(struct script_state* st, TBL_PC*& sd)
 {
-	int32 i, j;
-	TBL_PC* sd = nullptr;
-	const char* query;
-	struct script_data* data;
-	const char* name;
-	uint32 max_rows = SCRIPT_MAX_ARRAYSIZE; // maximum number of rows
-	int32 num_vars;
-	int32 num_cols;
+	int32 i;
 
-	// check target variables
 	for( i = 3; script_hasdata(st,i); ++i ) {
-		data = script_getdata(st, i);
+		struct script_data* data = script_getdata(st, i);
 		if( data_isreference(data) ) { // it's a variable
-			name = reference_getname(data);
+			const char* name = reference_getname(data);
 			if( not_server_variable(*name) && sd == nullptr ) { // requires a player
 				if( !script_rid2sd(sd) ) { // no player attached
 					script_reportdata(data);
 					st->state = END;
-					return SCRIPT_CMD_FAILURE;
+					return -1;
 				}
 			}
 		} else {
 			ShowError("script:query_sql: not a variable\n");
 			script_reportdata(data);
 			st->state = END;
-			return SCRIPT_CMD_FAILURE;
+			return -1;
 		}
 	}
-	num_vars = i - 3;
+
+	return i - 3;
+}
+
+int32 buildin_query_sql_sub(struct script_state* st, Sql* handle)
+{
+	int32 i, j;
+	TBL_PC* sd = nullptr;
+	const char* query;
+	struct script_data* data;
+	const char* name;
+	uint32 max_rows = SCRIPT_MAX_ARRAYSIZE; // maximum number of rows
+	int32 num_vars;
+	int32 num_cols;
+
+	// check target variables
+	if( ( num_vars = buildin_query_sql_checkvars(st, sd) ) < 0 )
+		return SCRIPT_CMD_FAILURE;
 
 	// Execute the query
 	query = script_getstr(st,2);
@@ -18137,6 +19605,187 @@ BUILDIN_FUNC(query_logsql) {
 	return buildin_query_sql_sub(st, logmysql_handle);
 }
 
+/// Asynchronous query of a suspended script state
+struct s_script_async_query {
+	uint32 serial; ///< Tells a late result apart from the one of a newer query
+	t_tick deadline;
+	bool done;
+	s_sql_async_result result;
+};
+
+static std::unordered_map<uint32, s_script_async_query> script_async_queries; ///< script state id -> query
+static std::unordered_map<int32, int32> script_async_query_count; ///< npc id -> queries in flight
+static uint32 script_async_query_serial = 0;
+
+/// Receives the result of an asynchronous query and resumes the script that issued it.
+static void script_async_query_done(uint32 st_id, uint32 serial, int32 oid, s_sql_async_result& result)
+{
+	auto count = script_async_query_count.find(oid);
+
+	if( count != script_async_query_count.end() && --count->second <= 0 )
+		script_async_query_count.erase(count);
+
+	auto it = script_async_queries.find(st_id);
+
+	if( it == script_async_queries.end() || it->second.serial != serial ) // timed out
+		return;
+
+	struct script_state* st = (struct script_state*)idb_get(st_db, st_id);
+
+	if( st == nullptr ) { // script was freed in the meantime
+		script_async_queries.erase(it);
+		return;
+	}
+
+	it->second.result = std::move(result);
+	it->second.done = true;
+
+	if( st->sleep.timer != INVALID_TIMER ) {
+		delete_timer(st->sleep.timer, run_script_timer);
+
+		// Trigger the timer function
+		run_script_timer(INVALID_TIMER, gettick(), st->sleep.charid, (intptr_t)st);
+	}
+}
+
+/// Executes a query in the background, suspending the script until its result arrived.
+/// The script keeps its attached player, like with sleep2.
+int32 buildin_query_sql_async_sub(struct script_state* st, SqlAsync* queue, Sql* handle)
+{
+	TBL_PC* sd = nullptr;
+	int32 num_vars;
+	auto it = script_async_queries.find(st->id);
+
+	// First call(by function call)
+	if( it == script_async_queries.end() ) {
+		if( buildin_query_sql_checkvars(st, sd) < 0 )
+			return SCRIPT_CMD_FAILURE;
+
+		if( queue == nullptr ) // no workers, fall back to the blocking query
+			return buildin_query_sql_sub(st, handle);
+
+		if( script_config.query_sql_async_limit > 0 && script_async_query_count[st->oid] >= script_config.query_sql_async_limit ) {
+			ShowWarning("script:query_sql_async: NPC has reached the limit of %d queries in flight.\n", script_config.query_sql_async_limit);
+			script_pushint(st, -1);
+			return SCRIPT_CMD_SUCCESS;
+		}
+
+		uint32 st_id = st->id;
+		uint32 serial = ++script_async_query_serial;
+		int32 oid = st->oid;
+
+		if( SQL_ERROR == Sql_AsyncQueryStr(queue, script_getstr(st,2), [st_id, serial, oid]( s_sql_async_result& result ){ script_async_query_done(st_id, serial, oid, result); }) ) {
+			script_pushint(st, -1);
+			return SCRIPT_CMD_SUCCESS;
+		}
+		script_async_query_count[oid]++;
+
+		s_script_async_query& query = script_async_queries[st_id];
+
+		query.serial = serial;
+		query.deadline = gettick() + script_config.query_sql_async_timeout;
+		query.done = false;
+
+		// wait for the result, the timeout is the sleep time
+		st->state = RERUNLINE;
+		st->sleep.tick = script_config.query_sql_async_timeout;
+		return SCRIPT_CMD_SUCCESS;
+	}
+
+	// Second call(by the result or after the timeout)
+	if( !it->second.done ) {
+		t_tick remaining = DIFF_TICK(it->second.deadline, gettick());
+
+		if( remaining > 0 ) { // woken up early, e.g. by awake
+			st->state = RERUNLINE;
+			st->sleep.tick = (int32)remaining;
+			return SCRIPT_CMD_SUCCESS;
+		}
+
+		ShowWarning("script:query_sql_async: Query did not finish within %d ms.\n", script_config.query_sql_async_timeout);
+		script_async_queries.erase(it);
+		st->state = RUN;
+		st->sleep.tick = 0;
+		script_pushint(st, -1);
+		return SCRIPT_CMD_SUCCESS;
+	}
+
+	s_sql_async_result result = std::move(it->second.result);
+
+	script_async_queries.erase(it);
+	st->state = RUN;
+	st->sleep.tick = 0;
+
+	if( result.status == SQL_ERROR ) { // already reported by the queue
+		script_pushint(st, -1);
+		return SCRIPT_CMD_SUCCESS;
+	}
+
+	if( ( num_vars = buildin_query_sql_checkvars(st, sd) ) < 0 )
+		return SCRIPT_CMD_FAILURE;
+
+	if( result.rows.empty() ) { // No data received
+		script_pushint(st, 0);
+		return SCRIPT_CMD_SUCCESS;
+	}
+
+	// Count the number of columns to store
+	int32 num_cols = result.num_columns;
+	if( num_vars < num_cols ) {
+		ShowWarning("script:query_sql_async: Too many columns, discarding last %u columns.\n", (uint32)(num_cols-num_vars));
+		script_reportsrc(st);
+	} else if( num_vars > num_cols ) {
+		ShowWarning("script:query_sql_async: Too many variables (%u extra).\n", (uint32)(num_vars-num_cols));
+		script_reportsrc(st);
+	}
+
+	// Store data
+	size_t max_rows = SCRIPT_MAX_ARRAYSIZE; // maximum number of rows
+	size_t i;
+
+	for( i = 0; i < max_rows && i < result.rows.size(); ++i ) {
+		for( int32 j = 0; j < num_vars; ++j ) {
+			const char* str = j < num_cols ? result.rows[i][j].c_str() : "";
+			struct script_data* data = script_getdata(st, j+3);
+			const char* name = reference_getname(data);
+
+			if( is_string_variable(name) )
+				setd_sub_str( st, sd, name, (int32)i, str, reference_getref( data ) );
+			else
+				setd_sub_num( st, sd, name, (int32)i, strtoll( str, nullptr, 10 ), reference_getref( data ) );
+		}
+	}
+	if( i < result.rows.size() ) {
+		ShowWarning("script:query_sql_async: Only %" PRIuPTR "/%" PRIuPTR " rows have been stored.\n", i, result.rows.size());
+		script_reportsrc(st);
+	}
+
+	script_pushint(st, (int32)i);
+	return SCRIPT_CMD_SUCCESS;
+}
+
+/// Executes a query on the main database without blocking the server.
+/// The script is suspended until the result arrived.
+///
+/// query_sql_async "<query>"{, <array variable>{, <array variable>{, ...}}};
+BUILDIN_FUNC(query_sql_async) {
+	return buildin_query_sql_async_sub(st, qsmysql_async, qsmysql_handle);
+}
+
+/// Executes a query on the log database without blocking the server.
+/// The script is suspended until the result arrived.
+///
+/// query_logsql_async "<query>"{, <array variable>{, <array variable>{, ...}}};
+BUILDIN_FUNC(query_logsql_async) {
+	if( !log_config.sql_logs ) {// logmysql_handle == nullptr
+		ShowWarning("buildin_query_logsql_async: SQL logs are disabled, query '%s' will not be executed.\n", script_getstr(st,2));
+		script_pushint(st,-1);
+		return SCRIPT_CMD_FAILURE;
+	}
+
+	return buildin_query_sql_async_sub(st, logmysql_async, logmysql_handle);
+}
+
 //Allows escaping of a given string.
 BUILDIN_FUNC(escape_sql)
 {
@@ -28232,6 +29881,8 @@ struct script_function buildin_func[] = {
 	BUILDIN_DEF(axtoi,"s"),
 	BUILDIN_DEF(query_sql,"s*"),
 	BUILDIN_DEF(query_logsql,"s*"),
+	BUILDIN_DEF(query_sql_async,"s*"),
+	BUILDIN_DEF(query_logsql_async,"s*"),
 	BUILDIN_DEF(escape_sql,"v"),
 	BUILDIN_DEF(atoi,"s"),
 	BUILDIN_DEF(strtol,"si"),
@@ -133,6 +133,9 @@
 /// Maximum amount of elements in script arrays
 #define SCRIPT_MAX_ARRAYSIZE (UINT_MAX - 1)
 
+/// Array indices below this are found with a position table, higher ones are searched in the member list
+#define SCRIPT_ARRAY_DENSE_MAX (1U << 20)
+
 enum script_cmd_result {
 	SCRIPT_CMD_SUCCESS = 0, ///when a buildin cmd was correctly done
 	SCRIPT_CMD_FAILURE = 1, ///when an errors appear in cmd, show_debug will follow
@@ -157,6 +160,14 @@ struct Script_Config {
 	int32 check_gotocount;
 	int32 input_min_value;
 	int32 input_max_value;
+	int32 query_sql_async_limit;
+	int32 query_sql_async_timeout;
+	int32 script_cache;
+	char script_cache_path[256];
+	int32 script_optimize;
+	int32 script_profile;
+	int32 script_profile_sample_rate;
+	char script_profile_file[256];
 
 	// PC related
 	const char *die_event_name;
@@ -297,6 +308,8 @@ struct script_code {
 	unsigned char* script_buf;
 	struct reg_db local;
 	uint16 instances;
+	const char* source_file; ///< File the script was parsed from
+	int32 source_line; ///< Line the script starts at in source_file
 };
 
 struct script_stack {
@@ -345,10 +358,19 @@ struct script_regstr {
 	char* data;
 };
 
+/**
+ * Indices of the members of a script array.
+ * Members are removed by moving the last one into their place, so the member list
+ * is not in insertion order and callers walking it must not rely on any order.
+ */
 struct script_array {
-	uint32 id;       ///< the first 32b of the 64b uid, aka the id
-	uint32 size;     ///< how many members
-	uint32 *members; ///< member list
+	uint32 id;         ///< the first 32b of the 64b uid, aka the id
+	uint32 size;       ///< how many members
+	uint32 *members;   ///< member list, unordered
+	uint32 capacity;   ///< allocated length of the member list
+	uint32 *positions; ///< position in the member list of every index below dense_size, UINT_MAX if it is not a member
+	uint32 dense_size; ///< indices covered by positions, members with higher indices are searched in the member list
+	uint32 highest;    ///< highest member index, kept up to date on every change and only meaningful while size > 0
 };
 
 enum script_parse_options {
@@ -2298,6 +2320,25 @@ bool is_number(const char *p);
 struct script_code* parse_script_( const char *src, const char *file, int32 line, int32 options, const char* src_file, int32 src_line, const char* src_func );
 #define parse_script( src, file, line, options ) parse_script_( ( src ), ( file ), ( line ), ( options ), ALC_MARK )
 void run_script(struct script_code *rootscript,int32 pos,int32 rid,int32 oid);
+void script_cache_begin( const char* path, const char* buffer, size_t length );
+void script_cache_end();
+void script_cache_report( t_tick duration );
+uint64 script_cache_engine_key();
+int32 script_parser_warnings();
+void script_write_code( BinaryWriter& writer, const struct script_code* code );
+bool script_read_code( BinaryReader& reader, struct script_code*& code );
+
+/// Modes of the script profiler
+enum e_script_profile : int32 {
+	SCRIPT_PROFILE_OFF = 0, ///< Nothing is collected
+	SCRIPT_PROFILE_EXACT, ///< Every script execution is measured
+	SCRIPT_PROFILE_SAMPLE, ///< One of every script_profile_sample_rate executions is measured
+};
+
+void script_profile_enable( e_script_profile mode );
+void script_profile_reset( void );
+void script_profile_report( void );
+bool script_profile_export( const char* filename );
 
 bool set_reg_num(struct script_state* st, map_session_data* sd, int64 num, const char* name, const int64 value, struct reg_db *ref);
 bool set_reg_str(struct script_state* st, map_session_data* sd, int64 num, const char* name, const char* value, struct reg_db* ref);
@@ -2353,6 +2394,7 @@ void script_array_update(struct reg_db *src, int64 num, bool empty);
 void script_array_delete(struct reg_db *src, struct script_array *sa);
 void script_array_remove_member(struct reg_db *src, struct script_array *sa, uint32 idx);
 void script_array_add_member(struct script_array *sa, uint32 idx);
+uint32 script_array_find_member(struct script_array *sa, uint32 idx);
 uint32 script_array_size(struct script_state *st, map_session_data *sd, const char *name, struct reg_db *ref);
 uint32 script_array_highest_key(struct script_state *st, map_session_data *sd, const char *name, struct reg_db *ref);
 void script_array_ensure_zero(struct script_state *st, map_session_data *sd, int64 uid, struct reg_db *ref);
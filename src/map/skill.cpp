@@ -26367,10 +26367,12 @@ static void skill_readdb(void) {
 		aFree(dbsubpath2);
 	}
 
-	abra_db.load();
-	magic_mushroom_db.load();
-	reading_spellbook_db.load();
-	skill_arrow_db.load();
+	database_load_group( {
+		{ &abra_db },
+		{ &magic_mushroom_db },
+		{ &reading_spellbook_db },
+		{ &skill_arrow_db },
+	} );
 
 	skill_init_unit_layout();
 	skill_init_nounit_layout();
@@ -26402,7 +26404,7 @@ void do_init_skill(void)
 {
 	skill_readdb();
 
-	skillunit_db = idb_alloc(DB_OPT_BASE);
+	skillunit_db = idb_alloc(DB_OPT_OPEN_HASH);
 	skillusave_db = idb_alloc(DB_OPT_RELEASE_DATA);
 	bowling_db = idb_alloc(DB_OPT_BASE);
 	skill_timer_ers  = ers_new(sizeof(struct skill_timerskill),"skill.cpp::skill_timer_ers",ERS_CACHE_OPTIONS);
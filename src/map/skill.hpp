@@ -476,6 +476,9 @@ public:
 
 	const std::string getDefaultLocation() override;
 	uint64 parseBodyNode(const ryml::NodeRef& node) override;
+	bool canLoadInParallel() override{
+		return true;
+	}
 };
 
 extern SkillArrowDatabase skill_arrow_db;
@@ -494,6 +497,9 @@ public:
 
 	const std::string getDefaultLocation() override;
 	uint64 parseBodyNode(const ryml::NodeRef& node) override;
+	bool canLoadInParallel() override{
+		return true;
+	}
 };
 
 void do_init_skill(void);
@@ -2811,6 +2817,9 @@ public:
 
 	const std::string getDefaultLocation() override;
 	uint64 parseBodyNode(const ryml::NodeRef& node) override;
+	bool canLoadInParallel() override{
+		return true;
+	}
 
 	// Additional
 	std::shared_ptr<s_skill_spellbook_db> findBook(t_itemid nameid);
@@ -2834,6 +2843,9 @@ public:
 
 	const std::string getDefaultLocation() override;
 	uint64 parseBodyNode(const ryml::NodeRef& node) override;
+	bool canLoadInParallel() override{
+		return true;
+	}
 };
 
 extern MagicMushroomDatabase magic_mushroom_db;
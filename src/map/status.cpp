@@ -16480,17 +16480,19 @@ void status_readdb( bool reload ){
 	}
 
 	if( reload ){
-		size_fix_db.reload();
-		refine_db.reload();
-		status_db.reload();
-		enchantgrade_db.reload();
-	}else{
-		size_fix_db.load();
-		refine_db.load();
-		status_db.load();
-		enchantgrade_db.load();
-	}
-	elemental_attribute_db.load();
+		size_fix_db.clear();
+		refine_db.clear();
+		status_db.clear();
+		enchantgrade_db.clear();
+	}
+
+	database_load_group( {
+		{ &size_fix_db },
+		{ &refine_db },
+		{ &status_db },
+		{ &enchantgrade_db },
+		{ &elemental_attribute_db },
+	} );
 }
 
 /**
@@ -130,6 +130,9 @@ public:
 
 	const std::string getDefaultLocation() override;
 	uint64 parseBodyNode( const ryml::NodeRef& node ) override;
+	bool canLoadInParallel() override{
+		return true;
+	}
 
 	// Additional
 	std::shared_ptr<s_refine_level_info> findLevelInfo( const struct item_data& data, struct item& item );
@@ -151,6 +154,9 @@ public:
 
 	const std::string getDefaultLocation() override;
 	uint64 parseBodyNode(const ryml::NodeRef& node) override;
+	bool canLoadInParallel() override{
+		return true;
+	}
 };
 
 extern SizeFixDatabase size_fix_db;
@@ -169,6 +175,9 @@ public:
 	}
 	const std::string getDefaultLocation() override;
 	uint64 parseBodyNode(const ryml::NodeRef& node) override;
+	bool canLoadInParallel() override{
+		return true;
+	}
 
 	// Additional
 	int16 getAttribute(uint16 level, uint16 atk_ele, uint16 def_ele);
@@ -221,6 +230,9 @@ public:
 
 	const std::string getDefaultLocation() override;
 	uint64 parseBodyNode( const ryml::NodeRef& node ) override;
+	bool canLoadInParallel() override{
+		return true;
+	}
 	void loadingFinished() override;
 
 	// Additional
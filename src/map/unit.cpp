@@ -618,7 +618,7 @@ static TIMER_FUNC(unit_walktoxy_timer)
 	}
 
 	// Refresh view for all those we lose sight
-	map_foreachinmovearea(clif_outsight, bl, AREA_SIZE, dx, dy, sd?BL_ALL:BL_PC, bl);
+	clif_outsight_move(bl, dx, dy);
 
 	x += dx;
 	y += dy;
@@ -1197,7 +1197,7 @@ bool unit_movepos(block_list *bl, int16 dst_x, int16 dst_y, int32 easy, bool che
 	dx = dst_x - bl->x;
 	dy = dst_y - bl->y;
 
-	map_foreachinmovearea(clif_outsight, bl, AREA_SIZE, dx, dy, (sd ? BL_ALL : BL_PC), bl);
+	clif_outsight_move(bl, dx, dy);
 
 	map_moveblock(bl, dst_x, dst_y, gettick());
 
@@ -1325,7 +1325,7 @@ int32 unit_blown(block_list* bl, int32 dx, int32 dy, int32 count, enum e_skill_b
 		dy = ny-bl->y;
 
 		if(dx || dy) {
-			map_foreachinmovearea(clif_outsight, bl, AREA_SIZE, dx, dy, bl->type == BL_PC ? BL_ALL : BL_PC, bl);
+			clif_outsight_move(bl, dx, dy);
 
 			if(su) {
 				if (su->group && skill_get_unit_flag(su->group->skill_id, UF_KNOCKBACKGROUP))
@@ -4,6 +4,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <map>
 #include <string>
 #ifndef _WIN32
 #include <unistd.h>
@@ -13,8 +14,10 @@
 #include <common/core.hpp>
 #include <common/grfio.hpp>
 #include <common/malloc.hpp>
+#include <common/mapcache.hpp>
 #include <common/mmo.hpp>
 #include <common/showmsg.hpp>
+#include <common/strlib.hpp>
 #include <common/utils.hpp>
 
 using namespace rathena::server_core;
@@ -40,8 +43,6 @@ int32 rebuild = 0;
 
 FILE *map_cache_fp;
 
-unsigned long file_size;
-
 // Used internally, this structure contains the physical map cells
 struct map_data {
 	int16 xs;
@@ -49,13 +50,13 @@ struct map_data {
 	unsigned char *cells;
 };
 
-// This is the main header found at the very beginning of the file
+// This is the main header found at the very beginning of a v1 file
 struct main_header {
 	uint32 file_size;
 	uint16 map_count;
-} header;
+};
 
-// This is the header appended before every compressed map cells info
+// This is the header appended before every compressed map cells info in a v1 file
 struct map_info {
 	char name[MAP_NAME_LENGTH];
 	int16 xs;
@@ -63,6 +64,32 @@ struct map_info {
 	int32 len;
 };
 
+// A map held in memory until the cache is written
+struct cache_entry {
+	int16 xs;
+	int16 ys;
+	std::vector<uint8> cells; // terrain flags
+};
+
+// All maps of the cache, sorted by name
+std::map<std::string, cache_entry> cache_entries;
+
+// Converts a gat cell type into the terrain flags of the v2 cache
+uint8 gat2flags(unsigned char gat)
+{
+	switch( gat ){
+		case 0: return MAP_CACHE_CELL_WALKABLE | MAP_CACHE_CELL_SHOOTABLE; // walkable ground
+		case 1: return 0; // non-walkable ground
+		case 2: return MAP_CACHE_CELL_WALKABLE | MAP_CACHE_CELL_SHOOTABLE; // ???
+		case 3: return MAP_CACHE_CELL_WALKABLE | MAP_CACHE_CELL_SHOOTABLE | MAP_CACHE_CELL_WATER; // walkable water
+		case 4: return MAP_CACHE_CELL_WALKABLE | MAP_CACHE_CELL_SHOOTABLE; // ???
+		case 5: return MAP_CACHE_CELL_SHOOTABLE; // gap (snipable)
+		case 6: return MAP_CACHE_CELL_WALKABLE | MAP_CACHE_CELL_SHOOTABLE; // ???
+		default:
+			ShowWarning("gat2flags: unrecognized gat type '%d'\n", gat);
+			return 0;
+	}
+}
 
 // Reads a map from GRF's GAT and RSW files
 int32 read_map(char *name, struct map_data *m)
@@ -118,54 +145,163 @@ int32 read_map(char *name, struct map_data *m)
 // Adds a map to the cache
 void cache_map(char *name, struct map_data *m)
 {
-	struct map_info info;
-	unsigned long len;
-	unsigned char *write_buf;
-
-	// Create an output buffer twice as big as the uncompressed map... this way we're sure it fits
-	len = (unsigned long)m->xs*(unsigned long)m->ys*2;
-	write_buf = (unsigned char *)aMalloc(len);
-	// Compress the cells and get the compressed length
-	encode_zip(write_buf, &len, m->cells, m->xs*m->ys);
+	cache_entry entry;
+	size_t num_cells = (size_t)m->xs*(size_t)m->ys;
 
-	// Fill the map header
 	if (strlen(name) > MAP_NAME_LENGTH) // It does not hurt to warn that there are maps with name longer than allowed.
 		ShowWarning ("Map name '%s' size '%" PRIuPTR "' is too long. Truncating to '%d'.\n", name, strlen(name), MAP_NAME_LENGTH);
-	strncpy(info.name, name, MAP_NAME_LENGTH);
-	info.xs = MakeShortLE(m->xs);
-	info.ys = MakeShortLE(m->ys);
-	info.len = MakeLongLE(len);
-
-	// Append map header then compressed cells at the end of the file
-	fseek(map_cache_fp, header.file_size, SEEK_SET);
-	fwrite(&info, sizeof(struct map_info), 1, map_cache_fp);
-	fwrite(write_buf, 1, len, map_cache_fp);
-	header.file_size += sizeof(struct map_info) + len;
-	header.map_count++;
-
-	aFree(write_buf);
-	aFree(m->cells);
 
-	return;
+	entry.xs = m->xs;
+	entry.ys = m->ys;
+	entry.cells.resize(num_cells);
+
+	for (size_t xy = 0; xy < num_cells; xy++)
+		entry.cells[xy] = gat2flags(m->cells[xy]);
+
+	cache_entries[std::string(name, strnlen(name, MAP_NAME_LENGTH - 1))] = std::move(entry);
+
+	aFree(m->cells);
 }
 
 // Checks whether a map is already is the cache
 int32 find_map(char *name)
 {
-	int32 i;
-	struct map_info info;
+	return cache_entries.find(std::string(name, strnlen(name, MAP_NAME_LENGTH - 1))) != cache_entries.end();
+}
+
+// Loads the maps of an existing v1 cache
+bool load_cache_v1(unsigned char *buf, size_t size)
+{
+	uint16 map_count = GetUShort(buf + offsetof(struct main_header, map_count));
+	size_t off = sizeof(struct main_header);
+
+	for (int32 i = 0; i < map_count; i++) {
+		struct map_info info;
+
+		if (off + sizeof(struct map_info) > size)
+			return false;
+
+		memcpy(&info, buf + off, sizeof(struct map_info));
+		off += sizeof(struct map_info);
+
+		int32 len = GetLong((unsigned char *)&info.len);
+		int16 xs = (int16)GetUShort((unsigned char *)&info.xs);
+		int16 ys = (int16)GetUShort((unsigned char *)&info.ys);
+
+		if (len < 0 || off + len > size || xs <= 0 || ys <= 0)
+			return false;
+
+		unsigned long num_cells = (unsigned long)xs*(unsigned long)ys;
+		struct map_data map;
+
+		map.xs = xs;
+		map.ys = ys;
+		map.cells = (unsigned char *)aMalloc(num_cells);
+		decode_zip(map.cells, &num_cells, buf + off, len);
+		off += len;
+
+		if (num_cells != (unsigned long)xs*(unsigned long)ys) {
+			aFree(map.cells);
+			return false;
+		}
+
+		info.name[MAP_NAME_LENGTH - 1] = '\0';
+		cache_map(info.name, &map);
+	}
+
+	return true;
+}
+
+// Loads the maps of an existing v2 cache
+bool load_cache_v2(unsigned char *buf, size_t size)
+{
+	uint32 version = GetULong(buf + offsetof(struct map_cache_v2_header, version));
+	uint32 map_count = GetULong(buf + offsetof(struct map_cache_v2_header, map_count));
+
+	if (version != MAP_CACHE_V2_VERSION || size < sizeof(struct map_cache_v2_header) + (size_t)map_count * sizeof(struct map_cache_v2_index))
+		return false;
+
+	for (uint32 i = 0; i < map_count; i++) {
+		unsigned char *index = buf + sizeof(struct map_cache_v2_header) + i * sizeof(struct map_cache_v2_index);
+		int16 xs = (int16)GetUShort(index + offsetof(struct map_cache_v2_index, xs));
+		int16 ys = (int16)GetUShort(index + offsetof(struct map_cache_v2_index, ys));
+		uint64 offset = GetUInt64(index + offsetof(struct map_cache_v2_index, offset));
+
+		if (xs <= 0 || ys <= 0)
+			return false;
+
+		size_t num_cells = (size_t)xs*(size_t)ys;
+
+		if (offset > size || num_cells > size - offset)
+			return false;
+
+		const char *name = (const char *)index + offsetof(struct map_cache_v2_index, name);
+		cache_entry& entry = cache_entries[std::string(name, strnlen(name, MAP_NAME_LENGTH))];
+
+		entry.xs = xs;
+		entry.ys = ys;
+		entry.cells.assign(buf + offset, buf + offset + num_cells);
+	}
+
+	return true;
+}
+
+// Loads an existing cache of either version
+bool load_cache(FILE *fp)
+{
+	fseek(fp, 0, SEEK_END);
+	size_t size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	if (size == 0)
+		return true;
+
+	std::vector<unsigned char> buf(size);
+
+	if (fread(buf.data(), 1, size, fp) != size)
+		return false;
+
+	if (size >= sizeof(struct map_cache_v2_header) && memcmp(buf.data(), MAP_CACHE_V2_MAGIC, 4) == 0)
+		return load_cache_v2(buf.data(), size);
+	else if (size >= sizeof(struct main_header))
+		return load_cache_v1(buf.data(), size);
+
+	return false;
+}
+
+// Writes all maps as a v2 cache, in little-endian
+bool write_cache(FILE *fp)
+{
+	struct map_cache_v2_header header = {};
+	std::vector<struct map_cache_v2_index> index(cache_entries.size());
+	uint64 offset = sizeof(struct map_cache_v2_header) + cache_entries.size() * sizeof(struct map_cache_v2_index);
+	size_t i = 0;
+
+	memcpy(header.magic, MAP_CACHE_V2_MAGIC, 4);
+	header.version = (uint32)MakeLongLE(MAP_CACHE_V2_VERSION);
+	header.map_count = (uint32)MakeLongLE((int32)cache_entries.size());
+
+	for (const auto &it : cache_entries) {
+		memset(&index[i], 0, sizeof(struct map_cache_v2_index));
+		safestrncpy(index[i].name, it.first.c_str(), MAP_NAME_LENGTH);
+		index[i].xs = MakeShortLE(it.second.xs);
+		index[i].ys = MakeShortLE(it.second.ys);
+		index[i].offset = MakeUInt64LE(offset);
+		offset += it.second.cells.size();
+		i++;
+	}
 
-	fseek(map_cache_fp, sizeof(struct main_header), SEEK_SET);
+	if (fwrite(&header, sizeof(struct map_cache_v2_header), 1, fp) != 1)
+		return false;
+	if (!index.empty() && fwrite(index.data(), sizeof(struct map_cache_v2_index), index.size(), fp) != index.size())
+		return false;
 
-	for(i = 0; i < header.map_count; i++) {
-		if(fread(&info, sizeof(info), 1, map_cache_fp) != 1) printf("An error as occured in fread while reading map_cache\n");
-		if(strcmp(name, info.name) == 0) // Map found
-			return 1;
-		else // Map not found, jump to the beginning of the next map info header
-			fseek(map_cache_fp, GetLong((unsigned char *)&(info.len)), SEEK_CUR);
+	for (const auto &it : cache_entries) {
+		if (fwrite(it.second.cells.data(), 1, it.second.cells.size(), fp) != it.second.cells.size())
+			return false;
 	}
 
-	return 0;
+	return true;
 }
 
 // Cuts the extension from a map name
@@ -211,23 +347,21 @@ bool MapcacheTool::initialize( int32 argc, char* argv[] ){
 	ShowStatus("Initializing grfio with %s\n", grf_list_file.c_str());
 	grfio_init(grf_list_file.c_str());
 
-	// Attempt to open the map cache file and force rebuild if not found
+	// Load the existing map cache, if any, unless rebuilding
 	ShowStatus("Opening map cache: %s\n", map_cache_file.c_str());
 	if(!rebuild) {
 		map_cache_fp = fopen(map_cache_file.c_str(), "rb");
 		if(map_cache_fp == nullptr) {
 			ShowNotice("Existing map cache not found, forcing rebuild mode\n");
 			rebuild = 1;
-		} else
+		} else {
+			if(!load_cache(map_cache_fp)) {
+				ShowError("Failure when reading map cache file %s, use -rebuild to recreate it\n", map_cache_file.c_str());
+				fclose(map_cache_fp);
+				return false;
+			}
 			fclose(map_cache_fp);
-	}
-	if(rebuild)
-		map_cache_fp = fopen(map_cache_file.c_str(), "w+b");
-	else
-		map_cache_fp = fopen(map_cache_file.c_str(), "r+b");
-	if(map_cache_fp == nullptr) {
-		ShowError("Failure when opening map cache file %s\n", map_cache_file.c_str());
-		return false;
+		}
 	}
 
 	// Open the map list
@@ -244,16 +378,6 @@ bool MapcacheTool::initialize( int32 argc, char* argv[] ){
 			return false;
 		}
 
-		// Initialize the main header
-		if (rebuild) {
-			header.file_size = sizeof(struct main_header);
-			header.map_count = 0;
-		} else {
-			if (fread(&header, sizeof(struct main_header), 1, map_cache_fp) != 1) { printf("An error as occured while reading map_cache_fp \n"); }
-			header.file_size = GetULong((unsigned char *)&(header.file_size));
-			header.map_count = GetUShort((unsigned char *)&(header.map_count));
-		}
-
 		// Read and process the map list
 		char line[1024];
 
@@ -289,16 +413,24 @@ bool MapcacheTool::initialize( int32 argc, char* argv[] ){
 		fclose(list);
 	}
 
-	// Write the main header and close the map cache
-	ShowStatus("Closing map cache: %s\n", map_cache_file.c_str());
-	fseek(map_cache_fp, 0, SEEK_SET);
-	fwrite(&header, sizeof(struct main_header), 1, map_cache_fp);
+	// Write the cache in the indexed v2 format
+	ShowStatus("Writing map cache: %s\n", map_cache_file.c_str());
+	map_cache_fp = fopen(map_cache_file.c_str(), "wb");
+	if(map_cache_fp == nullptr) {
+		ShowError("Failure when opening map cache file %s\n", map_cache_file.c_str());
+		return false;
+	}
+	if(!write_cache(map_cache_fp)) {
+		ShowError("Failure when writing map cache file %s\n", map_cache_file.c_str());
+		fclose(map_cache_fp);
+		return false;
+	}
 	fclose(map_cache_fp);
 
 	ShowStatus("Finalizing grfio\n");
 	grfio_final();
 
-	ShowInfo("%d maps now in cache\n", header.map_count);
+	ShowInfo("%" PRIuPTR " maps now in cache\n", cache_entries.size());
 
 	return true;
 }
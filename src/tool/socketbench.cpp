@@ -0,0 +1,237 @@
+// Copyright (c) rAthena Dev Teams - Licensed under GNU GPL
+// For more information, see LICENCE in the main folder
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <common/core.hpp>
+#include <common/showmsg.hpp>
+#include <common/socket.hpp>
+#include <common/timer.hpp>
+
+using namespace rathena::server_core;
+
+namespace rathena::tool_socketbench {
+class SocketBenchTool : public Core{
+	protected:
+		bool initialize( int32 argc, char* argv[] ) override;
+		void handle_main( t_tick next ) override;
+		void finalize() override;
+
+	public:
+		SocketBenchTool() : Core( e_core_type::TOOL ){
+
+		}
+};
+}
+
+using namespace rathena::tool_socketbench;
+
+uint16 bench_port = 5999;
+int32 bench_clients = 500;
+int32 bench_packet_size = 32;
+int32 bench_seconds = 10;
+
+pid_t bench_child = 0;
+t_tick bench_start = 0;
+uint64 bench_packets = 0;
+struct rusage bench_usage;
+
+int32 parse_console( const char* buf ){
+	return 1;
+}
+
+void display_helpscreen( bool do_exit ){
+	ShowInfo( "Usage: %s [-clients <count>] [-size <bytes>] [-time <seconds>] [-port <port>]\n", SERVER_NAME );
+	if( do_exit )
+		exit( EXIT_SUCCESS );
+}
+
+void process_args( int32 argc, char* argv[] ){
+	for( int32 i = 0; i < argc; i++ ){
+		if( strcmp( argv[i], "-clients" ) == 0 ){
+			if( ++i < argc )
+				bench_clients = atoi( argv[i] );
+		}else if( strcmp( argv[i], "-size" ) == 0 ){
+			if( ++i < argc )
+				bench_packet_size = atoi( argv[i] );
+		}else if( strcmp( argv[i], "-time" ) == 0 ){
+			if( ++i < argc )
+				bench_seconds = atoi( argv[i] );
+		}else if( strcmp( argv[i], "-port" ) == 0 ){
+			if( ++i < argc )
+				bench_port = (uint16)atoi( argv[i] );
+		}else if( strcmp( argv[i], "-help" ) == 0 )
+			display_helpscreen( true );
+	}
+}
+
+/// Echoes every complete packet back to the client, the server side of the benchmark.
+int32 socketbench_parse( int32 fd ){
+	if( session[fd]->flag.eof ){
+		do_close( fd );
+		return 0;
+	}
+
+	while( RFIFOREST( fd ) >= bench_packet_size ){
+		WFIFOHEAD( fd, bench_packet_size );
+		memcpy( WFIFOP( fd, 0 ), RFIFOP( fd, 0 ), bench_packet_size );
+		WFIFOSET( fd, bench_packet_size );
+		RFIFOSKIP( fd, bench_packet_size );
+		bench_packets++;
+	}
+
+	return 0;
+}
+
+/// Runs all clients in the forked child, so that their sockets don't take up session numbers of the server.
+/// Every round each client sends a packet and waits for its echo, until the server closes the connections.
+[[noreturn]] void socketbench_clients(){
+	std::vector<int> fds( bench_clients );
+	std::vector<char> packet( bench_packet_size, 'r' );
+	std::vector<char> buffer( bench_packet_size );
+	struct sockaddr_in addr = {};
+	int yes = 1;
+
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl( INADDR_LOOPBACK );
+	addr.sin_port = htons( bench_port );
+
+	for( int& fd : fds ){
+		fd = socket( AF_INET, SOCK_STREAM, 0 );
+
+		if( fd < 0 || connect( fd, (struct sockaddr*)&addr, sizeof( addr ) ) != 0 ){
+			perror( "socketbench: client connect" );
+			_exit( EXIT_FAILURE );
+		}
+
+		setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof( yes ) );
+	}
+
+	while( true ){
+		for( int fd : fds ){
+			if( send( fd, packet.data(), bench_packet_size, MSG_NOSIGNAL ) != bench_packet_size )
+				_exit( EXIT_SUCCESS );
+		}
+
+		for( int fd : fds ){
+			for( int32 received = 0; received < bench_packet_size; ){
+				ssize_t len = recv( fd, buffer.data() + received, bench_packet_size - received, 0 );
+
+				if( len <= 0 )
+					_exit( EXIT_SUCCESS );
+
+				received += (int32)len;
+			}
+		}
+	}
+}
+
+bool SocketBenchTool::initialize( int32 argc, char* argv[] ){
+	process_args( argc, argv );
+
+	if( bench_clients < 1 || bench_packet_size < 1 || bench_packet_size > WFIFO_SIZE || bench_seconds < 1 ){
+		display_helpscreen( false );
+		return false;
+	}
+
+#if defined(SOCKET_EPOLL)
+	const char* dispatcher = "epoll";
+#else
+	const char* dispatcher = "select";
+#endif
+#if defined(SOCKET_IO_URING)
+	const char* submission = "io_uring";
+#else
+	const char* submission = "send/recv";
+#endif
+
+	ShowStatus( "Benchmarking %s with %s: %d clients echoing %d byte packets for %d seconds (MAXCONN %d)\n", dispatcher, submission, bench_clients, bench_packet_size, bench_seconds, MAXCONN );
+
+	// Every connection comes from loopback within a few milliseconds
+	ip_rules = 0;
+
+	int32 fd = make_listen_bind( htonl( INADDR_LOOPBACK ), bench_port );
+
+	if( fd < 0 )
+		return false;
+
+	// The default backlog of 5 would drop most of the connection burst
+	listen( fd, SOMAXCONN );
+
+	set_defaultparse( socketbench_parse );
+
+	bench_child = fork();
+
+	if( bench_child < 0 ){
+		ShowError( "socketbench: fork failed: %s\n", strerror( errno ) );
+		return false;
+	}
+
+	if( bench_child == 0 )
+		socketbench_clients();
+
+	return true;
+}
+
+void SocketBenchTool::handle_main( t_tick next ){
+	do_sockets( next );
+
+	if( bench_start == 0 ){
+		int32 connected = 0;
+
+		for( int32 i = 1; i < fd_max; i++ ){
+			if( session[i] != nullptr && session[i]->func_parse == socketbench_parse )
+				connected++;
+		}
+
+		// Measure from the first round that includes all clients
+		if( connected == bench_clients ){
+			bench_start = gettick();
+			bench_packets = 0;
+			getrusage( RUSAGE_SELF, &bench_usage );
+		}
+
+		return;
+	}
+
+	t_tick elapsed = DIFF_TICK( gettick(), bench_start );
+
+	if( elapsed < bench_seconds * 1000 )
+		return;
+
+	struct rusage usage;
+
+	getrusage( RUSAGE_SELF, &usage );
+
+	// CPU time of the server alone, the clients run in their own process
+	int64 cpu = ( usage.ru_utime.tv_sec - bench_usage.ru_utime.tv_sec + usage.ru_stime.tv_sec - bench_usage.ru_stime.tv_sec ) * 1000000LL
+		+ usage.ru_utime.tv_usec - bench_usage.ru_utime.tv_usec + usage.ru_stime.tv_usec - bench_usage.ru_stime.tv_usec;
+
+	ShowInfo( "Echoed " CL_WHITE "%" PRIu64 CL_RESET " packets in %" PRtf " ms: " CL_WHITE "%" PRIu64 CL_RESET " packets per second, " CL_WHITE "%.2f" CL_RESET " us server CPU per packet.\n",
+		bench_packets, elapsed, bench_packets * 1000 / elapsed, bench_packets > 0 ? (double)cpu / bench_packets : 0. );
+
+	this->signal_shutdown();
+}
+
+void SocketBenchTool::finalize(){
+	if( bench_child > 0 ){
+		kill( bench_child, SIGKILL );
+		waitpid( bench_child, nullptr, 0 );
+	}
+}
+
+int32 main( int32 argc, char *argv[] ){
+	return main_core<SocketBenchTool>( argc, argv );
+}